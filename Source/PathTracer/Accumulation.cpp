@@ -0,0 +1,225 @@
+#include "Accumulation.h"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    constexpr const char* Magic = "PTACCUM";
+    constexpr int Version = 1;
+
+    // Doubles of a pixel in a file, in the order of the Pixel members
+    constexpr size_t PixelDoubleCount = 12;
+
+    // Larger films are taken as a corrupt header, rather than allocated
+    constexpr int MaxDimension = 16384;
+
+    std::array<double, PixelDoubleCount> ToDoubles(const Accumulation::Pixel& pixel)
+    {
+        return {
+            pixel.radianceSum.r, pixel.radianceSum.g, pixel.radianceSum.b,
+            pixel.albedoSum.r, pixel.albedoSum.g, pixel.albedoSum.b,
+            pixel.normalSum.r, pixel.normalSum.g, pixel.normalSum.b,
+            pixel.luminanceSum, pixel.luminanceSquaredSum, pixel.sampleCount,
+        };
+    }
+
+    Accumulation::Pixel FromDoubles(const double* values)
+    {
+        Accumulation::Pixel pixel;
+        pixel.radianceSum = glm::dvec3(values[0], values[1], values[2]);
+        pixel.albedoSum = glm::dvec3(values[3], values[4], values[5]);
+        pixel.normalSum = glm::dvec3(values[6], values[7], values[8]);
+        pixel.luminanceSum = values[9];
+        pixel.luminanceSquaredSum = values[10];
+        pixel.sampleCount = values[11];
+        return pixel;
+    }
+
+    glm::vec4 GetVariance(double luminanceSum, double luminanceSquaredSum, double sampleCount)
+    {
+        if (sampleCount < 2.0)
+        {
+            return glm::vec4(0.0f);
+        }
+
+        // Unbiased sample variance, same as the noise estimate of adaptive sampling
+        double mean = luminanceSum / sampleCount;
+        double variance = std::max((luminanceSquaredSum - mean * luminanceSum) / (sampleCount - 1.0), 0.0);
+        return glm::vec4((float)variance, (float)(variance / sampleCount), (float)sampleCount, 0.0f);
+    }
+}
+
+Accumulation::Accumulation(int width, int height)
+    : m_width(width), m_height(height), m_pixels((size_t)width * height)
+{
+}
+
+double Accumulation::GetMaxSampleCount() const
+{
+    double sampleCount = 0.0;
+    for (const Pixel& pixel : m_pixels)
+    {
+        sampleCount = std::max(sampleCount, pixel.sampleCount);
+    }
+    return sampleCount;
+}
+
+bool Accumulation::Merge(const Accumulation& other)
+{
+    if (other.m_width != m_width || other.m_height != m_height)
+    {
+        return false;
+    }
+
+    // Sums of independent samples simply add up, which weighs every render by the samples it took
+    for (size_t i = 0; i < m_pixels.size(); i++)
+    {
+        const Pixel& source = other.m_pixels[i];
+        Pixel& pixel = m_pixels[i];
+        pixel.radianceSum += source.radianceSum;
+        pixel.albedoSum += source.albedoSum;
+        pixel.normalSum += source.normalSum;
+        pixel.luminanceSum += source.luminanceSum;
+        pixel.luminanceSquaredSum += source.luminanceSquaredSum;
+        pixel.sampleCount += source.sampleCount;
+    }
+    return true;
+}
+
+std::vector<glm::vec4> Accumulation::GetRadianceData() const
+{
+    return GetMeanData(&Pixel::radianceSum);
+}
+
+std::vector<glm::vec4> Accumulation::GetAlbedoData() const
+{
+    return GetMeanData(&Pixel::albedoSum);
+}
+
+std::vector<glm::vec4> Accumulation::GetNormalData() const
+{
+    return GetMeanData(&Pixel::normalSum);
+}
+
+std::vector<glm::vec4> Accumulation::GetVarianceData() const
+{
+    std::vector<glm::vec4> data(m_pixels.size());
+    for (size_t i = 0; i < m_pixels.size(); i++)
+    {
+        const Pixel& pixel = m_pixels[i];
+        data[i] = GetVariance(pixel.luminanceSum, pixel.luminanceSquaredSum, pixel.sampleCount);
+    }
+    return data;
+}
+
+std::vector<glm::vec4> Accumulation::GetVarianceData(const std::vector<glm::vec4>& sampleStats)
+{
+    std::vector<glm::vec4> data(sampleStats.size());
+    for (size_t i = 0; i < sampleStats.size(); i++)
+    {
+        const glm::vec4& stats = sampleStats[i];
+        data[i] = GetVariance(stats.x, stats.y, stats.z);
+    }
+    return data;
+}
+
+std::vector<glm::vec4> Accumulation::GetMeanData(glm::dvec3 Pixel::* sum) const
+{
+    std::vector<glm::vec4> data(m_pixels.size(), glm::vec4(0.0f));
+    for (size_t i = 0; i < m_pixels.size(); i++)
+    {
+        const Pixel& pixel = m_pixels[i];
+        if (pixel.sampleCount > 0.0)
+        {
+            data[i] = glm::vec4(glm::vec3(pixel.*sum / pixel.sampleCount), 1.0f);
+        }
+    }
+    return data;
+}
+
+bool Accumulation::Save(const std::string& path) const
+{
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << Magic << " " << Version << "\n" << m_width << " " << m_height << "\n";
+
+        // A row at a time keeps the writes large without a second copy of the whole film
+        std::vector<double> row((size_t)m_width * PixelDoubleCount);
+        for (int y = 0; y < m_height; y++)
+        {
+            for (int x = 0; x < m_width; x++)
+            {
+                std::array<double, PixelDoubleCount> values = ToDoubles(m_pixels[(size_t)y * m_width + x]);
+                std::copy(values.begin(), values.end(), row.begin() + (size_t)x * PixelDoubleCount);
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), (std::streamsize)(row.size() * sizeof(double)));
+        }
+
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    std::error_code errorCode;
+    std::filesystem::rename(temporaryPath, path, errorCode);
+    return !errorCode;
+}
+
+bool Accumulation::Load(const std::string& path, Accumulation& accumulation, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open \"" + path + "\"";
+        return false;
+    }
+
+    std::string magic;
+    int version = 0, width = 0, height = 0;
+    if (!(file >> magic >> version >> width >> height) || magic != Magic || width <= 0 || height <= 0 || width > MaxDimension || height > MaxDimension)
+    {
+        error = "\"" + path + "\" is no accumulation";
+        return false;
+    }
+    if (version != Version)
+    {
+        error = "\"" + path + "\" has unsupported version " + std::to_string(version);
+        return false;
+    }
+    file.get();
+
+    // The pixels are all that is left of the file, checked before anything is allocated for them
+    const std::streamoff payloadSize = (std::streamoff)((size_t)width * height * PixelDoubleCount * sizeof(double));
+    const std::streamoff payloadStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    const std::streamoff fileSize = file.tellg();
+    file.seekg(payloadStart);
+    if (payloadStart < 0 || fileSize - payloadStart != payloadSize)
+    {
+        error = "\"" + path + "\" does not hold " + std::to_string(width) + "x" + std::to_string(height) + " pixels";
+        return false;
+    }
+
+    std::vector<double> values((size_t)width * height * PixelDoubleCount);
+    if (!file.read(reinterpret_cast<char*>(values.data()), (std::streamsize)(values.size() * sizeof(double))))
+    {
+        error = "\"" + path + "\" is truncated";
+        return false;
+    }
+
+    accumulation = Accumulation(width, height);
+    for (size_t i = 0; i < accumulation.m_pixels.size(); i++)
+    {
+        accumulation.m_pixels[i] = FromDoubles(values.data() + i * PixelDoubleCount);
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Sums of the samples of every pixel of a film, which a render can be resumed from and independent renders merged into
+//
+// Sums are doubles, so neither long renders nor merges of many renders lose what a running mean in float would
+// Renders merged together must use distinct seeds, otherwise they add up the same samples
+// Files hold a short header and the pixels as raw little endian doubles, rows from the bottom up like the buffers of the CPU backend
+class Accumulation
+{
+public:
+    struct Pixel
+    {
+        glm::dvec3 radianceSum = glm::dvec3(0.0);
+        glm::dvec3 albedoSum = glm::dvec3(0.0);         // Of the primary hits, for denoising
+        glm::dvec3 normalSum = glm::dvec3(0.0);
+        double luminanceSum = 0.0;
+        double luminanceSquaredSum = 0.0;               // For the variance
+        double sampleCount = 0.0;
+    };
+
+    Accumulation() = default;
+    Accumulation(int width, int height);
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    bool IsEmpty() const { return m_pixels.empty(); }
+
+    std::vector<Pixel>& GetPixels() { return m_pixels; }
+    const std::vector<Pixel>& GetPixels() const { return m_pixels; }
+
+    // Samples of the pixel that took the most, the frames the render got through
+    double GetMaxSampleCount() const;
+
+    // Adds the samples of another render of the same film, false if its dimensions differ
+    bool Merge(const Accumulation& other);
+
+    // Means of the samples, in the layout of the CPU backend's buffers. Pixels without samples are black
+    std::vector<glm::vec4> GetRadianceData() const;
+    std::vector<glm::vec4> GetAlbedoData() const;
+    std::vector<glm::vec4> GetNormalData() const;
+
+    // Luminance variance of the samples, variance of their mean and the sample count
+    std::vector<glm::vec4> GetVarianceData() const;
+
+    // Same from the luminance sums and sample counts of the backend's sample statistics
+    static std::vector<glm::vec4> GetVarianceData(const std::vector<glm::vec4>& sampleStats);
+
+    // Written to a temporary file that replaces the file once complete, so a crash while checkpointing keeps the previous checkpoint
+    // False if the file cannot be written
+    bool Save(const std::string& path) const;
+
+    // False with a message if the file cannot be read or is no accumulation
+    static bool Load(const std::string& path, Accumulation& accumulation, std::string& error);
+
+private:
+    std::vector<glm::vec4> GetMeanData(glm::dvec3 Pixel::* sum) const;
+
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Pixel> m_pixels;
+};
@@ -1,5 +1,6 @@
 #include "BVH.h"
 #include <algorithm>
+#include <cmath>
 
 #define INF 114514.0f
 
@@ -236,3 +237,20 @@ int BVH::BuildBvhWithSah(std::vector<BvhPrimitive>& primitives, std::vector<BvhN
 
     return int(id);
 }
+
+float BVH::GetTextureLodBias(const BvhPrimitive& primitive)
+{
+    float worldArea = glm::length(glm::cross(primitive.posB - primitive.posA, primitive.posC - primitive.posA));
+
+    glm::vec2 deltaUVB = primitive.uvB - primitive.uvA;
+    glm::vec2 deltaUVC = primitive.uvC - primitive.uvA;
+    float uvArea = std::abs(deltaUVB.x * deltaUVC.y - deltaUVB.y * deltaUVC.x);
+
+    // Degenerate triangles keep the full resolution
+    if (worldArea <= 0.0f || uvArea <= 0.0f)
+    {
+        return -INF;
+    }
+
+    return 0.5f * std::log2(uvArea / worldArea);
+}
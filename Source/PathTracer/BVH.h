@@ -35,6 +35,8 @@ public:
 		glm::vec2 uvC;
 
 		unsigned int meshIndex;
+		unsigned int emissiveIndex = 0xffffffff;	// Index into the emissive triangles, 0xffffffff if not emissive
+		float textureLodBias = 0.0f;				// Triangle's part of the ray cone texture LOD, see GetTextureLodBias
 	};
 
 	struct alignas(16) BvhNodeAlign
@@ -59,9 +61,14 @@ public:
 		alignas(16) glm::vec4 norCuvY;
 
 		alignas(16) unsigned int meshIndex;
+		unsigned int emissiveIndex;
+		float textureLodBias;
 	};
 
 	// Construct BVH
 	static int BuildBvh(std::vector<BvhPrimitive>& triangles, std::vector<BvhNode>& nodes, int l, int r, int n);
 	static int BuildBvhWithSah(std::vector<BvhPrimitive>& triangles, std::vector<BvhNode>& nodes, int l, int r, int n);
+
+	// Half the log2 ratio of the triangle's UV area to its world area, which converts a ray cone's width into a texture LOD
+	static float GetTextureLodBias(const BvhPrimitive& primitive);
 };
\ No newline at end of file
@@ -0,0 +1,479 @@
+#include "BatchJob.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <type_traits>
+
+namespace
+{
+    std::string Trim(const std::string& text)
+    {
+        size_t first = text.find_first_not_of(" \t\r");
+        size_t last = text.find_last_not_of(" \t\r");
+        return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+    }
+
+    // Films and crops larger than this are taken as a mistake, rather than allocated
+    constexpr int MaxDimension = 16384;
+
+    // Reads all numbers of a value, false if there are fewer or more of them than expected or one is out of the range of its type
+    template<typename T>
+    bool ParseNumbers(const std::string& value, T* numbers, int count)
+    {
+        std::istringstream stream(value);
+        for (int i = 0; i < count; i++)
+        {
+            // Streams read "-1" into an unsigned number as its largest value
+            if constexpr (std::is_unsigned_v<T>)
+            {
+                if ((stream >> std::ws).peek() == '-')
+                {
+                    return false;
+                }
+            }
+            if (!(stream >> numbers[i]))
+            {
+                return false;
+            }
+        }
+        std::string rest;
+        return !(stream >> rest);
+    }
+
+    bool ParseFlag(const std::string& value, bool& flag)
+    {
+        if (value == "on" || value == "true" || value == "1")
+        {
+            flag = true;
+            return true;
+        }
+        if (value == "off" || value == "false" || value == "0")
+        {
+            flag = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Keys which only set a modifier or a flag, pointing into the job
+    std::map<std::string, float*> GetModifierKeys(BatchJob& job)
+    {
+        return
+        {
+            { "specular", &job.modifiers.specular },
+            { "specular-tint", &job.modifiers.specularTint },
+            { "metallic", &job.modifiers.metallic },
+            { "roughness", &job.modifiers.roughness },
+            { "subsurface", &job.modifiers.subsurface },
+            { "anisotropy", &job.modifiers.anisotropy },
+            { "sheen-roughness", &job.modifiers.sheenRoughness },
+            { "sheen-tint", &job.modifiers.sheenTint },
+            { "clearcoat", &job.modifiers.clearcoat },
+            { "clearcoat-roughness", &job.modifiers.clearcoatRoughness },
+            { "refraction", &job.modifiers.refraction },
+            { "transmission", &job.modifiers.transmission },
+        };
+    }
+
+    std::map<std::string, bool*> GetFlagKeys(BatchJob& job)
+    {
+        return
+        {
+            { "anti-aliasing", &job.antiAliasingEnabled },
+            { "emissive-light-sampling", &job.emissiveSamplingEnabled },
+            { "light-tree", &job.lightTreeEnabled },
+            { "path-guiding", &job.pathGuidingEnabled },
+            { "reservoir-resampling", &job.reservoirResamplingEnabled },
+            { "caustic-photons", &job.causticPhotonsEnabled },
+            { "radiance-cache", &job.radianceCacheEnabled },
+            { "adjoint-russian-roulette", &job.adjointRussianRouletteEnabled },
+            { "temporal-reprojection", &job.temporalReprojectionEnabled },
+        };
+    }
+
+    // Buffers a job can write or reply with
+    const char* BufferNames[] = { "radiance", "albedo", "normal" };
+
+    bool ParseKeyframe(const std::string& value, BatchJob::Keyframe& keyframe)
+    {
+        float numbers[6];
+        if (!ParseNumbers(value, numbers, 6))
+        {
+            return false;
+        }
+        keyframe.cameraPosition = glm::vec3(numbers[0], numbers[1], numbers[2]);
+        keyframe.cameraTarget = glm::vec3(numbers[3], numbers[4], numbers[5]);
+        return true;
+    }
+
+    // Keyframes of a camera path file, false if it cannot be read or a line is no keyframe
+    bool LoadCameraPath(const std::string& path, std::vector<BatchJob::Keyframe>& keyframes)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        keyframes.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = Trim(line);
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            BatchJob::Keyframe& keyframe = keyframes.emplace_back();
+            if (!ParseKeyframe(line, keyframe))
+            {
+                return false;
+            }
+        }
+        return !keyframes.empty();
+    }
+
+    // Uniform Catmull-Rom spline, passes through b at t = 0 and c at t = 1
+    glm::vec3 CatmullRom(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d, float t)
+    {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * (2.0f * b + (c - a) * t + (2.0f * a - 5.0f * b + 4.0f * c - d) * t2 + (3.0f * b - a - 3.0f * c + d) * t3);
+    }
+
+    // Replaces the run of '#' with the zero padded frame number, or adds the number before the extension
+    std::string GetFramePath(const std::string& path, unsigned int frame)
+    {
+        if (path.empty())
+        {
+            return path;
+        }
+
+        size_t first = path.find('#');
+        if (first == std::string::npos)
+        {
+            size_t slash = path.find_last_of("/\\");
+            size_t dot = path.find_last_of('.');
+            size_t position = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot : path.size();
+            std::ostringstream number;
+            number << "_" << std::setw(4) << std::setfill('0') << frame;
+            return path.substr(0, position) + number.str() + path.substr(position);
+        }
+
+        size_t last = path.find_first_not_of('#', first);
+        size_t width = (last == std::string::npos ? path.size() : last) - first;
+        std::ostringstream number;
+        number << std::setw((int)width) << std::setfill('0') << frame;
+        return path.substr(0, first) + number.str() + path.substr(first + width);
+    }
+}
+
+bool BatchJob::Load(const std::string& path, std::vector<BatchJob>& jobs, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "Cannot open job file " + path;
+        return false;
+    }
+
+    return Parse(file, path, jobs, error);
+}
+
+bool BatchJob::Parse(std::istream& stream, const std::string& source, std::vector<BatchJob>& jobs, std::string& error, bool allowFiles)
+{
+    // Lines before the first [job] fill in the defaults of all jobs
+    BatchJob job;
+    bool inJob = false;
+
+    // Region and crop are checked against the film once the whole job is read, in messages naming the line that set them
+    int regionLine = 0;
+    int cropLine = 0;
+    auto checkRectangle = [&](const char* key, const glm::ivec4& rectangle, const glm::ivec2& size, int lineNumber)
+    {
+        if (rectangle == glm::ivec4(0))
+        {
+            return true;
+        }
+        if (rectangle.x < 0 || rectangle.y < 0 || rectangle.z <= 0 || rectangle.w <= 0
+            || rectangle.x > size.x - rectangle.z || rectangle.y > size.y - rectangle.w)
+        {
+            error = source + ":" + std::to_string(lineNumber) + ": " + key + " does not lie within the " + std::to_string(size.x) + "x" + std::to_string(size.y) + " film";
+            return false;
+        }
+        return true;
+    };
+
+    auto finishJob = [&]()
+    {
+        if (inJob)
+        {
+            // A region lies within the crop, which is the film the job renders
+            const glm::ivec2 filmSize = job.crop.z > 0 && job.crop.w > 0 ? glm::ivec2(job.crop.z, job.crop.w) : job.resolution;
+            if (!checkRectangle("crop", job.crop, job.resolution, cropLine) || !checkRectangle("region", job.region, filmSize, regionLine))
+            {
+                return false;
+            }
+
+            if (job.name.empty())
+            {
+                job.name = "Job " + std::to_string(jobs.size() + 1);
+            }
+            jobs.push_back(job);
+
+            // Another job writing to the same files would overwrite them
+            job.name.clear();
+            job.radianceOutput.clear();
+            job.albedoOutput.clear();
+            job.normalOutput.clear();
+            job.reply.clear();
+            job.checkpoint.clear();
+            job.keyframes.clear();
+        }
+        return true;
+    };
+
+    const std::map<std::string, float*> modifiers = GetModifierKeys(job);
+    const std::map<std::string, bool*> flags = GetFlagKeys(job);
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(stream, line); lineNumber++)
+    {
+        line = Trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        if (line == "[job]")
+        {
+            if (!finishJob())
+            {
+                return false;
+            }
+            inJob = true;
+            continue;
+        }
+
+        size_t separator = line.find('=');
+        if (separator == std::string::npos)
+        {
+            error = source + ":" + std::to_string(lineNumber) + ": expected key = value";
+            return false;
+        }
+
+        std::string key = Trim(line.substr(0, separator));
+        std::string value = Trim(line.substr(separator + 1));
+
+        std::string lowerValue = value;
+        std::transform(lowerValue.begin(), lowerValue.end(), lowerValue.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+
+        if (!allowFiles && (key == "camera-path" || key == "radiance" || key == "albedo" || key == "normal" || key == "checkpoint"))
+        {
+            error = source + ":" + std::to_string(lineNumber) + ": " + key + " names a file, which is not allowed here, use reply";
+            return false;
+        }
+
+        bool valid = true;
+        if (key == "name") job.name = value;
+        else if (key == "scene") job.scene = value;
+        else if (key == "hdri") job.hdri = value;
+        else if (key == "camera")
+        {
+            float numbers[6];
+            valid = ParseNumbers(value, numbers, 6);
+            job.cameraPosition = glm::vec3(numbers[0], numbers[1], numbers[2]);
+            job.cameraTarget = glm::vec3(numbers[3], numbers[4], numbers[5]);
+        }
+        else if (key == "keyframe") valid = ParseKeyframe(value, job.keyframes.emplace_back());
+        else if (key == "camera-path")
+        {
+            if (!LoadCameraPath(value, job.keyframes))
+            {
+                error = source + ":" + std::to_string(lineNumber) + ": cannot read camera path " + value;
+                return false;
+            }
+        }
+        else if (key == "frames") valid = ParseNumbers(value, &job.frameCount, 1);
+        else if (key == "loop") valid = ParseFlag(lowerValue, job.loop);
+        else if (key == "fov") valid = ParseNumbers(value, &job.fov, 1) && job.fov > 0.0f && job.fov < 3.14159265f;
+        else if (key == "focal-length") valid = ParseNumbers(value, &job.focalLength, 1) && job.focalLength > 0.0f;
+        else if (key == "aperture-size") valid = ParseNumbers(value, &job.apertureSize, 1) && job.apertureSize >= 0.0f;
+        else if (key == "resolution")
+        {
+            valid = ParseNumbers(value, &job.resolution[0], 2) && job.resolution.x > 0 && job.resolution.y > 0
+                && job.resolution.x <= MaxDimension && job.resolution.y <= MaxDimension;
+        }
+        else if (key == "region")
+        {
+            valid = ParseNumbers(value, &job.region[0], 4);
+            regionLine = lineNumber;
+        }
+        else if (key == "crop")
+        {
+            valid = ParseNumbers(value, &job.crop[0], 4);
+            cropLine = lineNumber;
+        }
+        else if (key == "samples") valid = ParseNumbers(value, &job.sampleCount, 1) && job.sampleCount > 0;
+        else if (key == "noise") valid = ParseNumbers(value, &job.noiseThreshold, 1) && job.noiseThreshold >= 0.0f;
+        else if (key == "min-samples") valid = ParseNumbers(value, &job.minSampleCount, 1);
+        else if (key == "time") valid = ParseNumbers(value, &job.timeLimit, 1) && job.timeLimit >= 0.0f;
+        else if (key == "priority") valid = ParseNumbers(value, &job.priority, 1);
+        else if (key == "integrator")
+        {
+            job.integrator = lowerValue == "bidirectional" ? PathTracingCpuBackend::Integrator::Bidirectional : PathTracingCpuBackend::Integrator::PathTracing;
+            job.metropolisEnabled = lowerValue == "metropolis";
+            valid = lowerValue == "path" || lowerValue == "bidirectional" || lowerValue == "metropolis";
+        }
+        else if (key == "sampler")
+        {
+            if (lowerValue == "pcg") job.samplerType = Sampler::Type::Pcg;
+            else if (lowerValue == "sobol") job.samplerType = Sampler::Type::Sobol;
+            else if (lowerValue == "sobol-blue-noise") job.samplerType = Sampler::Type::SobolBlueNoise;
+            else valid = false;
+        }
+        else if (key == "seed") valid = ParseNumbers(value, &job.seed, 1);
+        else if (key == "radiance") job.radianceOutput = value;
+        else if (key == "albedo") job.albedoOutput = value;
+        else if (key == "normal") job.normalOutput = value;
+        else if (key == "exposure") valid = ParseNumbers(value, &job.exposure, 1) && job.exposure > 0.0f;
+        else if (key == "denoise") valid = ParseFlag(lowerValue, job.denoise);
+        else if (key == "reply")
+        {
+            std::istringstream names(lowerValue);
+            std::string name;
+            while (valid && names >> name)
+            {
+                valid = std::find(std::begin(BufferNames), std::end(BufferNames), name) != std::end(BufferNames);
+            }
+            job.reply = lowerValue;
+        }
+        else if (key == "checkpoint") job.checkpoint = value;
+        else if (key == "checkpoint-interval") valid = ParseNumbers(value, &job.checkpointInterval, 1) && job.checkpointInterval > 0.0f;
+        else if (modifiers.count(key)) valid = ParseNumbers(value, modifiers.at(key), 1);
+        else if (flags.count(key)) valid = ParseFlag(lowerValue, *flags.at(key));
+        else
+        {
+            error = source + ":" + std::to_string(lineNumber) + ": unknown key " + key;
+            return false;
+        }
+
+        if (!valid)
+        {
+            error = source + ":" + std::to_string(lineNumber) + ": invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+
+    if (!finishJob())
+    {
+        return false;
+    }
+
+    if (jobs.empty())
+    {
+        error = "No [job] in " + source;
+        return false;
+    }
+    return true;
+}
+
+void BatchJob::Save(std::ostream& stream) const
+{
+    // Enough digits that every float reads back the same
+    stream << std::setprecision(9);
+
+    stream << "[job]\n";
+    stream << "name = " << name << "\n";
+    stream << "scene = " << scene << "\n";
+    stream << "hdri = " << hdri << "\n";
+    stream << "camera = " << cameraPosition.x << " " << cameraPosition.y << " " << cameraPosition.z << " "
+        << cameraTarget.x << " " << cameraTarget.y << " " << cameraTarget.z << "\n";
+    for (const Keyframe& keyframe : keyframes)
+    {
+        stream << "keyframe = " << keyframe.cameraPosition.x << " " << keyframe.cameraPosition.y << " " << keyframe.cameraPosition.z << " "
+            << keyframe.cameraTarget.x << " " << keyframe.cameraTarget.y << " " << keyframe.cameraTarget.z << "\n";
+    }
+    stream << "frames = " << frameCount << "\n";
+    stream << "loop = " << (loop ? "on" : "off") << "\n";
+    stream << "fov = " << fov << "\n";
+    stream << "focal-length = " << focalLength << "\n";
+    stream << "aperture-size = " << apertureSize << "\n";
+    stream << "resolution = " << resolution.x << " " << resolution.y << "\n";
+    stream << "region = " << region.x << " " << region.y << " " << region.z << " " << region.w << "\n";
+    stream << "crop = " << crop.x << " " << crop.y << " " << crop.z << " " << crop.w << "\n";
+    stream << "samples = " << sampleCount << "\n";
+    stream << "noise = " << noiseThreshold << "\n";
+    stream << "min-samples = " << minSampleCount << "\n";
+    stream << "time = " << timeLimit << "\n";
+    stream << "priority = " << priority << "\n";
+
+    const char* integratorName = metropolisEnabled ? "metropolis" : integrator == PathTracingCpuBackend::Integrator::Bidirectional ? "bidirectional" : "path";
+    const char* samplerName = samplerType == Sampler::Type::Pcg ? "pcg" : samplerType == Sampler::Type::Sobol ? "sobol" : "sobol-blue-noise";
+    stream << "integrator = " << integratorName << "\n";
+    stream << "sampler = " << samplerName << "\n";
+    stream << "seed = " << seed << "\n";
+
+    // The key tables point into a job, a copy lends them one
+    BatchJob job = *this;
+    for (const auto& [key, flag] : GetFlagKeys(job))
+    {
+        stream << key << " = " << (*flag ? "on" : "off") << "\n";
+    }
+    for (const auto& [key, modifier] : GetModifierKeys(job))
+    {
+        stream << key << " = " << *modifier << "\n";
+    }
+
+    if (!radianceOutput.empty()) stream << "radiance = " << radianceOutput << "\n";
+    if (!albedoOutput.empty()) stream << "albedo = " << albedoOutput << "\n";
+    if (!normalOutput.empty()) stream << "normal = " << normalOutput << "\n";
+    stream << "exposure = " << exposure << "\n";
+    stream << "denoise = " << (denoise ? "on" : "off") << "\n";
+    if (!reply.empty()) stream << "reply = " << reply << "\n";
+    if (!checkpoint.empty()) stream << "checkpoint = " << checkpoint << "\n";
+    stream << "checkpoint-interval = " << checkpointInterval << "\n";
+}
+
+std::vector<BatchJob> BatchJob::GetAnimationFrames() const
+{
+    const int keyframeCount = (int)keyframes.size();
+    const unsigned int frames = frameCount > 0 ? frameCount : (unsigned int)keyframeCount;
+
+    // Frames are spaced evenly along the keyframes, a loop spaces them up to the first keyframe again
+    auto getKeyframe = [&](int index) -> const Keyframe&
+    {
+        return keyframes[loop ? ((index % keyframeCount) + keyframeCount) % keyframeCount : std::clamp(index, 0, keyframeCount - 1)];
+    };
+
+    std::vector<BatchJob> frameJobs;
+    for (unsigned int frame = 0; frame < frames; frame++)
+    {
+        float position = loop ? (float)frame * keyframeCount / frames
+            : frames > 1 ? (float)frame * (keyframeCount - 1) / (frames - 1) : 0.0f;
+        int index = std::min((int)position, loop ? keyframeCount - 1 : std::max(keyframeCount - 2, 0));
+        float t = position - index;
+
+        const Keyframe& a = getKeyframe(index - 1);
+        const Keyframe& b = getKeyframe(index);
+        const Keyframe& c = getKeyframe(index + 1);
+        const Keyframe& d = getKeyframe(index + 2);
+
+        BatchJob frameJob = *this;
+        frameJob.keyframes.clear();
+        frameJob.frameCount = 0;
+        frameJob.name = name + " frame " + std::to_string(frame + 1);
+        frameJob.cameraPosition = CatmullRom(a.cameraPosition, b.cameraPosition, c.cameraPosition, d.cameraPosition, t);
+        frameJob.cameraTarget = CatmullRom(a.cameraTarget, b.cameraTarget, c.cameraTarget, d.cameraTarget, t);
+        frameJob.radianceOutput = GetFramePath(radianceOutput, frame + 1);
+        frameJob.albedoOutput = GetFramePath(albedoOutput, frame + 1);
+        frameJob.normalOutput = GetFramePath(normalOutput, frame + 1);
+        frameJob.checkpoint = GetFramePath(checkpoint, frame + 1);
+        frameJobs.push_back(std::move(frameJob));
+    }
+    return frameJobs;
+}
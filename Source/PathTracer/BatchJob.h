@@ -0,0 +1,125 @@
+#pragma once
+
+#include "DisneyBrdf.h"
+#include "PathTracingCpuBackend.h"
+#include "Sampler.h"
+#include <glm/glm.hpp>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A render of the batch mode, read from a job file
+//
+// Job files hold "key = value" lines, a "[job]" line starts the next job. Lines starting with '#' are comments
+// Every job starts out as a copy of the previous one but for its name, outputs and keyframes, so only what changes has to be listed
+// A job with keyframes is an animation, rendered as one job per frame with the camera moving along the keyframes
+//
+//     scene = Bunny Glass                 Name of a scene in the GUI, or the path of a model file
+//     hdri = Meadow                       Name of an HDRI in the GUI, or the path of an .hdr file
+//     camera = -2.5 1 0  0 0 0            Position and target
+//     keyframe = -2.5 1 0  0 0 0          Position and target of the camera at a keyframe of an animation, a line per keyframe
+//     camera-path = Paths/flythrough.txt  Keyframes read from a file, a "position target" line each such as a recorded camera path
+//     frames = 120                        Frames along the keyframes, 0 for a frame per keyframe
+//     loop = on                           The camera returns to the first keyframe, as for a turntable
+//     fov = 1.57                          Vertical, in radians
+//     resolution = 512 512
+//     region = 0 0 128 128                x, y, width and height of the rendered pixels, from the bottom left
+//     crop = 0 0 128 128                  Part of the film rendered as a film of its own size, the way distributed renders split a frame
+//     samples = 256
+//     noise = 0.02                        Adaptive sampling threshold, 0 samples every pixel equally
+//     time = 60                           Seconds after which the job stops, 0 for no limit
+//     priority = 1                        Jobs waiting in the render server start highest priority first
+//     integrator = bidirectional          path, bidirectional or metropolis
+//     sampler = sobol                     pcg, sobol or sobol-blue-noise
+//     seed = 1                            Independent renders of a job that are merged later need distinct seeds
+//     path-guiding = on                   Any of the CPU backend's features, named as in the GUI in lower case with dashes
+//                                         temporal-reprojection starts each frame of an animation from the accumulation of the previous frame
+//     roughness = 0.2                     Any of the material modifiers, named the same way
+//     radiance = Renders/bunny.exr        Outputs, jobs without any are rendered but not written. .exr radiance holds all layers, see ImageWriter
+//                                         Frames of an animation replace the '#' of outputs and checkpoints with their number, or add it before the extension
+//     exposure = 1                        Of .png outputs
+//     denoise = on                        Radiance outputs are denoised, while the next job renders
+//     reply = radiance albedo             Buffers a render server sends back to the client, see RenderServer
+//     checkpoint = Renders/bunny.acc      Accumulation saved while rendering and resumed by the next run of the job, see Accumulation
+//     checkpoint-interval = 60            Seconds of rendering between checkpoints
+struct BatchJob
+{
+    std::string name;
+
+    // Assets, shared with the previous job when they are the same
+    std::string scene = "Bunny Dielectric";
+    std::string hdri = "Brown Photostudio";
+
+    // Camera
+    glm::vec3 cameraPosition = glm::vec3(-2.5f, 1.0f, 0.0f);
+    glm::vec3 cameraTarget = glm::vec3(0.0f);
+    float fov = 1.57f;
+    float focalLength = 3.5f;
+    float apertureSize = 0.0f;
+
+    // Animation
+    struct Keyframe
+    {
+        glm::vec3 cameraPosition;
+        glm::vec3 cameraTarget;
+    };
+    std::vector<Keyframe> keyframes;            // Empty for a single frame
+    unsigned int frameCount = 0;                // 0 for a frame per keyframe
+    bool loop = false;
+
+    // Film
+    glm::ivec2 resolution = glm::ivec2(1024, 1024);
+    glm::ivec4 region = glm::ivec4(0);          // Empty for all pixels
+    glm::ivec4 crop = glm::ivec4(0);            // Empty for the whole film
+
+    // Termination, whichever comes first
+    unsigned int sampleCount = 64;
+    float noiseThreshold = 0.0f;
+    unsigned int minSampleCount = 16;
+    float timeLimit = 0.0f;
+
+    int priority = 0;
+
+    // Integrator
+    PathTracingCpuBackend::Integrator integrator = PathTracingCpuBackend::Integrator::PathTracing;
+    bool metropolisEnabled = false;
+    Sampler::Type samplerType = Sampler::Type::Sobol;
+    unsigned int seed = 0;
+    bool antiAliasingEnabled = true;
+    bool emissiveSamplingEnabled = false;
+    bool lightTreeEnabled = true;
+    bool pathGuidingEnabled = false;
+    bool reservoirResamplingEnabled = false;
+    bool causticPhotonsEnabled = false;
+    bool radianceCacheEnabled = false;
+    bool adjointRussianRouletteEnabled = false;
+    bool temporalReprojectionEnabled = false;
+
+    DisneyBrdf::MaterialModifiers modifiers;
+
+    // Outputs
+    std::string radianceOutput;
+    std::string albedoOutput;
+    std::string normalOutput;
+    float exposure = 1.0f;
+    bool denoise = false;
+    std::string reply;
+    std::string checkpoint;
+    float checkpointInterval = 60.0f;
+
+    // Reads all jobs of a file, false with a message naming the line if the file cannot be read or has errors
+    static bool Load(const std::string& path, std::vector<BatchJob>& jobs, std::string& error);
+
+    // Same for jobs of any other source, the source names it in messages
+    // Without files allowed, outputs, checkpoints and camera paths are errors, as for jobs of clients the files do not belong to
+    static bool Parse(std::istream& stream, const std::string& source, std::vector<BatchJob>& jobs, std::string& error, bool allowFiles = true);
+
+    // Writes the job in the format Parse reads, with every key
+    void Save(std::ostream& stream) const;
+
+    bool IsAnimation() const { return !keyframes.empty(); }
+
+    // A job per frame of an animation, with the camera along a Catmull-Rom spline through the keyframes and the frame number in its outputs
+    std::vector<BatchJob> GetAnimationFrames() const;
+};
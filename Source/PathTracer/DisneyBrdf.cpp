@@ -0,0 +1,972 @@
+#include "DisneyBrdf.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float PI = 3.141592653589f;
+    constexpr float TWO_PI = 6.283185307178f;
+    constexpr float ONE_OVER_PI = 0.318309886183f;
+    constexpr float ONE_OVER_TWO_PI = 0.159154943091f;
+
+    constexpr float MIN_DIELECTRICS_F0 = 0.04f;
+
+    // -------------------------------------------------------------------------
+    //    Physically based shading utilities, see brdf.glsl
+    // -------------------------------------------------------------------------
+
+    inline float Mix(float a, float b, float t)
+    {
+        return a + (b - a) * t;
+    }
+
+    inline float D_GGX(float alpha, float NdotH)
+    {
+        float oneMinusNoHSquared = 1.0f - NdotH * NdotH;
+        float a = NdotH * alpha;
+        float k = alpha / (oneMinusNoHSquared + a * a);
+        return k * k * ONE_OVER_PI;
+    }
+
+    inline float D_GGX_Anisotropic(float at, float ab, float HdotX, float HdotY, float NdotH)
+    {
+        float a2 = at * ab;
+        float dx = ab * HdotX;
+        float dy = at * HdotY;
+        float dz = a2 * NdotH;
+        float d2 = dx * dx + dy * dy + dz * dz;
+        float b2 = a2 / d2;
+        return a2 * b2 * b2 * ONE_OVER_PI;
+    }
+
+    inline float D_Charlie(float roughness, float NdotH)
+    {
+        float invR = 1.0f / roughness;
+        float cos2h = NdotH * NdotH;
+        float sin2h = 1.0f - cos2h;
+        return (2.0f + invR) * std::pow(sin2h, invR * 0.5f) * ONE_OVER_TWO_PI;
+    }
+
+    inline float V_Smith_G1_GGX_Anisotropic(float ax, float ay, float VdotX, float VdotY, float NdotV)
+    {
+        float a = VdotX * ax;
+        float b = VdotY * ay;
+        float c = NdotV;
+        return (2.0f * NdotV) / (NdotV + std::sqrt(a * a + b * b + c * c));
+    }
+
+    inline float V_Smith_G2_Correlated_GGX_Anisotropic(float ax, float ay, float VdotX, float VdotY, float LdotX, float LdotY, float NdotV, float NdotL)
+    {
+        float vx = ax * VdotX;
+        float vy = ay * VdotY;
+        float lx = ax * LdotX;
+        float ly = ay * LdotY;
+        float lambdaV = NdotL * std::sqrt(vx * vx + vy * vy + NdotV * NdotV);
+        float lambdaL = NdotV * std::sqrt(lx * lx + ly * ly + NdotL * NdotL);
+        return 0.5f / (lambdaV + lambdaL);
+    }
+
+    inline float V_Kelemen(float LdotH)
+    {
+        // Constant to prevent NaN
+        return 0.25f / (LdotH * LdotH + 1e-5f);
+    }
+
+    inline float V_Neubelt(float NdotV, float NdotL)
+    {
+        return 1.0f / (4.0f * (NdotL + NdotV - NdotL * NdotV));
+    }
+
+    inline float F_SchlickWeight(float u)
+    {
+        float m = std::clamp(1.0f - u, 0.0f, 1.0f);
+        float m2 = m * m;
+        return m * m2 * m2;
+    }
+
+    inline float F_Schlick(float f0, float f90, float u)
+    {
+        float w = F_SchlickWeight(u);
+        return f0 + (f90 - f0) * w;
+    }
+
+    inline float F_Dielectric(float cosThetaI, float incidentIor)
+    {
+        float sinThetaTSq = incidentIor * incidentIor * (1.0f - cosThetaI * cosThetaI);
+
+        // Total internal reflection
+        if (sinThetaTSq > 1.0f)
+            return 1.0f;
+
+        float cosThetaT = std::sqrt(std::max(1.0f - sinThetaTSq, 0.0f));
+
+        float rs = (incidentIor * cosThetaT - cosThetaI) / (incidentIor * cosThetaT + cosThetaI);
+        float rp = (incidentIor * cosThetaI - cosThetaT) / (incidentIor * cosThetaI + cosThetaT);
+
+        return 0.5f * (rs * rs + rp * rp);
+    }
+
+    inline float Fd_Burley(float roughness, float NdotV, float NdotL, float LdotH)
+    {
+        float f90 = 0.5f + 2.0f * roughness * LdotH * LdotH;
+        float lightScatter = F_Schlick(1.0f, f90, NdotL);
+        float viewScatter = F_Schlick(1.0f, f90, NdotV);
+        return lightScatter * viewScatter * ONE_OVER_PI;
+    }
+
+    inline float Fd_HanrahanKrueger(float roughness, float NdotV, float NdotL, float LdotH)
+    {
+        float Fss90 = roughness * LdotH * LdotH;
+        float FLss = F_SchlickWeight(NdotL);
+        float FVss = F_SchlickWeight(NdotV);
+        float Fss = Mix(1.0f, Fss90, FLss) * Mix(1.0f, Fss90, FVss);
+        return 1.25f * (Fss * (1.0f / (NdotL + NdotV) - 0.5f) + 0.5f) * ONE_OVER_PI;
+    }
+
+    // -------------------------------------------------------------------------
+    //    Importance sampling, see montecarlo.glsl
+    // -------------------------------------------------------------------------
+
+    glm::vec3 ImportanceSampleGGX(float alpha, const glm::vec2& Xi)
+    {
+        float a2 = alpha * alpha;
+
+        float cosThetaH = std::sqrt((1.0f - Xi.y) / (1.0f + (a2 - 1.0f) * Xi.y));
+        float sinThetaH = std::sqrt(std::max(0.0f, 1.0f - cosThetaH * cosThetaH));
+
+        float phiH = TWO_PI * Xi.x;
+
+        return glm::vec3(sinThetaH * std::cos(phiH), sinThetaH * std::sin(phiH), cosThetaH);
+    }
+
+    glm::vec3 ImportanceSampleVisibleGGX(const glm::vec3& Ve, float ax, float ay, const glm::vec2& Xi)
+    {
+        // Section 3.2: transforming the view direction to the hemisphere configuration
+        glm::vec3 Vh = glm::normalize(glm::vec3(ax * Ve.x, ay * Ve.y, Ve.z));
+
+        // Section 4.1: orthonormal basis (with special case if cross product is zero)
+        float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+        glm::vec3 T1 = lensq > 0.0f ? glm::vec3(-Vh.y, Vh.x, 0.0f) / std::sqrt(lensq) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 T2 = glm::cross(Vh, T1);
+
+        // Section 4.2: parameterization of the projected area
+        float r = std::sqrt(Xi.x);
+        float phi = TWO_PI * Xi.y;
+        float t1 = r * std::cos(phi);
+        float t2 = r * std::sin(phi);
+        float s = 0.5f * (1.0f + Vh.z);
+        t2 = Mix(std::sqrt(1.0f - t1 * t1), t2, s);
+
+        // Section 4.3: reprojection onto hemisphere
+        glm::vec3 Nh = t1 * T1 + t2 * T2 + std::sqrt(std::max(0.0f, 1.0f - t1 * t1 - t2 * t2)) * Vh;
+
+        // Section 3.4: transforming the normal back to the ellipsoid configuration
+        return glm::normalize(glm::vec3(ax * Nh.x, ay * Nh.y, std::max(0.0f, Nh.z)));
+    }
+
+    inline float RescaleRandomNumber(float randomValue, float lowerBound, float upperBound)
+    {
+        const float oneMinusEpsilon = 0.99999994f; // 32-bit float just before 1.0
+        return std::min((randomValue - lowerBound) / (upperBound - lowerBound), oneMinusEpsilon);
+    }
+
+    // -------------------------------------------------------------------------
+    //    Disney lobe weights, see disney.glsl
+    // -------------------------------------------------------------------------
+
+    struct LobeWeights
+    {
+        glm::vec3 Csheen;
+        glm::vec3 Cspec0;
+
+        float dielectricWeight;
+        float metalWeight;
+        float glassWeight;
+        float sheenWeight;
+        float clearcoatWeight;
+
+        float diffuseProbability;
+        float dielectricProbability;
+        float metalProbability;
+        float glassProbability;
+        float sheenProbability;
+        float clearcoatProbability;
+    };
+
+    LobeWeights CalculateLobeWeights(const DisneyBrdf::Material& material, const DisneyBrdf::BrdfData& brdfData, unsigned int lobes)
+    {
+        LobeWeights weights;
+
+        // Tint colors
+        float luminance = DisneyBrdf::Luminance(material.albedo);
+        glm::vec3 Ctint = luminance > 0.0f ? material.albedo / luminance : glm::vec3(1.0f);
+        weights.Cspec0 = brdfData.f0 * glm::mix(glm::vec3(1.0f), Ctint, material.specularTint) * material.specular;
+        weights.Csheen = glm::mix(glm::vec3(1.0f), Ctint, material.sheenTint);
+
+        // Energy loss
+        float clearcoatEnergyLoss = 1.0f - (F_Schlick(MIN_DIELECTRICS_F0, 1.0f, brdfData.LdotH) * material.clearcoat);
+
+        // Model weights
+        weights.dielectricWeight = (1.0f - material.metallic) * (1.0f - material.transmission) * clearcoatEnergyLoss;
+        weights.metalWeight = material.metallic * clearcoatEnergyLoss;
+        weights.glassWeight = (1.0f - material.metallic) * material.transmission;
+        weights.sheenWeight = material.sheenRoughness;
+        weights.clearcoatWeight = material.clearcoat;
+
+        // Lobe probabilities, lobes outside of the mask are known to have no weight
+        float schlickWeight = F_SchlickWeight(brdfData.NdotV);
+        weights.diffuseProbability = (lobes & DisneyBrdf::LobeDiffuse) ? weights.dielectricWeight * luminance : 0.0f;
+        weights.dielectricProbability = (lobes & DisneyBrdf::LobeDielectric) ? weights.dielectricWeight * DisneyBrdf::Luminance(glm::mix(weights.Cspec0, glm::vec3(1.0f), schlickWeight)) : 0.0f;
+        weights.metalProbability = (lobes & DisneyBrdf::LobeMetal) ? weights.metalWeight * DisneyBrdf::Luminance(glm::mix(material.albedo, glm::vec3(1.0f), schlickWeight)) : 0.0f;
+        weights.glassProbability = (lobes & DisneyBrdf::LobeGlass) ? weights.glassWeight : 0.0f;
+        weights.sheenProbability = (lobes & DisneyBrdf::LobeSheen) ? weights.sheenWeight : 0.0f;
+        weights.clearcoatProbability = (lobes & DisneyBrdf::LobeClearcoat) ? weights.clearcoatWeight : 0.0f;
+
+        // Normalize probabilities
+        float invTotalWeight = 1.0f / (weights.diffuseProbability + weights.dielectricProbability + weights.metalProbability + weights.glassProbability + weights.sheenProbability + weights.clearcoatProbability);
+        weights.diffuseProbability *= invTotalWeight;
+        weights.dielectricProbability *= invTotalWeight;
+        weights.metalProbability *= invTotalWeight;
+        weights.glassProbability *= invTotalWeight;
+        weights.sheenProbability *= invTotalWeight;
+        weights.clearcoatProbability *= invTotalWeight;
+
+        return weights;
+    }
+
+    // -------------------------------------------------------------------------
+    //    Disney evaluation functions, see disney.glsl
+    // -------------------------------------------------------------------------
+
+    glm::vec3 EvaluateDisneyDiffuse(const DisneyBrdf::Material& material, const DisneyBrdf::BrdfData& brdfData, float& pdf)
+    {
+        pdf = 0.0f;
+        if (brdfData.NdotL <= 0.0f)
+        {
+            return glm::vec3(0.0f);
+        }
+
+        float Fd = Fd_Burley(brdfData.roughness, brdfData.NdotV, brdfData.NdotL, brdfData.LdotH);
+        float Fdss = Fd_HanrahanKrueger(brdfData.roughness, brdfData.NdotV, brdfData.NdotL, brdfData.LdotH);
+
+        pdf = brdfData.NdotL * ONE_OVER_PI;
+        return Mix(Fd, Fdss, material.subsurface) * material.albedo;
+    }
+
+    glm::vec3 EvaluateMicrofacetReflection(const DisneyBrdf::BrdfData& brdfData, const glm::vec3& F, float& pdf)
+    {
+        pdf = 0.0f;
+        if (brdfData.NdotL <= 0.0f)
+        {
+            return glm::vec3(0.0f);
+        }
+
+        float D = D_GGX_Anisotropic(brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, brdfData.HdotX, brdfData.HdotY, brdfData.NdotH);
+        float V1 = V_Smith_G1_GGX_Anisotropic(brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, brdfData.VdotX, brdfData.VdotY, std::abs(brdfData.NdotV));
+        float V2 = V_Smith_G2_Correlated_GGX_Anisotropic(brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, brdfData.VdotX, brdfData.VdotY, brdfData.LdotX, brdfData.LdotY, std::abs(brdfData.NdotV), std::abs(brdfData.NdotL));
+
+        pdf = D * V1 / (4.0f * brdfData.NdotV);
+        return F * D * V2;
+    }
+
+    glm::vec3 EvaluateMicrofacetRefraction(const DisneyBrdf::Material& material, const DisneyBrdf::BrdfData& brdfData, float F, float& pdf)
+    {
+        pdf = 0.0f;
+        if (brdfData.NdotL >= 0.0f)
+        {
+            return glm::vec3(0.0f);
+        }
+
+        float D = D_GGX_Anisotropic(brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, brdfData.HdotX, brdfData.HdotY, brdfData.NdotH);
+        float V1 = V_Smith_G1_GGX_Anisotropic(brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, brdfData.VdotX, brdfData.VdotY, std::abs(brdfData.NdotV));
+        float V2 = V_Smith_G2_Correlated_GGX_Anisotropic(brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, brdfData.VdotX, brdfData.VdotY, brdfData.LdotX, brdfData.LdotY, std::abs(brdfData.NdotV), std::abs(brdfData.NdotL));
+
+        float denom = brdfData.LdotH + brdfData.VdotH * brdfData.eta;
+        denom *= denom;
+        float eta2 = brdfData.eta * brdfData.eta;
+        float jacobian = std::abs(brdfData.LdotH) / denom;
+
+        pdf = D * V1 * std::max(0.0f, brdfData.VdotH) * jacobian / brdfData.NdotV;
+        return glm::sqrt(material.albedo) * (1.0f - F) * D * V2 * std::abs(brdfData.VdotH) * jacobian * eta2 * 4.0f;
+    }
+
+    glm::vec3 EvaluateSheen(const DisneyBrdf::Material& material, const DisneyBrdf::BrdfData& brdfData, const glm::vec3& Csheen, float& pdf)
+    {
+        pdf = 0.0f;
+        if (brdfData.NdotL <= 0.0f)
+        {
+            return glm::vec3(0.0f);
+        }
+
+        float D = D_Charlie(material.sheenRoughness, std::clamp(brdfData.NdotH, 0.0f, 1.0f));
+        float V = V_Neubelt(brdfData.NdotV, brdfData.NdotL);
+
+        pdf = brdfData.NdotL * ONE_OVER_PI;
+        return D * V * Csheen;
+    }
+
+    glm::vec3 EvaluateClearcoat(const DisneyBrdf::BrdfData& brdfData, float& pdf)
+    {
+        pdf = 0.0f;
+        if (brdfData.NdotL <= 0.0f)
+        {
+            return glm::vec3(0.0f);
+        }
+
+        float D = D_GGX(brdfData.alphaClearcoat, brdfData.NdotH);
+        float V = V_Kelemen(brdfData.LdotH);
+        float F = F_Schlick(MIN_DIELECTRICS_F0, 1.0f, brdfData.LdotH); // Fix IOR to 1.5
+
+        pdf = D * brdfData.NdotH / (4.0f * brdfData.LdotH);
+        return glm::vec3(D * V * F);
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Lobes and modifiers
+// -------------------------------------------------------------------------
+
+unsigned int DisneyBrdf::GetMaterialLobes(const Material& material, bool hasMetallicTexture, bool hasTransmissionTexture)
+{
+    // Textures only scale the attributes, so they can lower metallic and transmission but never raise them
+    bool canBeNonMetallic = material.metallic < 1.0f || hasMetallicTexture;
+    bool canBeOpaque = material.transmission < 1.0f || hasTransmissionTexture;
+
+    unsigned int lobes = 0;
+    if (canBeNonMetallic && canBeOpaque)
+    {
+        lobes |= LobeDiffuse | LobeDielectric;
+    }
+    if (material.metallic > 0.0f)
+    {
+        lobes |= LobeMetal;
+    }
+    if (canBeNonMetallic && material.transmission > 0.0f)
+    {
+        lobes |= LobeGlass;
+    }
+    if (material.sheenRoughness > 0.0f)
+    {
+        lobes |= LobeSheen;
+    }
+    if (material.clearcoat > 0.0f)
+    {
+        lobes |= LobeClearcoat;
+    }
+
+    return lobes;
+}
+
+unsigned int DisneyBrdf::GetModifierLobes(const MaterialModifiers& modifiers)
+{
+    unsigned int lobes = 0;
+    if (modifiers.metallic < 0.0f)
+    {
+        lobes |= LobeDiffuse | LobeDielectric | LobeGlass;
+    }
+    if (modifiers.metallic > 0.0f)
+    {
+        lobes |= LobeMetal;
+    }
+    if (modifiers.transmission < 0.0f)
+    {
+        lobes |= LobeDiffuse | LobeDielectric;
+    }
+    if (modifiers.transmission > 0.0f)
+    {
+        lobes |= LobeGlass;
+    }
+    if (modifiers.sheenRoughness > 0.0f)
+    {
+        lobes |= LobeSheen;
+    }
+    if (modifiers.clearcoat > 0.0f)
+    {
+        lobes |= LobeClearcoat;
+    }
+
+    return lobes;
+}
+
+void DisneyBrdf::ApplyModifiers(Material& material, const MaterialModifiers& modifiers)
+{
+    material.specular = std::clamp(material.specular + modifiers.specular, 0.0f, 1.0f);
+    material.specularTint = std::clamp(material.specularTint + modifiers.specularTint, 0.0f, 1.0f);
+    material.metallic = std::clamp(material.metallic + modifiers.metallic, 0.0f, 1.0f);
+    material.roughness = std::clamp(material.roughness + modifiers.roughness, 0.0f, 1.0f);
+    material.subsurface = std::clamp(material.subsurface + modifiers.subsurface, 0.0f, 1.0f);
+    material.anisotropy = std::clamp(material.anisotropy + modifiers.anisotropy, 0.0f, 1.0f);
+    material.sheenRoughness = std::clamp(material.sheenRoughness + modifiers.sheenRoughness, 0.0f, 1.0f);
+    material.sheenTint = std::clamp(material.sheenTint + modifiers.sheenTint, 0.0f, 1.0f);
+    material.clearcoat = std::clamp(material.clearcoat + modifiers.clearcoat, 0.0f, 1.0f);
+    material.clearcoatRoughness = std::clamp(material.clearcoatRoughness + modifiers.clearcoatRoughness, 0.0f, 1.0f);
+    material.refraction = std::clamp(material.refraction + modifiers.refraction, 1.01f, 2.0f);
+    material.transmission = std::clamp(material.transmission + modifiers.transmission, 0.0f, 1.0f);
+}
+
+// -------------------------------------------------------------------------
+//    BRDF data preparation
+// -------------------------------------------------------------------------
+
+DisneyBrdf::BrdfData DisneyBrdf::PrepareEvaluationBrdfData(const Material& material, const glm::vec3& V, const glm::vec3& N, const glm::vec3& L)
+{
+    BrdfData data;
+
+    // Get tangent and bitangent
+    GetTangentBitangent(N, data.X, data.Y);
+
+    // Unpack 'perceptively linear' -> 'linear' -> 'squared' roughness
+    data.roughness = std::clamp(material.roughness, 0.045f, 1.0f);
+    data.alpha = data.roughness * data.roughness;
+
+    float roughnessClearcoat = std::clamp(material.clearcoatRoughness, 0.045f, 1.0f);
+    data.alphaClearcoat = roughnessClearcoat * roughnessClearcoat;
+
+    // Kulla 2017, "Revisiting Physically Based Shading at Imageworks"
+    float aspect = std::sqrt(1.0f - 0.9f * material.anisotropy);
+    data.alphaAnisotropicX = std::max(0.002025f, data.alpha / aspect);
+    data.alphaAnisotropicY = std::max(0.002025f, data.alpha * aspect);
+
+    data.V = V;
+    data.N = N;
+    data.L = L;
+
+    float NdotV = glm::dot(N, V);
+    float NdotL = glm::dot(N, L);
+
+    // eta to estimate in and out refractive direction, based on V backfacing
+    data.eta = NdotV <= 0.0f ? material.refraction : (1.0f / material.refraction);
+
+    // Calculate half vector based on eta, based on L backfacing
+    data.H = NdotL <= 0.0f ? glm::normalize(L + V * data.eta) : glm::normalize(L + V);
+
+    // Avoid half vector going into ground
+    if (glm::dot(N, data.H) < 0.0f)
+        data.H = -data.H;
+
+    data.NdotV = NdotV;
+    data.NdotL = NdotL;
+    data.VdotH = glm::dot(data.V, data.H);
+    data.NdotH = glm::dot(data.N, data.H);
+    data.LdotH = glm::dot(data.L, data.H);
+    data.VdotX = glm::dot(data.V, data.X);
+    data.LdotX = glm::dot(data.L, data.X);
+    data.HdotX = glm::dot(data.H, data.X);
+    data.VdotY = glm::dot(data.V, data.Y);
+    data.LdotY = glm::dot(data.L, data.Y);
+    data.HdotY = glm::dot(data.H, data.Y);
+
+    float r = (1.0f - data.eta) / (1.0f + data.eta);
+    data.f0 = r * r;
+
+    return data;
+}
+
+// -------------------------------------------------------------------------
+//    Disney sampling BRDF
+// -------------------------------------------------------------------------
+
+glm::vec3 DisneyBrdf::SampleDisneyBrdf(const Material& material, const BrdfData& brdfData, const glm::vec3& Xi, unsigned int lobes)
+{
+    LobeWeights weights = CalculateLobeWeights(material, brdfData, lobes);
+
+    // CDF of the sampling probabilities
+    float cdf[6];
+    cdf[0] = weights.diffuseProbability;
+    cdf[1] = cdf[0] + weights.dielectricProbability;
+    cdf[2] = cdf[1] + weights.metalProbability;
+    cdf[3] = cdf[2] + weights.glassProbability;
+    cdf[4] = cdf[3] + weights.sheenProbability;
+    cdf[5] = cdf[4] + weights.clearcoatProbability;
+
+    // Sample a lobe based on its importance
+    float rd = Xi.z;
+
+    if (rd < cdf[0]) // Diffuse
+    {
+        return ToWorld(brdfData.N, HemispherepointCos(Xi.x, Xi.y));
+    }
+    else if (rd < cdf[2]) // Dielectric + Metallic reflection
+    {
+        glm::vec3 tangentV = ToLocal(brdfData.N, brdfData.V);
+        glm::vec3 H = ImportanceSampleVisibleGGX(tangentV, brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, glm::vec2(Xi));
+
+        // Avoid scattered ray going into ground
+        if (H.z < 0.0f)
+            H = -H;
+
+        H = ToWorld(brdfData.N, H);
+
+        return glm::normalize(glm::reflect(-brdfData.V, H));
+    }
+    else if (rd < cdf[3]) // Glass
+    {
+        glm::vec3 tangentV = ToLocal(brdfData.N, brdfData.V);
+        glm::vec3 H = ImportanceSampleVisibleGGX(tangentV, brdfData.alphaAnisotropicX, brdfData.alphaAnisotropicY, glm::vec2(Xi));
+
+        // Avoid scattered ray going into ground
+        if (H.z < 0.0f)
+            H = -H;
+
+        H = ToWorld(brdfData.N, H);
+
+        float F = F_Dielectric(std::abs(glm::dot(brdfData.V, H)), brdfData.eta);
+
+        // Rescale random number for reuse
+        rd = RescaleRandomNumber(rd, cdf[2], cdf[3]);
+
+        if (rd < F) // Reflection
+        {
+            return glm::normalize(glm::reflect(-brdfData.V, H));
+        }
+        else // Transmission
+        {
+            return glm::normalize(glm::refract(-brdfData.V, H, brdfData.eta));
+        }
+    }
+    else if (rd < cdf[4]) // Sheen
+    {
+        return ToWorld(brdfData.N, HemispherepointCos(Xi.x, Xi.y));
+    }
+    else // Clearcoat
+    {
+        glm::vec3 H = ImportanceSampleGGX(brdfData.alphaClearcoat, glm::vec2(Xi));
+
+        // Avoid scattered ray going into ground
+        if (H.z < 0.0f)
+            H = -H;
+
+        H = ToWorld(brdfData.N, H);
+
+        return glm::normalize(glm::reflect(-brdfData.V, H));
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Disney evaluation BRDF
+// -------------------------------------------------------------------------
+
+glm::vec3 DisneyBrdf::EvaluateDisneyBrdf(const Material& material, const BrdfData& brdfData, float& pdf, unsigned int lobes)
+{
+    glm::vec3 f = glm::vec3(0.0f);
+    pdf = 0.0f;
+
+    LobeWeights weights = CalculateLobeWeights(material, brdfData, lobes);
+
+    bool reflection = brdfData.NdotL * brdfData.NdotV > 0.0f;
+
+    float tmpPdf = 0.0f;
+    float VdotH = std::abs(brdfData.VdotH);
+
+    // Diffuse
+    if (weights.diffuseProbability > 0.0f && reflection)
+    {
+        f += EvaluateDisneyDiffuse(material, brdfData, tmpPdf) * weights.dielectricWeight;
+        pdf += tmpPdf * weights.diffuseProbability;
+    }
+
+    // Dielectric Reflection
+    if (weights.dielectricProbability > 0.0f && reflection)
+    {
+        // Normalize for interpolating based on Cspec0
+        float F = (F_Dielectric(VdotH, 1.0f / material.refraction) - brdfData.f0) / (1.0f - brdfData.f0);
+
+        f += EvaluateMicrofacetReflection(brdfData, glm::mix(weights.Cspec0, glm::vec3(1.0f), F), tmpPdf) * weights.dielectricWeight;
+        pdf += tmpPdf * weights.dielectricProbability;
+    }
+
+    // Metallic reflection
+    if (weights.metalProbability > 0.0f && reflection)
+    {
+        // Tinted to albedo
+        glm::vec3 F = glm::mix(material.albedo, glm::vec3(1.0f), F_SchlickWeight(VdotH));
+
+        f += EvaluateMicrofacetReflection(brdfData, F, tmpPdf) * weights.metalWeight;
+        pdf += tmpPdf * weights.metalProbability;
+    }
+
+    // Glass/Specular BSDF
+    if (weights.glassProbability > 0.0f)
+    {
+        // Dielectric fresnel (achromatic)
+        float F = F_Dielectric(VdotH, brdfData.eta);
+
+        if (reflection)
+        {
+            f += EvaluateMicrofacetReflection(brdfData, glm::vec3(F), tmpPdf) * weights.glassWeight;
+            pdf += tmpPdf * weights.glassProbability * F;
+        }
+        else
+        {
+            f += EvaluateMicrofacetRefraction(material, brdfData, F, tmpPdf) * weights.glassWeight;
+            pdf += tmpPdf * weights.glassProbability * (1.0f - F);
+        }
+    }
+
+    // Sheen
+    if (weights.sheenProbability > 0.0f && reflection)
+    {
+        f += EvaluateSheen(material, brdfData, weights.Csheen, tmpPdf) * weights.sheenWeight;
+        pdf += tmpPdf * weights.sheenProbability;
+    }
+
+    // Clearcoat
+    if (weights.clearcoatProbability > 0.0f && reflection)
+    {
+        f += EvaluateClearcoat(brdfData, tmpPdf) * weights.clearcoatWeight;
+        pdf += tmpPdf * weights.clearcoatProbability;
+    }
+
+    // Apply NdotL
+    return f * std::abs(brdfData.NdotL);
+}
+
+// -------------------------------------------------------------------------
+//    Batched Disney evaluation BRDF
+// -------------------------------------------------------------------------
+
+void DisneyBrdf::ShadingBatch::SetLane(int lane, const Material& material, const glm::vec3& V, const glm::vec3& N, const glm::vec3& L)
+{
+    Vx[lane] = V.x; Vy[lane] = V.y; Vz[lane] = V.z;
+    Nx[lane] = N.x; Ny[lane] = N.y; Nz[lane] = N.z;
+    Lx[lane] = L.x; Ly[lane] = L.y; Lz[lane] = L.z;
+
+    albedoR[lane] = material.albedo.r;
+    albedoG[lane] = material.albedo.g;
+    albedoB[lane] = material.albedo.b;
+    specular[lane] = material.specular;
+    specularTint[lane] = material.specularTint;
+    metallic[lane] = material.metallic;
+    roughness[lane] = material.roughness;
+    subsurface[lane] = material.subsurface;
+    anisotropy[lane] = material.anisotropy;
+    sheenRoughness[lane] = material.sheenRoughness;
+    sheenTint[lane] = material.sheenTint;
+    clearcoat[lane] = material.clearcoat;
+    clearcoatRoughness[lane] = material.clearcoatRoughness;
+    refraction[lane] = material.refraction;
+    transmission[lane] = material.transmission;
+}
+
+void DisneyBrdf::ShadingBatch::SetDirection(int lane, const glm::vec3& L)
+{
+    Lx[lane] = L.x; Ly[lane] = L.y; Lz[lane] = L.z;
+}
+
+void DisneyBrdf::EvaluateDisneyBrdfBatch(ShadingBatch& b, unsigned int lobes)
+{
+    const int count = b.count;
+
+    // Prepare BRDF data, same as PrepareEvaluationBrdfData
+    for (int i = 0; i < count; i++)
+    {
+        float nx = b.Nx[i], ny = b.Ny[i], nz = b.Nz[i];
+        float vx = b.Vx[i], vy = b.Vy[i], vz = b.Vz[i];
+        float lx = b.Lx[i], ly = b.Ly[i], lz = b.Lz[i];
+
+        // Tangent from cross(N, helper), helper is either (1, 0, 0) or (0, 0, 1)
+        bool useZ = std::abs(nx) > 0.999f;
+        float tx = useZ ? ny : 0.0f;
+        float ty = useZ ? -nx : nz;
+        float tz = useZ ? 0.0f : -ny;
+        float invT = 1.0f / std::sqrt(tx * tx + ty * ty + tz * tz);
+        tx *= invT; ty *= invT; tz *= invT;
+
+        // Bitangent from cross(N, T)
+        float bx = ny * tz - nz * ty;
+        float by = nz * tx - nx * tz;
+        float bz = nx * ty - ny * tx;
+        float invB = 1.0f / std::sqrt(bx * bx + by * by + bz * bz);
+        bx *= invB; by *= invB; bz *= invB;
+
+        float r = std::clamp(b.roughness[i], 0.045f, 1.0f);
+        float alpha = r * r;
+        float rc = std::clamp(b.clearcoatRoughness[i], 0.045f, 1.0f);
+        float aspect = std::sqrt(1.0f - 0.9f * b.anisotropy[i]);
+
+        b.dRoughness[i] = r;
+        b.dAlphaClearcoat[i] = rc * rc;
+        b.dAlphaX[i] = std::max(0.002025f, alpha / aspect);
+        b.dAlphaY[i] = std::max(0.002025f, alpha * aspect);
+
+        float NdotV = nx * vx + ny * vy + nz * vz;
+        float NdotL = nx * lx + ny * ly + nz * lz;
+        float eta = NdotV <= 0.0f ? b.refraction[i] : (1.0f / b.refraction[i]);
+
+        float s = NdotL <= 0.0f ? eta : 1.0f;
+        float hx = lx + vx * s;
+        float hy = ly + vy * s;
+        float hz = lz + vz * s;
+        float invH = 1.0f / std::sqrt(hx * hx + hy * hy + hz * hz);
+        float flip = (nx * hx + ny * hy + nz * hz) < 0.0f ? -invH : invH;
+        hx *= flip; hy *= flip; hz *= flip;
+
+        b.NdotV[i] = NdotV;
+        b.NdotL[i] = NdotL;
+        b.VdotH[i] = vx * hx + vy * hy + vz * hz;
+        b.NdotH[i] = nx * hx + ny * hy + nz * hz;
+        b.LdotH[i] = lx * hx + ly * hy + lz * hz;
+        b.VdotX[i] = vx * tx + vy * ty + vz * tz;
+        b.LdotX[i] = lx * tx + ly * ty + lz * tz;
+        b.HdotX[i] = hx * tx + hy * ty + hz * tz;
+        b.VdotY[i] = vx * bx + vy * by + vz * bz;
+        b.LdotY[i] = lx * bx + ly * by + lz * bz;
+        b.HdotY[i] = hx * bx + hy * by + hz * bz;
+
+        float f0 = (1.0f - eta) / (1.0f + eta);
+        b.eta[i] = eta;
+        b.f0[i] = f0 * f0;
+    }
+
+    // Lobe weights and probabilities, same as CalculateLobeWeights
+    for (int i = 0; i < count; i++)
+    {
+        float ar = b.albedoR[i], ag = b.albedoG[i], ab = b.albedoB[i];
+        float luminance = ar * 0.2126f + ag * 0.7152f + ab * 0.0722f;
+        float invLuminance = luminance > 0.0f ? 1.0f / luminance : 0.0f;
+        float tr = luminance > 0.0f ? ar * invLuminance : 1.0f;
+        float tg = luminance > 0.0f ? ag * invLuminance : 1.0f;
+        float tb = luminance > 0.0f ? ab * invLuminance : 1.0f;
+
+        float specularScale = b.f0[i] * b.specular[i];
+        b.cspec0R[i] = specularScale * Mix(1.0f, tr, b.specularTint[i]);
+        b.cspec0G[i] = specularScale * Mix(1.0f, tg, b.specularTint[i]);
+        b.cspec0B[i] = specularScale * Mix(1.0f, tb, b.specularTint[i]);
+        b.csheenR[i] = Mix(1.0f, tr, b.sheenTint[i]);
+        b.csheenG[i] = Mix(1.0f, tg, b.sheenTint[i]);
+        b.csheenB[i] = Mix(1.0f, tb, b.sheenTint[i]);
+
+        float clearcoatEnergyLoss = 1.0f - (F_Schlick(MIN_DIELECTRICS_F0, 1.0f, b.LdotH[i]) * b.clearcoat[i]);
+
+        float dielectricWeight = (1.0f - b.metallic[i]) * (1.0f - b.transmission[i]) * clearcoatEnergyLoss;
+        float metalWeight = b.metallic[i] * clearcoatEnergyLoss;
+        float glassWeight = (1.0f - b.metallic[i]) * b.transmission[i];
+
+        float schlickWeight = F_SchlickWeight(b.NdotV[i]);
+        float cspecLuminance = Mix(b.cspec0R[i], 1.0f, schlickWeight) * 0.2126f + Mix(b.cspec0G[i], 1.0f, schlickWeight) * 0.7152f + Mix(b.cspec0B[i], 1.0f, schlickWeight) * 0.0722f;
+        float metalLuminance = Mix(ar, 1.0f, schlickWeight) * 0.2126f + Mix(ag, 1.0f, schlickWeight) * 0.7152f + Mix(ab, 1.0f, schlickWeight) * 0.0722f;
+
+        float diffuseProbability = (lobes & LobeDiffuse) ? dielectricWeight * luminance : 0.0f;
+        float dielectricProbability = (lobes & LobeDielectric) ? dielectricWeight * cspecLuminance : 0.0f;
+        float metalProbability = (lobes & LobeMetal) ? metalWeight * metalLuminance : 0.0f;
+        float glassProbability = (lobes & LobeGlass) ? glassWeight : 0.0f;
+        float sheenProbability = (lobes & LobeSheen) ? b.sheenRoughness[i] : 0.0f;
+        float clearcoatProbability = (lobes & LobeClearcoat) ? b.clearcoat[i] : 0.0f;
+
+        float invTotalWeight = 1.0f / (diffuseProbability + dielectricProbability + metalProbability + glassProbability + sheenProbability + clearcoatProbability);
+
+        b.dielectricWeight[i] = dielectricWeight;
+        b.metalWeight[i] = metalWeight;
+        b.glassWeight[i] = glassWeight;
+        b.sheenWeight[i] = b.sheenRoughness[i];
+        b.clearcoatWeight[i] = b.clearcoat[i];
+
+        b.diffuseProbability[i] = diffuseProbability * invTotalWeight;
+        b.dielectricProbability[i] = dielectricProbability * invTotalWeight;
+        b.metalProbability[i] = metalProbability * invTotalWeight;
+        b.glassProbability[i] = glassProbability * invTotalWeight;
+        b.sheenProbability[i] = sheenProbability * invTotalWeight;
+        b.clearcoatProbability[i] = clearcoatProbability * invTotalWeight;
+
+        b.fR[i] = 0.0f;
+        b.fG[i] = 0.0f;
+        b.fB[i] = 0.0f;
+        b.pdf[i] = 0.0f;
+    }
+
+    // Diffuse
+    if (lobes & LobeDiffuse)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            float NdotV = b.NdotV[i], NdotL = b.NdotL[i], LdotH = b.LdotH[i];
+            bool active = b.diffuseProbability[i] > 0.0f && NdotL > 0.0f && NdotV > 0.0f;
+
+            float Fd = Fd_Burley(b.dRoughness[i], NdotV, NdotL, LdotH);
+            float Fdss = Fd_HanrahanKrueger(b.dRoughness[i], NdotV, NdotL, LdotH);
+            float value = Mix(Fd, Fdss, b.subsurface[i]) * b.dielectricWeight[i];
+
+            b.fR[i] += active ? value * b.albedoR[i] : 0.0f;
+            b.fG[i] += active ? value * b.albedoG[i] : 0.0f;
+            b.fB[i] += active ? value * b.albedoB[i] : 0.0f;
+            b.pdf[i] += active ? NdotL * ONE_OVER_PI * b.diffuseProbability[i] : 0.0f;
+        }
+    }
+
+    // Microfacet terms shared by the dielectric, metal and glass reflection lobes
+    auto microfacet = [&b](int i, float& D, float& V1, float& V2)
+    {
+        float absNdotV = std::abs(b.NdotV[i]);
+        float absNdotL = std::abs(b.NdotL[i]);
+        D = D_GGX_Anisotropic(b.dAlphaX[i], b.dAlphaY[i], b.HdotX[i], b.HdotY[i], b.NdotH[i]);
+        V1 = V_Smith_G1_GGX_Anisotropic(b.dAlphaX[i], b.dAlphaY[i], b.VdotX[i], b.VdotY[i], absNdotV);
+        V2 = V_Smith_G2_Correlated_GGX_Anisotropic(b.dAlphaX[i], b.dAlphaY[i], b.VdotX[i], b.VdotY[i], b.LdotX[i], b.LdotY[i], absNdotV, absNdotL);
+    };
+
+    // Dielectric reflection
+    if (lobes & LobeDielectric)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            bool active = b.dielectricProbability[i] > 0.0f && b.NdotL[i] > 0.0f && b.NdotV[i] > 0.0f;
+
+            float D, V1, V2;
+            microfacet(i, D, V1, V2);
+
+            float F = (F_Dielectric(std::abs(b.VdotH[i]), 1.0f / b.refraction[i]) - b.f0[i]) / (1.0f - b.f0[i]);
+            float value = D * V2 * b.dielectricWeight[i];
+
+            b.fR[i] += active ? Mix(b.cspec0R[i], 1.0f, F) * value : 0.0f;
+            b.fG[i] += active ? Mix(b.cspec0G[i], 1.0f, F) * value : 0.0f;
+            b.fB[i] += active ? Mix(b.cspec0B[i], 1.0f, F) * value : 0.0f;
+            b.pdf[i] += active ? D * V1 / (4.0f * b.NdotV[i]) * b.dielectricProbability[i] : 0.0f;
+        }
+    }
+
+    // Metallic reflection
+    if (lobes & LobeMetal)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            bool active = b.metalProbability[i] > 0.0f && b.NdotL[i] > 0.0f && b.NdotV[i] > 0.0f;
+
+            float D, V1, V2;
+            microfacet(i, D, V1, V2);
+
+            float F = F_SchlickWeight(std::abs(b.VdotH[i]));
+            float value = D * V2 * b.metalWeight[i];
+
+            b.fR[i] += active ? Mix(b.albedoR[i], 1.0f, F) * value : 0.0f;
+            b.fG[i] += active ? Mix(b.albedoG[i], 1.0f, F) * value : 0.0f;
+            b.fB[i] += active ? Mix(b.albedoB[i], 1.0f, F) * value : 0.0f;
+            b.pdf[i] += active ? D * V1 / (4.0f * b.NdotV[i]) * b.metalProbability[i] : 0.0f;
+        }
+    }
+
+    // Glass/Specular BSDF
+    if (lobes & LobeGlass)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            float NdotV = b.NdotV[i], NdotL = b.NdotL[i];
+            bool reflection = NdotL * NdotV > 0.0f;
+            bool activeReflection = b.glassProbability[i] > 0.0f && reflection && NdotL > 0.0f;
+            bool activeRefraction = b.glassProbability[i] > 0.0f && !reflection && NdotL < 0.0f;
+
+            float D, V1, V2;
+            microfacet(i, D, V1, V2);
+
+            float F = F_Dielectric(std::abs(b.VdotH[i]), b.eta[i]);
+
+            // Reflection
+            float reflectionValue = F * D * V2 * b.glassWeight[i];
+            float reflectionPdf = D * V1 / (4.0f * NdotV) * b.glassProbability[i] * F;
+
+            // Refraction
+            float denom = b.LdotH[i] + b.VdotH[i] * b.eta[i];
+            denom *= denom;
+            float eta2 = b.eta[i] * b.eta[i];
+            float jacobian = std::abs(b.LdotH[i]) / denom;
+            float refractionValue = (1.0f - F) * D * V2 * std::abs(b.VdotH[i]) * jacobian * eta2 * 4.0f * b.glassWeight[i];
+            float refractionPdf = D * V1 * std::max(0.0f, b.VdotH[i]) * jacobian / NdotV * b.glassProbability[i] * (1.0f - F);
+
+            b.fR[i] += activeReflection ? reflectionValue : (activeRefraction ? std::sqrt(b.albedoR[i]) * refractionValue : 0.0f);
+            b.fG[i] += activeReflection ? reflectionValue : (activeRefraction ? std::sqrt(b.albedoG[i]) * refractionValue : 0.0f);
+            b.fB[i] += activeReflection ? reflectionValue : (activeRefraction ? std::sqrt(b.albedoB[i]) * refractionValue : 0.0f);
+            b.pdf[i] += activeReflection ? reflectionPdf : (activeRefraction ? refractionPdf : 0.0f);
+        }
+    }
+
+    // Sheen
+    if (lobes & LobeSheen)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            float NdotV = b.NdotV[i], NdotL = b.NdotL[i];
+            bool active = b.sheenProbability[i] > 0.0f && NdotL > 0.0f && NdotV > 0.0f;
+
+            float D = active ? D_Charlie(b.sheenRoughness[i], std::clamp(b.NdotH[i], 0.0f, 1.0f)) : 0.0f;
+            float value = D * V_Neubelt(NdotV, NdotL) * b.sheenWeight[i];
+
+            b.fR[i] += active ? value * b.csheenR[i] : 0.0f;
+            b.fG[i] += active ? value * b.csheenG[i] : 0.0f;
+            b.fB[i] += active ? value * b.csheenB[i] : 0.0f;
+            b.pdf[i] += active ? NdotL * ONE_OVER_PI * b.sheenProbability[i] : 0.0f;
+        }
+    }
+
+    // Clearcoat
+    if (lobes & LobeClearcoat)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            bool active = b.clearcoatProbability[i] > 0.0f && b.NdotL[i] > 0.0f && b.NdotV[i] > 0.0f;
+
+            float D = D_GGX(b.dAlphaClearcoat[i], b.NdotH[i]);
+            float V = V_Kelemen(b.LdotH[i]);
+            float F = F_Schlick(MIN_DIELECTRICS_F0, 1.0f, b.LdotH[i]); // Fix IOR to 1.5
+            float value = D * V * F * b.clearcoatWeight[i];
+
+            b.fR[i] += active ? value : 0.0f;
+            b.fG[i] += active ? value : 0.0f;
+            b.fB[i] += active ? value : 0.0f;
+            b.pdf[i] += active ? D * b.NdotH[i] / (4.0f * b.LdotH[i]) * b.clearcoatProbability[i] : 0.0f;
+        }
+    }
+
+    // Apply NdotL
+    for (int i = 0; i < count; i++)
+    {
+        float absNdotL = std::abs(b.NdotL[i]);
+        b.fR[i] *= absNdotL;
+        b.fG[i] *= absNdotL;
+        b.fB[i] *= absNdotL;
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Monte carlo helpers
+// -------------------------------------------------------------------------
+
+glm::vec3 DisneyBrdf::HemispherepointCos(float u, float v)
+{
+    float phi = v * TWO_PI;
+    float cosTheta = std::sqrt(1.0f - u);
+    float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+    return glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+
+void DisneyBrdf::GetTangentBitangent(const glm::vec3& N, glm::vec3& tangent, glm::vec3& bitangent)
+{
+    // Choose a helper vector for the cross product
+    glm::vec3 helper = std::abs(N.x) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+
+    tangent = glm::normalize(glm::cross(N, helper));
+    bitangent = glm::normalize(glm::cross(N, tangent));
+}
+
+glm::vec3 DisneyBrdf::ToWorld(const glm::vec3& N, const glm::vec3& V)
+{
+    glm::vec3 T, B;
+    GetTangentBitangent(N, T, B);
+    return T * V.x + B * V.y + N * V.z;
+}
+
+glm::vec3 DisneyBrdf::ToLocal(const glm::vec3& N, const glm::vec3& V)
+{
+    glm::vec3 T, B;
+    GetTangentBitangent(N, T, B);
+    return glm::vec3(glm::dot(T, V), glm::dot(B, V), glm::dot(N, V));
+}
+
+float DisneyBrdf::Luminance(const glm::vec3& rgb)
+{
+    return glm::dot(rgb, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+float DisneyBrdf::MisMixWeight(float a, float b)
+{
+    float t = a * a;
+    return t / (b * b + t);
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+
+// CPU port of Shaders/Library/brdf.glsl, Shaders/Library/disney.glsl and Shaders/Library/montecarlo.glsl
+// Any change to the shading model must be applied in both places
+class DisneyBrdf
+{
+public:
+    // Lobes a material can contribute to. Whole lobes are skipped when not present in the mask
+    enum Lobe : unsigned int
+    {
+        LobeDiffuse     = 1 << 0,
+        LobeDielectric  = 1 << 1,
+        LobeMetal       = 1 << 2,
+        LobeGlass       = 1 << 3,
+        LobeSheen       = 1 << 4,
+        LobeClearcoat   = 1 << 5,
+        LobeAll         = (1 << 6) - 1,
+    };
+
+    // Evaluated material, same as the Material struct in common.glsl without texture handles
+    struct Material
+    {
+        glm::vec3 emission = glm::vec3(0.0f, 0.0f, 0.0f);
+        glm::vec3 albedo = glm::vec3(1.0f, 1.0f, 1.0f);
+        float specular = 0.5f;
+        float specularTint = 0.0f;
+        float metallic = 0.0f;
+        float roughness = 1.0f;
+        float subsurface = 0.0f;
+        float anisotropy = 0.0f;
+        float sheenRoughness = 0.0f;
+        float sheenTint = 0.5f;
+        float clearcoat = 0.0f;
+        float clearcoatRoughness = 0.0f;
+        float refraction = 1.5f;
+        float transmission = 0.0f;
+    };
+
+    // Global material modifiers, added on top of the evaluated material
+    struct MaterialModifiers
+    {
+        float specular = 0.0f;
+        float specularTint = 0.0f;
+        float metallic = 0.0f;
+        float roughness = 0.0f;
+        float subsurface = 0.0f;
+        float anisotropy = 0.0f;
+        float sheenRoughness = 0.0f;
+        float sheenTint = 0.0f;
+        float clearcoat = 0.0f;
+        float clearcoatRoughness = 0.0f;
+        float refraction = 0.0f;
+        float transmission = 0.0f;
+    };
+
+    // Same as the BrdfData struct in common.glsl
+    struct BrdfData
+    {
+        // Roughnesses
+        float roughness;
+        float alpha;
+        float alphaClearcoat;
+        float alphaAnisotropicX;
+        float alphaAnisotropicY;
+
+        // Vectors
+        glm::vec3 V;
+        glm::vec3 N;
+        glm::vec3 L;
+        glm::vec3 H;
+        glm::vec3 X;
+        glm::vec3 Y;
+
+        // Angles
+        float NdotV;
+        float NdotL;
+        float VdotH;
+        float NdotH;
+        float LdotH;
+        float VdotX;
+        float LdotX;
+        float HdotX;
+        float VdotY;
+        float LdotY;
+        float HdotY;
+
+        // Common used terms for BRDF evaluation
+        float eta;
+        float f0;
+    };
+
+    // Structure of arrays for a batch of hits sharing the same material
+    // Every lobe is evaluated for all lanes of the batch in one loop, which keeps the loops free of
+    // per-lane branching on the lobe type and lets the compiler vectorize them
+    struct ShadingBatch
+    {
+        static constexpr int MaxSize = 256;
+        using Lane = std::array<float, MaxSize>;
+
+        int count = 0;
+
+        // Inputs
+        Lane Vx, Vy, Vz;
+        Lane Nx, Ny, Nz;
+        Lane Lx, Ly, Lz;
+        Lane albedoR, albedoG, albedoB;
+        Lane specular, specularTint, metallic, roughness, subsurface, anisotropy;
+        Lane sheenRoughness, sheenTint, clearcoat, clearcoatRoughness, refraction, transmission;
+
+        // Prepared BRDF data
+        Lane dRoughness, dAlphaClearcoat, dAlphaX, dAlphaY;
+        Lane NdotV, NdotL, VdotH, NdotH, LdotH, VdotX, LdotX, HdotX, VdotY, LdotY, HdotY;
+        Lane eta, f0;
+
+        // Lobe weights and probabilities
+        Lane dielectricWeight, metalWeight, glassWeight, sheenWeight, clearcoatWeight;
+        Lane diffuseProbability, dielectricProbability, metalProbability, glassProbability, sheenProbability, clearcoatProbability;
+        Lane cspec0R, cspec0G, cspec0B, csheenR, csheenG, csheenB;
+
+        // Outputs
+        Lane fR, fG, fB, pdf;
+
+        void SetLane(int lane, const Material& material, const glm::vec3& V, const glm::vec3& N, const glm::vec3& L);
+        void SetDirection(int lane, const glm::vec3& L);
+        glm::vec3 GetF(int lane) const { return glm::vec3(fR[lane], fG[lane], fB[lane]); }
+    };
+
+public:
+    // Lobes a material can ever contribute to, based on its attributes and whether textures can alter them
+    static unsigned int GetMaterialLobes(const Material& material, bool hasMetallicTexture, bool hasTransmissionTexture);
+
+    // Lobes that global modifiers may enable on top of the material lobes
+    static unsigned int GetModifierLobes(const MaterialModifiers& modifiers);
+
+    // Apply modifiers to an evaluated material, same as EvaluateMaterial in utility.glsl
+    static void ApplyModifiers(Material& material, const MaterialModifiers& modifiers);
+
+    static BrdfData PrepareEvaluationBrdfData(const Material& material, const glm::vec3& V, const glm::vec3& N, const glm::vec3& L);
+
+    // Sample a direction L. Xi.xy are used for the direction and Xi.z for the lobe selection
+    static glm::vec3 SampleDisneyBrdf(const Material& material, const BrdfData& brdfData, const glm::vec3& Xi, unsigned int lobes = LobeAll);
+
+    // Evaluate a single direction, used by the non batched path and as the reference for the batch
+    static glm::vec3 EvaluateDisneyBrdf(const Material& material, const BrdfData& brdfData, float& pdf, unsigned int lobes = LobeAll);
+
+    // Evaluate all lanes of a batch, lobes not present in the mask are skipped for the whole batch
+    static void EvaluateDisneyBrdfBatch(ShadingBatch& batch, unsigned int lobes);
+
+public:
+    // Monte carlo helpers shared with the CPU integrator
+    static glm::vec3 HemispherepointCos(float u, float v);
+    static glm::vec3 ToWorld(const glm::vec3& N, const glm::vec3& V);
+    static glm::vec3 ToLocal(const glm::vec3& N, const glm::vec3& V);
+    static void GetTangentBitangent(const glm::vec3& N, glm::vec3& tangent, glm::vec3& bitangent);
+    static float Luminance(const glm::vec3& rgb);
+    static float MisMixWeight(float a, float b);
+};
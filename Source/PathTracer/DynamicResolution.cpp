@@ -0,0 +1,44 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float MinScale = 0.125f;
+    constexpr float ScaleStep = 1.0f / 32.0f;   // Scales are rounded to steps, so timing noise does not change the resolution every frame
+    constexpr float Damping = 0.5f;             // Part of the way to the ideal scale taken per frame
+}
+
+void DynamicResolution::Update(bool interactive, float frameMilliseconds)
+{
+    if (!interactive)
+    {
+        m_interactive = false;
+        m_scale = 1.0f;
+        return;
+    }
+
+    // The previous frame was not interactive, so its time says nothing about the interactive scale
+    if (!m_interactive)
+    {
+        m_interactive = true;
+        m_scale = m_interactiveScale;
+        return;
+    }
+
+    if (frameMilliseconds > 0.0f)
+    {
+        // The amount of pixels goes with the square of the scale
+        float idealScale = m_scale * std::sqrt(m_targetMilliseconds / frameMilliseconds);
+        float scale = m_scale + (idealScale - m_scale) * Damping;
+        m_scale = std::clamp(std::round(scale / ScaleStep) * ScaleStep, MinScale, 1.0f);
+    }
+
+    m_interactiveScale = m_scale;
+}
+
+glm::ivec2 DynamicResolution::GetRenderDimensions(const glm::ivec2& fullDimensions) const
+{
+    glm::ivec2 dimensions = glm::ivec2(glm::round(glm::vec2(fullDimensions) * m_scale));
+    return glm::clamp(dimensions, glm::ivec2(1), glm::max(fullDimensions, glm::ivec2(1)));
+}
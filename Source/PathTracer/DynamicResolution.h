@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Picks the render scale of interactive frames, so they stay close to a target frame time
+// The cost of a frame is taken to be proportional to its pixels, which for the CPU backend are its camera rays
+class DynamicResolution
+{
+public:
+    // Call once per frame, with the time the previous frame took to render at the current scale
+    // Frames which are not interactive always render at full resolution
+    void Update(bool interactive, float frameMilliseconds);
+
+    // Width and height rendered out of the full dimensions, at least a pixel each
+    glm::ivec2 GetRenderDimensions(const glm::ivec2& fullDimensions) const;
+
+    void SetTargetMilliseconds(float value) { m_targetMilliseconds = value; }
+    const float GetTargetMilliseconds() const { return m_targetMilliseconds; }
+
+    // Fraction of the full width and height rendered
+    const float GetScale() const { return m_scale; }
+
+private:
+    float m_targetMilliseconds = 33.3f;
+    float m_scale = 1.0f;
+    float m_interactiveScale = 0.5f;    // Scale of the last interactive frame, where the next interaction picks up
+    bool m_interactive = false;
+};
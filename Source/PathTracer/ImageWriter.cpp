@@ -0,0 +1,685 @@
+#include "ImageWriter.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_WRITER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Files store little endian numbers, same as the machines this runs on
+    template<typename T>
+    void Append(std::string& bytes, T value)
+    {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // -------------------------------------------------------------------------
+    //    OpenEXR
+    // -------------------------------------------------------------------------
+
+    struct ExrChannel
+    {
+        std::string name;           // Layer and channel, e.g. "albedo.R"
+        const ImageWriter::Layer* layer = nullptr;
+        int component = 0;
+        bool halfFloat = false;
+    };
+
+    void AppendExrAttribute(std::string& header, const char* name, const char* type, const std::string& value)
+    {
+        header += name;
+        header += '\0';
+        header += type;
+        header += '\0';
+        Append(header, (int32_t)value.size());
+        header += value;
+    }
+
+    std::string GetExrBox(int width, int height)
+    {
+        std::string box;
+        Append(box, (int32_t)0);
+        Append(box, (int32_t)0);
+        Append(box, (int32_t)(width - 1));
+        Append(box, (int32_t)(height - 1));
+        return box;
+    }
+
+    // Runs of 3 to 128 equal bytes as a count and the byte, anything else as a negative count and the bytes, see ImfRle.cpp
+    std::string CompressRle(const std::string& input)
+    {
+        constexpr ptrdiff_t MinRunLength = 3;
+        constexpr ptrdiff_t MaxRunLength = 127;
+
+        std::string output;
+        output.reserve(input.size() + input.size() / MaxRunLength + 1);
+
+        const char* end = input.data() + input.size();
+        const char* runStart = input.data();
+        const char* runEnd = runStart + 1;
+        while (runStart < end)
+        {
+            while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < MaxRunLength)
+            {
+                runEnd++;
+            }
+
+            if (runEnd - runStart >= MinRunLength)
+            {
+                output += (char)((runEnd - runStart) - 1);
+                output += *runStart;
+                runStart = runEnd;
+            }
+            else
+            {
+                while (runEnd < end && ((runEnd + 1 >= end || *runEnd != *(runEnd + 1)) || (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2)))
+                    && runEnd - runStart < MaxRunLength)
+                {
+                    runEnd++;
+                }
+
+                output += (char)(runStart - runEnd);
+                output.append(runStart, runEnd);
+                runStart = runEnd;
+            }
+
+            runEnd++;
+        }
+
+        return output;
+    }
+
+    // A scanline with the pixels of each channel in turn, compressed unless that does not make it smaller
+    std::string GetExrScanline(const std::vector<ExrChannel>& channels, int width, int row)
+    {
+        std::string raw;
+        for (const ExrChannel& channel : channels)
+        {
+            const glm::vec4* pixels = channel.layer->pixels.data() + (size_t)row * width;
+            for (int x = 0; x < width; x++)
+            {
+                float value = pixels[x][channel.component];
+                if (channel.halfFloat)
+                {
+                    Append(raw, (uint16_t)glm::packHalf1x16(value));
+                }
+                else
+                {
+                    Append(raw, value);
+                }
+            }
+        }
+
+        if (raw.empty())
+        {
+            return raw;
+        }
+
+        // Low and high bytes are split into halves, and every byte is stored as the difference to the one before, see ImfRleCompressor.cpp
+        std::string reordered(raw.size(), '\0');
+        const size_t half = (raw.size() + 1) / 2;
+        for (size_t i = 0; i < raw.size(); i++)
+        {
+            reordered[(i & 1) ? half + i / 2 : i / 2] = raw[i];
+        }
+        unsigned char previous = (unsigned char)reordered[0];
+        for (size_t i = 1; i < reordered.size(); i++)
+        {
+            unsigned char current = (unsigned char)reordered[i];
+            reordered[i] = (char)(int(current) - int(previous) + (128 + 256));
+            previous = current;
+        }
+
+        std::string compressed = CompressRle(reordered);
+        return compressed.size() < raw.size() ? compressed : raw;
+    }
+
+    // -------------------------------------------------------------------------
+    //    PNG
+    // -------------------------------------------------------------------------
+
+    std::array<uint32_t, 256> GenerateCrcTable()
+    {
+        std::array<uint32_t, 256> table{ };
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1u) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    const std::array<uint32_t, 256> CrcTable = GenerateCrcTable();
+
+    void AppendBigEndian(std::string& bytes, uint32_t value)
+    {
+        bytes += (char)(value >> 24);
+        bytes += (char)(value >> 16);
+        bytes += (char)(value >> 8);
+        bytes += (char)value;
+    }
+
+    void AppendPngChunk(std::string& file, const char* type, const std::string& data)
+    {
+        std::string chunk = type + data;
+        uint32_t crc = 0xffffffffu;
+        for (char byte : chunk)
+        {
+            crc = CrcTable[(crc ^ (unsigned char)byte) & 0xffu] ^ (crc >> 8);
+        }
+
+        AppendBigEndian(file, (uint32_t)data.size());
+        file += chunk;
+        AppendBigEndian(file, crc ^ 0xffffffffu);
+    }
+
+    // -------------------------------------------------------------------------
+    //    Tone mapping
+    // -------------------------------------------------------------------------
+
+    // Rows of the matrices of tonemapping.frag, which multiplies the color from the left
+    // sRGB => XYZ => D65_2_D60 => AP1 => RRT_SAT
+    constexpr float AcesInput[3][3] =
+    {
+        { 0.59719f, 0.35458f, 0.04823f },
+        { 0.07600f, 0.90834f, 0.01566f },
+        { 0.02840f, 0.13383f, 0.83777f },
+    };
+
+    // ODT_SAT => XYZ => D60_2_D65 => sRGB
+    constexpr float AcesOutput[3][3] =
+    {
+        { 1.60475f, -0.53108f, -0.07367f },
+        { -0.10208f, 1.10813f, -0.00605f },
+        { -0.00327f, -0.07276f, 1.07602f },
+    };
+
+    // The window's framebuffer encodes to sRGB, a table of it over linear values is finer than the 8 bits it ends up in
+    constexpr int SrgbTableSize = 1 << 14;
+
+    std::vector<unsigned char> GenerateSrgbTable()
+    {
+        std::vector<unsigned char> table(SrgbTableSize);
+        for (int i = 0; i < SrgbTableSize; i++)
+        {
+            float linear = (float)i / (float)(SrgbTableSize - 1);
+            float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+            table[i] = (unsigned char)std::lround(srgb * 255.0f);
+        }
+        return table;
+    }
+
+    const std::vector<unsigned char> SrgbTable = GenerateSrgbTable();
+
+    glm::vec3 AcesFitted(glm::vec3 color)
+    {
+        auto multiply = [](const float (&matrix)[3][3], const glm::vec3& v)
+        {
+            return glm::vec3(
+                matrix[0][0] * v.r + matrix[0][1] * v.g + matrix[0][2] * v.b,
+                matrix[1][0] * v.r + matrix[1][1] * v.g + matrix[1][2] * v.b,
+                matrix[2][0] * v.r + matrix[2][1] * v.g + matrix[2][2] * v.b);
+        };
+
+        color = multiply(AcesInput, color);
+
+        // Apply RRT and ODT
+        glm::vec3 a = color * (color + 0.0245786f) - 0.000090537f;
+        glm::vec3 b = color * (0.983729f * color + 0.4329510f) + 0.238081f;
+        color = a / b;
+
+        color = multiply(AcesOutput, color);
+        return glm::clamp(color, 0.0f, 1.0f);
+    }
+
+    unsigned char EncodeSrgb(float value)
+    {
+        // NaNs end up black, like the clamping of the SSE path
+        value = value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+        return SrgbTable[(size_t)std::lround(value * (float)(SrgbTableSize - 1))];
+    }
+
+#ifdef IMAGE_WRITER_SSE
+    // Same as AcesFitted for the channels of four pixels
+    void AcesFitted(__m128& r, __m128& g, __m128& b)
+    {
+        auto multiply = [](const float (&matrix)[3][3], __m128 r, __m128 g, __m128 b, __m128& outR, __m128& outG, __m128& outB)
+        {
+            __m128* outputs[3] = { &outR, &outG, &outB };
+            for (int row = 0; row < 3; row++)
+            {
+                *outputs[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix[row][0]), r), _mm_mul_ps(_mm_set1_ps(matrix[row][1]), g)),
+                    _mm_mul_ps(_mm_set1_ps(matrix[row][2]), b));
+            }
+        };
+
+        auto fit = [](__m128 v)
+        {
+            __m128 a = _mm_sub_ps(_mm_mul_ps(v, _mm_add_ps(v, _mm_set1_ps(0.0245786f))), _mm_set1_ps(0.000090537f));
+            __m128 b = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.983729f), v), _mm_set1_ps(0.4329510f))), _mm_set1_ps(0.238081f));
+            return _mm_div_ps(a, b);
+        };
+
+        __m128 inputR, inputG, inputB;
+        multiply(AcesInput, r, g, b, inputR, inputG, inputB);
+
+        // Apply RRT and ODT
+        multiply(AcesOutput, fit(inputR), fit(inputG), fit(inputB), r, g, b);
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        r = _mm_min_ps(_mm_max_ps(r, zero), one);
+        g = _mm_min_ps(_mm_max_ps(g, zero), one);
+        b = _mm_min_ps(_mm_max_ps(b, zero), one);
+    }
+#endif
+}
+
+// -------------------------------------------------------------------------
+//    Background writing
+// -------------------------------------------------------------------------
+
+ImageWriter::ImageWriter()
+    : m_thread(&ImageWriter::Run, this)
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void ImageWriter::WriteAsync(Images images, std::function<void(const std::vector<std::string>&)> written, std::function<void(Images&)> prepare)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back({ std::move(images), std::move(written), std::move(prepare) });
+        m_pendingCount++;
+    }
+    m_condition.notify_all();
+}
+
+void ImageWriter::WriteAsync(std::string path, Accumulation accumulation, std::function<void(bool)> written)
+{
+    // A task without images, which saves the accumulation while preparing
+    std::shared_ptr<bool> saved = std::make_shared<bool>(false);
+    WriteAsync(Images(), [saved, written = std::move(written)](const std::vector<std::string>&)
+    {
+        if (written)
+        {
+            written(*saved);
+        }
+    }, [saved, path = std::move(path), accumulation = std::move(accumulation)](Images&)
+    {
+        *saved = accumulation.Save(path);
+    });
+}
+
+void ImageWriter::Wait(size_t maxPendingCount)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_writtenCondition.wait(lock, [this, maxPendingCount]() { return m_pendingCount <= maxPendingCount; });
+}
+
+double ImageWriter::GetBusySeconds() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_busySeconds;
+}
+
+void ImageWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+        // Queued images are still written when stopping, a batch job counts on its outputs
+        if (m_tasks.empty())
+        {
+            return;
+        }
+
+        Task task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        if (task.prepare)
+        {
+            task.prepare(task.images);
+        }
+
+        std::vector<std::string> failedPaths;
+        for (const auto& [path, image] : task.images)
+        {
+            if (!Write(path, image))
+            {
+                failedPaths.push_back(path);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (task.written)
+        {
+            task.written(failedPaths);
+        }
+        lock.lock();
+
+        m_pendingCount--;
+        m_busySeconds += seconds;
+        m_writtenCondition.notify_all();
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Formats
+// -------------------------------------------------------------------------
+
+bool ImageWriter::HasExtension(const std::string& path, const char* extension)
+{
+    size_t length = std::strlen(extension);
+    if (path.size() < length)
+    {
+        return false;
+    }
+    return std::equal(path.end() - length, path.end(), extension, [](char a, char b) { return std::tolower((unsigned char)a) == b; });
+}
+
+bool ImageWriter::Write(const std::string& path, const Image& image)
+{
+    if (image.layers.empty())
+    {
+        return false;
+    }
+
+    if (HasExtension(path, ".exr"))
+    {
+        return WriteExr(path, image);
+    }
+    if (HasExtension(path, ".png"))
+    {
+        return WritePng(path, image);
+    }
+    return WritePfm(path, image.width, image.height, image.layers.front().pixels);
+}
+
+bool ImageWriter::WritePfm(const std::string& path, int width, int height, const std::vector<glm::vec4>& pixels)
+{
+    if (pixels.size() < (size_t)width * height)
+    {
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    // A negative scale marks little endian floats, rows are stored from the bottom up like the buffers
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+
+    std::vector<float> row((size_t)width * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const glm::vec4& pixel = pixels[(size_t)y * width + x];
+            row[(size_t)x * 3 + 0] = pixel.r;
+            row[(size_t)x * 3 + 1] = pixel.g;
+            row[(size_t)x * 3 + 2] = pixel.b;
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), (std::streamsize)(row.size() * sizeof(float)));
+    }
+
+    return (bool)file;
+}
+
+bool ImageWriter::WriteExr(const std::string& path, const Image& image)
+{
+    const int width = image.width;
+    const int height = image.height;
+
+    // Readers expect the channels sorted by name
+    std::vector<ExrChannel> channels;
+    for (const Layer& layer : image.layers)
+    {
+        if (layer.pixels.size() < (size_t)width * height || layer.channels.size() > 4)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < layer.channels.size(); i++)
+        {
+            channels.push_back({ layer.name.empty() ? layer.channels[i] : layer.name + "." + layer.channels[i], &layer, (int)i, layer.halfFloat });
+        }
+    }
+    std::sort(channels.begin(), channels.end(), [](const ExrChannel& a, const ExrChannel& b) { return a.name < b.name; });
+
+    std::string channelList;
+    for (const ExrChannel& channel : channels)
+    {
+        channelList += channel.name;
+        channelList += '\0';
+        Append(channelList, (int32_t)(channel.halfFloat ? 1 : 2));     // HALF or FLOAT
+        Append(channelList, (int32_t)0);                                // Not perceptually linear, and reserved bytes
+        Append(channelList, (int32_t)1);                                // No subsampling
+        Append(channelList, (int32_t)1);
+    }
+    channelList += '\0';
+
+    // Magic number, and version 2 of single part scanline files
+    std::string header;
+    Append(header, (int32_t)20000630);
+    Append(header, (int32_t)2);
+
+    std::string aspectRatio, screenWindowCenter, screenWindowWidth;
+    Append(aspectRatio, 1.0f);
+    Append(screenWindowCenter, 0.0f);
+    Append(screenWindowCenter, 0.0f);
+    Append(screenWindowWidth, 1.0f);
+
+    AppendExrAttribute(header, "channels", "chlist", channelList);
+    AppendExrAttribute(header, "compression", "compression", std::string(1, '\1'));     // RLE, a scanline per block
+    AppendExrAttribute(header, "dataWindow", "box2i", GetExrBox(width, height));
+    AppendExrAttribute(header, "displayWindow", "box2i", GetExrBox(width, height));
+    AppendExrAttribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));        // Increasing y, from the top
+    AppendExrAttribute(header, "pixelAspectRatio", "float", aspectRatio);
+    AppendExrAttribute(header, "screenWindowCenter", "v2f", screenWindowCenter);
+    AppendExrAttribute(header, "screenWindowWidth", "float", screenWindowWidth);
+    header += '\0';
+
+    // Blocks are compressed on all cores, they only have to be written in order
+    std::vector<std::string> blocks(height);
+    std::atomic<int> nextBlock = 0;
+    auto compress = [&]()
+    {
+        for (int y = nextBlock++; y < height; y = nextBlock++)
+        {
+            // Files start at the top row, the buffers at the bottom one
+            blocks[y] = GetExrScanline(channels, width, height - 1 - y);
+        }
+    };
+
+    std::vector<std::thread> threads(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    for (std::thread& thread : threads)
+    {
+        thread = std::thread(compress);
+    }
+    compress();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // The offset table points at every block, each of them a line number, a size and the data
+    std::string offsets;
+    uint64_t offset = header.size() + (size_t)height * sizeof(uint64_t);
+    for (const std::string& block : blocks)
+    {
+        Append(offsets, offset);
+        offset += 2 * sizeof(int32_t) + block.size();
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file.write(header.data(), (std::streamsize)header.size());
+    file.write(offsets.data(), (std::streamsize)offsets.size());
+    for (int y = 0; y < height; y++)
+    {
+        std::string blockHeader;
+        Append(blockHeader, (int32_t)y);
+        Append(blockHeader, (int32_t)blocks[y].size());
+        file.write(blockHeader.data(), (std::streamsize)blockHeader.size());
+        file.write(blocks[y].data(), (std::streamsize)blocks[y].size());
+    }
+
+    return (bool)file;
+}
+
+bool ImageWriter::WritePng(const std::string& path, const Image& image)
+{
+    const int width = image.width;
+    const int height = image.height;
+    if (image.layers.empty() || image.layers.front().pixels.size() < (size_t)width * height)
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> rgb;
+    ToneMap(image.layers.front().pixels, image.exposure, rgb);
+
+    // Rows from the top, each after the byte of its filter, none
+    std::string rows;
+    rows.reserve((size_t)height * (width * 3 + 1));
+    for (int y = height - 1; y >= 0; y--)
+    {
+        rows += '\0';
+        rows.append(reinterpret_cast<const char*>(rgb.data()) + (size_t)y * width * 3, (size_t)width * 3);
+    }
+
+    // A zlib stream of stored deflate blocks, and its Adler-32 checksum
+    std::string data = "\x78\x01";
+    for (size_t start = 0; start < rows.size() || start == 0; start += 65535)
+    {
+        size_t size = std::min<size_t>(rows.size() - start, 65535);
+        data += (char)(start + size >= rows.size() ? 1 : 0);
+        Append(data, (uint16_t)size);
+        Append(data, (uint16_t)~size);
+        data.append(rows, start, size);
+    }
+    uint32_t adlerA = 1, adlerB = 0;
+    for (char byte : rows)
+    {
+        adlerA = (adlerA + (unsigned char)byte) % 65521u;
+        adlerB = (adlerB + adlerA) % 65521u;
+    }
+    AppendBigEndian(data, (adlerB << 16) | adlerA);
+
+    std::string header;
+    AppendBigEndian(header, (uint32_t)width);
+    AppendBigEndian(header, (uint32_t)height);
+    header += "\x08\x02";                   // 8 bit RGB
+    header += std::string(3, '\0');         // Deflate, adaptive filtering, not interlaced
+
+    std::string file = "\x89PNG\r\n\x1a\n";
+    AppendPngChunk(file, "IHDR", header);
+    AppendPngChunk(file, "sRGB", std::string(1, '\0'));
+    AppendPngChunk(file, "IDAT", data);
+    AppendPngChunk(file, "IEND", std::string());
+
+    std::ofstream stream(path, std::ios::binary);
+    stream.write(file.data(), (std::streamsize)file.size());
+    return (bool)stream;
+}
+
+void ImageWriter::ToneMap(const std::vector<glm::vec4>& pixels, float exposure, std::vector<unsigned char>& rgb)
+{
+    rgb.resize(pixels.size() * 3);
+
+    size_t first = 0;
+#ifdef IMAGE_WRITER_SSE
+    const __m128 exposureScale = _mm_set1_ps(exposure);
+    const __m128 tableScale = _mm_set1_ps((float)(SrgbTableSize - 1));
+    for (; first + 4 <= pixels.size(); first += 4)
+    {
+        // Four pixels as a register per channel
+        __m128 r = _mm_loadu_ps(&pixels[first + 0].r);
+        __m128 g = _mm_loadu_ps(&pixels[first + 1].r);
+        __m128 b = _mm_loadu_ps(&pixels[first + 2].r);
+        __m128 a = _mm_loadu_ps(&pixels[first + 3].r);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        r = _mm_mul_ps(r, exposureScale);
+        g = _mm_mul_ps(g, exposureScale);
+        b = _mm_mul_ps(b, exposureScale);
+        AcesFitted(r, g, b);
+
+        alignas(16) int32_t indices[3][4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices[0]), _mm_cvtps_epi32(_mm_mul_ps(r, tableScale)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices[1]), _mm_cvtps_epi32(_mm_mul_ps(g, tableScale)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices[2]), _mm_cvtps_epi32(_mm_mul_ps(b, tableScale)));
+        for (int i = 0; i < 4; i++)
+        {
+            for (int channel = 0; channel < 3; channel++)
+            {
+                rgb[(first + i) * 3 + channel] = SrgbTable[indices[channel][i]];
+            }
+        }
+    }
+#endif
+
+    for (size_t pixel = first; pixel < pixels.size(); pixel++)
+    {
+        glm::vec3 color = AcesFitted(glm::vec3(pixels[pixel]) * exposure);
+        rgb[pixel * 3 + 0] = EncodeSrgb(color.r);
+        rgb[pixel * 3 + 1] = EncodeSrgb(color.g);
+        rgb[pixel * 3 + 2] = EncodeSrgb(color.b);
+    }
+}
+
+ImageWriter::Image ImageWriter::GetRenderImage(int width, int height, std::vector<glm::vec4> radiance, std::vector<glm::vec4> albedo, std::vector<glm::vec4> normal,
+    const std::vector<glm::vec4>& statistics)
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+
+    std::vector<glm::vec4> variance(statistics.size());
+    std::vector<glm::vec4> samples(statistics.size());
+    for (size_t pixel = 0; pixel < statistics.size(); pixel++)
+    {
+        variance[pixel] = glm::vec4(statistics[pixel].x, 0.0f, 0.0f, 0.0f);
+        samples[pixel] = glm::vec4(statistics[pixel].z, 0.0f, 0.0f, 0.0f);
+    }
+
+    image.layers.push_back({ "", { "R", "G", "B" }, std::move(radiance), false });
+    image.layers.push_back({ "albedo", { "R", "G", "B" }, std::move(albedo), true });
+    image.layers.push_back({ "normal", { "X", "Y", "Z" }, std::move(normal), true });
+    image.layers.push_back({ "variance", { "Y" }, std::move(variance), false });
+    image.layers.push_back({ "samples", { "Y" }, std::move(samples), false });
+    return image;
+}
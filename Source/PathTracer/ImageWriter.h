@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Accumulation.h"
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Writes the accumulation buffers of the CPU backend to image files
+// Pixels are in rows as wide as the image, starting at the bottom row
+//
+// An instance writes queued images on a thread of its own, so rendering goes on while they are compressed and written
+class ImageWriter
+{
+public:
+    // Channels of a layer are the leading components of its pixels
+    struct Layer
+    {
+        std::string name;                                       // Empty for the main channels
+        std::vector<std::string> channels = { "R", "G", "B" };
+        std::vector<glm::vec4> pixels;
+        bool halfFloat = false;                                 // 16 bit floats in OpenEXR files, plenty for albedo and normals
+    };
+
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<Layer> layers;      // Formats with a single layer take the first one
+        float exposure = 1.0f;          // Of tonemapped formats
+    };
+
+    ImageWriter();
+    ~ImageWriter();     // Writes the images still queued
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    using Images = std::vector<std::pair<std::string, Image>>;
+
+    // Queues images by their paths. The callback is called on the writer's thread once all of them are written, with the paths that could not be
+    // Preparing runs on the writer's thread before writing, for work such as denoising that should not hold up rendering either
+    void WriteAsync(Images images, std::function<void(const std::vector<std::string>&)> written = nullptr, std::function<void(Images&)> prepare = nullptr);
+
+    // Queues an accumulation such as a checkpoint in line with the images. The callback is called on the writer's thread with whether it was saved
+    void WriteAsync(std::string path, Accumulation accumulation, std::function<void(bool)> written = nullptr);
+
+    // Blocks until at most this many of the queued writes are left, counting the one being written
+    void Wait(size_t maxPendingCount = 0);
+
+    // Seconds the writer spent preparing and writing images so far
+    double GetBusySeconds() const;
+
+    // Case insensitive, the extension is given in lower case with its dot
+    static bool HasExtension(const std::string& path, const char* extension);
+
+    // Format picked by the extension of the path, .exr, .png and anything else as .pfm. False if the file cannot be written
+    static bool Write(const std::string& path, const Image& image);
+
+    // Portable float map, the RGB channels at full precision. False if the file cannot be written
+    static bool WritePfm(const std::string& path, int width, int height, const std::vector<glm::vec4>& pixels);
+
+    // OpenEXR scanlines with all layers, compressed with RLE on all cores
+    static bool WriteExr(const std::string& path, const Image& image);
+
+    // 8 bit sRGB of the first layer, tonemapped like the window. Rows are stored uncompressed
+    static bool WritePng(const std::string& path, const Image& image);
+
+    // ACESFitted of tonemapping.frag, to 8 bit sRGB. Four pixels at a time with SSE where available
+    static void ToneMap(const std::vector<glm::vec4>& pixels, float exposure, std::vector<unsigned char>& rgb);
+
+    // Radiance with the layers of its render: albedo, normal, the luminance variance of the samples and the sample count
+    // Statistics per pixel are the luminance variance, the variance of the mean and the sample count, see Accumulation::GetVarianceData
+    static Image GetRenderImage(int width, int height, std::vector<glm::vec4> radiance, std::vector<glm::vec4> albedo, std::vector<glm::vec4> normal,
+        const std::vector<glm::vec4>& statistics);
+
+private:
+    struct Task
+    {
+        Images images;
+        std::function<void(const std::vector<std::string>&)> written;
+        std::function<void(Images&)> prepare;
+    };
+
+    void Run();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_writtenCondition;     // Signaled once a task is written
+    std::deque<Task> m_tasks;
+    size_t m_pendingCount = 0;                      // Queued tasks and the one being written
+    double m_busySeconds = 0.0;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,288 @@
+#include "LightTree.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+    constexpr float PI = 3.141592653589f;
+
+    constexpr int BucketCount = 12;
+
+    float SafeSqrt(float x)
+    {
+        return std::sqrt(std::max(x, 0.0f));
+    }
+
+    float SafeAcos(float x)
+    {
+        return std::acos(std::clamp(x, -1.0f, 1.0f));
+    }
+
+    glm::vec3 GetCentroid(const LightTree::LightBounds& bounds)
+    {
+        return (bounds.AA + bounds.BB) * 0.5f;
+    }
+
+    // Cost of a node, based on the surface area orientation heuristic
+    // Kr regularizes the split axis, so that thin boxes are not split along their short side
+    float GetCost(const LightTree::LightBounds& bounds, float Kr)
+    {
+        float thetaO = SafeAcos(bounds.cosThetaO);
+        float thetaE = SafeAcos(bounds.cosThetaE);
+        float thetaW = std::min(thetaO + thetaE, PI);
+        float sinThetaO = SafeSqrt(1.0f - bounds.cosThetaO * bounds.cosThetaO);
+
+        // Solid angle measure of the orientation cone
+        float orientationMeasure = 2.0f * PI * (1.0f - bounds.cosThetaO) + PI / 2.0f * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + bounds.cosThetaO);
+
+        glm::vec3 diagonal = bounds.BB - bounds.AA;
+        float surfaceArea = 2.0f * (diagonal.x * diagonal.y + diagonal.y * diagonal.z + diagonal.z * diagonal.x);
+
+        return bounds.power * orientationMeasure * Kr * surfaceArea;
+    }
+
+    // Cosine of max(0, theta a - theta b)
+    float CosSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+    {
+        if (cosThetaA > cosThetaB) return 1.0f;
+        return cosThetaA * cosThetaB + sinThetaA * sinThetaB;
+    }
+
+    // Sine of max(0, theta a - theta b)
+    float SinSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+    {
+        if (cosThetaA > cosThetaB) return 0.0f;
+        return sinThetaA * cosThetaB - cosThetaA * sinThetaB;
+    }
+}
+
+void LightTree::BuildLightTree(const std::vector<LightBounds>& lights, std::vector<LightTreeNode>& nodes)
+{
+    nodes.clear();
+
+    // Leaves
+    for (unsigned int i = 0; i < lights.size(); i++)
+    {
+        LightTreeNode leaf{ };
+        leaf.bounds = lights[i];
+        leaf.left = leaf.right = leaf.parent = -1;
+        leaf.emissiveIndex = i;
+        nodes.push_back(leaf);
+    }
+
+    if (lights.empty()) return;
+
+    // Inner nodes
+    std::vector<unsigned int> indices(lights.size());
+    std::iota(indices.begin(), indices.end(), 0u);
+
+    Build(lights, indices, 0, (int)lights.size() - 1, nodes);
+}
+
+int LightTree::Build(const std::vector<LightBounds>& lights, std::vector<unsigned int>& indices, int l, int r, std::vector<LightTreeNode>& nodes)
+{
+    // A single light is its own leaf
+    if (l == r) return int(indices[l]);
+
+    // Calculate bounds of the lights and of their centroids
+    LightBounds bounds = lights[indices[l]];
+    glm::vec3 centroidMin = GetCentroid(bounds);
+    glm::vec3 centroidMax = centroidMin;
+
+    for (int i = l + 1; i <= r; i++)
+    {
+        bounds = Union(bounds, lights[indices[i]]);
+        centroidMin = glm::min(centroidMin, GetCentroid(lights[indices[i]]));
+        centroidMax = glm::max(centroidMax, GetCentroid(lights[indices[i]]));
+    }
+
+    glm::vec3 diagonal = bounds.BB - bounds.AA;
+    float maxExtent = std::max(diagonal.x, std::max(diagonal.y, diagonal.z));
+
+    auto getBucket = [&](const LightBounds& light, int axis)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        int bucket = int((GetCentroid(light)[axis] - centroidMin[axis]) / extent * BucketCount);
+        return std::clamp(bucket, 0, BucketCount - 1);
+    };
+
+    // Find the bucket split with the lowest cost
+    float bestCost = 3.402823466e+38f;
+    int bestAxis = -1;
+    int bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (centroidMax[axis] <= centroidMin[axis]) continue;
+
+        std::array<LightBounds, BucketCount> buckets;
+        std::array<bool, BucketCount> bucketUsed{ };
+
+        for (int i = l; i <= r; i++)
+        {
+            const LightBounds& light = lights[indices[i]];
+            int bucket = getBucket(light, axis);
+
+            buckets[bucket] = bucketUsed[bucket] ? Union(buckets[bucket], light) : light;
+            bucketUsed[bucket] = true;
+        }
+
+        float Kr = maxExtent / diagonal[axis];
+
+        for (int split = 1; split < BucketCount; split++)
+        {
+            LightBounds left{ }, right{ };
+            bool leftUsed = false, rightUsed = false;
+
+            for (int i = 0; i < split; i++)
+            {
+                if (!bucketUsed[i]) continue;
+                left = leftUsed ? Union(left, buckets[i]) : buckets[i];
+                leftUsed = true;
+            }
+            for (int i = split; i < BucketCount; i++)
+            {
+                if (!bucketUsed[i]) continue;
+                right = rightUsed ? Union(right, buckets[i]) : buckets[i];
+                rightUsed = true;
+            }
+
+            if (!leftUsed || !rightUsed) continue;
+
+            float cost = GetCost(left, Kr) + GetCost(right, Kr);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // Split the range, in the middle if all centroids coincide
+    int mid = (l + r) / 2;
+    if (bestAxis >= 0)
+    {
+        auto it = std::partition(indices.begin() + l, indices.begin() + r + 1, [&](unsigned int index) { return getBucket(lights[index], bestAxis) < bestSplit; });
+        mid = int(it - indices.begin()) - 1;
+    }
+
+    int left = Build(lights, indices, l, mid, nodes);
+    int right = Build(lights, indices, mid + 1, r, nodes);
+
+    // Children are built first, so the root ends up as the last node
+    LightTreeNode node{ };
+    node.bounds = bounds;
+    node.left = left;
+    node.right = right;
+    node.parent = -1;
+    node.emissiveIndex = 0xffffffff;
+    nodes.push_back(node);
+
+    int id = int(nodes.size() - 1);
+    nodes[left].parent = id;
+    nodes[right].parent = id;
+
+    return id;
+}
+
+LightTree::LightBounds LightTree::GetTriangleBounds(const glm::vec3& posA, const glm::vec3& posB, const glm::vec3& posC, float power)
+{
+    LightBounds bounds{ };
+    bounds.AA = glm::min(posA, glm::min(posB, posC));
+    bounds.BB = glm::max(posA, glm::max(posB, posC));
+
+    // Triangles are one-sided and emit into the hemisphere around their normal
+    bounds.axis = glm::normalize(glm::cross(posB - posA, posC - posA));
+    bounds.cosThetaO = 1.0f;
+    bounds.cosThetaE = 0.0f;
+
+    bounds.power = power;
+
+    return bounds;
+}
+
+LightTree::LightBounds LightTree::Union(const LightBounds& a, const LightBounds& b)
+{
+    LightBounds result{ };
+    result.AA = glm::min(a.AA, b.AA);
+    result.BB = glm::max(a.BB, b.BB);
+    result.power = a.power + b.power;
+    result.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+
+    // Smallest cone containing both orientation cones
+    float thetaA = SafeAcos(a.cosThetaO);
+    float thetaB = SafeAcos(b.cosThetaO);
+    float thetaD = SafeAcos(glm::dot(a.axis, b.axis));
+
+    if (std::min(thetaD + thetaB, PI) <= thetaA)
+    {
+        result.axis = a.axis;
+        result.cosThetaO = a.cosThetaO;
+        return result;
+    }
+    if (std::min(thetaD + thetaA, PI) <= thetaB)
+    {
+        result.axis = b.axis;
+        result.cosThetaO = b.cosThetaO;
+        return result;
+    }
+
+    float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+    glm::vec3 rotationAxis = glm::cross(a.axis, b.axis);
+
+    if (thetaO >= PI || glm::dot(rotationAxis, rotationAxis) == 0.0f)
+    {
+        result.axis = a.axis;
+        result.cosThetaO = -1.0f;
+        return result;
+    }
+
+    // Rotate axis a towards axis b
+    float thetaR = thetaO - thetaA;
+    glm::vec3 k = glm::normalize(rotationAxis);
+    result.axis = glm::normalize(a.axis * std::cos(thetaR) + glm::cross(k, a.axis) * std::sin(thetaR) + k * glm::dot(k, a.axis) * (1.0f - std::cos(thetaR)));
+    result.cosThetaO = std::cos(thetaO);
+
+    return result;
+}
+
+float LightTree::Importance(const LightBounds& bounds, const glm::vec3& P, const glm::vec3& N)
+{
+    glm::vec3 center = GetCentroid(bounds);
+    glm::vec3 diagonal = bounds.BB - bounds.AA;
+    float radiusSquared = 0.25f * glm::dot(diagonal, diagonal);
+
+    glm::vec3 toPoint = P - center;
+    float distanceSquared = glm::dot(toPoint, toPoint);
+
+    // Clamp the distance, so points inside the bounds do not get an unbounded importance
+    float clampedDistanceSquared = std::max(distanceSquared, radiusSquared);
+
+    glm::vec3 wi = distanceSquared > 0.0f ? toPoint / std::sqrt(distanceSquared) : glm::vec3(0.0f);
+
+    // Angle between the cone axis and the shading point
+    float cosThetaW = glm::dot(bounds.axis, wi);
+    float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+
+    // Angle bounding the box as seen from the shading point
+    float cosThetaB = distanceSquared > radiusSquared ? SafeSqrt(1.0f - radiusSquared / distanceSquared) : -1.0f;
+    float sinThetaB = SafeSqrt(1.0f - cosThetaB * cosThetaB);
+
+    // Minimum angle between the emission and the shading point, max(0, theta w - theta o - theta b)
+    float sinThetaO = SafeSqrt(1.0f - bounds.cosThetaO * bounds.cosThetaO);
+    float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, bounds.cosThetaO);
+    float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, bounds.cosThetaO);
+    float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= bounds.cosThetaE) return 0.0f;
+
+    // Minimum incident angle at the shading point, max(0, theta i - theta b)
+    float cosThetaI = -glm::dot(wi, N);
+    float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+    float cosThetaPI = CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    if (cosThetaPI <= 0.0f) return 0.0f;
+
+    return bounds.power * cosThetaP * cosThetaPI / clampedDistanceSquared;
+}
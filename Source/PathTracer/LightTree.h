@@ -0,0 +1,64 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <vector>
+
+// Bounding volume hierarchy over emissive triangles, which bounds their position, orientation and power
+// See "Importance Sampling of Many Lights with Adaptive Tree Splitting" (Conty Estevez and Kulla 2018)
+class LightTree
+{
+public:
+	struct LightBounds
+	{
+		// Bounding box
+		glm::vec3 AA;
+		glm::vec3 BB;
+
+		// Orientation cone, light is emitted within theta o + theta e around the axis
+		glm::vec3 axis;
+		float cosThetaO;	// Spread of the surface normals
+		float cosThetaE;	// Spread of the emission around a normal
+
+		float power;
+	};
+
+	struct LightTreeNode
+	{
+		LightBounds bounds;
+
+		// Left and right subtree index, -1 for leaves
+		int left;
+		int right;
+
+		// Parent index, -1 for the root
+		int parent;
+
+		// Emissive triangle of a leaf
+		unsigned int emissiveIndex;
+	};
+
+	struct alignas(16) LightTreeNodeAlign
+	{
+		alignas(16) glm::vec4 AApower;
+		alignas(16) glm::vec4 BBcosThetaO;
+		alignas(16) glm::vec4 axisCosThetaE;
+		int left;
+		int right;
+		int parent;
+		unsigned int emissiveIndex;
+	};
+
+	// Construct light tree
+	// Leaves are stored first, so the leaf of light i is node i, and the root is the last node
+	static void BuildLightTree(const std::vector<LightBounds>& lights, std::vector<LightTreeNode>& nodes);
+
+	// Bounds of a single emissive triangle
+	static LightBounds GetTriangleBounds(const glm::vec3& posA, const glm::vec3& posB, const glm::vec3& posC, float power);
+
+	// Conservative estimate of the light a shading point at P with normal N receives from the bounds
+	static float Importance(const LightBounds& bounds, const glm::vec3& P, const glm::vec3& N);
+
+private:
+	static int Build(const std::vector<LightBounds>& lights, std::vector<unsigned int>& indices, int l, int r, std::vector<LightTreeNode>& nodes);
+
+	static LightBounds Union(const LightBounds& a, const LightBounds& b);
+};
@@ -1,7 +1,197 @@
+#include "Accumulation.h"
+#include "ImageWriter.h"
 #include "PathTracingApplication.h"
+#include "RenderCoordinator.h"
+#include "SharedFilm.h"
 
-int main()
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
 {
-    PathTracingApplication pathTracingApplication;
+    // Adds up the checkpoints of independent renders, and writes the image of their samples for an .exr, .png or .pfm output or the merged checkpoint otherwise
+    int MergeAccumulations(const std::vector<std::string>& inputs, const std::string& output)
+    {
+        Accumulation merged;
+        for (const std::string& input : inputs)
+        {
+            std::string error;
+            Accumulation accumulation;
+            if (!Accumulation::Load(input, accumulation, error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+
+            if (merged.IsEmpty())
+            {
+                merged = std::move(accumulation);
+            }
+            else if (!merged.Merge(accumulation))
+            {
+                std::cerr << "\"" << input << "\" has other dimensions than \"" << inputs.front() << "\"" << std::endl;
+                return 1;
+            }
+        }
+
+        bool image = ImageWriter::HasExtension(output, ".exr") || ImageWriter::HasExtension(output, ".png") || ImageWriter::HasExtension(output, ".pfm");
+        bool written = image ? ImageWriter::Write(output, ImageWriter::GetRenderImage(merged.GetWidth(), merged.GetHeight(),
+            merged.GetRadianceData(), merged.GetAlbedoData(), merged.GetNormalData(), merged.GetVarianceData())) : merged.Save(output);
+        if (!written)
+        {
+            std::cerr << "Cannot write \"" << output << "\"" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    constexpr int WatchPollMilliseconds = 10;
+
+    // Prints a line per frame the renderer publishes to the shared memory, and writes each frame to the output if there is one
+    // Frames are read in place, only writing them copies their layers
+    int WatchSharedFilm(const std::string& name, const std::string& output)
+    {
+        SharedFilm sharedFilm;
+        std::string error;
+        if (!sharedFilm.Open(name, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        uint64_t lastFrameNumber = 0;
+        while (!sharedFilm.IsClosed())
+        {
+            if (sharedFilm.GetLatestFrameNumber() == lastFrameNumber)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(WatchPollMilliseconds));
+                continue;
+            }
+
+            SharedFilm::Frame frame;
+            std::vector<glm::vec4> layers[SharedFilm::LayerCount];
+            bool intact = sharedFilm.ReadLatest([&](const SharedFilm::Frame& latest)
+            {
+                frame = latest;
+                for (uint32_t i = 0; i < SharedFilm::LayerCount && !output.empty(); i++)
+                {
+                    layers[i].assign(latest.layers[i], latest.layers[i] + (size_t)latest.width * latest.height);
+                }
+            });
+
+            // A frame overwritten while it was read is dropped, the next one is read instead
+            if (!intact)
+            {
+                continue;
+            }
+            lastFrameNumber = frame.frameNumber;
+
+            std::cout << "frame " << frame.frameNumber << ": " << frame.width << "x" << frame.height << ", " << frame.sampleCount << " samples, " << frame.renderTime << " s" << std::endl;
+            if (!output.empty() && !ImageWriter::Write(output, ImageWriter::GetRenderImage(frame.width, frame.height,
+                std::move(layers[0]), std::move(layers[1]), std::move(layers[2]), Accumulation::GetVarianceData(layers[3]))))
+            {
+                std::cerr << "Cannot write \"" << output << "\"" << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // "--job <file>" renders the jobs of the file without showing a window, see BatchJob for the format
+    // "--serve <address>" keeps rendering jobs other processes send to the address, see RenderServer. Other machines can only connect to "host:port"
+    // "--worker <address>" renders the jobs on the render server at the address instead, split into tiles, see RenderCoordinator
+    // "--merge <checkpoint>... --output <file>" merges the checkpoints of independent renders of a job, see Accumulation
+    // "--shared-film <name>" publishes every frame to shared memory, "--watch <name> [--output <file>]" dumps the frames published there
+    std::vector<BatchJob> batchJobs;
+    std::unique_ptr<RenderServer> renderServer;
+    std::vector<std::string> workers;
+    std::vector<std::string> mergeInputs;
+    std::string output;
+    std::string sharedFilmName;
+    std::string watchName;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string error;
+        if (std::strcmp(argv[i], "--job") == 0 && i + 1 < argc)
+        {
+            if (!BatchJob::Load(argv[++i], batchJobs, error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc && !renderServer)
+        {
+            renderServer = std::make_unique<RenderServer>();
+            if (!renderServer->Start(argv[++i], error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--worker") == 0 && i + 1 < argc)
+        {
+            workers.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--merge") == 0 && i + 1 < argc)
+        {
+            mergeInputs.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--shared-film") == 0 && i + 1 < argc)
+        {
+            sharedFilmName = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--watch") == 0 && i + 1 < argc)
+        {
+            watchName = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: PathTracer [--job <file>]... [--serve <address> | --worker <address>...] [--shared-film <name>]" << std::endl;
+            std::cerr << "       PathTracer --merge <checkpoint>... --output <file>" << std::endl;
+            std::cerr << "       PathTracer --watch <name> [--output <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    // A server renders what it is sent itself, it would not pass the jobs on to the workers
+    if (!workers.empty() && renderServer)
+    {
+        std::cerr << "--serve and --worker cannot be combined" << std::endl;
+        return 1;
+    }
+
+    if (!watchName.empty())
+    {
+        return WatchSharedFilm(watchName, output);
+    }
+
+    if (!mergeInputs.empty() || !output.empty())
+    {
+        if (mergeInputs.empty() || output.empty())
+        {
+            std::cerr << "Merging needs --merge <checkpoint>... and --output <file>" << std::endl;
+            return 1;
+        }
+        return MergeAccumulations(mergeInputs, output);
+    }
+
+    // The coordinator only sends jobs and merges tiles, it needs no window
+    if (!workers.empty())
+    {
+        RenderCoordinator renderCoordinator(std::move(workers));
+        return renderCoordinator.Render(batchJobs) ? 0 : 1;
+    }
+
+    PathTracingApplication pathTracingApplication(std::move(batchJobs), std::move(renderServer), sharedFilmName);
     return pathTracingApplication.Run();
 }
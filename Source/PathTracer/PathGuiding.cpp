@@ -0,0 +1,296 @@
+#include "PathGuiding.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace
+{
+    constexpr float TWO_PI = 6.283185307178f;
+    constexpr float ONE_OVER_FOUR_PI = 0.079577471545f;
+
+    constexpr float OneMinusEpsilon = 0.99999994f;
+
+    // Subdivision thresholds of the paper
+    constexpr float SpatialThreshold = 12000.0f;        // Samples per spatial leaf, scaled by the square root of the iteration's frame count
+    constexpr float DirectionalThreshold = 0.01f;       // Fraction of the energy per directional quadrant
+    constexpr int MaxDirectionalDepth = 20;
+    constexpr int MaxSpatialDepth = 48;
+
+    // Area preserving mapping between directions and the unit square, so densities only differ by a constant factor
+    glm::vec2 DirectionToCanonical(const glm::vec3& direction)
+    {
+        float cosTheta = std::clamp(direction.z, -1.0f, 1.0f);
+        float phi = std::atan2(direction.y, direction.x);
+        if (phi < 0.0f) phi += TWO_PI;
+
+        return glm::clamp(glm::vec2((cosTheta + 1.0f) * 0.5f, phi / TWO_PI), 0.0f, OneMinusEpsilon);
+    }
+
+    glm::vec3 CanonicalToDirection(const glm::vec2& p)
+    {
+        float cosTheta = 2.0f * p.x - 1.0f;
+        float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+        float phi = TWO_PI * p.y;
+
+        return glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+    // Quadrant of p within a node, p is moved into the quadrant's own unit square
+    int GetQuadrant(glm::vec2& p)
+    {
+        int x = p.x >= 0.5f ? 1 : 0;
+        int y = p.y >= 0.5f ? 1 : 0;
+        p = glm::min(p * 2.0f - glm::vec2((float)x, (float)y), OneMinusEpsilon);
+        return x + 2 * y;
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Directional tree
+// -------------------------------------------------------------------------
+
+void PathGuiding::DirectionalTree::Record(const glm::vec3& direction, float value)
+{
+    glm::vec2 p = DirectionToCanonical(direction);
+
+    // Every node on the way down holds the energy of its quadrants
+    int node = 0;
+    while (true)
+    {
+        int quadrant = GetQuadrant(p);
+        std::atomic_ref<float>(m_nodes[node].sums[quadrant]).fetch_add(value, std::memory_order_relaxed);
+
+        node = m_nodes[node].children[quadrant];
+        if (node == 0) break;
+    }
+}
+
+float PathGuiding::DirectionalTree::Pdf(const glm::vec3& direction) const
+{
+    if (!IsValid()) return 0.0f;
+
+    glm::vec2 p = DirectionToCanonical(direction);
+
+    float pdf = 1.0f;
+    int node = 0;
+    while (true)
+    {
+        const Node& current = m_nodes[node];
+        float total = current.sums[0] + current.sums[1] + current.sums[2] + current.sums[3];
+        if (total <= 0.0f) return 0.0f;
+
+        // A quadrant covers a quarter of its parent's area
+        int quadrant = GetQuadrant(p);
+        pdf *= 4.0f * current.sums[quadrant] / total;
+
+        node = current.children[quadrant];
+        if (node == 0) break;
+    }
+
+    // The cylindrical mapping spreads the unit square over 4 pi steradians
+    return pdf * ONE_OVER_FOUR_PI;
+}
+
+glm::vec3 PathGuiding::DirectionalTree::Sample(glm::vec2 Xi) const
+{
+    glm::vec2 origin = glm::vec2(0.0f);
+    float size = 1.0f;
+
+    int node = 0;
+    while (true)
+    {
+        const std::array<float, 4>& sums = m_nodes[node].sums;
+
+        // Pick the column, then the quadrant within the column, reusing the random numbers
+        float probabilityLeft = (sums[0] + sums[2]) / (sums[0] + sums[1] + sums[2] + sums[3]);
+        int x = Xi.x < probabilityLeft ? 0 : 1;
+        Xi.x = x == 0 ? Xi.x / probabilityLeft : (Xi.x - probabilityLeft) / (1.0f - probabilityLeft);
+
+        float probabilityBottom = sums[x] / (sums[x] + sums[2 + x]);
+        int y = Xi.y < probabilityBottom ? 0 : 1;
+        Xi.y = y == 0 ? Xi.y / probabilityBottom : (Xi.y - probabilityBottom) / (1.0f - probabilityBottom);
+
+        Xi = glm::min(Xi, OneMinusEpsilon);
+
+        size *= 0.5f;
+        origin += glm::vec2((float)x, (float)y) * size;
+
+        node = m_nodes[node].children[x + 2 * y];
+        if (node == 0) break;
+    }
+
+    // Uniform within the leaf quadrant
+    return CanonicalToDirection(origin + Xi * size);
+}
+
+void PathGuiding::DirectionalTree::Build()
+{
+    const std::array<float, 4>& sums = m_nodes[0].sums;
+    m_sum = sums[0] + sums[1] + sums[2] + sums[3];
+
+    if (!std::isfinite(m_sum)) m_sum = 0.0f;
+}
+
+void PathGuiding::DirectionalTree::Refine(const DirectionalTree& previous, float threshold)
+{
+    m_nodes.assign(1, Node{ });
+    m_sum = 0.0f;
+
+    float total = previous.m_sum;
+    if (total <= 0.0f) return;
+
+    // Nodes are visited with the energy the previous tree recorded for them
+    // New nodes, which the previous tree did not have, spread the energy of their parent quadrant evenly
+    struct Entry
+    {
+        int node;
+        int previousNode;   // -1 for new nodes
+        std::array<float, 4> sums;
+        int depth;
+    };
+
+    std::vector<Entry> stack{ Entry{ 0, 0, previous.m_nodes[0].sums, 1 } };
+    while (!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+
+        for (int quadrant = 0; quadrant < 4; quadrant++)
+        {
+            if (entry.sums[quadrant] <= total * threshold || entry.depth >= MaxDirectionalDepth) continue;
+
+            int child = (int)m_nodes.size();
+            m_nodes.push_back(Node{ });
+            m_nodes[entry.node].children[quadrant] = child;
+
+            int previousChild = entry.previousNode >= 0 ? previous.m_nodes[entry.previousNode].children[quadrant] : 0;
+
+            Entry childEntry{ child, -1, { }, entry.depth + 1 };
+            if (previousChild > 0)
+            {
+                childEntry.previousNode = previousChild;
+                childEntry.sums = previous.m_nodes[previousChild].sums;
+            }
+            else
+            {
+                childEntry.sums.fill(entry.sums[quadrant] * 0.25f);
+            }
+
+            stack.push_back(childEntry);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Spatial tree
+// -------------------------------------------------------------------------
+
+void PathGuiding::Reset(const glm::vec3& AA, const glm::vec3& BB)
+{
+    m_AA = AA;
+    m_BB = BB;
+
+    Reset();
+}
+
+void PathGuiding::Reset()
+{
+    m_nodes.assign(1, SpatialNode{ });
+    m_iteration = 0;
+    m_iterationFrameCount = 0;
+}
+
+int PathGuiding::GetLeaf(const glm::vec3& position) const
+{
+    glm::vec3 extent = glm::max(m_BB - m_AA, glm::vec3(1e-6f));
+    glm::vec3 p = glm::clamp((position - m_AA) / extent, 0.0f, OneMinusEpsilon);
+
+    // Children split their parent in half along its axis
+    int node = 0;
+    while (m_nodes[node].children[0] != 0)
+    {
+        const SpatialNode& current = m_nodes[node];
+        int axis = current.axis;
+
+        int child = p[axis] >= 0.5f ? 1 : 0;
+        p[axis] = std::min(p[axis] * 2.0f - (float)child, OneMinusEpsilon);
+
+        node = current.children[child];
+    }
+
+    return node;
+}
+
+void PathGuiding::Record(int leaf, const glm::vec3& direction, float radiance, float pdf)
+{
+    float value = radiance / pdf;
+    if (pdf <= 0.0f || !std::isfinite(value)) return;
+
+    SpatialNode& node = m_nodes[leaf];
+    node.building.Record(direction, value);
+    std::atomic_ref<unsigned int>(node.sampleCount).fetch_add(1, std::memory_order_relaxed);
+}
+
+void PathGuiding::EndFrame()
+{
+    m_iterationFrameCount++;
+
+    if (m_iterationFrameCount >= (1u << std::min(m_iteration, 20u)))
+    {
+        Refine();
+
+        m_iteration++;
+        m_iterationFrameCount = 0;
+    }
+}
+
+void PathGuiding::Refine()
+{
+    // Split leaves with many samples, so their directional trees can adapt to smaller regions
+    // Both children start out with the directional trees of their parent
+    const float threshold = SpatialThreshold * std::sqrt(float(1u << std::min(m_iteration, 20u)));
+
+    std::vector<std::pair<int, int>> stack{ { 0, 0 } };
+    while (!stack.empty())
+    {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        if (m_nodes[index].children[0] != 0)
+        {
+            stack.push_back({ m_nodes[index].children[0], depth + 1 });
+            stack.push_back({ m_nodes[index].children[1], depth + 1 });
+            continue;
+        }
+
+        if ((float)m_nodes[index].sampleCount <= threshold || depth >= MaxSpatialDepth) continue;
+
+        SpatialNode child = m_nodes[index];
+        child.axis = (m_nodes[index].axis + 1) % 3;
+        child.sampleCount /= 2;
+
+        int first = (int)m_nodes.size();
+        m_nodes.push_back(child);
+        m_nodes.push_back(child);
+
+        SpatialNode& parent = m_nodes[index];
+        parent.children = { first, first + 1 };
+        parent.sampling = DirectionalTree();
+        parent.building = DirectionalTree();
+
+        // Children may still have enough samples to split again
+        stack.push_back({ first, depth + 1 });
+        stack.push_back({ first + 1, depth + 1 });
+    }
+
+    // The learned distribution is sampled in the next iteration, while a refined tree learns from scratch
+    for (SpatialNode& node : m_nodes)
+    {
+        if (node.children[0] != 0) continue;
+
+        node.building.Build();
+        node.sampling = node.building;
+        node.building.Refine(node.sampling, DirectionalThreshold);
+        node.sampleCount = 0;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+// Online path guiding for the CPU backend
+// See "Practical Path Guiding for Efficient Light-Transport Simulation" (Muller et al. 2017)
+// A binary tree over the scene bounds holds a directional quadtree per leaf, which learns the incident radiance over iterations
+class PathGuiding
+{
+public:
+    // Quadtree over the cylindrical mapping of the sphere of directions
+    class DirectionalTree
+    {
+    public:
+        struct Node
+        {
+            std::array<float, 4> sums{ };       // Energy of every quadrant
+            std::array<int, 4> children{ };     // Child node of every quadrant, 0 for leaves
+        };
+
+    public:
+        DirectionalTree() : m_nodes(1) { }
+
+        // Splat an energy sample, can be called concurrently
+        void Record(const glm::vec3& direction, float value);
+
+        // Solid angle probability density of sampling the direction
+        float Pdf(const glm::vec3& direction) const;
+        glm::vec3 Sample(glm::vec2 Xi) const;
+
+        // Whether the tree has learned anything that can be sampled
+        const bool IsValid() const { return m_sum > 0.0f; }
+
+        // Finalizes recorded energy for sampling
+        void Build();
+
+        // Builds an empty tree, which subdivides the quadrants of the previous tree that hold more than threshold of its energy
+        void Refine(const DirectionalTree& previous, float threshold);
+
+    private:
+        std::vector<Node> m_nodes;
+        float m_sum = 0.0f;
+    };
+
+    // Spatial tree node, leaves own the directional trees of their region
+    struct SpatialNode
+    {
+        int axis = 0;                       // Split axis of inner nodes
+        std::array<int, 2> children{ };     // Children, 0 for leaves
+
+        DirectionalTree sampling;           // Learned in the previous iteration, read-only while rendering
+        DirectionalTree building;           // Learned in the current iteration
+        unsigned int sampleCount = 0;       // Samples recorded into the building tree
+    };
+
+    // Probability of sampling the guiding distribution instead of the BRDF
+    static constexpr float SamplingFraction = 0.5f;
+
+public:
+    PathGuiding() { Reset(); }
+
+    // Clears all learned data, bounds are the scene bounds the spatial tree subdivides
+    void Reset(const glm::vec3& AA, const glm::vec3& BB);
+    void Reset();
+
+    // Index of the spatial leaf containing the position
+    int GetLeaf(const glm::vec3& position) const;
+    const SpatialNode& GetNode(int index) const { return m_nodes[index]; }
+
+    // Splat the incident radiance arriving at position from direction, pdf is the density the direction was sampled with
+    // Can be called concurrently while rendering
+    void Record(int leaf, const glm::vec3& direction, float radiance, float pdf);
+
+    // Call once after every frame, ends the iteration and refines the trees once it has rendered all of its frames
+    void EndFrame();
+
+    const unsigned int GetIteration() const { return m_iteration; }
+    const size_t GetSpatialNodeCount() const { return m_nodes.size(); }
+
+private:
+    void Refine();
+
+private:
+    glm::vec3 m_AA = glm::vec3(0.0f);
+    glm::vec3 m_BB = glm::vec3(1.0f);
+
+    std::vector<SpatialNode> m_nodes;
+
+    // Every iteration renders twice as many frames as the previous one
+    unsigned int m_iteration = 0;
+    unsigned int m_iterationFrameCount = 0;
+};
@@ -11,6 +11,10 @@
 #include "Shader/Material.h"
 #include "Texture/FramebufferObject.h"
 #include "Texture/Texture2DObject.h"
+#include "Accumulation.h"
+#include "ImageWriter.h"
+#include <algorithm>
+#include <filesystem>
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtx/transform.hpp>
 #include <imgui.h>
@@ -22,11 +26,89 @@
 #include <Asset/ModelLoader.h>
 #include <Geometry/VertexFormat.h>
 #include <iostream>
+#include <sstream>
 #include "PathTracingRenderer.h"
+#include "PathTracingCpuBackend.h"
 #include "PathTracingRendererSceneVisitor.h"
 #include "Scene/RendererSceneVisitor.h"
+#include "OpenImageDenoise/oidn.hpp"
+#include <chrono>
 
-PathTracingApplication::PathTracingApplication() : Application(1024, 1024, "PathTracer")
+namespace
+{
+    // Same order as PathTracingHdri and PathTracingScene, shown in the GUI and used by batch jobs
+    const char* HdriNames[] = { "Autumn Field", "Black", "Brown Photostudio", "Chinese Garden", "Evening Road", "Meadow", "Symmetrical Garden"};
+    const char* SceneNames[] = { "Area Light", "Fireplace", "Mill", "Sponza", "Sponza Reduced", "Bunny Dielectric", "Bunny Metallic", "Bunny Glass", "Bunny Clearcoat", "Dragon Dielectric", "Dragon Metallic", "Dragon Glass", "Dragon Clearcoat" };
+
+    // Index of the name in the list, -1 if it is none of them
+    template<size_t N>
+    int FindName(const char* (&names)[N], const std::string& name)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            if (name == names[i])
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    constexpr int ServerWindowSize = 2048;      // Films of jobs sent to the render server are not known up front, larger ones are rejected
+
+    // The window holds the largest film of all batch jobs, smaller films are rendered into its bottom left part
+    glm::ivec2 GetWindowDimensions(const std::vector<BatchJob>& batchJobs, bool serving)
+    {
+        glm::ivec2 dimensions = serving ? glm::ivec2(ServerWindowSize) : batchJobs.empty() ? glm::ivec2(1024, 1024) : glm::ivec2(1, 1);
+        for (const BatchJob& job : batchJobs)
+        {
+            dimensions = glm::max(dimensions, job.resolution);
+        }
+        return dimensions;
+    }
+
+    constexpr float BatchFrameMilliseconds = 250.0f;    // Batch frames only present progress, so they render many samples each
+    constexpr float BatchReportSeconds = 1.0f;          // Time between progress lines of a batch job
+    constexpr size_t MaxWarmScenes = 4;                 // Scenes whose models, textures and HDRIs stay loaded between batch jobs
+
+    // Denoises in place with the albedo and normal of the primary hits, like the render pass does for the window
+    // Only called on the image writer's thread, which the device belongs to
+    void DenoiseRadiance(std::vector<glm::vec4>& radiance, const std::vector<glm::vec4>& albedo, const std::vector<glm::vec4>& normal, int width, int height)
+    {
+        static oidn::DeviceRef device = []()
+        {
+            oidn::DeviceRef device = oidn::newDevice();
+            device.commit();
+            return device;
+        }();
+
+        // Pixels are read and written as the RGB of the vec4s, the output keeps an alpha of 1
+        std::vector<glm::vec4> output(radiance.size(), glm::vec4(1.0f));
+        oidn::FilterRef filter = device.newFilter("RT");
+        filter.setImage("color", radiance.data(), oidn::Format::Float3, width, height, 0, sizeof(glm::vec4));
+        filter.setImage("albedo", const_cast<glm::vec4*>(albedo.data()), oidn::Format::Float3, width, height, 0, sizeof(glm::vec4));
+        filter.setImage("normal", const_cast<glm::vec4*>(normal.data()), oidn::Format::Float3, width, height, 0, sizeof(glm::vec4));
+        filter.setImage("output", output.data(), oidn::Format::Float3, width, height, 0, sizeof(glm::vec4));
+        filter.set("hdr", true);
+        filter.commit();
+        filter.execute();
+
+        const char* errorMessage;
+        if (device.getError(errorMessage) != oidn::Error::None)
+        {
+            std::cout << "Error: " << errorMessage << std::endl;
+            return;
+        }
+        radiance = std::move(output);
+    }
+}
+
+PathTracingApplication::PathTracingApplication(std::vector<BatchJob> batchJobs, std::unique_ptr<RenderServer> renderServer, const std::string& sharedFilmName)
+    : Application(GetWindowDimensions(batchJobs, renderServer != nullptr).x, GetWindowDimensions(batchJobs, renderServer != nullptr).y, "PathTracer", batchJobs.empty() && !renderServer)
+    , m_batchMode(!batchJobs.empty() || renderServer)
+    , m_batchJobs(std::move(batchJobs))
+    , m_renderServer(std::move(renderServer))
+    , m_hdriLoader(TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F)
 {
     // OpenGL Extension Control
     if (!(GL_ARB_bindless_texture))
@@ -47,6 +129,24 @@ PathTracingApplication::PathTracingApplication() : Application(1024, 1024, "Path
     // Create PathTracing Renderer
     m_pathTracingRenderer = std::make_shared<PathTracingRenderer>(width, height, this, GetDevice());
 
+    // Rendering goes on without viewers if the shared memory cannot be created
+    if (!sharedFilmName.empty())
+    {
+        std::string error;
+        if (!m_sharedFilm.Create(sharedFilmName, width, height, error))
+        {
+            std::cerr << error << std::endl;
+        }
+    }
+
+    // Batch outputs are written from the accumulation buffers of the CPU backend
+    if (m_batchMode)
+    {
+        m_currentPathTracingBackend = PathTracingBackend::Cpu;
+        m_frameTimeBudgetEnabled = true;
+        m_sampleScheduler.SetTargetMilliseconds(BatchFrameMilliseconds);
+    }
+
     // Create Rasterization Renderer
     //m_rasterizationRenderer = std::make_shared<Renderer>(GetDevice());
 }
@@ -65,6 +165,12 @@ void PathTracingApplication::Initialize()
     InitializeCamera();
     InitializeLoader();
 
+    // Batch jobs load their own scene and HDRI when they start
+    if (m_batchMode)
+    {
+        return;
+    }
+
     // Process the chosen Hdri (based on default)
     // Don't process here, we're going to process all buffers anyway
     ProcessHdri(false);
@@ -78,17 +184,30 @@ void PathTracingApplication::Update()
 {
     Application::Update();
 
+    if (m_batchMode)
+    {
+        UpdateBatch();
+    }
+
     int width, height;
     GetMainWindow().GetDimensions(width, height);
 
-    // Increment frame count (capped by max)
-    m_frameCount = m_frameCount < m_maxFrameCount ? ++m_frameCount : m_frameCount;
+    // Accumulation stops once the time budget is spent, so integrators can be compared at equal time
+    bool timeBudgetSpent = m_timeBudget > 0.0f && m_renderTime >= m_timeBudget;
+
+    // Advance frame count by the samples of the last frame (capped by max, or stopped once adaptive sampling has converged)
+    m_frameCount = m_frameCount < m_maxFrameCount && !m_converged && !timeBudgetSpent ? std::min(m_frameCount + m_frameSampleCount, m_maxFrameCount) : m_frameCount;
 
     // Determine if we should do the actual rendering
-    m_shouldPathTrace = m_frameCount < m_maxFrameCount;
+    m_shouldPathTrace = m_frameCount < m_maxFrameCount && !m_converged && !timeBudgetSpent;
 
     // Determine if we should denoise
-    m_shouldDenoise = m_frameCount >= m_maxFrameCount && m_denoiserEnabled;
+    m_shouldDenoise = (m_frameCount >= m_maxFrameCount || m_converged || timeBudgetSpent) && m_denoiserEnabled;
+
+    if (m_shouldPathTrace)
+    {
+        m_renderTime += GetDeltaTime();
+    }
 
     // Update camera controller
     m_cameraController.Update(GetMainWindow(), GetDeltaTime());
@@ -110,7 +229,65 @@ void PathTracingApplication::Update()
     // Invalidate accumulation when moving the camera
     if (m_cameraController.IsEnabled())
     {
-        InvalidateScene();
+        InvalidateScene(true);
+    }
+
+    // Interactive frames render at the resolution which keeps them near the target frame time, measured on the backend that renders them
+    // The accumulation of another resolution is laid out differently, so it starts over whenever the resolution changes
+    {
+        m_dynamicResolution.Update(m_dynamicResolutionEnabled && m_cameraController.IsEnabled(), m_frameMilliseconds);
+
+        glm::ivec2 renderDimensions = m_dynamicResolution.GetRenderDimensions(GetFullDimensions());
+        if (renderDimensions != m_renderDimensions)
+        {
+            m_renderDimensions = renderDimensions;
+            m_sampleScheduler.Reset();
+            InvalidateScene();
+        }
+    }
+
+    // Pixels outside of the region keep their accumulation, so iterating on a detail costs a fraction of a full frame
+    // Pixels entering the region may hold the accumulation of an older scene, so it starts over whenever the region changes
+    {
+        const glm::ivec2 fullDimensions = GetFullDimensions();
+
+        glm::ivec4 renderRegion = glm::ivec4(0, 0, m_renderDimensions);
+        if (m_renderRegionEnabled)
+        {
+            if (m_renderRegionFollowsCursor && !ImGui::GetIO().WantCaptureMouse)
+            {
+                glm::ivec2 cursor = glm::ivec2((GetMainWindow().GetMousePosition(true) * 0.5f + 0.5f) * glm::vec2(fullDimensions));
+                m_renderRegionRect.x = cursor.x - m_renderRegionRect.z / 2;
+                m_renderRegionRect.y = cursor.y - m_renderRegionRect.w / 2;
+            }
+
+            // The region is kept in window pixels, so it stays in place when dynamic resolution scales the render dimensions
+            glm::vec2 scale = glm::vec2(m_renderDimensions) / glm::vec2(fullDimensions);
+            glm::ivec2 regionMin = glm::ivec2(glm::floor(glm::vec2(m_renderRegionRect.x, m_renderRegionRect.y) * scale));
+            glm::ivec2 regionMax = glm::ivec2(glm::ceil(glm::vec2(m_renderRegionRect.x + m_renderRegionRect.z, m_renderRegionRect.y + m_renderRegionRect.w) * scale));
+            regionMin = glm::clamp(regionMin, glm::ivec2(0), m_renderDimensions);
+            regionMax = glm::clamp(regionMax, regionMin, m_renderDimensions);
+
+            if (regionMax.x > regionMin.x && regionMax.y > regionMin.y)
+            {
+                renderRegion = glm::ivec4(regionMin, regionMax);
+            }
+        }
+
+        if (renderRegion != m_renderRegion)
+        {
+            m_renderRegion = renderRegion;
+            m_sampleScheduler.Reset();
+            InvalidateScene();
+        }
+    }
+
+    // Samples of this frame, as many as fit the frame time budget but no more than the accumulation still needs
+    // Reduced resolution frames are already kept at their target time by the resolution, so they render one
+    {
+        bool reducedResolution = m_renderDimensions != GetFullDimensions();
+        unsigned int frameSampleCount = m_frameTimeBudgetEnabled && !reducedResolution ? m_sampleScheduler.GetSampleCount() : 1;
+        m_frameSampleCount = std::clamp(frameSampleCount, 1u, std::max(m_maxFrameCount - std::min(m_frameCount, m_maxFrameCount), 1u));
     }
 
     const Camera& camera = *m_cameraController.GetCamera()->GetCamera();
@@ -121,6 +298,9 @@ void PathTracingApplication::Update()
 
     // Update materials
     UpdateMaterial(camera, width, height);
+
+    m_cameraMoved = false;
+    m_sceneChanged = false;
 }
 
 void PathTracingApplication::Render()
@@ -144,8 +324,11 @@ void PathTracingApplication::Render()
     // Render the scene using pathtracing renderer
     m_pathTracingRenderer->Render();
 
-    // Render the debug user interface
-    RenderGUI();
+    // Render the debug user interface, batch mode has no one to show it to
+    if (!m_batchMode)
+    {
+        RenderGUI();
+    }
 }
 
 void PathTracingApplication::Cleanup()
@@ -156,22 +339,526 @@ void PathTracingApplication::Cleanup()
     Application::Cleanup();
 }
 
-void PathTracingApplication::InvalidateScene()
+void PathTracingApplication::InvalidateScene(bool cameraOnly)
 {
+    m_cameraMoved |= cameraOnly;
+    m_sceneChanged |= !cameraOnly;
+
     // If scene was dirty, we should reset the denoised state as well
     m_frameCount = 1;
+    m_renderTime = 0.0f;
     m_denoiseProgress = 0.0f;
     m_denoised = false;
+    m_converged = false;
+
+    // Learned guiding distributions and cached radiance would no longer match the scene
+    m_pathTracingRenderer->GetCpuBackend()->ResetPathGuiding();
+    m_pathTracingRenderer->GetCpuBackend()->ResetRadianceCache();
 }
 
 void PathTracingApplication::RefreshScene()
 {
     // Reset to default state
     m_frameCount = 0;
+    m_frameSampleCount = 1;
+    m_sampleScheduler.Reset();
+    m_sceneChanged = true;
+    m_renderTime = 0.0f;
     m_shouldPathTrace = false;
     m_shouldDenoise = false;
     m_denoiseProgress = 0.0f;
     m_denoised = false;
+    m_converged = false;
+}
+
+void PathTracingApplication::SetFrameTiming(unsigned int sampleCount, float milliseconds)
+{
+    m_frameMilliseconds = milliseconds;
+    m_sampleScheduler.AddFrame(sampleCount, milliseconds);
+}
+
+void PathTracingApplication::AddFrameSamples(unsigned int sampleCount)
+{
+    m_batchSampleCount += sampleCount;
+}
+
+void PathTracingApplication::SetActivePixelCount(unsigned int value)
+{
+    m_activePixelCount = value;
+
+    // Every tile was skipped, so further frames would not change the image
+    if (m_adaptiveSamplingEnabled && m_activePixelCount == 0)
+    {
+        m_converged = true;
+    }
+}
+
+glm::ivec2 PathTracingApplication::GetFullDimensions() const
+{
+    if (m_batchMode)
+    {
+        return m_batchResolution;
+    }
+    return glm::ivec2(m_pathTracingRenderer->GetWidth(), m_pathTracingRenderer->GetHeight());
+}
+
+void PathTracingApplication::UpdateBatch()
+{
+    // The previous Update stopped the accumulation, so the film holds everything the job will get
+    if (m_batchJobStarted && !m_shouldPathTrace)
+    {
+        FinishBatchJob();
+
+        m_batchJobStarted = false;
+        m_batchRequest = { };
+    }
+
+    while (!m_batchJobStarted)
+    {
+        // Frames of an animation come first, then jobs of the job files, then the ones sent to the render server
+        if (!m_animationFrames.empty())
+        {
+            m_batchRequest = m_animationRequest;
+            m_batchRequest.job = std::move(m_animationFrames.front());
+            m_animationFrames.pop_front();
+        }
+        else if (m_batchJobIndex < m_batchJobs.size())
+        {
+            m_batchRequest.job = m_batchJobs[m_batchJobIndex++];
+        }
+        else if (!m_renderServer || !m_renderServer->PopRequest(m_batchRequest))
+        {
+            // The server keeps running, waiting for the next request
+            if (!m_renderServer)
+            {
+                Close();
+            }
+            return;
+        }
+
+        if (m_batchRequest.job.IsAnimation())
+        {
+            StartAnimation();
+            continue;
+        }
+
+        // Jobs whose assets cannot be found are skipped, the others still render
+        std::string error;
+        m_batchJobStarted = StartBatchJob(m_batchRequest.job, error);
+        if (!m_batchJobStarted)
+        {
+            ReportBatch("error: " + error);
+            m_batchRequest = { };
+
+            // The other frames of the animation would fail the same way
+            if (m_animationFrameCount > 0)
+            {
+                ReportBatch(m_animationRequest, "error: frame " + std::to_string(m_animationFrame + 1) + " failed");
+                m_animationFrames.clear();
+                m_animationFrameCount = 0;
+                m_animationRequest = { };
+            }
+        }
+    }
+
+    if (m_shouldPathTrace && m_renderTime >= m_batchReportTime)
+    {
+        ReportBatch(std::to_string(m_batchSampleCount) + "/" + std::to_string(m_batchRequest.job.sampleCount) + " samples, " + std::to_string(m_renderTime) + " s");
+
+        m_batchReportTime = m_renderTime + BatchReportSeconds;
+    }
+
+    // Nobody is left to receive the outputs, e.g. a coordinator whose other worker finished the tile first
+    if (m_batchJobStarted && RenderServer::IsDisconnected(m_batchRequest))
+    {
+        std::cout << m_batchRequest.job.name << ": cancelled, the client disconnected" << std::endl;
+
+        // The next Update stops accumulating, the next job is taken on the one after
+        m_maxFrameCount = m_frameCount;
+        m_batchJobStarted = false;
+        m_batchRequest = { };
+
+        if (m_animationFrameCount > 0)
+        {
+            m_animationFrames.clear();
+            m_animationFrameCount = 0;
+            m_animationRequest = { };
+        }
+        return;
+    }
+
+    // Checkpoints read back the whole film, so they are only taken every so often
+    if (m_shouldPathTrace && !m_batchRequest.job.checkpoint.empty() && m_renderTime >= m_batchCheckpointTime)
+    {
+        SaveBatchCheckpoint();
+
+        m_batchCheckpointTime = m_renderTime + m_batchRequest.job.checkpointInterval;
+    }
+}
+
+void PathTracingApplication::ReportBatch(const std::string& message)
+{
+    ReportBatch(m_batchRequest, message);
+}
+
+void PathTracingApplication::ReportBatch(const RenderServer::Request& request, const std::string& message)
+{
+    std::string line = request.job.name + ": " + message;
+    std::cout << line << std::endl;
+
+    // Clients of the render server only get the messages of their own jobs
+    RenderServer::Send(request, line);
+}
+
+bool PathTracingApplication::TakeSaveRequest(std::string& path)
+{
+    if (!m_saveRequested)
+    {
+        return false;
+    }
+
+    m_saveRequested = false;
+    path = m_savePath;
+    return true;
+}
+
+void PathTracingApplication::SaveBatchCheckpoint(std::shared_ptr<bool> written)
+{
+    // Only copying the sums holds up rendering, they are saved while the next frames render
+    const std::string& path = m_batchRequest.job.checkpoint;
+    m_imageWriter.WriteAsync(path, m_pathTracingRenderer->GetCpuBackend()->GetAccumulation(), [request = m_batchRequest, path, written](bool saved)
+    {
+        if (!saved)
+        {
+            ReportBatch(request, "error: cannot write checkpoint \"" + path + "\"");
+            if (written)
+            {
+                *written = false;
+            }
+        }
+    });
+}
+
+void PathTracingApplication::StartAnimation()
+{
+    std::vector<BatchJob> frames = m_batchRequest.job.GetAnimationFrames();
+    m_animationFrames.assign(std::make_move_iterator(frames.begin()), std::make_move_iterator(frames.end()));
+    m_animationRequest = std::move(m_batchRequest);
+    m_batchRequest = { };
+
+    m_animationFrameCount = (unsigned int)m_animationFrames.size();
+    m_animationFrame = 0;
+    m_animationStartTime = GetCurrentTime();
+    m_animationStallSeconds = 0.0;
+
+    // Outputs of earlier jobs are written first, so the busy time of the image writer only counts frames of the animation
+    m_imageWriter.Wait();
+    m_animationBusySeconds = m_imageWriter.GetBusySeconds();
+
+    ReportBatch(m_animationRequest, "started, " + std::to_string(m_animationFrameCount) + " frames");
+}
+
+void PathTracingApplication::FinishAnimationFrame()
+{
+    m_animationFrame++;
+    if (m_animationFrame == 1)
+    {
+        m_animationSteadyTime = GetCurrentTime();
+    }
+    if (m_animationFrame < m_animationFrameCount)
+    {
+        return;
+    }
+
+    // The last frame has nothing left to overlap its outputs with
+    WaitForAnimationOutputs();
+
+    // Overlap is the share of the image writer's work the renderer did not have to wait for
+    float secondsPerFrame = m_animationFrameCount > 1 ? (GetCurrentTime() - m_animationSteadyTime) / (m_animationFrameCount - 1) : GetCurrentTime() - m_animationStartTime;
+    double busySeconds = m_imageWriter.GetBusySeconds() - m_animationBusySeconds;
+    double overlap = busySeconds > 0.0 ? std::max(1.0 - m_animationStallSeconds / busySeconds, 0.0) : 1.0;
+
+    ReportBatch(m_animationRequest, "done, " + std::to_string(m_animationFrameCount) + " frames, " + std::to_string(secondsPerFrame) + " s per frame steady state, "
+        + std::to_string((int)std::round(overlap * 100.0)) + "% of denoising and writing overlapped with rendering");
+
+    m_animationFrameCount = 0;
+    m_animationRequest = { };
+}
+
+void PathTracingApplication::WaitForAnimationOutputs()
+{
+    auto start = std::chrono::steady_clock::now();
+    m_imageWriter.Wait();
+    m_animationStallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool PathTracingApplication::StartBatchJob(const BatchJob& job, std::string& error)
+{
+    // Names of the GUI pick the built-in assets, anything else is a file
+    int hdriIndex = FindName(HdriNames, job.hdri);
+    int sceneIndex = FindName(SceneNames, job.scene);
+    if (hdriIndex < 0 && !std::filesystem::exists(job.hdri))
+    {
+        error = "no HDRI named or file \"" + job.hdri + "\"";
+        return false;
+    }
+    if (sceneIndex < 0 && !std::filesystem::exists(job.scene))
+    {
+        error = "no scene named or file \"" + job.scene + "\"";
+        return false;
+    }
+
+    // Films are rendered into the window, a server cannot grow it for a larger job
+    const glm::ivec2 filmSize = job.crop.z > 0 && job.crop.w > 0 ? glm::ivec2(job.crop.z, job.crop.w) : job.resolution;
+    int width, height;
+    GetMainWindow().GetDimensions(width, height);
+    if (filmSize.x > width || filmSize.y > height)
+    {
+        error = "film " + std::to_string(filmSize.x) + "x" + std::to_string(filmSize.y) + " is larger than the "
+            + std::to_string(width) + "x" + std::to_string(height) + " this process renders, split it into crops";
+        return false;
+    }
+
+    // A checkpoint left by an earlier run of the job is resumed, only the samples it lacks are rendered
+    Accumulation resumedAccumulation;
+    if (!job.checkpoint.empty() && std::filesystem::exists(job.checkpoint) && !Accumulation::Load(job.checkpoint, resumedAccumulation, error))
+    {
+        return false;
+    }
+
+    ReportBatch("started");
+
+    // The loaders keep every model and texture they loaded, so a long running server would end up holding every scene it was asked for
+    // Past the budget they let go of all of them, the scene of this job is loaded again
+    bool sceneWarm = std::find(m_warmScenes.begin(), m_warmScenes.end(), job.scene) != m_warmScenes.end();
+    if (!sceneWarm && m_warmScenes.size() >= MaxWarmScenes)
+    {
+        m_modelLoader->ClearShared();
+        m_modelLoader->GetTexture2DLoader().ClearShared();
+        m_hdriLoader.ClearShared();
+        m_pathTracingRenderer->ClearKeptScenes();
+        m_warmScenes.clear();
+        m_batchScene.clear();
+        m_batchHdri.clear();
+    }
+    if (!sceneWarm)
+    {
+        m_warmScenes.push_back(job.scene);
+    }
+
+    // Warm scenes keep their buffers, BVH and texture caches, and HDRIs their environment, so going back to one starts rendering right away
+    bool hdriChanged = job.hdri != m_batchHdri;
+    bool sceneChanged = job.scene != m_batchScene;
+    if (hdriChanged)
+    {
+        m_currentPathTracingHdri = hdriIndex >= 0 ? static_cast<PathTracingHdri>(hdriIndex) : m_currentPathTracingHdri;
+        m_hdriPath = hdriIndex >= 0 ? std::string() : job.hdri;
+        ProcessHdri(true);
+        m_batchHdri = job.hdri;
+    }
+    if (sceneChanged)
+    {
+        m_currentPathTracingScene = sceneIndex >= 0 ? static_cast<PathTracingScene>(sceneIndex) : m_currentPathTracingScene;
+        m_scenePath = sceneIndex >= 0 ? std::string() : job.scene;
+        if (!m_pathTracingRenderer->RestoreScene(job.scene))
+        {
+            ProcessScene();
+            m_pathTracingRenderer->KeepScene(job.scene);
+        }
+        m_batchScene = job.scene;
+    }
+
+    // A crop is rendered as a film of its own, with the projection of the whole film narrowed down to it
+    glm::mat4 cropMatrix(1.0f);
+    if (job.crop.z > 0 && job.crop.w > 0)
+    {
+        glm::vec2 scale = glm::vec2(job.resolution) / glm::vec2(job.crop.z, job.crop.w);
+        glm::vec2 center = (glm::vec2(job.crop.x, job.crop.y) * 2.0f + glm::vec2(job.crop.z, job.crop.w)) / glm::vec2(job.resolution) - 1.0f;
+        cropMatrix = glm::scale(glm::vec3(scale, 1.0f)) * glm::translate(glm::vec3(-center, 0.0f));
+    }
+
+    // Camera
+    std::shared_ptr<SceneCamera> sceneCamera = m_cameraController.GetCamera();
+    sceneCamera->GetCamera()->SetViewMatrix(job.cameraPosition, job.cameraTarget);
+    sceneCamera->GetCamera()->SetPerspectiveProjectionMatrix(job.fov, float(job.resolution.x) / float(job.resolution.y), 0.01f, 1000.0f);
+    sceneCamera->GetCamera()->SetProjectionMatrix(cropMatrix * sceneCamera->GetCamera()->GetProjectionMatrix());
+    sceneCamera->MatchTransformToCamera();
+    m_focalLength = job.focalLength;
+    m_apertureSize = job.apertureSize;
+
+    // Film, which fits into the window
+    m_batchResolution = glm::max(filmSize, glm::ivec2(1));
+    m_renderRegionEnabled = job.region.z > 0 && job.region.w > 0;
+    m_renderRegionRect = job.region;
+
+    if (!resumedAccumulation.IsEmpty() && glm::ivec2(resumedAccumulation.GetWidth(), resumedAccumulation.GetHeight()) != m_batchResolution)
+    {
+        error = "checkpoint \"" + job.checkpoint + "\" is " + std::to_string(resumedAccumulation.GetWidth()) + "x" + std::to_string(resumedAccumulation.GetHeight())
+            + ", the film " + std::to_string(m_batchResolution.x) + "x" + std::to_string(m_batchResolution.y);
+        return false;
+    }
+
+    // Termination, the frame count starts at 1 so it stops one above the samples
+    // A resumed job renders at least one frame, which is the one that takes up the checkpoint
+    m_resumedSampleCount = std::min((unsigned int)resumedAccumulation.GetMaxSampleCount(), job.sampleCount - 1);
+    m_maxFrameCount = job.sampleCount - m_resumedSampleCount + 1;
+    m_adaptiveSamplingEnabled = job.noiseThreshold > 0.0f;
+    m_noiseThreshold = job.noiseThreshold;
+    m_minSampleCount = job.minSampleCount;
+    m_timeBudget = job.timeLimit;
+
+    // Integrator
+    m_currentPathTracingIntegrator = static_cast<PathTracingIntegrator>(job.integrator);
+    m_metropolisEnabled = job.metropolisEnabled;
+    m_currentPathTracingSampler = static_cast<PathTracingSampler>(job.samplerType);
+    m_seed = job.seed;
+    m_AntiAliasingEnabled = job.antiAliasingEnabled;
+    m_emissiveSamplingEnabled = job.emissiveSamplingEnabled;
+    m_lightTreeEnabled = job.lightTreeEnabled;
+    m_pathGuidingEnabled = job.pathGuidingEnabled;
+    m_reservoirResamplingEnabled = job.reservoirResamplingEnabled;
+    m_causticPhotonsEnabled = job.causticPhotonsEnabled;
+    m_radianceCacheEnabled = job.radianceCacheEnabled;
+    m_adjointRussianRouletteEnabled = job.adjointRussianRouletteEnabled;
+    m_temporalReprojectionEnabled = job.temporalReprojectionEnabled;
+
+    m_specularModifier = job.modifiers.specular;
+    m_specularTintModifier = job.modifiers.specularTint;
+    m_metallicModifier = job.modifiers.metallic;
+    m_roughnessModifier = job.modifiers.roughness;
+    m_subsurfaceModifier = job.modifiers.subsurface;
+    m_anisotropyModifier = job.modifiers.anisotropy;
+    m_sheenRoughnessModifier = job.modifiers.sheenRoughness;
+    m_sheenTintModifier = job.modifiers.sheenTint;
+    m_clearcoatModifier = job.modifiers.clearcoat;
+    m_clearcoatRoughnessModifier = job.modifiers.clearcoatRoughness;
+    m_refractionModifier = job.modifiers.refraction;
+    m_transmissionModifier = job.modifiers.transmission;
+
+    // Start over with nothing learned from the previous job, the frame count advances to the first sample in this same Update
+    // Frames of an animation after the first only moved the camera, so the backend can reproject the accumulation of the previous frame
+    bool cameraOnly = m_animationFrameCount > 0 && m_animationFrame > 0 && !hdriChanged && !sceneChanged;
+    InvalidateScene(cameraOnly);
+    RefreshScene();
+
+    // Refreshing marks the scene changed, which would keep the backend from reprojecting
+    m_sceneChanged = !cameraOnly;
+    m_batchSampleCount = m_resumedSampleCount;
+    m_batchReportTime = 0.0f;
+    m_batchCheckpointTime = job.checkpointInterval;
+
+    if (!resumedAccumulation.IsEmpty())
+    {
+        ReportBatch("resuming from " + std::to_string(m_resumedSampleCount) + " samples");
+        m_pathTracingRenderer->GetCpuBackend()->ResumeAccumulation(std::move(resumedAccumulation));
+    }
+
+    return true;
+}
+
+void PathTracingApplication::FinishBatchJob()
+{
+    const BatchJob& job = m_batchRequest.job;
+
+    std::shared_ptr<PathTracingCpuBackend> cpuBackend = m_pathTracingRenderer->GetCpuBackend();
+    const int width = cpuBackend->GetWidth();
+    const int height = cpuBackend->GetHeight();
+
+    // Outputs are copies of the buffers, the image writer compresses and writes them while the next job renders
+    ImageWriter::Images images;
+    auto addOutput = [&](const std::string& path, const std::vector<glm::vec4>& pixels)
+    {
+        if (path.empty())
+        {
+            return;
+        }
+
+        ImageWriter::Image& image = images.emplace_back(path, ImageWriter::Image()).second;
+        image.width = width;
+        image.height = height;
+        image.exposure = job.exposure;
+        image.layers.emplace_back().pixels = pixels;
+    };
+
+    // OpenEXR radiance takes the other layers of the render along, the variance from the luminance sums of the samples
+    if (ImageWriter::HasExtension(job.radianceOutput, ".exr"))
+    {
+        ImageWriter::Image& image = images.emplace_back(job.radianceOutput, ImageWriter::GetRenderImage(width, height,
+            cpuBackend->GetRadianceData(), cpuBackend->GetPrimaryAlbedoData(), cpuBackend->GetPrimaryNormalData(),
+            Accumulation::GetVarianceData(cpuBackend->GetSampleStatsData()))).second;
+        image.exposure = job.exposure;
+    }
+    else
+    {
+        addOutput(job.radianceOutput, cpuBackend->GetRadianceData());
+    }
+    addOutput(job.albedoOutput, cpuBackend->GetPrimaryAlbedoData());
+    addOutput(job.normalOutput, cpuBackend->GetPrimaryNormalData());
+
+    // The checkpoint is queued ahead of the outputs, so it is written by the time they are
+    std::shared_ptr<bool> written = std::make_shared<bool>(true);
+    if (!job.checkpoint.empty())
+    {
+        SaveBatchCheckpoint(written);
+    }
+
+    // Replies hold the rendered region only, the client of a distributed render merges the regions of all its workers
+    std::istringstream replyNames(job.reply);
+    std::string replyName;
+    while (replyNames >> replyName)
+    {
+        const std::vector<glm::vec4>& pixels = replyName == "albedo" ? cpuBackend->GetPrimaryAlbedoData()
+            : replyName == "normal" ? cpuBackend->GetPrimaryNormalData() : cpuBackend->GetRadianceData();
+
+        const glm::ivec2 regionSize = glm::ivec2(m_renderRegion.z, m_renderRegion.w) - glm::ivec2(m_renderRegion.x, m_renderRegion.y);
+        std::vector<float> rgb;
+        rgb.reserve((size_t)regionSize.x * regionSize.y * 3);
+        for (int y = m_renderRegion.y; y < m_renderRegion.w; y++)
+        {
+            for (int x = m_renderRegion.x; x < m_renderRegion.z; x++)
+            {
+                const glm::vec4& pixel = pixels[(size_t)y * width + x];
+                rgb.insert(rgb.end(), { pixel.r, pixel.g, pixel.b });
+            }
+        }
+
+        RenderServer::SendBuffer(m_batchRequest, replyName, regionSize.x, regionSize.y, rgb);
+    }
+
+    // Denoising runs on the image writer's thread as well, the radiance output is the first of the images
+    std::function<void(ImageWriter::Images&)> prepare;
+    if (job.denoise && !job.radianceOutput.empty())
+    {
+        prepare = [albedo = cpuBackend->GetPrimaryAlbedoData(), normal = cpuBackend->GetPrimaryNormalData(), width, height](ImageWriter::Images& images)
+        {
+            DenoiseRadiance(images.front().second.layers.front().pixels, albedo, normal, width, height);
+        };
+    }
+
+    // Frames of an animation hold the outputs of one frame at a time, which were written while the next frame rendered
+    if (m_animationFrameCount > 0)
+    {
+        WaitForAnimationOutputs();
+    }
+
+    // The job is done once its outputs are written, clients may read them as soon as they hear so
+    const std::string done = "done, " + std::to_string(m_batchSampleCount) + " samples in " + std::to_string(m_renderTime) + " s";
+    m_imageWriter.WriteAsync(std::move(images), [request = m_batchRequest, written, done](const std::vector<std::string>& failedPaths)
+    {
+        for (const std::string& path : failedPaths)
+        {
+            ReportBatch(request, "error: cannot write \"" + path + "\"");
+        }
+        if (*written && failedPaths.empty())
+        {
+            ReportBatch(request, done);
+        }
+    }, std::move(prepare));
+
+    if (m_animationFrameCount > 0)
+    {
+        FinishAnimationFrame();
+    }
 }
 
 void PathTracingApplication::InitializeLoader()
@@ -224,6 +911,9 @@ void PathTracingApplication::InitializeLoader()
     // Material Properties for rasterization
     m_modelLoader->SetMaterialProperty(ModelLoader::MaterialProperty::DiffuseTexture, "DiffuseTexture");
     m_modelLoader->SetMaterialProperty(ModelLoader::MaterialProperty::NormalTexture, "NormalTexture");
+
+    // HDRIs are mipmapped, as any texture loaded with LoadTextureShared
+    m_hdriLoader.SetGenerateMipmap(true);
 }
 
 void PathTracingApplication::InitializeCamera()
@@ -243,13 +933,39 @@ void PathTracingApplication::InitializeCamera()
 
 void PathTracingApplication::UpdateMaterial(const Camera& camera, int width, int height)
 {
+    // Modifiers, shared by both backends
+    DisneyBrdf::MaterialModifiers modifiers;
+    modifiers.specular = m_specularModifier;
+    modifiers.specularTint = m_specularTintModifier;
+    modifiers.metallic = m_metallicModifier;
+    modifiers.roughness = m_roughnessModifier;
+    modifiers.subsurface = m_subsurfaceModifier;
+    modifiers.anisotropy = m_anisotropyModifier;
+    modifiers.sheenRoughness = m_sheenRoughnessModifier;
+    modifiers.sheenTint = m_sheenTintModifier;
+    modifiers.clearcoat = m_clearcoatModifier;
+    modifiers.clearcoatRoughness = m_clearcoatRoughnessModifier;
+    modifiers.refraction = m_refractionModifier;
+    modifiers.transmission = m_transmissionModifier;
+
     // Path Tracing material
     {
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("ViewMatrix", camera.GetViewMatrix());
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("ProjMatrix", camera.GetProjectionMatrix());
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("InvProjMatrix", glm::inverse(camera.GetProjectionMatrix()));
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("FrameCount", m_frameCount);
-        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("FrameDimensions", glm::vec2((float)width, (float)height));
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("FrameDimensions", glm::vec2(m_renderDimensions));
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("RenderRegion", glm::vec4(m_renderRegion));
+
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("SamplerType", (unsigned int)m_currentPathTracingSampler);
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("SampleCount", m_maxFrameCount);
+
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("AdaptiveSamplingEnabled", (unsigned int)m_adaptiveSamplingEnabled);
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("NoiseThreshold", m_noiseThreshold);
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("MinSampleCount", m_minSampleCount);
+
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("EmissiveSamplingEnabled", (unsigned int)m_emissiveSamplingEnabled);
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("LightTreeEnabled", (unsigned int)m_lightTreeEnabled);
 
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("AntiAliasingEnabled", (unsigned int)m_AntiAliasingEnabled);
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("FocalLength", m_focalLength);
@@ -268,11 +984,56 @@ void PathTracingApplication::UpdateMaterial(const Camera& camera, int width, int
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("ClearcoatRoughnessModifier", m_clearcoatRoughnessModifier);
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("RefractionModifier", m_refractionModifier);
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("TransmissionModifier", m_transmissionModifier);
+        m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("ModifierLobes", DisneyBrdf::GetModifierLobes(modifiers));
 
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("DebugValueA", m_debugValueA);
         m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("DebugValueB", m_debugValueB);
     }
 
+    // CPU backend, same data as the path tracing material
+    {
+        PathTracingCpuBackend::FrameSettings frameSettings;
+        frameSettings.viewMatrix = camera.GetViewMatrix();
+        frameSettings.invProjMatrix = glm::inverse(camera.GetProjectionMatrix());
+        frameSettings.frameCount = m_frameCount;
+        frameSettings.frameSampleCount = m_frameSampleCount;
+        frameSettings.renderDimensions = m_renderDimensions;
+        frameSettings.renderRegion = m_renderRegion;
+
+        frameSettings.samplerType = (Sampler::Type)m_currentPathTracingSampler;
+        frameSettings.sampleCount = m_maxFrameCount + m_resumedSampleCount;
+        frameSettings.seed = m_seed;
+
+        frameSettings.integrator = (PathTracingCpuBackend::Integrator)m_currentPathTracingIntegrator;
+        frameSettings.metropolisEnabled = m_metropolisEnabled;
+
+        frameSettings.adaptiveSamplingEnabled = m_adaptiveSamplingEnabled;
+        frameSettings.noiseThreshold = m_noiseThreshold;
+        frameSettings.minSampleCount = m_minSampleCount;
+
+        frameSettings.emissiveSamplingEnabled = m_emissiveSamplingEnabled;
+        frameSettings.lightTreeEnabled = m_lightTreeEnabled;
+
+        frameSettings.pathGuidingEnabled = m_pathGuidingEnabled;
+        frameSettings.reservoirResamplingEnabled = m_reservoirResamplingEnabled;
+        frameSettings.causticPhotonsEnabled = m_causticPhotonsEnabled;
+        frameSettings.radianceCacheEnabled = m_radianceCacheEnabled;
+        frameSettings.adjointRussianRouletteEnabled = m_adjointRussianRouletteEnabled;
+
+        // Reprojection needs everything but the camera to be the same as in the last frame
+        frameSettings.temporalReprojectionEnabled = m_temporalReprojectionEnabled;
+        frameSettings.cameraMoved = m_cameraMoved && !m_sceneChanged;
+
+        frameSettings.antiAliasingEnabled = m_AntiAliasingEnabled;
+        frameSettings.focalLength = m_focalLength;
+        frameSettings.apertureSize = m_apertureSize;
+        frameSettings.apertureShape = m_apertureShape;
+
+        frameSettings.modifiers = modifiers;
+
+        m_pathTracingRenderer->GetCpuBackend()->SetFrameSettings(frameSettings);
+    }
+
     // Tone Mapping material
     {
         m_pathTracingRenderer->GetToneMappingMaterial()->SetUniformValue("Exposure", m_exposure);
@@ -294,6 +1055,42 @@ void PathTracingApplication::RenderGUI()
         ImGui::Text(std::string("Frame Render Time (ms): " + std::to_string(miliSeconds)).c_str());
 
         ImGui::Text(std::string("Frame Count: " + std::to_string(m_frameCount)).c_str());
+        ImGui::Text(std::string("Samples per Frame: " + std::to_string(m_frameSampleCount) + " (" + std::to_string(m_frameMilliseconds) + " ms)").c_str());
+        ImGui::Text(std::string("Render Resolution: " + std::to_string(m_renderDimensions.x) + "x" + std::to_string(m_renderDimensions.y)).c_str());
+        ImGui::Text(std::string("Accumulation Time (s): " + std::to_string(m_renderTime)).c_str());
+
+        if (GetCpuBackendEnabled())
+        {
+            ImGui::Text(std::string("CPU Shading (ns/hit): " + std::to_string(m_pathTracingRenderer->GetCpuBackend()->GetShadingNanosecondsPerHit())).c_str());
+            ImGui::Text(std::string("CPU Render Time (s): " + std::to_string(m_pathTracingRenderer->GetCpuBackend()->GetRenderMilliseconds() * 1e-3f)).c_str());
+            ImGui::Text(std::string("CPU Rays per Pixel: " + std::to_string(m_pathTracingRenderer->GetCpuBackend()->GetRaysPerPixel())).c_str());
+
+            const TextureCache::Statistics& textureCacheStatistics = m_pathTracingRenderer->GetCpuBackend()->GetTextureCacheStatistics();
+            long long textureCacheHits = textureCacheStatistics.lookups - textureCacheStatistics.misses;
+            float textureCacheHitRate = textureCacheStatistics.lookups > 0 ? float(double(textureCacheHits) / double(textureCacheStatistics.lookups)) : 1.0f;
+            ImGui::Text(std::string("Texture Cache Hits: " + std::to_string(textureCacheHitRate * 100.0f) + "% (" + std::to_string(textureCacheStatistics.residentBytes >> 20) + " MB resident)").c_str());
+            ImGui::Text(std::string("Texture Cache I/O (ms): " + std::to_string(textureCacheStatistics.ioMilliseconds)).c_str());
+
+            if (m_pathGuidingEnabled)
+            {
+                const PathGuiding& pathGuiding = m_pathTracingRenderer->GetCpuBackend()->GetPathGuiding();
+                ImGui::Text(std::string("Guiding Iteration: " + std::to_string(pathGuiding.GetIteration()) + " (" + std::to_string(pathGuiding.GetSpatialNodeCount()) + " spatial nodes)").c_str());
+            }
+
+            if (m_causticPhotonsEnabled)
+            {
+                const PhotonMap& photonMap = m_pathTracingRenderer->GetCpuBackend()->GetCausticPhotonMap();
+                ImGui::Text(std::string("Caustic Photons: " + std::to_string(photonMap.GetPhotonCount()) + " (radius " + std::to_string(photonMap.GetRadius()) + ")").c_str());
+            }
+
+            if (m_radianceCacheEnabled)
+            {
+                std::shared_ptr<PathTracingCpuBackend> cpuBackend = m_pathTracingRenderer->GetCpuBackend();
+                const RadianceCache& radianceCache = cpuBackend->GetRadianceCache();
+                ImGui::Text(std::string("Radiance Cache: " + std::to_string(radianceCache.GetEntryCount()) + " / " + std::to_string(radianceCache.GetCapacity()) + " entries (" + std::to_string(radianceCache.GetMemoryBytes() >> 20) + " MB)").c_str());
+                ImGui::Text(std::string("Cache Terminated Paths: " + std::to_string(cpuBackend->GetRadianceCacheTerminationRate() * 100.0f) + "%").c_str());
+            }
+        }
         
         ImGui::Spacing();
         ImGui::Separator();
@@ -305,6 +1102,11 @@ void PathTracingApplication::RenderGUI()
             ImGui::ProgressBar((float)m_frameCount / (float)m_maxFrameCount);
         }
 
+        if (m_adaptiveSamplingEnabled)
+        {
+            ImGui::Text(std::string("Active Pixels: " + std::to_string(m_activePixelCount) + (m_converged ? " (Converged)" : "")).c_str());
+        }
+
         if (m_denoiserEnabled)
         {
             ImGui::Spacing();
@@ -326,7 +1128,47 @@ void PathTracingApplication::RenderGUI()
                 invalidate = true;
             }
         }
+        ImGui::InputFloat("Time Budget (s)", &m_timeBudget);
         ImGui::Checkbox("Denoiser Enabled", (bool*)(&m_denoiserEnabled));
+
+        // Changes to the region start the accumulation over when the frame is updated
+        ImGui::Checkbox("Render Region", (bool*)(&m_renderRegionEnabled));
+        if (m_renderRegionEnabled)
+        {
+            ImGui::InputInt4("Region (x, y, w, h)", &m_renderRegionRect[0]);
+            ImGui::Checkbox("Region Follows Cursor", (bool*)(&m_renderRegionFollowsCursor));
+        }
+
+        // Only changes how many samples a frame renders, so nothing needs to be invalidated
+        ImGui::Checkbox("Frame Time Budget", (bool*)(&m_frameTimeBudgetEnabled));
+        if (m_frameTimeBudgetEnabled)
+        {
+            // 0 renders all remaining samples in one frame, for batch renders
+            float targetMilliseconds = m_sampleScheduler.GetTargetMilliseconds();
+            if (ImGui::SliderFloat("Frame Budget (ms)", &targetMilliseconds, 0.0f, 100.0f))
+            {
+                m_sampleScheduler.SetTargetMilliseconds(targetMilliseconds);
+            }
+        }
+
+        // Only applies while the camera moves, so nothing needs to be invalidated
+        ImGui::Checkbox("Dynamic Resolution", (bool*)(&m_dynamicResolutionEnabled));
+        if (m_dynamicResolutionEnabled)
+        {
+            float targetMilliseconds = m_dynamicResolution.GetTargetMilliseconds();
+            if (ImGui::SliderFloat("Target Frame Time (ms)", &targetMilliseconds, 4.0f, 100.0f))
+            {
+                m_dynamicResolution.SetTargetMilliseconds(targetMilliseconds);
+            }
+        }
+
+        invalidate |= ImGui::Checkbox("Adaptive Sampling", (bool*)(&m_adaptiveSamplingEnabled));
+        if (m_adaptiveSamplingEnabled)
+        {
+            invalidate |= ImGui::SliderFloat("Noise Threshold", &m_noiseThreshold, 0.001f, 0.1f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            invalidate |= ImGui::InputInt("Min Sample Count", (int*)(&m_minSampleCount));
+        }
+        ImGui::Checkbox("Sample Heatmap", (bool*)(&m_sampleHeatmapEnabled));
         invalidate |= ImGui::Button("Invalidate Scene");
         //refresh |= ImGui::Checkbox("Use Rasterization as Preview", (bool*)(&m_shouldRasterizeAsPreview));
 
@@ -334,10 +1176,65 @@ void PathTracingApplication::RenderGUI()
         ImGui::Separator();
         ImGui::Spacing();
 
-        const char* hdriItems[] = { "Autumn Field", "Black", "Brown Photostudio", "Chinese Garden", "Evening Road", "Meadow", "Symmetrical Garden"};
+        const char* backendItems[] = { "GPU", "CPU" };
+        int currentBackendItem = static_cast<int>(m_currentPathTracingBackend);
+
+        if (ImGui::Combo("Select Backend", &currentBackendItem, backendItems, IM_ARRAYSIZE(backendItems)))
+        {
+            m_currentPathTracingBackend = static_cast<PathTracingBackend>(currentBackendItem);
+
+            refresh = true;
+        }
+
+        if (GetCpuBackendEnabled())
+        {
+            const char* integratorItems[] = { "Path Tracing", "Bidirectional" };
+            int currentIntegratorItem = static_cast<int>(m_currentPathTracingIntegrator);
+
+            if (ImGui::Combo("Select Integrator", &currentIntegratorItem, integratorItems, IM_ARRAYSIZE(integratorItems)))
+            {
+                m_currentPathTracingIntegrator = static_cast<PathTracingIntegrator>(currentIntegratorItem);
+
+                invalidate = true;
+            }
+
+            bool batchedShadingEnabled = m_pathTracingRenderer->GetCpuBackend()->GetBatchedShadingEnabled();
+            if (ImGui::Checkbox("Batched Shading", &batchedShadingEnabled))
+            {
+                m_pathTracingRenderer->GetCpuBackend()->SetBatchedShadingEnabled(batchedShadingEnabled);
+
+                invalidate = true;
+            }
+
+            // Only changes how many texture tiles stay in memory, not the image
+            int textureCacheMegabytes = (int)(m_pathTracingRenderer->GetCpuBackend()->GetTextureCacheBudget() >> 20);
+            if (ImGui::InputInt("Texture Cache (MB)", &textureCacheMegabytes, 16, 256))
+            {
+                m_pathTracingRenderer->GetCpuBackend()->SetTextureCacheBudget((size_t)std::max(textureCacheMegabytes, 1) << 20);
+            }
+
+            invalidate |= ImGui::Checkbox("Path Guiding", (bool*)(&m_pathGuidingEnabled));
+            invalidate |= ImGui::Checkbox("Reservoir Resampling", (bool*)(&m_reservoirResamplingEnabled));
+            invalidate |= ImGui::Checkbox("Caustic Photons", (bool*)(&m_causticPhotonsEnabled));
+            invalidate |= ImGui::Checkbox("Radiance Cache", (bool*)(&m_radianceCacheEnabled));
+            invalidate |= ImGui::Checkbox("Adjoint Russian Roulette", (bool*)(&m_adjointRussianRouletteEnabled));
+            invalidate |= ImGui::Checkbox("Metropolis", (bool*)(&m_metropolisEnabled));
+            invalidate |= ImGui::Checkbox("Temporal Reprojection", (bool*)(&m_temporalReprojectionEnabled));
+        }
+
+        const char* samplerItems[] = { "PCG", "Sobol", "Sobol Blue Noise" };
+        int currentSamplerItem = static_cast<int>(m_currentPathTracingSampler);
+
+        if (ImGui::Combo("Select Sampler", &currentSamplerItem, samplerItems, IM_ARRAYSIZE(samplerItems)))
+        {
+            m_currentPathTracingSampler = static_cast<PathTracingSampler>(currentSamplerItem);
+
+            invalidate = true;
+        }
+
         int currentHdriItem = static_cast<int>(m_currentPathTracingHdri);
 
-        if (ImGui::Combo("Select HDRI", &currentHdriItem, hdriItems, IM_ARRAYSIZE(hdriItems)))
+        if (ImGui::Combo("Select HDRI", &currentHdriItem, HdriNames, IM_ARRAYSIZE(HdriNames)))
         {
             m_currentPathTracingHdri = static_cast<PathTracingHdri>(currentHdriItem);
             ProcessHdri(true);
@@ -345,10 +1242,9 @@ void PathTracingApplication::RenderGUI()
             refresh = true;
         }
 
-        const char* sceneItems[] = { "Area Light", "Fireplace", "Mill", "Sponza", "Sponza Reduced", "Bunny Dielectric", "Bunny Metallic", "Bunny Glass", "Bunny Clearcoat", "Dragon Dielectric", "Dragon Metallic", "Dragon Glass", "Dragon Clearcoat" };
         int currentSceneItem = static_cast<int>(m_currentPathTracingScene);
 
-        if (ImGui::Combo("Select Scene", &currentSceneItem, sceneItems, IM_ARRAYSIZE(sceneItems)))
+        if (ImGui::Combo("Select Scene", &currentSceneItem, SceneNames, IM_ARRAYSIZE(SceneNames)))
         {
             m_currentPathTracingScene = static_cast<PathTracingScene>(currentSceneItem);
             ProcessScene();
@@ -361,10 +1257,18 @@ void PathTracingApplication::RenderGUI()
         ImGui::Spacing();
 
         invalidate |= ImGui::Checkbox("Anti-Aliasing", (bool*)(&m_AntiAliasingEnabled));
+        invalidate |= ImGui::Checkbox("Emissive Light Sampling", (bool*)(&m_emissiveSamplingEnabled));
+        invalidate |= ImGui::Checkbox("Light Tree", (bool*)(&m_lightTreeEnabled));
         ImGui::SliderFloat("Exposure", (float*)(&m_exposure), 0.0f, 10.0f);
 
         ImGui::Spacing();
 
+        // .exr keeps all layers of the render, .png is tonemapped with the exposure, anything else is written as .pfm
+        ImGui::InputText("Save Path", m_savePath, sizeof(m_savePath));
+        m_saveRequested |= ImGui::Button("Save Render");
+
+        ImGui::Spacing();
+
         invalidate |= ImGui::SliderFloat("Focal Length", (float*)(&m_focalLength), 0.0f, 15.0f);
         invalidate |= ImGui::SliderFloat("Aperture Size", (float*)(&m_apertureSize), 0.0f, 1.0f);
         invalidate |= ImGui::SliderFloat2("Aperture Shape", (float*)(&m_apertureShape), 0.0f, 1.0f);
@@ -404,32 +1308,39 @@ void PathTracingApplication::RenderGUI()
 
 void PathTracingApplication::ProcessHdri(bool processEnvironmentBuffer)
 {
-    switch (m_currentPathTracingHdri)
-    {
-    case PathTracingHdri::AutumnField:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/AutumnField.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    case PathTracingHdri::Black:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/Black.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    case PathTracingHdri::BrownPhotostudio:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/BrownPhotostudio.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    case PathTracingHdri::ChineseGarden:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/ChineseGarden.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    case PathTracingHdri::EveningRoad:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/EveningRoad.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    case PathTracingHdri::Meadow:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/Meadow.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    case PathTracingHdri::SymmetricalGarden:
-        m_hdri = Texture2DLoader::LoadTextureShared("Content/HDRI/SymmetricalGarden.hdr", TextureObject::FormatRGB, TextureObject::InternalFormatRGB32F);
-        break;
-    default:
-        throw std::runtime_error("No such Path Tracing Hdri...");
-    };
+    std::string path = m_hdriPath;
+    if (path.empty())
+    {
+        switch (m_currentPathTracingHdri)
+        {
+        case PathTracingHdri::AutumnField:
+            path = "Content/HDRI/AutumnField.hdr";
+            break;
+        case PathTracingHdri::Black:
+            path = "Content/HDRI/Black.hdr";
+            break;
+        case PathTracingHdri::BrownPhotostudio:
+            path = "Content/HDRI/BrownPhotostudio.hdr";
+            break;
+        case PathTracingHdri::ChineseGarden:
+            path = "Content/HDRI/ChineseGarden.hdr";
+            break;
+        case PathTracingHdri::EveningRoad:
+            path = "Content/HDRI/EveningRoad.hdr";
+            break;
+        case PathTracingHdri::Meadow:
+            path = "Content/HDRI/Meadow.hdr";
+            break;
+        case PathTracingHdri::SymmetricalGarden:
+            path = "Content/HDRI/SymmetricalGarden.hdr";
+            break;
+        default:
+            throw std::runtime_error("No such Path Tracing Hdri...");
+        };
+    }
+
+    // The loader keeps the HDRIs it loaded, so going back to one does not decode it again
+    m_hdri = m_hdriLoader.LoadShared(path.c_str());
 
     // Once a Hdri has been chosen process the environment buffer for renderer
     // This function calls application
@@ -445,50 +1356,57 @@ void PathTracingApplication::ProcessScene()
     m_pathTracingRenderer->ClearPathTracingModels();
 
     Scene scene;
-    switch (m_currentPathTracingScene)
-    {
-    case PathTracingScene::AreaLight:
-        scene = LoadAreaLightScene();
-        break;
-    case PathTracingScene::Fireplace:
-        scene = LoadFireplaceScene();
-        break;
-    case PathTracingScene::Mill:
-        scene = LoadMillScene();
-        break;
-    case PathTracingScene::Sponza:
-        scene = LoadSponzaScene();
-        break;
-    case PathTracingScene::SponzaReduced:
-        scene = LoadSponzaReducedScene();
-        break;
-    case PathTracingScene::BunnyDielectric:
-        scene = LoadBunnyDielectricScene();
-        break;
-    case PathTracingScene::BunnyMetallic:
-        scene = LoadBunnyMetallicScene();
-        break;
-    case PathTracingScene::BunnyGlass:
-        scene = LoadBunnyGlassScene();
-        break;
-    case PathTracingScene::BunnyClearcoat:
-        scene = LoadBunnyClearcoatScene();
-        break;
-    case PathTracingScene::DragonDielectric:
-        scene = LoadDragonDielectricScene();
-        break;
-    case PathTracingScene::DragonMetallic:
-        scene = LoadDragonMetallicScene();
-        break;
-    case PathTracingScene::DragonGlass:
-        scene = LoadDragonGlassScene();
-        break;
-    case PathTracingScene::DragonClearcoat:
-        scene = LoadDragonClearcoatScene();
-        break;
-    default:
-        throw std::runtime_error("No such Path Tracing scene...");
-    };
+    if (!m_scenePath.empty())
+    {
+        scene = LoadModelScene(m_scenePath);
+    }
+    else
+    {
+        switch (m_currentPathTracingScene)
+        {
+        case PathTracingScene::AreaLight:
+            scene = LoadAreaLightScene();
+            break;
+        case PathTracingScene::Fireplace:
+            scene = LoadFireplaceScene();
+            break;
+        case PathTracingScene::Mill:
+            scene = LoadMillScene();
+            break;
+        case PathTracingScene::Sponza:
+            scene = LoadSponzaScene();
+            break;
+        case PathTracingScene::SponzaReduced:
+            scene = LoadSponzaReducedScene();
+            break;
+        case PathTracingScene::BunnyDielectric:
+            scene = LoadBunnyDielectricScene();
+            break;
+        case PathTracingScene::BunnyMetallic:
+            scene = LoadBunnyMetallicScene();
+            break;
+        case PathTracingScene::BunnyGlass:
+            scene = LoadBunnyGlassScene();
+            break;
+        case PathTracingScene::BunnyClearcoat:
+            scene = LoadBunnyClearcoatScene();
+            break;
+        case PathTracingScene::DragonDielectric:
+            scene = LoadDragonDielectricScene();
+            break;
+        case PathTracingScene::DragonMetallic:
+            scene = LoadDragonMetallicScene();
+            break;
+        case PathTracingScene::DragonGlass:
+            scene = LoadDragonGlassScene();
+            break;
+        case PathTracingScene::DragonClearcoat:
+            scene = LoadDragonClearcoatScene();
+            break;
+        default:
+            throw std::runtime_error("No such Path Tracing scene...");
+        };
+    }
 
     // Add the scene nodes to the pathtracing renderer
     PathTracingRendererSceneVisitor pathTracingRendererSceneVisitor(m_pathTracingRenderer);
@@ -737,3 +1655,13 @@ Scene PathTracingApplication::LoadDragonClearcoatScene()
 
     return testScene1;
 }
+
+Scene PathTracingApplication::LoadModelScene(const std::string& path)
+{
+    std::shared_ptr<Model> model = m_modelLoader->LoadShared(path.c_str());
+
+    Scene modelScene;
+    modelScene.AddSceneNode(std::make_shared<SceneModel>("model", model));
+
+    return modelScene;
+}
@@ -4,6 +4,14 @@
 
 #include "Camera/CameraController.h"
 #include "Utils/DearImGui.h"
+#include "Asset/Texture2DLoader.h"
+#include "BatchJob.h"
+#include "DynamicResolution.h"
+#include "ImageWriter.h"
+#include "RenderServer.h"
+#include "SampleScheduler.h"
+#include "SharedFilm.h"
+#include <deque>
 #include <vector>
 
 class Scene;
@@ -17,7 +25,10 @@ class Renderer;
 class PathTracingApplication : public Application
 {
 public:
-    PathTracingApplication();
+    // Without batch jobs or a render server the application is interactive
+    // With them it renders each job to its outputs in a hidden window, and exits after the last one unless it serves
+    // Either way a shared film name publishes every frame to shared memory, see SharedFilm
+    PathTracingApplication(std::vector<BatchJob> batchJobs = { }, std::unique_ptr<RenderServer> renderServer = nullptr, const std::string& sharedFilmName = std::string());
 
 protected:
     void Initialize() override;
@@ -31,12 +42,57 @@ private:
 
     void UpdateMaterial(const Camera& camera, int width, int height);
 
+    // Size of the film at full resolution, the window or the resolution of the current batch job
+    glm::ivec2 GetFullDimensions() const;
+
     void RefreshScene();
-    void InvalidateScene();
+    // Camera only invalidations let the CPU backend reproject the accumulation instead of starting over
+    void InvalidateScene(bool cameraOnly = false);
 
     void RenderGUI();
 
+    // Finishes the current batch job once its accumulation stopped and starts the next one
+    void UpdateBatch();
+    // False with a message if an asset of the job cannot be found
+    bool StartBatchJob(const BatchJob& job, std::string& error);
+    void FinishBatchJob();
+    // Prints a line about the current batch job, and sends it to the client of the job
+    void ReportBatch(const std::string& message);
+    // Same for a job that may have finished already, from any thread
+    static void ReportBatch(const RenderServer::Request& request, const std::string& message);
+    // Queues the accumulation of the current batch job to be saved to its checkpoint by the image writer
+    // The flag, if any, is cleared on the writer's thread if the checkpoint cannot be written
+    void SaveBatchCheckpoint(std::shared_ptr<bool> written = nullptr);
+
+    // Queues the frames of the animation of the current request, which render as batch jobs of their own
+    void StartAnimation();
+    // Reports the pipeline of the animation once its last frame is written
+    void FinishAnimationFrame();
+    // Waits for the image writer to be done with the outputs of the previous frame, counting the time as a stall of the pipeline
+    void WaitForAnimationOutputs();
+
 private:
+    enum PathTracingBackend
+    {
+        Gpu,
+        Cpu,
+    };
+
+    // Same order as Sampler::Type
+    enum PathTracingSampler
+    {
+        Pcg,
+        Sobol,
+        SobolBlueNoise,
+    };
+
+    // Same order as PathTracingCpuBackend::Integrator
+    enum PathTracingIntegrator
+    {
+        PathTracing,
+        Bidirectional,
+    };
+
     enum PathTracingHdri
     {
         AutumnField,
@@ -81,6 +137,7 @@ private:
     Scene LoadDragonMetallicScene();
     Scene LoadDragonGlassScene();
     Scene LoadDragonClearcoatScene();
+    Scene LoadModelScene(const std::string& path);
 
 public:
     const bool GetShouldPathTrace() const { return m_shouldPathTrace; }
@@ -95,11 +152,45 @@ public:
 
     const bool GetDenoiserEnabled() const { return m_denoiserEnabled; }
 
+    const bool GetCpuBackendEnabled() const { return m_currentPathTracingBackend == PathTracingBackend::Cpu; }
+
+    const unsigned int GetFrameCount() const { return m_frameCount; }
+    const float GetRenderTime() const { return m_renderTime; }
+    const unsigned int GetMaxFrameCount() const { return m_maxFrameCount; }
+
+    // Samples per pixel of this frame, the first of them is the one of the frame count
+    const unsigned int GetFrameSampleCount() const { return m_frameSampleCount; }
+
+    // Samples a frame rendered and the time they took, measured by the render pass. GPU times arrive a few frames late
+    void SetFrameTiming(unsigned int sampleCount, float milliseconds);
+    // Samples the last frame rendered, counted right away
+    void AddFrameSamples(unsigned int sampleCount);
+
+    // Pixels rendered this frame, smaller than the window while dynamic resolution is active
+    const glm::ivec2 GetRenderDimensions() const { return m_renderDimensions; }
+
+    // Min and max corner of the pixels rendered this frame, within the render dimensions
+    const glm::ivec4 GetRenderRegion() const { return m_renderRegion; }
+
+    const bool GetAdaptiveSamplingEnabled() const { return m_adaptiveSamplingEnabled; }
+    const bool GetSampleHeatmapEnabled() const { return m_sampleHeatmapEnabled; }
+
+    const float GetExposure() const { return m_exposure; }
+
+    void SetActivePixelCount(unsigned int value);
+
     const float GetDebugValueA() const { return m_debugValueA; }
     const float GetDebugValueB() const { return m_debugValueB; }
 
     const std::shared_ptr<Texture2DObject> GetHdri() { return m_hdri; }
 
+    // Path of the render the GUI asked to save, taken once by the render pass that reads back the film. False without a request
+    bool TakeSaveRequest(std::string& path);
+    ImageWriter& GetImageWriter() { return m_imageWriter; }
+
+    // Null unless frames are published to shared memory
+    SharedFilm* GetSharedFilm() { return m_sharedFilm.IsOpen() ? &m_sharedFilm : nullptr; }
+
 private:
     // Helper object for debug GUI
     DearImGui m_imGui;
@@ -108,9 +199,78 @@ private:
     unsigned int m_maxFrameCount = 50;          // Total rendered amount of frames
     //bool m_shouldRasterizeAsPreview = false;    // If this is enabled, we would render the models in rasterization instead of raytracing for scene invalidation (when camera is enabled)
     bool m_denoiserEnabled = false;             // Denoiser enabled for the rendered image
+    float m_timeBudget = 0.0f;                  // Seconds of accumulation after which rendering stops, 0 for no limit so it never cuts a render short unasked
+
+    // Dynamic resolution
+    bool m_dynamicResolutionEnabled = false;    // Render at a reduced resolution while the camera moves, full resolution accumulation once it stops
+    DynamicResolution m_dynamicResolution;      // Picks the resolution from the frame time
+    glm::ivec2 m_renderDimensions = glm::ivec2(0);
+
+    // Render region
+    bool m_renderRegionEnabled = false;                     // Only render the pixels of the region, the others keep their accumulation
+    bool m_renderRegionFollowsCursor = false;               // Center the region on the mouse cursor, while it is not over the GUI
+    glm::ivec4 m_renderRegionRect = glm::ivec4(0, 0, 256, 256);    // Position and size of the region in window pixels, from the bottom left
+    glm::ivec4 m_renderRegion = glm::ivec4(0);              // Min and max corner of the rendered pixels, in render dimensions
+
+    // Batch mode
+    bool m_batchMode = false;
+    std::vector<BatchJob> m_batchJobs;          // Rendered one after another, before any job of the render server
+    size_t m_batchJobIndex = 0;
+    std::unique_ptr<RenderServer> m_renderServer;
+    RenderServer::Request m_batchRequest;       // Current job, and the client waiting for it if it came from the render server
+    bool m_batchJobStarted = false;
+    unsigned int m_batchSampleCount = 0;        // Samples per pixel the current job has rendered so far
+    float m_batchReportTime = 0.0f;             // Accumulation time of the next progress line
+    float m_batchCheckpointTime = 0.0f;         // Accumulation time of the next checkpoint
+    unsigned int m_resumedSampleCount = 0;      // Samples per pixel of the checkpoint the current job resumed, the frame count starts over on top of them
+    unsigned int m_seed = 0;                    // Of the samplers, independent renders of the same job take distinct seeds
+    glm::ivec2 m_batchResolution = glm::ivec2(0);   // Film of the current job, at most the size of the window
+    std::string m_scenePath;                    // Model file loaded instead of the chosen scene, if not empty
+    std::string m_hdriPath;                     // HDRI file loaded instead of the chosen HDRI, if not empty
+    std::string m_batchScene;                   // Scene and HDRI of the buffers processed by the last batch job
+    std::string m_batchHdri;
+    std::vector<std::string> m_warmScenes;      // Scenes of batch jobs whose assets the loaders keep
+
+    // Animation
+    // Frames render one after another on the loaded scene, while the image writer denoises and writes the previous frame
+    std::deque<BatchJob> m_animationFrames;     // Frames still to render
+    RenderServer::Request m_animationRequest;   // Animation job and the client waiting for it
+    unsigned int m_animationFrameCount = 0;     // Frames of the current animation, 0 while none renders
+    unsigned int m_animationFrame = 0;          // Frames finished so far
+    float m_animationStartTime = 0.0f;
+    float m_animationSteadyTime = 0.0f;         // Time the first frame finished, which loaded the scene, from then on frames are steady state
+    double m_animationBusySeconds = 0.0;        // Busy seconds of the image writer when the animation started
+    double m_animationStallSeconds = 0.0;       // Time frames waited for the image writer
+
+    // Image output
+    ImageWriter m_imageWriter;                  // Writes outputs while the next frames render, destroyed first so queued outputs reach their clients
+    char m_savePath[256] = "render.exr";        // Of the render saved from the GUI, the extension picks the format
+    bool m_saveRequested = false;
+    SharedFilm m_sharedFilm;                    // Frames for viewers of other processes, at most the size of the window
+
+    // Frame time budget
+    bool m_frameTimeBudgetEnabled = false;      // Render as many samples per frame as fit the target time, instead of one
+    SampleScheduler m_sampleScheduler;          // Picks the samples from the measured time per sample
+    unsigned int m_frameSampleCount = 1;        // Samples per pixel of the current frame
+    float m_frameMilliseconds = 0.0f;           // Path tracing time of the last rendered frame
+
+    // Adaptive sampling
+    bool m_adaptiveSamplingEnabled = false;     // Skip tiles whose pixels have converged, max frame count is still the cap
+    float m_noiseThreshold = 0.02f;             // Relative standard error a pixel has to reach to be converged
+    unsigned int m_minSampleCount = 16;         // Samples every pixel takes before it can converge
+    bool m_sampleHeatmapEnabled = false;        // Show the per-pixel sample count instead of the render
 
     // Settings
     bool m_AntiAliasingEnabled = true;                  // Whether path tracer should anti-aliase during rendering
+    bool m_emissiveSamplingEnabled = false;             // Whether emissive triangles are sampled directly, next to the HDRI. Off until compared at equal time
+    bool m_lightTreeEnabled = true;                     // Whether emissive triangles are picked by the light tree instead of by power only
+    bool m_pathGuidingEnabled = false;                  // Whether the CPU backend learns and samples the incident radiance. Opt-in, its gain over unguided sampling is unmeasured
+    bool m_reservoirResamplingEnabled = false;          // Whether the CPU backend resamples direct lighting of primary hits from reservoirs
+    bool m_causticPhotonsEnabled = false;               // Whether the CPU backend gathers caustics from a photon map. Opt-in, its convergence was never checked against the reference
+    bool m_radianceCacheEnabled = false;                // Whether the CPU backend terminates paths in a radiance cache. Biased at rough surfaces past the first bounce, by an amount not measured
+    bool m_adjointRussianRouletteEnabled = false;       // Whether the CPU backend plays Russian roulette and splits by expected contribution. Off, its error on Sponza and Mill is not measured yet
+    bool m_metropolisEnabled = false;                   // Whether the CPU path tracer mutates paths with primary sample space Metropolis
+    bool m_temporalReprojectionEnabled = false;         // Whether the CPU backend keeps the accumulation of visible surfaces when the camera moves
     float m_exposure = 1.0f;                            // Frame exposure. Can be tuned any time
     float m_focalLength = 3.5f;                         // Controls the Depth of Field's focus distance
     float m_apertureSize = 0.0f;                        // Controls the Depth of Field's strength
@@ -134,12 +294,20 @@ private:
     float m_debugValueB = 0.0f;
 
     unsigned int m_frameCount = 0;              // Current path tracing frame count
+    float m_renderTime = 0.0f;                  // Seconds spent on the current accumulation
     bool m_shouldPathTrace = false;             // Only render path tracing if frame count is below max
     bool m_shouldDenoise = false;               // We should only denoise once frame count has reached max
     float m_denoiseProgress = 0.0f;             // The progress 0..1 of the denoiser
     bool m_denoised = false;                    // Whether the fully converged render has been denoised
+    unsigned int m_activePixelCount = 0;        // Pixels that were still sampled in the last frame
+    bool m_converged = false;                   // Whether adaptive sampling has converged every pixel
+    bool m_cameraMoved = false;                 // Whether the camera moved since the last frame
+    bool m_sceneChanged = false;                // Whether anything but the camera invalidated the accumulation since the last frame
 
     // Current chosen data
+    PathTracingBackend m_currentPathTracingBackend = PathTracingBackend::Gpu;
+    PathTracingSampler m_currentPathTracingSampler = PathTracingSampler::Sobol;
+    PathTracingIntegrator m_currentPathTracingIntegrator = PathTracingIntegrator::PathTracing;    // Bidirectional only when picked, it has not been timed against path tracing
     PathTracingHdri m_currentPathTracingHdri = PathTracingHdri::BrownPhotostudio;
     PathTracingScene m_currentPathTracingScene = PathTracingScene::BunnyDielectric;
 
@@ -148,6 +316,7 @@ private:
 
     // HDRI texture
     std::shared_ptr<Texture2DObject> m_hdri;
+    Texture2DLoader m_hdriLoader;
 
     // Model loader
     std::shared_ptr<ModelLoader> m_modelLoader;
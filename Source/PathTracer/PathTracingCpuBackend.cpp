@@ -0,0 +1,3467 @@
+#include "PathTracingCpuBackend.h"
+
+#include "Texture/Texture2DObject.h"
+#include "Utils/Timer.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <mutex>
+#include <span>
+#include <thread>
+
+namespace
+{
+    constexpr float PI = 3.141592653589f;
+    constexpr float TWO_PI = 6.283185307178f;
+    constexpr float ONE_OVER_PI = 0.318309886183f;
+    constexpr float ONE_OVER_TWO_PI = 0.159154943091f;
+
+    constexpr float FLT_MAX_VALUE = 3.402823466e+38f;
+    constexpr float OneMinusEpsilon = 0.99999994f;
+
+    // -------------------------------------------------------------------------
+    //    Common utilities, see utility.glsl
+    // -------------------------------------------------------------------------
+
+    // Offsets the ray origin from current position P, along geometric normal N, so that no self-intersection can occur
+    glm::vec3 OffsetRay(const glm::vec3& P, const glm::vec3& N)
+    {
+        const float origin = 1.0f / 32.0f;
+        const float floatScale = 1.0f / 65536.0f;
+        const float intScale = 256.0f;
+
+        glm::vec3 result;
+        for (int i = 0; i < 3; i++)
+        {
+            int offset = int(intScale * N[i]);
+            float offsetP = std::bit_cast<float>(std::bit_cast<int>(P[i]) + ((P[i] < 0.0f) ? -offset : offset));
+            result[i] = std::abs(P[i]) < origin ? P[i] + floatScale * N[i] : offsetP;
+        }
+        return result;
+    }
+
+    // -------------------------------------------------------------------------
+    //    Triangle and AABB intersection, see intersection.glsl
+    // -------------------------------------------------------------------------
+
+    // Note: Triangle order matters! Must go counter-clock wise
+    bool RayTriangle(const PathTracingCpuBackend::Ray& ray, const BVH::BvhPrimitive& primitive, float& dst, float& u, float& v)
+    {
+        glm::vec3 edgeAB = primitive.posB - primitive.posA;
+        glm::vec3 edgeAC = primitive.posC - primitive.posA;
+        glm::vec3 normalVector = glm::cross(edgeAB, edgeAC);
+        glm::vec3 ao = ray.origin - primitive.posA;
+        glm::vec3 dao = glm::cross(ao, ray.direction);
+
+        float determinant = -glm::dot(ray.direction, normalVector);
+        float invDet = 1.0f / determinant;
+
+        dst = glm::dot(ao, normalVector) * invDet;
+        u = glm::dot(edgeAC, dao) * invDet;
+        v = -glm::dot(edgeAB, dao) * invDet;
+        float w = 1.0f - u - v;
+
+        return determinant >= 1e-10f && dst >= 0.0f && u >= 0.0f && v >= 0.0f && w >= 0.0f;
+    }
+
+    // Return distance at which the ray enters the AABB box, 0 if it starts inside and -1 if it misses
+    float HitAABB(const PathTracingCpuBackend::Ray& ray, const glm::vec3& invDirection, const glm::vec3& AA, const glm::vec3& BB)
+    {
+        glm::vec3 f = (BB - ray.origin) * invDirection;
+        glm::vec3 n = (AA - ray.origin) * invDirection;
+
+        glm::vec3 tmax = glm::max(f, n);
+        glm::vec3 tmin = glm::min(f, n);
+
+        float t1 = std::min(tmax.x, std::min(tmax.y, tmax.z));
+        float t0 = std::max(tmin.x, std::max(tmin.y, tmin.z));
+
+        return (t1 >= t0 && t1 >= 0.0f) ? std::max(t0, 0.0f) : -1.0f;
+    }
+
+    uint32_t Hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Random numbers of the reservoir and photon passes
+    // Independent of the path's sampler, so light candidates and photons do not correlate with the decisions of the path
+    struct PassRandom
+    {
+        uint32_t state;
+
+        PassRandom(size_t index, unsigned int frame, unsigned int pass, unsigned int seed)
+            : state(Hash((uint32_t)index ^ Hash(frame * 3u + pass) ^ (seed == 0 ? 0u : Hash(seed))))
+        {
+        }
+
+        // PCG, see montecarlo.glsl
+        float Next()
+        {
+            state = state * 747796405u + 2891336453u;
+            uint32_t result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+            result = (result >> 22) ^ result;
+            return float(result >> 8) * (1.0f / 16777216.0f);
+        }
+
+        glm::vec3 Next3D()
+        {
+            float R1 = Next();
+            float R2 = Next();
+            float R3 = Next();
+            return glm::vec3(R1, R2, R3);
+        }
+    };
+
+    // Scattering vertex of a guided path, its incident radiance is known once the path has ended
+    struct GuidingVertex
+    {
+        int leaf;                   // Spatial leaf of the vertex
+        glm::vec3 direction;        // Sampled direction
+        glm::vec3 radiance;         // Radiance the path had gathered before the direction was sampled
+        glm::vec3 throughput;       // Throughput after the direction was sampled
+        float pdf;                  // Density the direction was sampled with
+    };
+
+    // Diffuse hit of a path, its outgoing radiance is known once the path has ended
+    struct RadianceCacheVertex
+    {
+        uint64_t key;               // Radiance cache cell of the hit
+        glm::vec3 radiance;         // Radiance the path had gathered before shading the hit
+        glm::vec3 throughput;       // Throughput arriving at the hit
+    };
+}
+
+// -------------------------------------------------------------------------
+//    Tile state
+// -------------------------------------------------------------------------
+
+struct PathTracingCpuBackend::PathState
+{
+    Ray ray;
+    HitInfo hitInfo;
+    DisneyBrdf::Material material;
+
+    glm::vec3 radiance;
+    glm::vec3 throughput;
+    glm::vec3 f;
+    float pdfBrdf;
+
+    // Shading point of the previous bounce, for the light tree probability of emissive hits
+    glm::vec3 previousPosition;
+    glm::vec3 previousNormal;
+
+    glm::vec3 primaryAlbedo;
+    glm::vec3 primaryNormal;
+
+    // Light sample of the current bounce
+    glm::vec3 lightDirection;
+    bool lightVisible;
+
+    // Emissive triangle sample of the current bounce
+    glm::vec3 emissiveDirection;
+    glm::vec3 emissiveRadiance;
+    float emissivePdf;
+    bool emissiveVisible;
+
+    // Path guiding, the tree is null when the current hit is not guided
+    int guidingLeaf;
+    const PathGuiding::DirectionalTree* guidingTree;
+    std::array<GuidingVertex, MaxBounceCount> guidingVertices;
+    int guidingVertexCount;
+
+    // Direct lighting of the primary hit, resampled from the reservoirs
+    glm::vec3 reservoirRadiance;    // Radiance of the reservoir sample, times geometry term and contribution weight
+    bool directLightingReused;      // The next hit must not add light the reservoirs already accounted for
+
+    // Diffuse hits, which record their outgoing radiance into the radiance cache
+    std::array<RadianceCacheVertex, MaxBounceCount> radianceCacheVertices;
+    int radianceCacheVertexCount;
+
+    // Caustics are gathered from the photon map at the first non-specular hit
+    bool causticGathered;
+    int causticChain;               // Specular hits since the gather, -1 once a non-specular hit ends the chain
+
+    // Footprint for texture filtering
+    RayCone rayCone;
+
+    Sampler sampler;
+    size_t pixel;
+    int parentLane;                 // Path a split copy adds its radiance to, -1 for the paths of the pixels
+    int splitIndex;                 // Copy of the path, 0 for the paths of the pixels
+    bool alive;
+};
+
+struct PathTracingCpuBackend::TileState
+{
+    // Split copies of the paths follow after the paths of the pixels
+    static constexpr int MaxPathCount = TileSize * TileSize * MaxSplitCount;
+
+    std::array<PathState, MaxPathCount> paths;
+    std::array<int, MaxPathCount> lanes;
+    DisneyBrdf::ShadingBatch batch;
+
+    unsigned int workerIndex = 0;   // Worker owning the tile state, selects its splat buffer
+
+    // Primary sample vectors of the Metropolis lanes
+    std::array<std::array<float, MetropolisSampleCount>, TileSize * TileSize> primarySamples;
+
+    long long shadingNanoseconds = 0;
+    long long shadedHits = 0;
+
+    long long rayCount = 0;
+    long long pathCount = 0;
+    long long radianceCacheTerminations = 0;
+
+    // Luminance of the Metropolis large steps, which refines the normalization
+    double metropolisLuminanceSum = 0.0;
+    long long metropolisLuminanceCount = 0;
+};
+
+struct PathTracingCpuBackend::BidirectionalVertex
+{
+    enum Type
+    {
+        Camera,
+        Light,      // Point on an emissive triangle, which starts a light subpath
+        Surface,
+    };
+
+    Type type = Surface;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);             // Shading normal, the emitting side for lights
+    glm::vec3 geometryNormal = glm::vec3(0.0f);
+
+    DisneyBrdf::Material material;
+    unsigned int lobes = 0;
+    unsigned int emissiveIndex = 0xffffffff;        // Emissive triangle of lights and of surfaces hit on one
+    glm::vec3 emission = glm::vec3(0.0f);           // Emitted radiance of lights
+
+    glm::vec3 throughput = glm::vec3(0.0f);
+    float pdfFwd = 0.0f;                            // Area density of sampling the vertex from its predecessor in the subpath
+    float pdfRev = 0.0f;                            // Area density of sampling the vertex from its successor, as the other subpath would
+
+    // Converts a solid angle density at this vertex into an area density at the next vertex
+    float ConvertDensity(float pdf, const BidirectionalVertex& next) const
+    {
+        glm::vec3 offset = next.position - position;
+        float distanceSquared = glm::dot(offset, offset);
+        if (distanceSquared <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        // The pinhole camera is a point, only surfaces are foreshortened
+        if (next.type != Camera)
+        {
+            pdf *= std::abs(glm::dot(next.geometryNormal, offset)) / std::sqrt(distanceSquared);
+        }
+        return pdf / distanceSquared;
+    }
+};
+
+// -------------------------------------------------------------------------
+//    Textures
+// -------------------------------------------------------------------------
+
+glm::vec4 PathTracingCpuBackend::Texture::Fetch(int x, int y) const
+{
+    size_t index = (size_t)y * width + x;
+    if (!hdrTexels.empty())
+    {
+        return glm::vec4(hdrTexels[index * 3 + 0], hdrTexels[index * 3 + 1], hdrTexels[index * 3 + 2], 1.0f);
+    }
+
+    const unsigned char* texel = &ldrTexels[index * 4];
+    if (srgb)
+    {
+        return glm::vec4(TextureCache::SrgbToLinear(texel[0]), TextureCache::SrgbToLinear(texel[1]), TextureCache::SrgbToLinear(texel[2]), texel[3] / 255.0f);
+    }
+    return glm::vec4(texel[0], texel[1], texel[2], texel[3]) / 255.0f;
+}
+
+glm::vec4 PathTracingCpuBackend::Texture::Sample(const glm::vec2& uv) const
+{
+    if (width == 0 || height == 0)
+    {
+        return glm::vec4(0.0f);
+    }
+
+    // Bilinear filtering with repeat wrapping, texel centers at half integers
+    float x = uv.x * width - 0.5f;
+    float y = uv.y * height - 0.5f;
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float tx = x - fx;
+    float ty = y - fy;
+
+    auto wrap = [](int value, int size) { int result = value % size; return result < 0 ? result + size : result; };
+    int x0 = wrap((int)fx, width);
+    int y0 = wrap((int)fy, height);
+    int x1 = wrap(x0 + 1, width);
+    int y1 = wrap(y0 + 1, height);
+
+    glm::vec4 bottom = glm::mix(Fetch(x0, y0), Fetch(x1, y0), tx);
+    glm::vec4 top = glm::mix(Fetch(x0, y1), Fetch(x1, y1), tx);
+    return glm::mix(bottom, top, ty);
+}
+
+bool PathTracingCpuBackend::ReadbackTexture(Texture2DObject& textureObject, Texture& texture, int level)
+{
+    textureObject.Bind();
+
+    // Textures without mipmaps report a width of 0 for their other levels
+    GLint internalFormat;
+    textureObject.GetParameter(0, TextureObject::ParameterInt::InternalFormat, internalFormat);
+    textureObject.GetParameter(level, TextureObject::ParameterInt::Width, texture.width);
+    textureObject.GetParameter(level, TextureObject::ParameterInt::Height, texture.height);
+
+    texture.ldrTexels.clear();
+    texture.hdrTexels.clear();
+
+    size_t texelCount = (size_t)texture.width * texture.height;
+    if (texelCount == 0)
+    {
+        textureObject.Unbind();
+        return false;
+    }
+
+    if (internalFormat == GL_RGB32F || internalFormat == GL_RGBA32F || internalFormat == GL_RGB16F || internalFormat == GL_RGBA16F)
+    {
+        texture.hdrTexels.resize(texelCount * 3);
+        textureObject.GetTextureData(level, TextureObject::Format::FormatRGB, Data::Type::Float, texture.hdrTexels.data());
+    }
+    else
+    {
+        // sRGB textures are returned encoded, they are decoded when fetched
+        texture.srgb = internalFormat == GL_SRGB8 || internalFormat == GL_SRGB8_ALPHA8;
+        texture.ldrTexels.resize(texelCount * 4);
+        textureObject.GetTextureData(level, TextureObject::Format::FormatRGBA, Data::Type::UByte, texture.ldrTexels.data());
+    }
+
+    textureObject.Unbind();
+    return true;
+}
+
+void PathTracingCpuBackend::ResolveTextures()
+{
+    if (!m_texturesDirty && !m_environmentDirty)
+    {
+        return;
+    }
+
+    Timer timer("CPU Texture Readback");
+
+    // Material textures are converted one level at a time into tiles of the cache, so no texture stays in memory as a whole
+    // The mip levels are the ones GL generated, so both backends filter the same texels
+    if (m_texturesDirty)
+    {
+        m_textureCache->Reset();
+        for (size_t i = 0; i < m_textureObjects.size(); i++)
+        {
+            Texture level;
+            bool hasLevel = ReadbackTexture(*m_textureObjects[i], level);
+
+            int texture = m_textureCache->AddTexture(!level.hdrTexels.empty(), level.srgb);
+            for (int levelIndex = 1; hasLevel; levelIndex++)
+            {
+                m_textureCache->AddLevel(texture, level.width, level.height, level.hdrTexels.empty() ? (const void*)level.ldrTexels.data() : (const void*)level.hdrTexels.data());
+
+                if (level.width <= 1 && level.height <= 1)
+                {
+                    break;
+                }
+                hasLevel = ReadbackTexture(*m_textureObjects[i], level, levelIndex);
+            }
+        }
+    }
+
+    if (m_environmentDirty)
+    {
+        m_hdri = Texture();
+        m_hdriCache = Texture();
+        if (m_hdriObject && m_hdriCacheObject)
+        {
+            ReadbackTexture(*m_hdriObject, m_hdri);
+            ReadbackTexture(*m_hdriCacheObject, m_hdriCache);
+        }
+    }
+
+    timer.Stop();
+    timer.Print();
+
+    m_texturesDirty = false;
+    m_environmentDirty = false;
+}
+
+// -------------------------------------------------------------------------
+//    Scene data
+// -------------------------------------------------------------------------
+
+PathTracingCpuBackend::PathTracingCpuBackend(int width, int height)
+    : m_width(width), m_height(height), m_maxWidth(width), m_maxHeight(height)
+{
+    m_radiance.resize((size_t)width * height, glm::vec4(0.0f));
+    m_primaryAlbedo.resize((size_t)width * height, glm::vec4(0.0f));
+    m_primaryNormal.resize((size_t)width * height, glm::vec4(0.0f));
+    m_sampleStats.resize((size_t)width * height, glm::vec4(0.0f));
+    m_sums.resize((size_t)width * height);
+}
+
+void PathTracingCpuBackend::ProcessEnvironment(std::shared_ptr<Texture2DObject> hdri, std::shared_ptr<Texture2DObject> hdriCache)
+{
+    m_hdriObject = hdri;
+    m_hdriCacheObject = hdriCache;
+    m_environmentDirty = true;
+}
+
+void PathTracingCpuBackend::ProcessMaterials(std::vector<MaterialData> materials, std::vector<std::shared_ptr<Texture2DObject>> textures)
+{
+    m_materials = std::move(materials);
+    m_textureObjects = std::move(textures);
+    m_texturesDirty = true;
+}
+
+void PathTracingCpuBackend::ProcessBvhNodes(std::vector<BVH::BvhNode> bvhNodes)
+{
+    m_bvhNodes = std::move(bvhNodes);
+
+    // The guiding spatial tree subdivides the bounds of the root node
+    m_pathGuiding.Reset(m_bvhNodes[0].AA, m_bvhNodes[0].BB);
+}
+
+void PathTracingCpuBackend::ProcessBvhPrimitives(std::vector<BVH::BvhPrimitive> bvhPrimitives)
+{
+    m_bvhPrimitives = std::move(bvhPrimitives);
+}
+
+void PathTracingCpuBackend::ProcessEmissiveTriangles(std::vector<EmissiveTriangle> emissiveTriangles)
+{
+    m_emissiveTriangles = std::move(emissiveTriangles);
+
+    // Reservoirs may refer to triangles that no longer exist
+    m_reservoirHistoryValid = false;
+}
+
+void PathTracingCpuBackend::ProcessLightTree(std::vector<LightTree::LightTreeNode> lightTreeNodes)
+{
+    m_lightTreeNodes = std::move(lightTreeNodes);
+}
+
+std::unique_ptr<PathTracingCpuBackend::SceneData> PathTracingCpuBackend::TakeScene()
+{
+    std::unique_ptr<SceneData> scene = std::make_unique<SceneData>();
+    scene->bvhNodes = std::move(m_bvhNodes);
+    scene->bvhPrimitives = std::move(m_bvhPrimitives);
+    scene->materials = std::move(m_materials);
+    scene->emissiveTriangles = std::move(m_emissiveTriangles);
+    scene->lightTreeNodes = std::move(m_lightTreeNodes);
+    scene->textureObjects = std::move(m_textureObjects);
+    scene->texturesDirty = m_texturesDirty;
+
+    // The taken cache gives its tiles up, only the active one may hold the budget
+    const size_t budget = m_textureCache->GetBudget();
+    scene->textureCache = std::move(m_textureCache);
+    scene->textureCache->SetBudget(0);
+    m_textureCache = std::make_unique<TextureCache>();
+    m_textureCache->SetBudget(budget);
+
+    m_bvhNodes.clear();
+    m_bvhPrimitives.clear();
+    m_materials.clear();
+    m_emissiveTriangles.clear();
+    m_lightTreeNodes.clear();
+    m_textureObjects.clear();
+    m_texturesDirty = false;
+    m_reservoirHistoryValid = false;
+
+    return scene;
+}
+
+void PathTracingCpuBackend::RestoreScene(std::unique_ptr<SceneData> scene)
+{
+    m_bvhNodes = std::move(scene->bvhNodes);
+    m_bvhPrimitives = std::move(scene->bvhPrimitives);
+    m_materials = std::move(scene->materials);
+    m_emissiveTriangles = std::move(scene->emissiveTriangles);
+    m_lightTreeNodes = std::move(scene->lightTreeNodes);
+    m_textureObjects = std::move(scene->textureObjects);
+    m_texturesDirty = scene->texturesDirty;
+
+    const size_t budget = m_textureCache->GetBudget();
+    m_textureCache = std::move(scene->textureCache);
+    m_textureCache->SetBudget(budget);
+
+    // Same as processing the scene anew, nothing learned from another scene applies
+    if (!m_bvhNodes.empty())
+    {
+        m_pathGuiding.Reset(m_bvhNodes[0].AA, m_bvhNodes[0].BB);
+    }
+    m_reservoirHistoryValid = false;
+}
+
+std::unique_ptr<PathTracingCpuBackend::EnvironmentData> PathTracingCpuBackend::TakeEnvironment()
+{
+    std::unique_ptr<EnvironmentData> environment = std::make_unique<EnvironmentData>();
+    environment->hdriObject = std::move(m_hdriObject);
+    environment->hdriCacheObject = std::move(m_hdriCacheObject);
+    environment->hdri = std::move(m_hdri);
+    environment->hdriCache = std::move(m_hdriCache);
+    environment->dirty = m_environmentDirty;
+
+    m_hdriObject = nullptr;
+    m_hdriCacheObject = nullptr;
+    m_hdri = Texture();
+    m_hdriCache = Texture();
+    m_environmentDirty = false;
+
+    return environment;
+}
+
+void PathTracingCpuBackend::RestoreEnvironment(std::unique_ptr<EnvironmentData> environment)
+{
+    m_hdriObject = std::move(environment->hdriObject);
+    m_hdriCacheObject = std::move(environment->hdriCacheObject);
+    m_hdri = std::move(environment->hdri);
+    m_hdriCache = std::move(environment->hdriCache);
+    m_environmentDirty = environment->dirty;
+}
+
+// -------------------------------------------------------------------------
+//    BVH traversal
+// -------------------------------------------------------------------------
+
+PathTracingCpuBackend::HitInfo PathTracingCpuBackend::HitBvhClosest(const Ray& ray) const
+{
+    HitInfo closestHit;
+    closestHit.didHit = false;
+    closestHit.dst = FLT_MAX_VALUE;
+
+    if (m_bvhNodes.size() < 2)
+    {
+        return closestHit;
+    }
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    int closestPrimitive = -1;
+    float closestU = 0.0f;
+    float closestV = 0.0f;
+
+    // Node 0 is the initialization node, the root is at index 1
+    int stack[64];
+    int stackPointer = 0;
+    stack[stackPointer++] = 1;
+
+    while (stackPointer > 0)
+    {
+        const BVH::BvhNode& node = m_bvhNodes[stack[--stackPointer]];
+
+        // If node is leaf, traverse primitives and find intersection
+        if (node.n > 0)
+        {
+            for (int i = node.index; i < node.index + node.n; i++)
+            {
+                float dst, u, v;
+                if (RayTriangle(ray, m_bvhPrimitives[i], dst, u, v) && dst < closestHit.dst)
+                {
+                    closestHit.didHit = true;
+                    closestHit.dst = dst;
+                    closestPrimitive = i;
+                    closestU = u;
+                    closestV = v;
+                }
+            }
+            continue;
+        }
+
+        // Find intersection with left and right boxes AABB, boxes behind the closest hit are skipped
+        float dstLeft = -1.0f;
+        float dstRight = -1.0f;
+
+        if (node.left > 0)
+        {
+            const BVH::BvhNode& leftNode = m_bvhNodes[node.left];
+            dstLeft = HitAABB(ray, invDirection, leftNode.AA, leftNode.BB);
+            dstLeft = dstLeft < closestHit.dst ? dstLeft : -1.0f;
+        }
+
+        if (node.right > 0)
+        {
+            const BVH::BvhNode& rightNode = m_bvhNodes[node.right];
+            dstRight = HitAABB(ray, invDirection, rightNode.AA, rightNode.BB);
+            dstRight = dstRight < closestHit.dst ? dstRight : -1.0f;
+        }
+
+        // Push the farthest child first, so the nearest is traversed first
+        if (dstLeft >= 0.0f && dstRight >= 0.0f)
+        {
+            stack[stackPointer++] = dstLeft < dstRight ? node.right : node.left;
+            stack[stackPointer++] = dstLeft < dstRight ? node.left : node.right;
+        }
+        else if (dstLeft >= 0.0f)
+        {
+            stack[stackPointer++] = node.left;
+        }
+        else if (dstRight >= 0.0f)
+        {
+            stack[stackPointer++] = node.right;
+        }
+    }
+
+    if (!closestHit.didHit)
+    {
+        return closestHit;
+    }
+
+    // Fill in the hit information of the closest primitive only
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[closestPrimitive];
+    float u = closestU;
+    float v = closestV;
+    float w = 1.0f - u - v;
+
+    glm::vec3 edgeAB = primitive.posB - primitive.posA;
+    glm::vec3 edgeAC = primitive.posC - primitive.posA;
+
+    closestHit.hitPosition = ray.origin + ray.direction * closestHit.dst;
+    closestHit.hitDirection = ray.direction;
+    closestHit.uv = primitive.uvA * w + primitive.uvB * u + primitive.uvC * v;
+    closestHit.shadingNormal = glm::normalize(primitive.norA * w + primitive.norB * u + primitive.norC * v);
+    closestHit.geometryNormal = glm::normalize(glm::cross(edgeAC, edgeAB));
+    closestHit.materialIndex = primitive.meshIndex;
+    closestHit.emissiveIndex = primitive.emissiveIndex;
+    closestHit.textureLodBias = primitive.textureLodBias;
+
+    // Calculate tangent
+    glm::vec2 deltaUVB = primitive.uvB - primitive.uvA;
+    glm::vec2 deltaUVC = primitive.uvC - primitive.uvA;
+    float invTangentDeterminant = 1.0f / (deltaUVB.x * deltaUVC.y - deltaUVB.y * deltaUVC.x);
+    closestHit.tangent = (edgeAB * deltaUVC.y - edgeAC * deltaUVB.y) * invTangentDeterminant;
+
+    return closestHit;
+}
+
+bool PathTracingCpuBackend::HitBvhAny(const Ray& ray) const
+{
+    return HitBvhAny(ray, FLT_MAX_VALUE);
+}
+
+bool PathTracingCpuBackend::HitBvhAny(const Ray& ray, float maxDistance) const
+{
+    if (m_bvhNodes.size() < 2)
+    {
+        return false;
+    }
+
+    glm::vec3 invDirection = 1.0f / ray.direction;
+
+    int stack[64];
+    int stackPointer = 0;
+    stack[stackPointer++] = 1;
+
+    while (stackPointer > 0)
+    {
+        const BVH::BvhNode& node = m_bvhNodes[stack[--stackPointer]];
+
+        // If node is leaf, any intersection ends the traversal
+        if (node.n > 0)
+        {
+            for (int i = node.index; i < node.index + node.n; i++)
+            {
+                float dst, u, v;
+                if (RayTriangle(ray, m_bvhPrimitives[i], dst, u, v) && dst < maxDistance)
+                {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        if (node.left > 0)
+        {
+            const BVH::BvhNode& leftNode = m_bvhNodes[node.left];
+            float dstLeft = HitAABB(ray, invDirection, leftNode.AA, leftNode.BB);
+            if (dstLeft >= 0.0f && dstLeft < maxDistance)
+            {
+                stack[stackPointer++] = node.left;
+            }
+        }
+
+        if (node.right > 0)
+        {
+            const BVH::BvhNode& rightNode = m_bvhNodes[node.right];
+            float dstRight = HitAABB(ray, invDirection, rightNode.AA, rightNode.BB);
+            if (dstRight >= 0.0f && dstRight < maxDistance)
+            {
+                stack[stackPointer++] = node.right;
+            }
+        }
+    }
+
+    return false;
+}
+
+// -------------------------------------------------------------------------
+//    Material evaluation
+// -------------------------------------------------------------------------
+
+DisneyBrdf::Material PathTracingCpuBackend::EvaluateMaterial(const MaterialData& material, HitInfo& hitInfo) const
+{
+    DisneyBrdf::Material evaluatedMaterial = material.attributes;
+
+    auto sample = [&](Material::MaterialTextureSlot slot)
+    {
+        return m_textureCache->Sample(material.textureIndices[slot], hitInfo.uv, hitInfo.textureLod);
+    };
+
+    if (material.textureIndices[Material::EmissionTexture] >= 0)
+    {
+        evaluatedMaterial.emission *= glm::vec3(sample(Material::EmissionTexture));
+    }
+    if (material.textureIndices[Material::AlbedoTexture] >= 0)
+    {
+        evaluatedMaterial.albedo *= glm::vec3(sample(Material::AlbedoTexture));
+    }
+    if (material.textureIndices[Material::NormalTexture] >= 0)
+    {
+        // Gram-Schmidt process: Re-orthogonalize T with respect to N
+        glm::vec3 N = hitInfo.shadingNormal;
+        glm::vec3 T = glm::normalize(hitInfo.tangent - glm::dot(hitInfo.tangent, N) * N);
+        glm::vec3 B = glm::cross(N, T);
+
+        glm::vec3 normalMap = glm::normalize(glm::vec3(sample(Material::NormalTexture)) * 2.0f - 1.0f);
+        hitInfo.shadingNormal = glm::normalize(T * normalMap.x + B * normalMap.y + N * normalMap.z);
+    }
+    if (material.textureIndices[Material::SpecularTexture] >= 0)
+    {
+        evaluatedMaterial.specular *= sample(Material::SpecularTexture).a;
+    }
+    if (material.textureIndices[Material::SpecularColorTexture] >= 0)
+    {
+        evaluatedMaterial.specularTint *= glm::length(glm::vec3(sample(Material::SpecularColorTexture)));
+    }
+    if (material.textureIndices[Material::MetallicRoughnessTexture] >= 0)
+    {
+        glm::vec4 metallicRoughnessSample = sample(Material::MetallicRoughnessTexture);
+        evaluatedMaterial.metallic *= metallicRoughnessSample.x;
+        evaluatedMaterial.roughness *= metallicRoughnessSample.y;
+    }
+    if (material.textureIndices[Material::SheenRoughnessTexture] >= 0)
+    {
+        evaluatedMaterial.sheenRoughness *= sample(Material::SheenRoughnessTexture).a;
+    }
+    if (material.textureIndices[Material::SheenColorTexture] >= 0)
+    {
+        evaluatedMaterial.sheenTint *= glm::length(glm::vec3(sample(Material::SheenColorTexture)));
+    }
+    if (material.textureIndices[Material::ClearcoatTexture] >= 0)
+    {
+        evaluatedMaterial.clearcoat *= sample(Material::ClearcoatTexture).r;
+    }
+    if (material.textureIndices[Material::ClearcoatRoughnessTexture] >= 0)
+    {
+        evaluatedMaterial.clearcoatRoughness *= sample(Material::ClearcoatRoughnessTexture).g;
+    }
+    if (material.textureIndices[Material::TransmissionTexture] >= 0)
+    {
+        evaluatedMaterial.transmission *= sample(Material::TransmissionTexture).r;
+    }
+
+    DisneyBrdf::ApplyModifiers(evaluatedMaterial, m_frameSettings.modifiers);
+
+    return evaluatedMaterial;
+}
+
+// -------------------------------------------------------------------------
+//    HDRI sampling, see hdri.glsl
+// -------------------------------------------------------------------------
+
+glm::vec3 PathTracingCpuBackend::SampleHdri(const glm::vec2& Xi) const
+{
+    glm::vec2 uv = glm::vec2(m_hdriCache.Sample(Xi)); // x, y
+    uv.y = 1.0f - uv.y; // Flip
+
+    float phi = TWO_PI * (uv.x - 0.5f);    // [-pi ~ pi]
+    float theta = PI * (uv.y - 0.5f);      // [-pi/2 ~ pi/2]
+
+    return glm::vec3(std::cos(theta) * std::cos(phi), std::sin(theta), std::cos(theta) * std::sin(phi));
+}
+
+glm::vec3 PathTracingCpuBackend::EvaluateHdri(const glm::vec3& L, float& pdf) const
+{
+    glm::vec3 direction = glm::normalize(L);
+    glm::vec2 uv = glm::vec2(std::atan2(direction.z, direction.x) * ONE_OVER_TWO_PI + 0.5f, 0.5f - std::asin(direction.y) * ONE_OVER_PI);
+
+    glm::vec3 color = glm::vec3(m_hdri.Sample(uv));
+    pdf = m_hdriCache.Sample(uv).b;
+
+    float theta = PI * (1.0f - uv.y);
+    float sinTheta = std::max(std::sin(theta), 1e-10f);
+
+    // Conversion factor between spherical coordinates and image integration domain
+    pdf *= float(m_hdriCache.width) * float(m_hdriCache.height) / (TWO_PI * PI * sinTheta);
+
+    return color;
+}
+
+// -------------------------------------------------------------------------
+//    Emissive triangle sampling, see emissive.glsl
+// -------------------------------------------------------------------------
+
+bool PathTracingCpuBackend::IsEmissiveSamplingEnabled() const
+{
+    return m_frameSettings.emissiveSamplingEnabled && !m_emissiveTriangles.empty();
+}
+
+unsigned int PathTracingCpuBackend::SampleLightTree(const glm::vec3& P, const glm::vec3& N, float Xi, float& pmf) const
+{
+    pmf = 1.0f;
+
+    // Leaves are stored first, the root is the last node
+    const LightTree::LightTreeNode* node = &m_lightTreeNodes.back();
+
+    while (node->left >= 0)
+    {
+        float importanceLeft = LightTree::Importance(m_lightTreeNodes[node->left].bounds, P, N);
+        float importanceRight = LightTree::Importance(m_lightTreeNodes[node->right].bounds, P, N);
+        if (importanceLeft + importanceRight <= 0.0f)
+        {
+            pmf = 0.0f;
+            return 0xffffffff;
+        }
+
+        // Reuse the random number for the next level
+        float probabilityLeft = importanceLeft / (importanceLeft + importanceRight);
+        if (Xi < probabilityLeft)
+        {
+            Xi = std::min(Xi / probabilityLeft, 0.99999994f);
+            pmf *= probabilityLeft;
+            node = &m_lightTreeNodes[node->left];
+        }
+        else
+        {
+            Xi = std::min((Xi - probabilityLeft) / (1.0f - probabilityLeft), 0.99999994f);
+            pmf *= 1.0f - probabilityLeft;
+            node = &m_lightTreeNodes[node->right];
+        }
+    }
+
+    return node->emissiveIndex;
+}
+
+float PathTracingCpuBackend::GetLightTreePmf(unsigned int emissiveIndex, const glm::vec3& P, const glm::vec3& N) const
+{
+    float pmf = 1.0f;
+
+    // Walk up from the leaf of the triangle
+    int nodeIndex = int(emissiveIndex);
+    int parentIndex = m_lightTreeNodes[nodeIndex].parent;
+
+    while (parentIndex >= 0)
+    {
+        const LightTree::LightTreeNode& parent = m_lightTreeNodes[parentIndex];
+
+        float importanceLeft = LightTree::Importance(m_lightTreeNodes[parent.left].bounds, P, N);
+        float importanceRight = LightTree::Importance(m_lightTreeNodes[parent.right].bounds, P, N);
+        if (importanceLeft + importanceRight <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        float probabilityLeft = importanceLeft / (importanceLeft + importanceRight);
+        pmf *= parent.left == nodeIndex ? probabilityLeft : 1.0f - probabilityLeft;
+
+        nodeIndex = parentIndex;
+        parentIndex = parent.parent;
+    }
+
+    return pmf;
+}
+
+float PathTracingCpuBackend::GetEmissiveTrianglePdf(unsigned int emissiveIndex, const glm::vec3& P, const glm::vec3& N, const glm::vec3& L, float dst) const
+{
+    const EmissiveTriangle& emissiveTriangle = m_emissiveTriangles[emissiveIndex];
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[emissiveTriangle.primitiveIndex];
+
+    glm::vec3 normalVector = glm::cross(primitive.posB - primitive.posA, primitive.posC - primitive.posA);
+    float doubleArea = glm::length(normalVector);
+
+    // Triangles are one-sided, so the back side has no density
+    float cosLight = -glm::dot(L, normalVector) / doubleArea;
+    if (cosLight <= 0.0f || doubleArea <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    float pmf = m_frameSettings.lightTreeEnabled ? GetLightTreePmf(emissiveIndex, P, N) : emissiveTriangle.pdf;
+
+    // Convert the area density to solid angle
+    return pmf * 2.0f * dst * dst / (doubleArea * cosLight);
+}
+
+unsigned int PathTracingCpuBackend::PickEmissiveTriangle(const glm::vec3& P, const glm::vec3& N, float Xi, float& pmf) const
+{
+    if (m_frameSettings.lightTreeEnabled)
+    {
+        return SampleLightTree(P, N, Xi, pmf);
+    }
+    return SampleEmissiveTriangleIndex(Xi, pmf);
+}
+
+unsigned int PathTracingCpuBackend::SampleEmissiveTriangleIndex(float Xi, float& pmf) const
+{
+    // Pick a triangle from the alias table, the fractional part decides between the entry and its alias
+    unsigned int count = (unsigned int)m_emissiveTriangles.size();
+    float scaled = Xi * float(count);
+    unsigned int index = std::min((unsigned int)scaled, count - 1);
+    unsigned int emissiveIndex = (scaled - float(index)) < m_emissiveTriangles[index].aliasProbability ? index : m_emissiveTriangles[index].alias;
+
+    pmf = m_emissiveTriangles[emissiveIndex].pdf;
+    return emissiveIndex;
+}
+
+glm::vec3 PathTracingCpuBackend::GetEmission(const BVH::BvhPrimitive& primitive, const glm::vec2& uv) const
+{
+    // Same emission as the evaluated material of a hit
+    const MaterialData& material = m_materials[primitive.meshIndex];
+    glm::vec3 emission = material.attributes.emission;
+    if (material.textureIndices[Material::EmissionTexture] >= 0)
+    {
+        emission *= glm::vec3(m_textureCache->Sample(material.textureIndices[Material::EmissionTexture], uv, FullResolutionTextureLod));
+    }
+
+    return emission;
+}
+
+PathTracingCpuBackend::EmissivePoint PathTracingCpuBackend::SampleEmissiveTrianglePoint(const BVH::BvhPrimitive& primitive, const glm::vec2& Xi)
+{
+    EmissivePoint point;
+
+    // Uniformly distributed barycentric coordinates
+    float su = std::sqrt(Xi.x);
+    float w = 1.0f - su;
+    float u = Xi.y * su;
+    point.barycentrics = glm::vec3(w, u, 1.0f - w - u);
+
+    point.position = primitive.posA * point.barycentrics.x + primitive.posB * point.barycentrics.y + primitive.posC * point.barycentrics.z;
+    point.uv = primitive.uvA * point.barycentrics.x + primitive.uvB * point.barycentrics.y + primitive.uvC * point.barycentrics.z;
+
+    glm::vec3 normalVector = glm::cross(primitive.posB - primitive.posA, primitive.posC - primitive.posA);
+    float doubleArea = glm::length(normalVector);
+    point.area = 0.5f * doubleArea;
+    point.normal = doubleArea > 0.0f ? normalVector / doubleArea : glm::vec3(0.0f);
+
+    return point;
+}
+
+glm::vec3 PathTracingCpuBackend::SampleEmissiveTriangle(const glm::vec3& P, const glm::vec3& N, const glm::vec3& Xi, glm::vec3& L, float& dst, float& pdf) const
+{
+    L = glm::vec3(0.0f);
+    dst = 0.0f;
+    pdf = 0.0f;
+
+    float pmf = 0.0f;
+    unsigned int emissiveIndex = PickEmissiveTriangle(P, N, Xi.x, pmf);
+    if (emissiveIndex == 0xffffffff)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[m_emissiveTriangles[emissiveIndex].primitiveIndex];
+
+    EmissivePoint point = SampleEmissiveTrianglePoint(primitive, glm::vec2(Xi.y, Xi.z));
+
+    glm::vec3 toLight = point.position - P;
+    dst = glm::length(toLight);
+    L = toLight / dst;
+
+    pdf = GetEmissiveTrianglePdf(emissiveIndex, P, N, L, dst);
+    if (pdf <= 0.0f)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    return GetEmission(primitive, point.uv);
+}
+
+// -------------------------------------------------------------------------
+//    Camera
+// -------------------------------------------------------------------------
+
+PathTracingCpuBackend::RayCone PathTracingCpuBackend::GetPrimaryRayCone() const
+{
+    // Primary rays start as a point, with a spread of one pixel
+    RayCone cone;
+    cone.width = 0.0f;
+    cone.spreadAngle = std::atan(2.0f * std::abs(m_frameSettings.invProjMatrix[1][1]) / (float)m_height);
+    return cone;
+}
+
+void PathTracingCpuBackend::PropagateRayCone(RayCone& cone, HitInfo& hitInfo)
+{
+    cone.width += cone.spreadAngle * hitInfo.dst;
+
+    // The footprint stretches with the inverse cosine towards grazing angles
+    float cosTheta = std::max(std::abs(glm::dot(hitInfo.hitDirection, hitInfo.geometryNormal)), 1e-4f);
+    hitInfo.textureLod = hitInfo.textureLodBias + std::log2(std::max(cone.width, 1e-10f)) - std::log2(cosTheta);
+}
+
+void PathTracingCpuBackend::ScatterRayCone(RayCone& cone, float roughness)
+{
+    // Rough lobes spread the cone further, roughly by the width of the GGX lobe
+    cone.spreadAngle += 2.0f * roughness * roughness;
+}
+
+PathTracingCpuBackend::Ray PathTracingCpuBackend::GenerateCameraRay(int x, int y, Sampler& sampler) const
+{
+    const glm::vec2 frameDimensions = glm::vec2((float)m_width, (float)m_height);
+
+    glm::vec2 uv = (glm::vec2((float)x, (float)y) + 0.5f) / frameDimensions;
+    if (m_frameSettings.antiAliasingEnabled)
+    {
+        glm::vec2 offset = sampler.Get2D(Sampler::DimensionAntiAliasing);
+        uv += (offset - 0.5f) / frameDimensions;
+    }
+
+    return GeneratePrimaryRay(uv, sampler);
+}
+
+PathTracingCpuBackend::Ray PathTracingCpuBackend::GeneratePinholeRay(const glm::vec2& uv) const
+{
+    glm::vec4 viewPos = m_frameSettings.invProjMatrix * glm::vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(viewPos) / viewPos.w;
+    glm::vec3 direction = glm::normalize(origin);
+
+    Ray ray;
+    ray.origin = glm::vec3(m_invViewMatrix * glm::vec4(origin, 1.0f));
+    ray.direction = glm::vec3(m_invViewMatrix * glm::vec4(direction, 0.0f));
+    return ray;
+}
+
+PathTracingCpuBackend::Ray PathTracingCpuBackend::GeneratePrimaryRay(glm::vec2 uv, Sampler& sampler) const
+{
+    Ray ray = GeneratePinholeRay(uv);
+
+    if (m_frameSettings.apertureSize == 0.0f)
+    {
+        return ray;
+    }
+
+    // Thin lens camera
+    const glm::mat4& viewMatrix = m_frameSettings.viewMatrix;
+    glm::vec3 cameraForward = -glm::vec3(viewMatrix[2][0], viewMatrix[2][1], viewMatrix[2][2]);
+    glm::vec3 cameraUp = glm::vec3(viewMatrix[1][0], viewMatrix[1][1], viewMatrix[1][2]);
+    glm::vec3 cameraRight = glm::cross(cameraUp, cameraForward);
+
+    glm::vec3 focalPoint = ray.origin + ray.direction * m_frameSettings.focalLength;
+
+    glm::vec2 Xi = sampler.Get2D(Sampler::DimensionLens);
+    glm::vec2 apertureSample = glm::vec2(DisneyBrdf::HemispherepointCos(Xi.x, Xi.y)) * m_frameSettings.apertureShape * m_frameSettings.apertureSize;
+
+    ray.origin = ray.origin + cameraRight * apertureSample.x + cameraUp * apertureSample.y;
+    ray.direction = glm::normalize(focalPoint - ray.origin);
+
+    return ray;
+}
+
+// -------------------------------------------------------------------------
+//    Adaptive sampling, see pathtracing.comp
+// -------------------------------------------------------------------------
+
+bool PathTracingCpuBackend::IsInRenderRegion(size_t pixel) const
+{
+    const int x = (int)(pixel % m_width);
+    const int y = (int)(pixel / m_width);
+    return x >= m_renderRegion.x && x < m_renderRegion.z && y >= m_renderRegion.y && y < m_renderRegion.w;
+}
+
+bool PathTracingCpuBackend::IsPixelConverged(const Accumulation::Pixel& sums) const
+{
+    if (!m_frameSettings.adaptiveSamplingEnabled || sums.sampleCount < std::max((double)m_frameSettings.minSampleCount, 2.0))
+    {
+        return false;
+    }
+
+    // Relative standard error of the mean luminance
+    double n = sums.sampleCount;
+    double mean = sums.luminanceSum / n;
+    double variance = std::max(sums.luminanceSquaredSum / n - mean * mean, 0.0) * n / (n - 1.0);
+
+    // Offset the mean, so that dark pixels do not need an unbounded amount of samples
+    double relativeError = std::sqrt(variance / n) / (mean + 0.01);
+
+    return relativeError < m_frameSettings.noiseThreshold;
+}
+
+void PathTracingCpuBackend::AddPrimarySample(size_t pixel, const glm::vec3& albedo, const glm::vec3& normal)
+{
+    m_sums[pixel].albedoSum += glm::dvec3(albedo);
+    m_sums[pixel].normalSum += glm::dvec3(normal);
+}
+
+void PathTracingCpuBackend::AddRadianceSample(size_t pixel, const glm::vec3& radiance)
+{
+    Accumulation::Pixel& sums = m_sums[pixel];
+    const double luminance = DisneyBrdf::Luminance(radiance);
+    sums.radianceSum += glm::dvec3(radiance);
+    sums.luminanceSum += luminance;
+    sums.luminanceSquaredSum += luminance * luminance;
+    sums.sampleCount += 1.0;
+
+    UpdateAccumulationBuffers(pixel);
+}
+
+void PathTracingCpuBackend::UpdateAccumulationBuffers(size_t pixel)
+{
+    const Accumulation::Pixel& sums = m_sums[pixel];
+    const double invSampleCount = sums.sampleCount > 0.0 ? 1.0 / sums.sampleCount : 0.0;
+    const float alpha = sums.sampleCount > 0.0 ? 1.0f : 0.0f;
+
+    m_radiance[pixel] = glm::vec4(glm::vec3(sums.radianceSum * invSampleCount), alpha);
+    m_primaryAlbedo[pixel] = glm::vec4(glm::vec3(sums.albedoSum * invSampleCount), alpha);
+    m_primaryNormal[pixel] = glm::vec4(glm::vec3(sums.normalSum * invSampleCount), alpha);
+    m_sampleStats[pixel] = glm::vec4((float)sums.luminanceSum, (float)sums.luminanceSquaredSum, (float)sums.sampleCount, 0.0f);
+}
+
+// -------------------------------------------------------------------------
+//    Reservoir resampling
+// -------------------------------------------------------------------------
+
+void PathTracingCpuBackend::Reservoir::Update(const LightSample& candidate, float weight, float count, float Xi)
+{
+    weightSum += weight;
+    M += count;
+
+    if (weight > 0.0f && Xi * weightSum < weight)
+    {
+        sample = candidate;
+    }
+}
+
+PathTracingCpuBackend::LightSample PathTracingCpuBackend::SampleLightCandidate(const glm::vec3& P, const glm::vec3& N, const glm::vec3& Xi, float Xs, float& pdf) const
+{
+    LightSample sample;
+    pdf = 0.0f;
+
+    // Half of the candidates come from the emissive triangles, when they can be sampled
+    float hdriProbability = IsEmissiveSamplingEnabled() ? 0.5f : 1.0f;
+
+    // Directions towards the HDRI are in solid angle measure
+    if (Xs < hdriProbability)
+    {
+        sample.data = SampleHdri(glm::vec2(Xi));
+
+        float pdfHdri = 0.0f;
+        EvaluateHdri(sample.data, pdfHdri);
+        pdf = hdriProbability * pdfHdri;
+
+        return sample;
+    }
+
+    float pmf = 0.0f;
+    sample.emissiveIndex = PickEmissiveTriangle(P, N, Xi.x, pmf);
+    if (sample.emissiveIndex == 0xffffffff)
+    {
+        return sample;
+    }
+
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[m_emissiveTriangles[sample.emissiveIndex].primitiveIndex];
+    EmissivePoint point = SampleEmissiveTrianglePoint(primitive, glm::vec2(Xi.y, Xi.z));
+    sample.data = point.barycentrics;
+
+    // Points on emissive triangles are in area measure
+    pdf = (1.0f - hdriProbability) * pmf / point.area;
+
+    return sample;
+}
+
+glm::vec3 PathTracingCpuBackend::EvaluateLightSample(const LightSample& sample, const glm::vec3& P, glm::vec3& L, float& dst, float& geometry) const
+{
+    if (sample.emissiveIndex == 0xffffffff)
+    {
+        L = sample.data;
+        dst = FLT_MAX_VALUE;
+        geometry = 1.0f;
+
+        float pdf = 0.0f;
+        return EvaluateHdri(L, pdf);
+    }
+
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[m_emissiveTriangles[sample.emissiveIndex].primitiveIndex];
+
+    glm::vec3 position = primitive.posA * sample.data.x + primitive.posB * sample.data.y + primitive.posC * sample.data.z;
+    glm::vec2 uv = primitive.uvA * sample.data.x + primitive.uvB * sample.data.y + primitive.uvC * sample.data.z;
+
+    glm::vec3 toLight = position - P;
+    dst = glm::length(toLight);
+    L = toLight / dst;
+
+    // Geometry term converts the area measure to solid angle, triangles are one-sided
+    glm::vec3 normalVector = glm::cross(primitive.posB - primitive.posA, primitive.posC - primitive.posA);
+    float cosLight = -glm::dot(L, normalVector) / glm::length(normalVector);
+    if (cosLight <= 0.0f || dst <= 0.0f)
+    {
+        geometry = 0.0f;
+        return glm::vec3(0.0f);
+    }
+    geometry = cosLight / (dst * dst);
+
+    return GetEmission(primitive, uv);
+}
+
+float PathTracingCpuBackend::EvaluateReservoirTarget(const LightSample& sample, const DisneyBrdf::Material& material, unsigned int lobes, const glm::vec3& P, const glm::vec3& V, const glm::vec3& N) const
+{
+    // Unshadowed contribution of the sample
+    glm::vec3 L;
+    float dst = 0.0f;
+    float geometry = 0.0f;
+    glm::vec3 radiance = EvaluateLightSample(sample, P, L, dst, geometry);
+    if (geometry <= 0.0f || glm::dot(N, L) <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(material, V, N, L);
+
+    float pdf = 0.0f;
+    glm::vec3 f = DisneyBrdf::EvaluateDisneyBrdf(material, brdfData, pdf, lobes);
+
+    return DisneyBrdf::Luminance(f * radiance) * geometry;
+}
+
+bool PathTracingCpuBackend::IsReservoirSurfaceSimilar(const ReservoirSurface& surface, const glm::vec3& N, float depth) const
+{
+    // Reservoirs are only reused across similar surfaces, which keeps the bias of reusing them low
+    return surface.valid && glm::dot(surface.normal, N) > 0.906f && std::abs(surface.depth - depth) < 0.1f * depth;
+}
+
+void PathTracingCpuBackend::GenerateReservoirs(int tileX, int tileY)
+{
+    const int x0 = std::max(tileX * TileSize, m_renderRegion.x);
+    const int y0 = std::max(tileY * TileSize, m_renderRegion.y);
+    const int x1 = std::min((tileX + 1) * TileSize, m_renderRegion.z);
+    const int y1 = std::min((tileY + 1) * TileSize, m_renderRegion.w);
+
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            size_t pixel = (size_t)y * m_width + x;
+
+            Reservoir& reservoir = m_candidateReservoirs[pixel];
+            ReservoirSurface& surface = m_reservoirSurfaces[pixel];
+            reservoir = Reservoir{ };
+            surface = ReservoirSurface{ };
+
+            // Same primary ray as RenderTile, which resets the sample statistics when the accumulation starts over
+            unsigned int sampleCount = m_accumulationReset ? 0 : (unsigned int)m_sums[pixel].sampleCount;
+            Sampler sampler(m_frameSettings.samplerType, x, y, m_width, m_height, sampleCount, m_frameSettings.sampleCount, m_frameSettings.seed);
+
+            HitInfo hitInfo = HitBvhClosest(GenerateCameraRay(x, y, sampler));
+            if (!hitInfo.didHit)
+            {
+                continue;
+            }
+
+            const MaterialData& materialData = m_materials[hitInfo.materialIndex];
+            DisneyBrdf::Material material = EvaluateMaterial(materialData, hitInfo);
+            unsigned int lobes = materialData.lobes | m_modifierLobes;
+
+            glm::vec3 P = hitInfo.hitPosition;
+            glm::vec3 V = -hitInfo.hitDirection;
+            glm::vec3 N = hitInfo.shadingNormal;
+
+            surface.position = P;
+            surface.normal = N;
+            surface.depth = hitInfo.dst;
+            surface.valid = true;
+
+            PassRandom random(pixel, m_reservoirFrame, 0, m_frameSettings.seed);
+
+            // Initial candidates, weighted by target over source density
+            for (int i = 0; i < ReservoirCandidateCount; i++)
+            {
+                glm::vec3 Xi = random.Next3D();
+                float Xs = random.Next();
+
+                float pdf = 0.0f;
+                LightSample candidate = SampleLightCandidate(P, N, Xi, Xs, pdf);
+                float weight = pdf > 0.0f ? EvaluateReservoirTarget(candidate, material, lobes, P, V, N) / pdf : 0.0f;
+
+                reservoir.Update(candidate, weight, 1.0f, random.Next());
+            }
+
+            // Temporal reuse of the reservoir, which saw the same point in the previous frame
+            if (m_reservoirHistoryValid)
+            {
+                glm::vec4 clip = m_previousViewProjMatrix * glm::vec4(P, 1.0f);
+                glm::vec2 uv = glm::vec2(clip) / clip.w * 0.5f + 0.5f;
+                int previousX = (int)std::floor(uv.x * m_width);
+                int previousY = (int)std::floor(uv.y * m_height);
+
+                if (clip.w > 0.0f && previousX >= m_renderRegion.x && previousX < m_renderRegion.z && previousY >= m_renderRegion.y && previousY < m_renderRegion.w)
+                {
+                    size_t previousPixel = (size_t)previousY * m_width + previousX;
+                    float previousDepth = glm::length(P - m_previousCameraPosition);
+
+                    if (IsReservoirSurfaceSimilar(m_previousReservoirSurfaces[previousPixel], N, previousDepth))
+                    {
+                        // Clamp the history, so stale samples are replaced over time
+                        Reservoir previous = m_reservoirs[previousPixel];
+                        previous.M = std::min(previous.M, ReservoirHistoryLength * ReservoirCandidateCount);
+
+                        float target = EvaluateReservoirTarget(previous.sample, material, lobes, P, V, N);
+                        reservoir.Update(previous.sample, target * previous.W * previous.M, previous.M, random.Next());
+                    }
+                }
+            }
+
+            float target = EvaluateReservoirTarget(reservoir.sample, material, lobes, P, V, N);
+            reservoir.W = target > 0.0f ? reservoir.weightSum / (reservoir.M * target) : 0.0f;
+        }
+    }
+}
+
+PathTracingCpuBackend::Reservoir PathTracingCpuBackend::ReuseSpatialReservoirs(const PathState& path, unsigned int lobes) const
+{
+    const glm::vec3& P = path.hitInfo.hitPosition;
+    glm::vec3 V = -path.hitInfo.hitDirection;
+    glm::vec3 N = path.hitInfo.shadingNormal;
+
+    // The pixel's own reservoir was resampled for the same surface
+    Reservoir reservoir = m_candidateReservoirs[path.pixel];
+
+    // Split copies of a path pick neighbours of their own, with the same random numbers they would all resample the same reservoir
+    PassRandom random(path.pixel + (size_t)path.splitIndex * m_width * m_height, m_reservoirFrame, 1, m_frameSettings.seed);
+    const int x = int(path.pixel % m_width);
+    const int y = int(path.pixel / m_width);
+
+    for (int i = 0; i < ReservoirNeighbourCount; i++)
+    {
+        // Uniformly distributed in a disk around the pixel
+        float radius = ReservoirRadius * std::sqrt(random.Next());
+        float angle = TWO_PI * random.Next();
+        int neighbourX = x + (int)std::round(radius * std::cos(angle));
+        int neighbourY = y + (int)std::round(radius * std::sin(angle));
+
+        if (neighbourX < m_renderRegion.x || neighbourX >= m_renderRegion.z || neighbourY < m_renderRegion.y || neighbourY >= m_renderRegion.w || (neighbourX == x && neighbourY == y))
+        {
+            continue;
+        }
+
+        size_t neighbourPixel = (size_t)neighbourY * m_width + neighbourX;
+        if (!IsReservoirSurfaceSimilar(m_reservoirSurfaces[neighbourPixel], N, path.hitInfo.dst))
+        {
+            continue;
+        }
+
+        const Reservoir& neighbour = m_candidateReservoirs[neighbourPixel];
+        float target = EvaluateReservoirTarget(neighbour.sample, path.material, lobes, P, V, N);
+        reservoir.Update(neighbour.sample, target * neighbour.W * neighbour.M, neighbour.M, random.Next());
+    }
+
+    float target = EvaluateReservoirTarget(reservoir.sample, path.material, lobes, P, V, N);
+    reservoir.W = target > 0.0f ? reservoir.weightSum / (reservoir.M * target) : 0.0f;
+
+    return reservoir;
+}
+
+// -------------------------------------------------------------------------
+//    Caustic photons
+// -------------------------------------------------------------------------
+
+bool PathTracingCpuBackend::IsCausticSpecular(const DisneyBrdf::Material& material) const
+{
+    // Smooth glass and metal, which path tracing can hardly connect to the lights through
+    return material.roughness <= CausticRoughness && (material.transmission > 0.5f || material.metallic > 0.5f);
+}
+
+void PathTracingCpuBackend::TraceCausticPhotons()
+{
+    // Shrink the gather radius every frame, see "Progressive Photon Mapping: A Probabilistic Approach" (Knaus and Zwicker 2011)
+    // Averaging the frames converges like stochastic progressive photon mapping, without per pixel statistics
+    const glm::vec3 sceneExtent = m_bvhNodes[0].BB - m_bvhNodes[0].AA;
+    if (m_frameSettings.frameCount <= 1)
+    {
+        m_causticRadius = CausticRadiusFraction * glm::length(sceneExtent);
+    }
+    else
+    {
+        float frame = (float)m_frameSettings.frameCount - 1.0f;
+        m_causticRadius *= std::sqrt((frame + CausticRadiusAlpha) / (frame + 1.0f));
+    }
+
+    // HDRI photons are only shot at the bounds of the specular primitives, the only ones that can start a caustic
+    glm::vec3 casterAA = glm::vec3(FLT_MAX_VALUE);
+    glm::vec3 casterBB = glm::vec3(-FLT_MAX_VALUE);
+    for (const BVH::BvhPrimitive& primitive : m_bvhPrimitives)
+    {
+        if (((m_materials[primitive.meshIndex].lobes | m_modifierLobes) & (DisneyBrdf::LobeGlass | DisneyBrdf::LobeMetal)) == 0)
+        {
+            continue;
+        }
+
+        casterAA = glm::min(casterAA, glm::min(primitive.posA, glm::min(primitive.posB, primitive.posC)));
+        casterBB = glm::max(casterBB, glm::max(primitive.posA, glm::max(primitive.posB, primitive.posC)));
+    }
+
+    if (casterAA.x > casterBB.x)
+    {
+        m_causticPhotonMap.Clear();
+        return;
+    }
+
+    glm::vec3 casterCenter = (casterAA + casterBB) * 0.5f;
+    float casterRadius = 0.5f * glm::length(casterBB - casterAA);
+
+    // Workers trace chunks of photons and keep the ones that ended up on a non-specular surface
+    constexpr unsigned int ChunkSize = 1024;
+    std::atomic<unsigned int> nextChunk = 0;
+    std::vector<PhotonMap::Photon> photons;
+    std::mutex photonsMutex;
+
+    auto worker = [&]()
+    {
+        std::vector<PhotonMap::Photon> workerPhotons;
+
+        for (unsigned int chunk = nextChunk++; chunk * ChunkSize < CausticPhotonCount; chunk = nextChunk++)
+        {
+            for (unsigned int i = chunk * ChunkSize; i < std::min((chunk + 1) * ChunkSize, CausticPhotonCount); i++)
+            {
+                PhotonMap::Photon photon;
+                if (TraceCausticPhoton(i, casterCenter, casterRadius, photon))
+                {
+                    workerPhotons.push_back(photon);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(photonsMutex);
+        photons.insert(photons.end(), workerPhotons.begin(), workerPhotons.end());
+    };
+
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    m_causticPhotonMap.Build(std::move(photons), m_causticRadius);
+}
+
+bool PathTracingCpuBackend::TraceCausticPhoton(unsigned int photonIndex, const glm::vec3& casterCenter, float casterRadius, PhotonMap::Photon& photon) const
+{
+    PassRandom random(photonIndex, m_frameSettings.frameCount, 2, m_frameSettings.seed);
+
+    // Emissive triangles and the HDRI each emit half of the photons, when there are emissive triangles
+    float hdriProbability = m_emissiveTriangles.empty() ? 1.0f : 0.5f;
+
+    Ray ray;
+    glm::vec3 power;
+
+    if (random.Next() < hdriProbability)
+    {
+        // Parallel rays from the sampled direction, through a disk covering the specular primitives
+        glm::vec3 L = SampleHdri(glm::vec2(random.Next(), random.Next()));
+
+        float pdf = 0.0f;
+        glm::vec3 radiance = EvaluateHdri(L, pdf);
+        if (pdf <= 0.0f)
+        {
+            return false;
+        }
+
+        glm::vec3 tangent, bitangent;
+        DisneyBrdf::GetTangentBitangent(L, tangent, bitangent);
+
+        float diskRadius = casterRadius * std::sqrt(random.Next());
+        float diskAngle = TWO_PI * random.Next();
+        glm::vec3 diskPoint = casterCenter + (tangent * std::cos(diskAngle) + bitangent * std::sin(diskAngle)) * diskRadius;
+
+        // Start outside of the scene, so everything in between can occlude the photon
+        const glm::vec3 sceneExtent = m_bvhNodes[0].BB - m_bvhNodes[0].AA;
+        ray.origin = diskPoint + L * (glm::length(sceneExtent) + casterRadius);
+        ray.direction = -L;
+
+        power = radiance * (PI * casterRadius * casterRadius) / (pdf * hdriProbability);
+    }
+    else
+    {
+        float pmf = 0.0f;
+        unsigned int emissiveIndex = SampleEmissiveTriangleIndex(random.Next(), pmf);
+        const BVH::BvhPrimitive& primitive = m_bvhPrimitives[m_emissiveTriangles[emissiveIndex].primitiveIndex];
+
+        float Xu = random.Next();
+        float Xv = random.Next();
+        EmissivePoint point = SampleEmissiveTrianglePoint(primitive, glm::vec2(Xu, Xv));
+
+        // Cosine weighted emission from the front side, which cancels with the cosine of the emitted flux
+        ray.direction = DisneyBrdf::ToWorld(point.normal, DisneyBrdf::HemispherepointCos(random.Next(), random.Next()));
+        ray.origin = OffsetRay(point.position, point.normal);
+
+        power = GetEmission(primitive, point.uv) * (PI * point.area) / (pmf * (1.0f - hdriProbability));
+    }
+
+    power /= (float)CausticPhotonCount;
+
+    // Follow the photon through specular hits, until it lands on a non-specular surface
+    for (int bounce = 0; bounce < MaxPhotonBounceCount; bounce++)
+    {
+        HitInfo hitInfo = HitBvhClosest(ray);
+        if (!hitInfo.didHit)
+        {
+            return false;
+        }
+
+        const MaterialData& materialData = m_materials[hitInfo.materialIndex];
+        DisneyBrdf::Material material = EvaluateMaterial(materialData, hitInfo);
+
+        // Photons that did not pass through a specular material are no caustic, path tracing handles them
+        if (!IsCausticSpecular(material))
+        {
+            if (bounce == 0)
+            {
+                return false;
+            }
+
+            photon.position = hitInfo.hitPosition;
+            photon.direction = -ray.direction;
+            photon.power = power;
+            return true;
+        }
+
+        glm::vec3 V = -ray.direction;
+        glm::vec3 N = hitInfo.shadingNormal;
+        unsigned int lobes = materialData.lobes | m_modifierLobes;
+
+        glm::vec3 Xi = glm::vec3(random.Next(), random.Next(), random.Next());
+        DisneyBrdf::BrdfData samplingBrdfData = DisneyBrdf::PrepareEvaluationBrdfData(material, V, N, glm::vec3(0.0f));
+        glm::vec3 L = DisneyBrdf::SampleDisneyBrdf(material, samplingBrdfData, Xi, lobes);
+
+        float pdf = 0.0f;
+        DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(material, V, N, L);
+        glm::vec3 f = DisneyBrdf::EvaluateDisneyBrdf(material, brdfData, pdf, lobes);
+        if (pdf <= 0.0f)
+        {
+            return false;
+        }
+        glm::vec3 throughput = f / pdf;
+
+        // Russian roulette, keeps the power of the surviving photons close to the emitted power
+        float p = std::min(std::max(throughput.r, std::max(throughput.g, throughput.b)), 1.0f);
+        if (random.Next() >= p)
+        {
+            return false;
+        }
+        power *= throughput / p;
+
+        // Transmitted photons continue on the other side of the surface
+        glm::vec3 offsetNormal = glm::dot(L, hitInfo.geometryNormal) > 0.0f ? hitInfo.geometryNormal : -hitInfo.geometryNormal;
+        ray.origin = OffsetRay(hitInfo.hitPosition, offsetNormal);
+        ray.direction = L;
+    }
+
+    return false;
+}
+
+glm::vec3 PathTracingCpuBackend::GatherCaustics(const DisneyBrdf::Material& material, unsigned int lobes, const glm::vec3& P, const glm::vec3& V, const glm::vec3& N) const
+{
+    glm::vec3 radiance = glm::vec3(0.0f);
+
+    m_causticPhotonMap.Gather(P, [&](const PhotonMap::Photon& photon)
+    {
+        float cosTheta = glm::dot(N, photon.direction);
+        if (cosTheta <= 0.0f)
+        {
+            return;
+        }
+
+        // The flux of the photon already is per projected area, so the cosine of the BRDF is divided out
+        DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(material, V, N, photon.direction);
+
+        float pdf = 0.0f;
+        glm::vec3 f = DisneyBrdf::EvaluateDisneyBrdf(material, brdfData, pdf, lobes);
+        radiance += f / cosTheta * photon.power;
+    });
+
+    // Density estimate over the disk of the gather radius
+    float radius = m_causticPhotonMap.GetRadius();
+    return radiance / (PI * radius * radius);
+}
+
+// -------------------------------------------------------------------------
+//    Radiance cache
+// -------------------------------------------------------------------------
+
+bool PathTracingCpuBackend::IsRadianceCacheSurface(const DisneyBrdf::Material& material) const
+{
+    return material.roughness >= 0.5f && material.metallic <= 0.1f && material.transmission <= 0.1f && material.clearcoat <= 0.1f;
+}
+
+uint64_t PathTracingCpuBackend::GetRadianceCacheKey(const HitInfo& hitInfo) const
+{
+    // Cells cover about the same amount of pixels at any distance to the camera
+    float distance = glm::length(hitInfo.hitPosition - glm::vec3(m_invViewMatrix[3]));
+    float cellSize = std::max(distance * m_radianceCacheCellScale, 1e-4f);
+
+    return RadianceCache::GetKey(hitInfo.hitPosition, hitInfo.geometryNormal, cellSize);
+}
+
+bool PathTracingCpuBackend::IsRadianceCacheRecording() const
+{
+    // Adjoint-driven roulette reads the cache, even when it does not terminate paths
+    return m_frameSettings.radianceCacheEnabled || m_frameSettings.adjointRussianRouletteEnabled;
+}
+
+// -------------------------------------------------------------------------
+//    Adjoint-driven Russian roulette and splitting
+// -------------------------------------------------------------------------
+
+bool PathTracingCpuBackend::GetAdjointRatio(const PathState& path, float& ratio)
+{
+    // The pixel's accumulated samples estimate its radiance
+    const Accumulation::Pixel& sums = m_sums[path.pixel];
+    if (sums.sampleCount < AdjointMinSampleCount || sums.luminanceSum <= 0.0)
+    {
+        return false;
+    }
+    float pixelEstimate = (float)(sums.luminanceSum / sums.sampleCount);
+
+    // The radiance cache estimates the radiance leaving the hit towards the path
+    glm::vec3 cachedRadiance;
+    if (!IsRadianceCacheSurface(path.material) || !m_radianceCache.Query(GetRadianceCacheKey(path.hitInfo), cachedRadiance))
+    {
+        return false;
+    }
+
+    ratio = DisneyBrdf::Luminance(path.throughput * cachedRadiance) / pixelEstimate;
+    return true;
+}
+
+int PathTracingCpuBackend::GetSplitCount(const PathState& path)
+{
+    // Paths of pixels whose samples vary a lot are split, more so if they are expected to contribute much
+    const Accumulation::Pixel& sums = m_sums[path.pixel];
+    if (sums.sampleCount < AdjointMinSampleCount || sums.luminanceSum <= 0.0)
+    {
+        return 1;
+    }
+
+    double mean = sums.luminanceSum / sums.sampleCount;
+    double variance = std::max(sums.luminanceSquaredSum / sums.sampleCount - mean * mean, 0.0);
+    float relativeDeviation = (float)(std::sqrt(variance) / mean);
+
+    float ratio = 1.0f;
+    GetAdjointRatio(path, ratio);
+
+    // Only split above the weight window, the upper bound of a window centered around 1
+    float split = ratio * relativeDeviation;
+    float upperBound = 2.0f * AdjointWeightWindowSize / (1.0f + AdjointWeightWindowSize);
+    return split > upperBound ? std::min((int)split, MaxSplitCount) : 1;
+}
+
+// -------------------------------------------------------------------------
+//    Temporal reprojection
+// -------------------------------------------------------------------------
+
+void PathTracingCpuBackend::TraceHistorySurfaces(int tileX, int tileY, std::vector<ReservoirSurface>& surfaces) const
+{
+    const int x0 = std::max(tileX * TileSize, m_renderRegion.x);
+    const int y0 = std::max(tileY * TileSize, m_renderRegion.y);
+    const int x1 = std::min((tileX + 1) * TileSize, m_renderRegion.z);
+    const int y1 = std::min((tileY + 1) * TileSize, m_renderRegion.w);
+
+    const glm::vec2 frameDimensions = glm::vec2((float)m_width, (float)m_height);
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            // Pixel centers through the center of the lens, independent of the samples
+            HitInfo hitInfo = HitBvhClosest(GeneratePinholeRay((glm::vec2((float)x, (float)y) + 0.5f) / frameDimensions));
+
+            ReservoirSurface& surface = surfaces[(size_t)y * m_width + x];
+            surface = ReservoirSurface{ };
+            if (hitInfo.didHit)
+            {
+                surface.position = hitInfo.hitPosition;
+                surface.normal = hitInfo.shadingNormal;
+                surface.depth = hitInfo.dst;
+                surface.valid = true;
+            }
+        }
+    }
+}
+
+void PathTracingCpuBackend::ReprojectAccumulation(const std::vector<ReservoirSurface>& surfaces)
+{
+    const std::vector<Accumulation::Pixel> previousSums = m_sums;
+
+    for (int y = m_renderRegion.y; y < m_renderRegion.w; y++)
+    {
+        for (int x = m_renderRegion.x; x < m_renderRegion.z; x++)
+        {
+            size_t pixel = (size_t)y * m_width + x;
+            const ReservoirSurface& surface = surfaces[pixel];
+
+            m_sums[pixel] = Accumulation::Pixel();
+            UpdateAccumulationBuffers(pixel);
+
+            // Pixels that see the HDRI start over, their few samples converge quickly
+            if (!surface.valid)
+            {
+                continue;
+            }
+
+            glm::vec4 clip = m_historyViewProjMatrix * glm::vec4(surface.position, 1.0f);
+            glm::vec2 uv = glm::vec2(clip) / clip.w * 0.5f + 0.5f;
+            int previousX = (int)std::floor(uv.x * m_width);
+            int previousY = (int)std::floor(uv.y * m_height);
+
+            if (clip.w <= 0.0f || previousX < 0 || previousX >= m_width || previousY < 0 || previousY >= m_height)
+            {
+                continue;
+            }
+
+            // Disoccluded pixels saw a different surface before the camera moved
+            size_t previousPixel = (size_t)previousY * m_width + previousX;
+            float previousDepth = glm::length(surface.position - m_historyCameraPosition);
+            if (!IsReservoirSurfaceSimilar(m_historySurfaces[previousPixel], surface.normal, previousDepth))
+            {
+                continue;
+            }
+
+            // Clamp the sample count, so the history is replaced over time. The sums are scaled along, which keeps their means
+            const Accumulation::Pixel& previous = previousSums[previousPixel];
+            double sampleCount = std::min(previous.sampleCount, (double)ReprojectionHistoryLength);
+            double scale = previous.sampleCount > 0.0 ? sampleCount / previous.sampleCount : 0.0;
+
+            Accumulation::Pixel& sums = m_sums[pixel];
+            sums.radianceSum = previous.radianceSum * scale;
+            sums.albedoSum = previous.albedoSum * scale;
+            sums.normalSum = previous.normalSum * scale;
+            sums.luminanceSum = previous.luminanceSum * scale;
+            sums.luminanceSquaredSum = previous.luminanceSquaredSum * scale;
+            sums.sampleCount = sampleCount;
+            UpdateAccumulationBuffers(pixel);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Checkpoints
+// -------------------------------------------------------------------------
+
+Accumulation PathTracingCpuBackend::GetAccumulation() const
+{
+    Accumulation accumulation(m_width, m_height);
+    std::vector<Accumulation::Pixel>& pixels = accumulation.GetPixels();
+    std::copy(m_sums.begin(), m_sums.begin() + pixels.size(), pixels.begin());
+    return accumulation;
+}
+
+void PathTracingCpuBackend::ApplyResumedAccumulation()
+{
+    // Pixels take up the samples they had, and as their sample index is their sample count, their sequences continue where they stopped
+    if (m_resumedAccumulation.GetWidth() == m_width && m_resumedAccumulation.GetHeight() == m_height)
+    {
+        const std::vector<Accumulation::Pixel>& pixels = m_resumedAccumulation.GetPixels();
+        for (size_t pixel = 0; pixel < pixels.size(); pixel++)
+        {
+            m_sums[pixel] = pixels[pixel];
+            UpdateAccumulationBuffers(pixel);
+        }
+        m_accumulationReset = false;
+    }
+
+    m_resumedAccumulation = Accumulation();
+}
+
+// -------------------------------------------------------------------------
+//    Rendering
+// -------------------------------------------------------------------------
+
+void PathTracingCpuBackend::RenderFrame()
+{
+    // Texture readback needs the GL context, so it is done before spawning workers
+    ResolveTextures();
+    m_textureCache->ResetStatistics();
+
+    // Each sample is rendered as if it was a frame of its own, only the first one follows a camera move
+    const FrameSettings frameSettings = m_frameSettings;
+    float frameMilliseconds = 0.0f;
+    for (unsigned int i = 0; i < std::max(frameSettings.frameSampleCount, 1u); i++)
+    {
+        m_frameSettings = frameSettings;
+        m_frameSettings.frameCount = frameSettings.frameCount + i;
+        m_frameSettings.cameraMoved = frameSettings.cameraMoved && i == 0;
+
+        RenderSample();
+        frameMilliseconds += m_frameMilliseconds;
+    }
+
+    m_frameMilliseconds = frameMilliseconds;
+}
+
+void PathTracingCpuBackend::RenderSample()
+{
+    Timer frameTimer("CPU Sample");
+
+    // Fewer pixels mean fewer camera rays, the buffers stay allocated for all of them
+    const glm::ivec2 renderDimensions = m_frameSettings.renderDimensions;
+    m_width = renderDimensions.x > 0 ? std::min(renderDimensions.x, m_maxWidth) : m_maxWidth;
+    m_height = renderDimensions.y > 0 ? std::min(renderDimensions.y, m_maxHeight) : m_maxHeight;
+
+    // Pixels outside of the region keep their accumulation, an empty region renders all of them
+    const glm::ivec4 renderRegion = m_frameSettings.renderRegion;
+    const glm::ivec2 regionMin = glm::clamp(glm::ivec2(renderRegion.x, renderRegion.y), glm::ivec2(0), glm::ivec2(m_width, m_height));
+    const glm::ivec2 regionMax = glm::clamp(glm::ivec2(renderRegion.z, renderRegion.w), regionMin, glm::ivec2(m_width, m_height));
+    const bool regionEmpty = regionMax.x <= regionMin.x || regionMax.y <= regionMin.y;
+    m_renderRegion = regionEmpty ? glm::ivec4(0, 0, m_width, m_height) : glm::ivec4(regionMin, regionMax);
+
+    m_invViewMatrix = glm::inverse(m_frameSettings.viewMatrix);
+    m_modifierLobes = DisneyBrdf::GetModifierLobes(m_frameSettings.modifiers);
+
+    m_shadingNanoseconds = 0;
+    m_shadedHits = 0;
+    m_rayCount = 0;
+    m_pathCount = 0;
+    m_radianceCacheTerminations = 0;
+    m_activePixelCount = 0;
+
+    if (m_frameSettings.frameCount <= 1)
+    {
+        m_renderMilliseconds = 0.0f;
+    }
+
+    // Reservoirs, photons and guiding only apply to the path tracer
+    const bool bidirectional = m_frameSettings.integrator == Integrator::Bidirectional;
+
+    // Metropolis chains mutate the random numbers of their paths, so a path must only depend on those numbers
+    // Estimators which learn from other paths or from the pixel's samples are turned off
+    const bool metropolis = m_frameSettings.metropolisEnabled && !bidirectional;
+    if (metropolis)
+    {
+        m_frameSettings.reservoirResamplingEnabled = false;
+        m_frameSettings.causticPhotonsEnabled = false;
+        m_frameSettings.pathGuidingEnabled = false;
+        m_frameSettings.radianceCacheEnabled = false;
+        m_frameSettings.adjointRussianRouletteEnabled = false;
+        m_frameSettings.adaptiveSamplingEnabled = false;
+    }
+
+    // Reservoirs are allocated on first use, their history is only valid if the previous frame resampled as well
+    const bool reservoirResampling = m_frameSettings.reservoirResamplingEnabled && !bidirectional;
+    if (reservoirResampling)
+    {
+        size_t pixelCount = (size_t)m_width * m_height;
+        if (m_reservoirs.size() != pixelCount)
+        {
+            m_reservoirs.assign(pixelCount, Reservoir{ });
+            m_candidateReservoirs.assign(pixelCount, Reservoir{ });
+            m_reservoirSurfaces.assign(pixelCount, ReservoirSurface{ });
+            m_previousReservoirSurfaces.assign(pixelCount, ReservoirSurface{ });
+            m_reservoirHistoryValid = false;
+        }
+    }
+    else
+    {
+        m_reservoirHistoryValid = false;
+    }
+
+    // Only the tiles overlapping the render region are processed
+    const int firstTileX = m_renderRegion.x / TileSize;
+    const int firstTileY = m_renderRegion.y / TileSize;
+    const int tilesX = (m_renderRegion.z + TileSize - 1) / TileSize - firstTileX;
+    const int tilesY = (m_renderRegion.w + TileSize - 1) / TileSize - firstTileY;
+    const int tileCount = tilesX * tilesY;
+
+    const unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Workers pull tasks from a shared counter until all tasks are processed
+    auto forEachTask = [&](int taskCount, auto&& processTask)
+    {
+        std::atomic<int> nextTask = 0;
+        auto worker = [&](unsigned int workerIndex)
+        {
+            std::unique_ptr<TileState> tileState = std::make_unique<TileState>();
+            tileState->workerIndex = workerIndex;
+
+            for (int task = nextTask++; task < taskCount; task = nextTask++)
+            {
+                processTask(*tileState, task);
+            }
+
+            m_shadingNanoseconds += tileState->shadingNanoseconds;
+            m_shadedHits += tileState->shadedHits;
+            m_rayCount += tileState->rayCount;
+            m_pathCount += tileState->pathCount;
+            m_radianceCacheTerminations += tileState->radianceCacheTerminations;
+            m_metropolisLuminanceSum += tileState->metropolisLuminanceSum;
+            m_metropolisLuminanceCount += tileState->metropolisLuminanceCount;
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back(worker, i);
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    };
+
+    auto forEachTile = [&](auto&& processTile)
+    {
+        forEachTask(tileCount, [&](TileState& tileState, int tile) { processTile(tileState, firstTileX + tile % tilesX, firstTileY + tile / tilesX); });
+    };
+
+    // Splat buffers are allocated on first use, one for every worker, and start out empty with the accumulation
+    const size_t pixelCount = (size_t)m_width * m_height;
+    if (bidirectional || metropolis)
+    {
+        if (m_splatBuffers.size() != threadCount || m_splatBuffers[0].size() != pixelCount)
+        {
+            m_splatBuffers.assign(threadCount, std::vector<glm::vec3>(pixelCount, glm::vec3(0.0f)));
+        }
+        else if (m_frameSettings.frameCount <= 1)
+        {
+            for (std::vector<glm::vec3>& splats : m_splatBuffers)
+            {
+                std::fill(splats.begin(), splats.end(), glm::vec3(0.0f));
+            }
+        }
+    }
+
+    if (bidirectional)
+    {
+        if (m_bidirectionalRadiance.size() != pixelCount)
+        {
+            m_bidirectionalRadiance.assign(pixelCount, glm::vec4(0.0f));
+        }
+
+        m_viewProjMatrix = glm::inverse(m_frameSettings.invProjMatrix) * m_frameSettings.viewMatrix;
+        m_cameraPosition = glm::vec3(m_invViewMatrix[3]);
+        m_cameraForward = -glm::normalize(glm::vec3(m_invViewMatrix[2]));
+        m_imagePlaneArea = 4.0f * std::abs(m_frameSettings.invProjMatrix[0][0]) * std::abs(m_frameSettings.invProjMatrix[1][1]);
+    }
+
+    // The radiance cache is allocated on first use, its cells are a fixed amount of pixels wide
+    if (IsRadianceCacheRecording())
+    {
+        if (!m_radianceCache.IsAllocated())
+        {
+            m_radianceCache.Allocate(RadianceCacheMemory);
+        }
+
+        float tanHalfFov = std::abs(m_frameSettings.invProjMatrix[1][1]);
+        m_radianceCacheCellScale = RadianceCachePixelsPerCell * 2.0f * tanHalfFov / (float)m_height;
+    }
+
+    // Photons are traced before rendering, every path gathers from the same photon map
+    if (m_frameSettings.causticPhotonsEnabled && !bidirectional)
+    {
+        TraceCausticPhotons();
+    }
+    else
+    {
+        m_causticPhotonMap.Clear();
+    }
+
+    // The history is taken whenever the accumulation starts over, the camera stays the same until the next reset
+    // Reprojected pixels keep their samples, so the accumulation only starts over for the others
+    m_accumulationReset = m_frameSettings.frameCount <= 1;
+    if (m_frameSettings.temporalReprojectionEnabled && !bidirectional && !metropolis)
+    {
+        if (m_accumulationReset)
+        {
+            std::vector<ReservoirSurface> surfaces(pixelCount);
+            forEachTile([&](TileState&, int tileX, int tileY) { TraceHistorySurfaces(tileX, tileY, surfaces); });
+
+            if (m_frameSettings.cameraMoved && m_historySurfaces.size() == pixelCount)
+            {
+                ReprojectAccumulation(surfaces);
+                m_accumulationReset = false;
+            }
+
+            m_historySurfaces = std::move(surfaces);
+            m_historyViewProjMatrix = glm::inverse(m_frameSettings.invProjMatrix) * m_frameSettings.viewMatrix;
+            m_historyCameraPosition = glm::vec3(m_invViewMatrix[3]);
+        }
+    }
+    else
+    {
+        m_historySurfaces.clear();
+    }
+
+    // A render resumed from a checkpoint starts over from its samples instead of from nothing
+    if (m_accumulationReset && !m_resumedAccumulation.IsEmpty())
+    {
+        ApplyResumedAccumulation();
+    }
+
+    // Candidates of every pixel must be ready before neighbours reuse them while rendering
+    if (reservoirResampling)
+    {
+        forEachTile([&](TileState&, int tileX, int tileY) { GenerateReservoirs(tileX, tileY); });
+    }
+
+    // Metropolis chains sample the whole image at once instead of rendering tiles
+    const int metropolisBatchCount = MetropolisChainCount / (TileSize * TileSize);
+    long long metropolisMutationCount = 0;
+    if (metropolis)
+    {
+        // Chains restart with the accumulation, from a bootstrap over independent paths
+        if (m_frameSettings.frameCount <= 1 || m_metropolisChains.empty())
+        {
+            std::vector<float> luminances(MetropolisBootstrapCount, 0.0f);
+            forEachTask(MetropolisBootstrapCount / (TileSize * TileSize), [&](TileState& tileState, int batch) { TraceMetropolisBootstrap(tileState, batch, luminances); });
+
+            double luminanceSum = 0.0;
+            for (float luminance : luminances)
+            {
+                luminanceSum += luminance;
+            }
+            m_metropolisLuminanceSum = luminanceSum;
+            m_metropolisLuminanceCount = MetropolisBootstrapCount;
+            m_metropolisNormalization = float(luminanceSum / MetropolisBootstrapCount);
+
+            // Chains start at bootstrap paths picked proportional to their luminance, stratified over the chains
+            // Without any light in the bootstrap there is nothing to mutate, and the frame stays black
+            m_metropolisChains.clear();
+            if (luminanceSum > 0.0)
+            {
+                std::vector<unsigned int> bootstrapIndices(MetropolisChainCount);
+                double cdf = 0.0;
+                unsigned int index = 0;
+                for (int chain = 0; chain < MetropolisChainCount; chain++)
+                {
+                    double target = (chain + 0.5) / MetropolisChainCount * luminanceSum;
+                    while (index + 1 < MetropolisBootstrapCount && cdf + luminances[index] < target)
+                    {
+                        cdf += luminances[index++];
+                    }
+                    bootstrapIndices[chain] = index;
+                }
+
+                m_metropolisChains.resize(MetropolisChainCount);
+                forEachTask(metropolisBatchCount, [&](TileState& tileState, int batch) { StartMetropolisChains(tileState, batch, bootstrapIndices); });
+            }
+        }
+
+        // About one mutation per pixel, so a frame costs as much as a frame of the path tracer
+        if (!m_metropolisChains.empty())
+        {
+            int stepCount = std::max(1, int(pixelCount / MetropolisChainCount));
+            forEachTask(metropolisBatchCount, [&](TileState& tileState, int batch) { MutateMetropolisChains(tileState, batch, stepCount); });
+
+            metropolisMutationCount = (long long)stepCount * MetropolisChainCount;
+        }
+        m_activePixelCount = (unsigned int)pixelCount;
+    }
+    else
+    {
+        forEachTile([&](TileState& tileState, int tileX, int tileY) { RenderTile(tileState, tileX, tileY); });
+    }
+
+    // Light subpaths and Metropolis paths splat anywhere on the image, so the samples are complete once every worker is done
+    // Every traced pixel traced one light subpath, which stands in for one light subpath per pixel of the image
+    // Every mutation splats the normalization in total, so the mutations of a frame make up one sample per pixel
+    if (bidirectional || metropolis)
+    {
+        long long splatCount = metropolis ? metropolisMutationCount : (long long)m_pathCount;
+        float splatScale = splatCount > 0 ? float(double(pixelCount) / double(splatCount)) : 0.0f;
+
+        forEachTile([&](TileState&, int tileX, int tileY) { MergeSplatTile(tileX, tileY, splatScale); });
+    }
+
+    // Large steps are independent samples of the whole image, which refine the normalization
+    if (metropolis && m_metropolisLuminanceCount > 0)
+    {
+        m_metropolisNormalization = float(m_metropolisLuminanceSum / double(m_metropolisLuminanceCount));
+    }
+
+    // The final reservoirs of this frame become the temporal history of the next one
+    if (reservoirResampling)
+    {
+        std::swap(m_reservoirSurfaces, m_previousReservoirSurfaces);
+        m_previousViewProjMatrix = glm::inverse(m_frameSettings.invProjMatrix) * m_frameSettings.viewMatrix;
+        m_previousCameraPosition = glm::vec3(m_invViewMatrix[3]);
+        m_reservoirHistoryValid = true;
+        m_reservoirFrame++;
+    }
+
+    long long shadedHits = m_shadedHits;
+    m_shadingNanosecondsPerHit = shadedHits > 0 ? double(m_shadingNanoseconds) / double(shadedHits) : 0.0;
+
+    long long pathCount = m_pathCount;
+    m_raysPerPixel = pathCount > 0 ? float(double(m_rayCount) / double(pathCount)) : 0.0f;
+    m_radianceCacheTerminationRate = pathCount > 0 ? float(double(m_radianceCacheTerminations) / double(pathCount)) : 0.0f;
+
+    // Workers flush their lookup counters when they exit, so all of them are in by now
+    m_textureCacheStatistics = m_textureCache->GetStatistics();
+
+    // Entries are only evicted in between frames, while no worker probes the table
+    if (IsRadianceCacheRecording())
+    {
+        m_radianceCache.EndFrame();
+    }
+
+    // Guiding trees are only refined in between frames, so workers can splat into them without locks
+    if (m_frameSettings.pathGuidingEnabled && !bidirectional)
+    {
+        m_pathGuiding.EndFrame();
+    }
+
+    m_frameMilliseconds = (float)frameTimer.Stop(Timer::TimeUnit::Nanoseconds) * 1e-6f;
+    m_renderMilliseconds += m_frameMilliseconds;
+}
+
+void PathTracingCpuBackend::RenderTile(TileState& tileState, int tileX, int tileY)
+{
+    const int x0 = std::max(tileX * TileSize, m_renderRegion.x);
+    const int y0 = std::max(tileY * TileSize, m_renderRegion.y);
+    const int x1 = std::min((tileX + 1) * TileSize, m_renderRegion.z);
+    const int y1 = std::min((tileY + 1) * TileSize, m_renderRegion.w);
+    const int tileWidth = x1 - x0;
+    const int laneCount = tileWidth * (y1 - y0);
+
+    auto getPixel = [&](int lane) { return (size_t)(y0 + lane / tileWidth) * m_width + (x0 + lane % tileWidth); };
+
+    // Sample statistics are reset together with the accumulation
+    if (m_accumulationReset)
+    {
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            m_sums[getPixel(lane)] = Accumulation::Pixel();
+        }
+    }
+
+    // The whole tile keeps sampling while any of its pixels is above the noise threshold
+    unsigned int tileActivePixelCount = 0;
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        tileActivePixelCount += IsPixelConverged(m_sums[getPixel(lane)]) ? 0 : 1;
+    }
+
+    if (tileActivePixelCount == 0)
+    {
+        return;
+    }
+    m_activePixelCount += tileActivePixelCount;
+
+    // The bidirectional integrator traces every pixel on its own
+    if (m_frameSettings.integrator == Integrator::Bidirectional)
+    {
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            RenderPixelBidirectional(tileState, x0 + lane % tileWidth, y0 + lane / tileWidth);
+        }
+        tileState.pathCount += laneCount;
+        return;
+    }
+
+    // Generate primary rays
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        int x = x0 + lane % tileWidth;
+        int y = y0 + lane / tileWidth;
+
+        PathState& path = tileState.paths[lane];
+        StartPath(path, getPixel(lane));
+
+        // The sample index is the amount of samples this pixel has taken
+        unsigned int sampleCount = (unsigned int)m_sums[path.pixel].sampleCount;
+        path.sampler = Sampler(m_frameSettings.samplerType, x, y, m_width, m_height, sampleCount, m_frameSettings.sampleCount, m_frameSettings.seed);
+
+        path.ray = GenerateCameraRay(x, y, path.sampler);
+    }
+    tileState.pathCount += laneCount;
+
+    TracePaths(tileState, laneCount);
+
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        const PathState& path = tileState.paths[lane];
+        size_t pixel = getPixel(lane);
+
+        // Temporal accumulation, the buffers are the means of all samples of the pixel
+        AddPrimarySample(pixel, path.primaryAlbedo, path.primaryNormal);
+        AddRadianceSample(pixel, path.radiance);
+    }
+}
+
+void PathTracingCpuBackend::StartPath(PathState& path, size_t pixel) const
+{
+    path.pixel = pixel;
+    path.parentLane = -1;
+    path.splitIndex = 0;
+
+    path.radiance = glm::vec3(0.0f);
+    path.throughput = glm::vec3(1.0f);
+    path.f = glm::vec3(1.0f);
+    path.pdfBrdf = 1.0f;
+    path.previousPosition = glm::vec3(0.0f);
+    path.previousNormal = glm::vec3(0.0f);
+    path.primaryAlbedo = glm::vec3(0.0f);
+    path.primaryNormal = glm::vec3(0.0f);
+    path.guidingVertexCount = 0;
+    path.radianceCacheVertexCount = 0;
+    path.causticGathered = false;
+    path.causticChain = -1;
+    path.directLightingReused = false;
+    path.rayCone = GetPrimaryRayCone();
+    path.alive = true;
+}
+
+void PathTracingCpuBackend::TracePaths(TileState& tileState, int laneCount)
+{
+    // Shades the lanes in runs that fit into the shading batch
+    auto shadeLanes = [&](const int* lanes, int count, unsigned int lobes, int bounce)
+    {
+        for (int start = 0; start < count; start += DisneyBrdf::ShadingBatch::MaxSize)
+        {
+            ShadeRun(tileState, lanes + start, std::min(count - start, DisneyBrdf::ShadingBatch::MaxSize), lobes, bounce);
+        }
+    };
+
+    // Grows when paths are split at the primary hit
+    int pathCount = laneCount;
+
+    for (int bounce = 0; bounce < MaxBounceCount; bounce++)
+    {
+        // Intersect and evaluate materials
+        int activeCount = 0;
+        const int bouncePathCount = pathCount;
+        for (int lane = 0; lane < bouncePathCount; lane++)
+        {
+            PathState& path = tileState.paths[lane];
+            if (!path.alive)
+            {
+                continue;
+            }
+
+            path.hitInfo = HitBvhClosest(path.ray);
+            tileState.rayCount++;
+
+            // Missed - HDRI light contribution
+            if (!path.hitInfo.didHit)
+            {
+                float pdfLight = 0.0f;
+                glm::vec3 colorLight = EvaluateHdri(path.ray.direction, pdfLight);
+
+                // Only MIS if there is data from previous bounce, reservoirs of the primary hit already include the HDRI
+                float misWeight = bounce > 0 ? DisneyBrdf::MisMixWeight(path.pdfBrdf, pdfLight) : 1.0f;
+                if (path.directLightingReused)
+                {
+                    misWeight = 0.0f;
+                }
+
+                // Light found through specular hits after the caustic gather is already in the photon map
+                if (path.causticChain > 0)
+                {
+                    misWeight = 0.0f;
+                }
+
+                if (misWeight > 0.0f)
+                {
+                    path.radiance += misWeight * path.throughput * colorLight * path.f / path.pdfBrdf;
+                }
+
+                path.alive = false;
+                continue;
+            }
+
+            // Textures are filtered over the ray cone's footprint
+            PropagateRayCone(path.rayCone, path.hitInfo);
+            path.material = EvaluateMaterial(m_materials[path.hitInfo.materialIndex], path.hitInfo);
+
+            // Emissive light contribution
+            if (glm::any(glm::greaterThan(path.material.emission, glm::vec3(0.0f))))
+            {
+                float misWeight = 1.0f;
+
+                // Only MIS if there is data from previous bounce, and the triangle could have been sampled directly
+                if (bounce > 0 && path.hitInfo.emissiveIndex != 0xffffffff && IsEmissiveSamplingEnabled())
+                {
+                    float pdfLight = GetEmissiveTrianglePdf(path.hitInfo.emissiveIndex, path.previousPosition, path.previousNormal, path.hitInfo.hitDirection, path.hitInfo.dst);
+                    misWeight = path.directLightingReused ? 0.0f : DisneyBrdf::MisMixWeight(path.pdfBrdf, pdfLight);
+                }
+
+                if (path.causticChain > 0)
+                {
+                    misWeight = 0.0f;
+                }
+
+                path.radiance += misWeight * path.throughput * path.material.emission;
+            }
+
+            // Split important but noisy paths at the primary hit, every copy continues with its share of the throughput
+            // Copies have their own random numbers and start without radiance, so the emission of the hit is only counted once
+            int splitCount = bounce == 0 && m_frameSettings.adjointRussianRouletteEnabled ? GetSplitCount(path) : 1;
+            if (splitCount > 1)
+            {
+                path.throughput /= (float)splitCount;
+
+                unsigned int sampleCount = (unsigned int)m_sums[path.pixel].sampleCount;
+                for (int i = 1; i < splitCount; i++)
+                {
+                    int splitLane = pathCount++;
+                    PathState& split = tileState.paths[splitLane];
+                    split = path;
+                    split.radiance = glm::vec3(0.0f);
+                    split.parentLane = lane;
+                    split.splitIndex = i;
+                    split.sampler = Sampler(Sampler::Pcg, unsigned(path.pixel % m_width), unsigned(path.pixel / m_width), m_width, m_height, SplitSamplerOffset + sampleCount * MaxSplitCount + i, m_frameSettings.sampleCount, m_frameSettings.seed);
+
+                    tileState.lanes[activeCount++] = splitLane;
+                }
+            }
+
+            // Paths end in the radiance cache at diffuse hits after the primary hit, the primary hit keeps the detail of the image
+            if (IsRadianceCacheRecording() && IsRadianceCacheSurface(path.material))
+            {
+                uint64_t key = GetRadianceCacheKey(path.hitInfo);
+
+                glm::vec3 cachedRadiance;
+                if (bounce > 0 && m_frameSettings.radianceCacheEnabled && m_radianceCache.Query(key, cachedRadiance))
+                {
+                    path.radiance += path.throughput * cachedRadiance;
+                    tileState.radianceCacheTerminations++;
+
+                    path.alive = false;
+                    continue;
+                }
+
+                path.radianceCacheVertices[path.radianceCacheVertexCount++] = RadianceCacheVertex{ key, path.radiance, path.throughput };
+            }
+
+            tileState.lanes[activeCount++] = lane;
+        }
+
+        if (activeCount == 0)
+        {
+            break;
+        }
+
+        Timer shadingTimer("CPU Shading");
+
+        if (m_batchedShadingEnabled)
+        {
+            // Group hits by material, so every run shares one lobe mask
+            std::sort(tileState.lanes.begin(), tileState.lanes.begin() + activeCount, [&](int a, int b)
+                {
+                    return tileState.paths[a].hitInfo.materialIndex < tileState.paths[b].hitInfo.materialIndex;
+                });
+
+            int runStart = 0;
+            while (runStart < activeCount)
+            {
+                unsigned int materialIndex = tileState.paths[tileState.lanes[runStart]].hitInfo.materialIndex;
+
+                int runEnd = runStart + 1;
+                while (runEnd < activeCount && tileState.paths[tileState.lanes[runEnd]].hitInfo.materialIndex == materialIndex)
+                {
+                    runEnd++;
+                }
+
+                unsigned int lobes = m_materials[materialIndex].lobes | m_modifierLobes;
+                shadeLanes(&tileState.lanes[runStart], runEnd - runStart, lobes, bounce);
+
+                runStart = runEnd;
+            }
+        }
+        else
+        {
+            shadeLanes(tileState.lanes.data(), activeCount, DisneyBrdf::LobeAll, bounce);
+        }
+
+        tileState.shadingNanoseconds += shadingTimer.Stop(Timer::TimeUnit::Nanoseconds);
+        tileState.shadedHits += activeCount;
+    }
+
+    for (int lane = 0; lane < pathCount; lane++)
+    {
+        const PathState& path = tileState.paths[lane];
+
+        // Splat the incident radiance at every guided vertex, which is the radiance the path gathered after it
+        for (int i = 0; i < path.guidingVertexCount; i++)
+        {
+            const GuidingVertex& vertex = path.guidingVertices[i];
+            glm::vec3 incident = glm::vec3(0.0f);
+            for (int c = 0; c < 3; c++)
+            {
+                incident[c] = vertex.throughput[c] > 0.0f ? (path.radiance[c] - vertex.radiance[c]) / vertex.throughput[c] : 0.0f;
+            }
+
+            m_pathGuiding.Record(vertex.leaf, vertex.direction, DisneyBrdf::Luminance(incident), vertex.pdf);
+        }
+
+        // Record the outgoing radiance of every diffuse hit, which is the radiance the path gathered after it
+        for (int i = 0; i < path.radianceCacheVertexCount; i++)
+        {
+            const RadianceCacheVertex& vertex = path.radianceCacheVertices[i];
+            glm::vec3 outgoing = glm::vec3(0.0f);
+            for (int c = 0; c < 3; c++)
+            {
+                outgoing[c] = vertex.throughput[c] > 0.0f ? (path.radiance[c] - vertex.radiance[c]) / vertex.throughput[c] : 0.0f;
+            }
+
+            m_radianceCache.Record(vertex.key, outgoing);
+        }
+    }
+
+    // Split copies add up to a single sample of their pixel
+    for (int lane = laneCount; lane < pathCount; lane++)
+    {
+        const PathState& split = tileState.paths[lane];
+        tileState.paths[split.parentLane].radiance += split.radiance;
+    }
+}
+
+void PathTracingCpuBackend::ShadeRun(TileState& tileState, const int* lanes, int count, unsigned int lobes, int bounce)
+{
+    DisneyBrdf::ShadingBatch& batch = tileState.batch;
+    batch.count = count;
+
+    // Evaluates the prepared batch, either for the whole batch at once or one lane at a time
+    auto evaluate = [&]()
+    {
+        if (m_batchedShadingEnabled)
+        {
+            DisneyBrdf::EvaluateDisneyBrdfBatch(batch, lobes);
+            return;
+        }
+
+        for (int k = 0; k < count; k++)
+        {
+            const PathState& path = tileState.paths[lanes[k]];
+            glm::vec3 V = -path.hitInfo.hitDirection;
+            glm::vec3 L = glm::vec3(batch.Lx[k], batch.Ly[k], batch.Lz[k]);
+
+            DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(path.material, V, path.hitInfo.shadingNormal, L);
+
+            float pdf = 0.0f;
+            glm::vec3 f = DisneyBrdf::EvaluateDisneyBrdf(path.material, brdfData, pdf);
+
+            batch.fR[k] = f.r;
+            batch.fG[k] = f.g;
+            batch.fB[k] = f.b;
+            batch.pdf[k] = pdf;
+        }
+    };
+
+    // Density of scattering towards L, which mixes BRDF and guided sampling when the hit is guided
+    auto getScatterPdf = [&](const PathState& path, const glm::vec3& L, float pdfBrdf)
+    {
+        if (path.guidingTree == nullptr)
+        {
+            return pdfBrdf;
+        }
+        return PathGuiding::SamplingFraction * path.guidingTree->Pdf(L) + (1.0f - PathGuiding::SamplingFraction) * pdfBrdf;
+    };
+
+    // Guiding distribution of the hit
+    for (int k = 0; k < count; k++)
+    {
+        PathState& path = tileState.paths[lanes[k]];
+        path.guidingLeaf = -1;
+        path.guidingTree = nullptr;
+
+        if (m_frameSettings.pathGuidingEnabled)
+        {
+            path.guidingLeaf = m_pathGuiding.GetLeaf(path.hitInfo.hitPosition);
+
+            // Nothing has been learned during the first iteration
+            const PathGuiding::DirectionalTree& tree = m_pathGuiding.GetNode(path.guidingLeaf).sampling;
+            path.guidingTree = tree.IsValid() ? &tree : nullptr;
+        }
+    }
+
+    // Caustics from the photon map at the first non-specular hit
+    // Specular hits after it start a chain, which must not connect to the lights again
+    if (m_frameSettings.causticPhotonsEnabled)
+    {
+        for (int k = 0; k < count; k++)
+        {
+            PathState& path = tileState.paths[lanes[k]];
+
+            if (IsCausticSpecular(path.material))
+            {
+                path.causticChain += path.causticChain >= 0 ? 1 : 0;
+                continue;
+            }
+
+            path.causticChain = -1;
+            if (path.causticGathered)
+            {
+                continue;
+            }
+
+            path.radiance += path.throughput * GatherCaustics(path.material, lobes, path.hitInfo.hitPosition, -path.hitInfo.hitDirection, path.hitInfo.shadingNormal);
+            path.causticGathered = true;
+            path.causticChain = 0;
+        }
+    }
+
+    // Direct lighting of primary hits is resampled from the reservoirs, which cover both the HDRI and the emissive triangles
+    const bool reuseDirectLighting = bounce == 0 && m_frameSettings.reservoirResamplingEnabled;
+
+    if (reuseDirectLighting)
+    {
+        for (int k = 0; k < count; k++)
+        {
+            PathState& path = tileState.paths[lanes[k]];
+            glm::vec3 V = -path.hitInfo.hitDirection;
+            glm::vec3 N = path.hitInfo.shadingNormal;
+
+            Reservoir reservoir = ReuseSpatialReservoirs(path, lobes);
+
+            float lightDistance = 0.0f;
+            float geometry = 0.0f;
+            glm::vec3 radiance = EvaluateLightSample(reservoir.sample, path.hitInfo.hitPosition, path.lightDirection, lightDistance, geometry);
+            path.reservoirRadiance = radiance * geometry * reservoir.W;
+            path.lightVisible = reservoir.W > 0.0f && glm::dot(N, path.lightDirection) > 0.0f;
+
+            // Only the selected sample casts a shadow ray, which stops just before points on emissive triangles
+            if (path.lightVisible)
+            {
+                Ray shadowRay;
+                shadowRay.origin = OffsetRay(path.hitInfo.hitPosition, path.hitInfo.geometryNormal);
+                shadowRay.direction = path.lightDirection;
+                path.lightVisible = reservoir.sample.emissiveIndex == 0xffffffff ? !HitBvhAny(shadowRay) : !HitBvhAny(shadowRay, lightDistance * 0.999f);
+            }
+
+            // Occluded samples are not reused by the next frame, which only reuses the reservoir of the pixel's own path
+            if (!path.lightVisible)
+            {
+                reservoir.W = 0.0f;
+            }
+            if (path.splitIndex == 0)
+            {
+                m_reservoirs[path.pixel] = reservoir;
+            }
+
+            batch.SetLane(k, path.material, V, N, path.lightDirection);
+        }
+
+        evaluate();
+
+        // The contribution weight replaces the pdf, and the reservoirs are the only strategy for direct lighting
+        for (int k = 0; k < count; k++)
+        {
+            PathState& path = tileState.paths[lanes[k]];
+            if (path.lightVisible)
+            {
+                path.radiance += path.throughput * path.reservoirRadiance * batch.GetF(k);
+            }
+        }
+    }
+    else
+    {
+        // Direct light contribution
+        for (int k = 0; k < count; k++)
+        {
+            PathState& path = tileState.paths[lanes[k]];
+            glm::vec3 V = -path.hitInfo.hitDirection;
+            glm::vec3 N = path.hitInfo.shadingNormal;
+
+            Ray hdriRay;
+            hdriRay.origin = OffsetRay(path.hitInfo.hitPosition, path.hitInfo.geometryNormal);
+            hdriRay.direction = SampleHdri(path.sampler.Get2D(Sampler::GetBounceDimension(bounce, Sampler::DimensionHdri)));
+
+            // Cast shadow ray, only continue light calculation if there is no occlusion toward light
+            path.lightDirection = hdriRay.direction;
+            path.lightVisible = glm::dot(N, hdriRay.direction) > 0.0f && path.causticChain <= 0 && !HitBvhAny(hdriRay);
+
+            batch.SetLane(k, path.material, V, N, hdriRay.direction);
+        }
+
+        evaluate();
+
+        for (int k = 0; k < count; k++)
+        {
+            PathState& path = tileState.paths[lanes[k]];
+            if (!path.lightVisible || batch.pdf[k] <= 0.0f)
+            {
+                continue;
+            }
+
+            float pdfLight = 0.0f;
+            glm::vec3 colorLight = EvaluateHdri(path.lightDirection, pdfLight);
+
+            // Multiple importance sampling
+            float misWeight = DisneyBrdf::MisMixWeight(pdfLight, getScatterPdf(path, path.lightDirection, batch.pdf[k]));
+            if (misWeight > 0.0f)
+            {
+                path.radiance += misWeight * path.throughput * colorLight * batch.GetF(k) / pdfLight;
+            }
+        }
+
+        // Direct emissive triangle contribution
+        if (IsEmissiveSamplingEnabled())
+        {
+            for (int k = 0; k < count; k++)
+            {
+                PathState& path = tileState.paths[lanes[k]];
+                glm::vec3 V = -path.hitInfo.hitDirection;
+                glm::vec3 N = path.hitInfo.shadingNormal;
+
+                float lightDistance = 0.0f;
+                path.emissiveRadiance = SampleEmissiveTriangle(path.hitInfo.hitPosition, N, path.sampler.Get3D(Sampler::GetBounceDimension(bounce, Sampler::DimensionEmissive)), path.emissiveDirection, lightDistance, path.emissivePdf);
+                path.emissiveVisible = path.emissivePdf > 0.0f && glm::dot(N, path.emissiveDirection) > 0.0f && path.causticChain <= 0;
+
+                // Cast shadow ray, which stops just before the sampled point, so the light itself does not occlude
+                if (path.emissiveVisible)
+                {
+                    Ray emissiveRay;
+                    emissiveRay.origin = OffsetRay(path.hitInfo.hitPosition, path.hitInfo.geometryNormal);
+                    emissiveRay.direction = path.emissiveDirection;
+                    path.emissiveVisible = !HitBvhAny(emissiveRay, lightDistance * 0.999f);
+                }
+
+                batch.SetLane(k, path.material, V, N, path.emissiveDirection);
+            }
+
+            evaluate();
+
+            for (int k = 0; k < count; k++)
+            {
+                PathState& path = tileState.paths[lanes[k]];
+                if (!path.emissiveVisible || batch.pdf[k] <= 0.0f)
+                {
+                    continue;
+                }
+
+                // Multiple importance sampling
+                float misWeight = DisneyBrdf::MisMixWeight(path.emissivePdf, getScatterPdf(path, path.emissiveDirection, batch.pdf[k]));
+                path.radiance += misWeight * path.throughput * path.emissiveRadiance * batch.GetF(k) / path.emissivePdf;
+            }
+        }
+    }
+
+    // Sample BRDF to get a direction L
+    for (int k = 0; k < count; k++)
+    {
+        PathState& path = tileState.paths[lanes[k]];
+        glm::vec3 V = -path.hitInfo.hitDirection;
+
+        glm::vec3 Xi = path.sampler.Get3D(Sampler::GetBounceDimension(bounce, Sampler::DimensionBrdf));
+        glm::vec3 L;
+
+        // One-sample MIS between guided and BRDF sampling, the first random number picks the strategy and is reused
+        if (path.guidingTree != nullptr && Xi.x < PathGuiding::SamplingFraction)
+        {
+            Xi.x = std::min(Xi.x / PathGuiding::SamplingFraction, 0.99999994f);
+            L = path.guidingTree->Sample(glm::vec2(Xi.x, Xi.y));
+        }
+        else
+        {
+            if (path.guidingTree != nullptr)
+            {
+                Xi.x = std::min((Xi.x - PathGuiding::SamplingFraction) / (1.0f - PathGuiding::SamplingFraction), 0.99999994f);
+            }
+
+            DisneyBrdf::BrdfData samplingBrdfData = DisneyBrdf::PrepareEvaluationBrdfData(path.material, V, path.hitInfo.shadingNormal, glm::vec3(0.0f));
+            L = DisneyBrdf::SampleDisneyBrdf(path.material, samplingBrdfData, Xi, lobes);
+        }
+
+        batch.SetDirection(k, L);
+    }
+
+    evaluate();
+
+    for (int k = 0; k < count; k++)
+    {
+        PathState& path = tileState.paths[lanes[k]];
+
+        glm::vec3 L = glm::vec3(batch.Lx[k], batch.Ly[k], batch.Lz[k]);
+
+        path.f = batch.GetF(k);
+        if (batch.pdf[k] <= 0.0f)
+        {
+            path.alive = false;
+            continue;
+        }
+
+        // Density the direction was actually sampled with, also used for MIS at the next hit
+        path.pdfBrdf = getScatterPdf(path, L, batch.pdf[k]);
+
+        // Russian roulette
+        float p = std::max(path.throughput.r, std::max(path.throughput.g, path.throughput.b));
+
+        // Adjoint-driven, only paths expected to contribute less than the lower bound of the weight window are played
+        float adjointRatio = 0.0f;
+        if (m_frameSettings.adjointRussianRouletteEnabled && GetAdjointRatio(path, adjointRatio))
+        {
+            float lowerBound = 2.0f / (1.0f + AdjointWeightWindowSize);
+            p = adjointRatio < lowerBound ? std::max(adjointRatio, AdjointMinSurvival) : 1.0f;
+        }
+        if (path.sampler.Get1D(Sampler::GetBounceDimension(bounce, Sampler::DimensionRussianRoulette)) >= p)
+        {
+            path.alive = false;
+            continue;
+        }
+        path.throughput *= 1.0f / p;
+
+        // Accumulate result
+        path.throughput *= path.f / path.pdfBrdf;
+
+        // Setup ray for the next bounce
+        path.ray.origin = OffsetRay(path.hitInfo.hitPosition, path.hitInfo.geometryNormal);
+        path.ray.direction = L;
+        ScatterRayCone(path.rayCone, path.material.roughness);
+
+        if (path.guidingLeaf >= 0)
+        {
+            path.guidingVertices[path.guidingVertexCount++] = GuidingVertex{ path.guidingLeaf, L, path.radiance, path.throughput, path.pdfBrdf };
+        }
+
+        path.previousPosition = path.hitInfo.hitPosition;
+        path.previousNormal = path.hitInfo.shadingNormal;
+        path.directLightingReused = reuseDirectLighting;
+
+        // Save data on the first bounce
+        if (bounce == 0)
+        {
+            path.primaryAlbedo = path.material.albedo;
+            path.primaryNormal = path.hitInfo.shadingNormal;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Bidirectional path tracing
+// -------------------------------------------------------------------------
+
+float PathTracingCpuBackend::GetCameraPdf(const glm::vec3& direction) const
+{
+    size_t pixel = 0;
+    float cosTheta = glm::dot(direction, m_cameraForward);
+    if (cosTheta <= 0.0f || !GetRasterPixel(m_cameraPosition + direction, pixel))
+    {
+        return 0.0f;
+    }
+
+    // Rays are uniform over the image at distance 1, whose area is seen under cos^3 per solid angle
+    return 1.0f / (m_imagePlaneArea * cosTheta * cosTheta * cosTheta);
+}
+
+bool PathTracingCpuBackend::GetRasterPixel(const glm::vec3& position, size_t& pixel) const
+{
+    glm::vec4 clipPos = m_viewProjMatrix * glm::vec4(position, 1.0f);
+    if (clipPos.w <= 0.0f)
+    {
+        return false;
+    }
+
+    // Inverse of the uv mapping of GenerateCameraRay
+    glm::vec2 uv = glm::vec2(clipPos) / clipPos.w * 0.5f + 0.5f;
+    if (uv.x < 0.0f || uv.y < 0.0f || uv.x >= 1.0f || uv.y >= 1.0f)
+    {
+        return false;
+    }
+
+    int x = std::min((int)(uv.x * (float)m_width), m_width - 1);
+    int y = std::min((int)(uv.y * (float)m_height), m_height - 1);
+    pixel = (size_t)y * m_width + x;
+    return true;
+}
+
+float PathTracingCpuBackend::GetLightOriginPdf(unsigned int emissiveIndex) const
+{
+    const EmissiveTriangle& emissiveTriangle = m_emissiveTriangles[emissiveIndex];
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[emissiveTriangle.primitiveIndex];
+
+    // Triangles are picked by power and sampled uniformly over their area
+    float doubleArea = glm::length(glm::cross(primitive.posB - primitive.posA, primitive.posC - primitive.posA));
+    return doubleArea > 0.0f ? emissiveTriangle.pdf * 2.0f / doubleArea : 0.0f;
+}
+
+float PathTracingCpuBackend::GetEmissionPdf(const BidirectionalVertex& light, const BidirectionalVertex& next) const
+{
+    // Cosine weighted emission, only towards the front side, which is the only side rays can hit a light from
+    glm::vec3 L = glm::normalize(next.position - light.position);
+    return light.ConvertDensity(std::abs(glm::dot(light.geometryNormal, L)) * ONE_OVER_PI, next);
+}
+
+bool PathTracingCpuBackend::SampleBidirectionalLight(const glm::vec3& Xi, BidirectionalVertex& vertex) const
+{
+    float pmf = 0.0f;
+    unsigned int emissiveIndex = SampleEmissiveTriangleIndex(Xi.x, pmf);
+    const BVH::BvhPrimitive& primitive = m_bvhPrimitives[m_emissiveTriangles[emissiveIndex].primitiveIndex];
+
+    EmissivePoint point = SampleEmissiveTrianglePoint(primitive, glm::vec2(Xi.y, Xi.z));
+    if (point.area <= 0.0f || pmf <= 0.0f)
+    {
+        return false;
+    }
+
+    vertex = BidirectionalVertex{ };
+    vertex.type = BidirectionalVertex::Light;
+    vertex.position = point.position;
+    vertex.normal = point.normal;
+    vertex.geometryNormal = vertex.normal;
+    vertex.emissiveIndex = emissiveIndex;
+    vertex.emission = GetEmission(primitive, point.uv);
+    vertex.pdfFwd = pmf / point.area;
+    vertex.throughput = vertex.emission / vertex.pdfFwd;
+
+    return true;
+}
+
+glm::vec3 PathTracingCpuBackend::EvaluateBidirectionalBsdf(const BidirectionalVertex& vertex, const glm::vec3& toCamera, const glm::vec3& toLight) const
+{
+    // Radiance arrives from the light side and leaves towards the camera side, also for the vertices of light subpaths
+    // The Disney BRDF includes the cosine towards L, which the connections apply themselves
+    float cosLight = std::abs(glm::dot(vertex.normal, toLight));
+    if (cosLight <= 1e-6f)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    float pdf = 0.0f;
+    DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(vertex.material, toCamera, vertex.normal, toLight);
+    return DisneyBrdf::EvaluateDisneyBrdf(vertex.material, brdfData, pdf, vertex.lobes) / cosLight;
+}
+
+float PathTracingCpuBackend::GetBidirectionalPdf(const BidirectionalVertex& vertex, const BidirectionalVertex* previous, const BidirectionalVertex& next) const
+{
+    glm::vec3 toNext = glm::normalize(next.position - vertex.position);
+
+    float pdf = 0.0f;
+    switch (vertex.type)
+    {
+    case BidirectionalVertex::Camera:
+        pdf = GetCameraPdf(toNext);
+        break;
+
+    case BidirectionalVertex::Light:
+        return GetEmissionPdf(vertex, next);
+
+    case BidirectionalVertex::Surface:
+    {
+        // Both subpaths sample the next direction with the previous one as view direction
+        glm::vec3 toPrevious = glm::normalize(previous->position - vertex.position);
+        DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(vertex.material, toPrevious, vertex.normal, toNext);
+        DisneyBrdf::EvaluateDisneyBrdf(vertex.material, brdfData, pdf, vertex.lobes);
+        break;
+    }
+    }
+
+    return vertex.ConvertDensity(pdf, next);
+}
+
+bool PathTracingCpuBackend::IsBidirectionalVisible(const BidirectionalVertex& from, const glm::vec3& to) const
+{
+    glm::vec3 offset = to - from.position;
+    float distance = glm::length(offset);
+
+    Ray ray;
+    ray.direction = offset / distance;
+    ray.origin = OffsetRay(from.position, glm::dot(ray.direction, from.geometryNormal) > 0.0f ? from.geometryNormal : -from.geometryNormal);
+
+    // Stops just before the other vertex, so its own triangle does not occlude
+    return !HitBvhAny(ray, distance * 0.999f);
+}
+
+int PathTracingCpuBackend::TraceBidirectionalSubpath(Ray ray, glm::vec3 throughput, float pdf, Sampler& sampler, unsigned int firstBounce, BidirectionalVertex* vertices, int maxVertexCount, glm::vec3* environmentRadiance, TileState& tileState) const
+{
+    const bool cameraSubpath = environmentRadiance != nullptr;
+
+    // The first vertex is the camera or the light, pdf is the solid angle density of the ray leaving it
+    int vertexCount = 1;
+    while (vertexCount < maxVertexCount)
+    {
+        HitInfo hitInfo = HitBvhClosest(ray);
+        tileState.rayCount++;
+
+        // Missed - HDRI light contribution, with the same MIS as the path tracer
+        if (!hitInfo.didHit)
+        {
+            if (cameraSubpath)
+            {
+                float pdfLight = 0.0f;
+                glm::vec3 colorLight = EvaluateHdri(ray.direction, pdfLight);
+
+                float misWeight = vertexCount > 1 ? DisneyBrdf::MisMixWeight(pdf, pdfLight) : 1.0f;
+                *environmentRadiance += misWeight * throughput * colorLight;
+            }
+            break;
+        }
+
+        const MaterialData& materialData = m_materials[hitInfo.materialIndex];
+
+        BidirectionalVertex& previous = vertices[vertexCount - 1];
+        BidirectionalVertex& vertex = vertices[vertexCount++];
+        vertex = BidirectionalVertex{ };
+        vertex.material = EvaluateMaterial(materialData, hitInfo);
+        vertex.lobes = materialData.lobes | m_modifierLobes;
+        vertex.position = hitInfo.hitPosition;
+        vertex.normal = hitInfo.shadingNormal;
+        vertex.geometryNormal = hitInfo.geometryNormal;
+        vertex.emissiveIndex = hitInfo.emissiveIndex;
+        vertex.throughput = throughput;
+        vertex.pdfFwd = previous.ConvertDensity(pdf, vertex);
+
+        if (vertexCount >= maxVertexCount)
+        {
+            break;
+        }
+
+        glm::vec3 V = -ray.direction;
+        glm::vec3 N = vertex.normal;
+        unsigned int bounce = firstBounce + (unsigned int)vertexCount - 2;
+
+        // Direct HDRI light contribution, the HDRI is not part of the light subpaths
+        if (cameraSubpath)
+        {
+            Ray hdriRay;
+            hdriRay.origin = OffsetRay(vertex.position, vertex.geometryNormal);
+            hdriRay.direction = SampleHdri(sampler.Get2D(Sampler::GetBounceDimension(bounce, Sampler::DimensionHdri)));
+
+            if (glm::dot(N, hdriRay.direction) > 0.0f && !HitBvhAny(hdriRay))
+            {
+                float pdfBrdf = 0.0f;
+                DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(vertex.material, V, N, hdriRay.direction);
+                glm::vec3 f = DisneyBrdf::EvaluateDisneyBrdf(vertex.material, brdfData, pdfBrdf, vertex.lobes);
+
+                float pdfLight = 0.0f;
+                glm::vec3 colorLight = EvaluateHdri(hdriRay.direction, pdfLight);
+
+                if (pdfBrdf > 0.0f && pdfLight > 0.0f)
+                {
+                    *environmentRadiance += DisneyBrdf::MisMixWeight(pdfLight, pdfBrdf) * throughput * colorLight * f / pdfLight;
+                }
+            }
+        }
+
+        // Sample BRDF to get a direction L
+        DisneyBrdf::BrdfData samplingBrdfData = DisneyBrdf::PrepareEvaluationBrdfData(vertex.material, V, N, glm::vec3(0.0f));
+        glm::vec3 L = DisneyBrdf::SampleDisneyBrdf(vertex.material, samplingBrdfData, sampler.Get3D(Sampler::GetBounceDimension(bounce, Sampler::DimensionBrdf)), vertex.lobes);
+
+        float pdfForward = 0.0f;
+        DisneyBrdf::BrdfData brdfData = DisneyBrdf::PrepareEvaluationBrdfData(vertex.material, V, N, L);
+        glm::vec3 f = DisneyBrdf::EvaluateDisneyBrdf(vertex.material, brdfData, pdfForward, vertex.lobes);
+
+        // Density of sampling the way back, which the other subpath's strategies need for MIS
+        float pdfReverse = 0.0f;
+        DisneyBrdf::BrdfData reverseBrdfData = DisneyBrdf::PrepareEvaluationBrdfData(vertex.material, L, N, V);
+        glm::vec3 fReverse = DisneyBrdf::EvaluateDisneyBrdf(vertex.material, reverseBrdfData, pdfReverse, vertex.lobes);
+
+        if (pdfForward <= 0.0f)
+        {
+            break;
+        }
+
+        if (cameraSubpath)
+        {
+            throughput *= f / pdfForward;
+        }
+        else
+        {
+            // Light arrives from V and leaves towards L, the cosine of the evaluation is swapped for the one towards L
+            float cosView = std::abs(glm::dot(N, V));
+            if (cosView <= 1e-6f)
+            {
+                break;
+            }
+            throughput *= fReverse * std::abs(glm::dot(N, L)) / (cosView * pdfForward);
+        }
+
+        previous.pdfRev = vertex.ConvertDensity(pdfReverse, previous);
+        pdf = pdfForward;
+
+        ray.origin = OffsetRay(vertex.position, glm::dot(L, vertex.geometryNormal) > 0.0f ? vertex.geometryNormal : -vertex.geometryNormal);
+        ray.direction = L;
+    }
+
+    return vertexCount;
+}
+
+float PathTracingCpuBackend::GetBidirectionalMisWeight(const BidirectionalVertex* cameraVertices, int t, const BidirectionalVertex* lightVertices, int s, const BidirectionalVertex& sampledLight, bool lightTracing) const
+{
+    if (s + t == 2)
+    {
+        return 1.0f;
+    }
+
+    // Densities of the path's vertices, the ones around the connection depend on the strategy
+    std::array<float, MaxCameraVertexCount> cameraPdfFwd, cameraPdfRev;
+    std::array<float, MaxLightVertexCount> lightPdfFwd, lightPdfRev;
+    for (int i = 0; i < t; i++)
+    {
+        cameraPdfFwd[i] = cameraVertices[i].pdfFwd;
+        cameraPdfRev[i] = cameraVertices[i].pdfRev;
+    }
+    for (int i = 0; i < s; i++)
+    {
+        lightPdfFwd[i] = lightVertices[i].pdfFwd;
+        lightPdfRev[i] = lightVertices[i].pdfRev;
+    }
+
+    // Connections to a newly sampled light replace the light vertex of the subpath
+    const BidirectionalVertex& pt = cameraVertices[t - 1];
+    const BidirectionalVertex* qs = s > 1 ? &lightVertices[s - 1] : (s == 1 ? &sampledLight : nullptr);
+    const BidirectionalVertex* ptMinus = t > 1 ? &cameraVertices[t - 2] : nullptr;
+    const BidirectionalVertex* qsMinus = s > 1 ? &lightVertices[s - 2] : nullptr;
+    if (s == 1)
+    {
+        lightPdfFwd[0] = sampledLight.pdfFwd;
+    }
+
+    cameraPdfRev[t - 1] = qs != nullptr ? GetBidirectionalPdf(*qs, qsMinus, pt) : GetLightOriginPdf(pt.emissiveIndex);
+    if (ptMinus != nullptr)
+    {
+        cameraPdfRev[t - 2] = qs != nullptr ? GetBidirectionalPdf(pt, qs, *ptMinus) : GetEmissionPdf(pt, *ptMinus);
+    }
+    if (qs != nullptr)
+    {
+        lightPdfRev[s - 1] = GetBidirectionalPdf(pt, ptMinus, *qs);
+    }
+    if (qsMinus != nullptr)
+    {
+        lightPdfRev[s - 2] = GetBidirectionalPdf(*qs, &pt, *qsMinus);
+    }
+
+    // Power heuristic over every strategy that could have sampled the same path, relative to this one
+    auto remap = [](float pdf) { return pdf != 0.0f ? pdf : 1.0f; };
+
+    float sum = 0.0f;
+    float ratio = 1.0f;
+    for (int i = t - 1; i > (lightTracing ? 0 : 1); i--)
+    {
+        ratio *= remap(cameraPdfRev[i]) / remap(cameraPdfFwd[i]);
+        sum += ratio * ratio;
+    }
+
+    ratio = 1.0f;
+    for (int i = s - 1; i >= 0; i--)
+    {
+        ratio *= remap(lightPdfRev[i]) / remap(lightPdfFwd[i]);
+        sum += ratio * ratio;
+    }
+
+    return 1.0f / (1.0f + sum);
+}
+
+glm::vec3 PathTracingCpuBackend::ConnectBidirectional(const BidirectionalVertex* cameraVertices, int t, const BidirectionalVertex* lightVertices, int s, Sampler& sampler, bool lightTracing, size_t& splatPixel) const
+{
+    const BidirectionalVertex& pt = cameraVertices[t - 1];
+    BidirectionalVertex sampledLight;
+    glm::vec3 contribution = glm::vec3(0.0f);
+
+    if (s == 0)
+    {
+        // The camera subpath hit a light by itself
+        contribution = pt.throughput * pt.material.emission;
+        if (!glm::any(glm::greaterThan(contribution, glm::vec3(0.0f))))
+        {
+            return glm::vec3(0.0f);
+        }
+
+        // Lights the light subpaths cannot start from have no other strategy
+        if (!IsEmissiveSamplingEnabled() || pt.emissiveIndex == 0xffffffff)
+        {
+            return contribution;
+        }
+    }
+    else if (t == 1)
+    {
+        // Light tracing, the light subpath is connected to the camera and splatted to the pixel it projects to
+        const BidirectionalVertex& qs = lightVertices[s - 1];
+        if (!GetRasterPixel(qs.position, splatPixel))
+        {
+            return glm::vec3(0.0f);
+        }
+
+        glm::vec3 toCamera = m_cameraPosition - qs.position;
+        float distanceSquared = glm::dot(toCamera, toCamera);
+        toCamera /= std::sqrt(distanceSquared);
+
+        // Importance times the cosine at the camera is the density of the camera rays
+        glm::vec3 f = EvaluateBidirectionalBsdf(qs, toCamera, glm::normalize(lightVertices[s - 2].position - qs.position));
+        contribution = qs.throughput * f * std::abs(glm::dot(qs.normal, toCamera)) * GetCameraPdf(-toCamera) / distanceSquared;
+
+        if (!glm::any(glm::greaterThan(contribution, glm::vec3(0.0f))) || !IsBidirectionalVisible(qs, m_cameraPosition))
+        {
+            return glm::vec3(0.0f);
+        }
+    }
+    else if (s == 1)
+    {
+        // Connect to a new point on a light, like the direct lighting of the path tracer
+        if (!SampleBidirectionalLight(sampler.Get3D(Sampler::GetBounceDimension(t - 2, Sampler::DimensionEmissive)), sampledLight))
+        {
+            return glm::vec3(0.0f);
+        }
+
+        glm::vec3 L = sampledLight.position - pt.position;
+        float distanceSquared = glm::dot(L, L);
+        L /= std::sqrt(distanceSquared);
+
+        float cosLight = -glm::dot(sampledLight.normal, L);
+        if (cosLight <= 0.0f)
+        {
+            return glm::vec3(0.0f);
+        }
+
+        glm::vec3 f = EvaluateBidirectionalBsdf(pt, glm::normalize(cameraVertices[t - 2].position - pt.position), L);
+        contribution = pt.throughput * f * sampledLight.throughput * std::abs(glm::dot(pt.normal, L)) * cosLight / distanceSquared;
+
+        if (!glm::any(glm::greaterThan(contribution, glm::vec3(0.0f))) || !IsBidirectionalVisible(pt, sampledLight.position))
+        {
+            return glm::vec3(0.0f);
+        }
+    }
+    else
+    {
+        // Connect the ends of both subpaths
+        const BidirectionalVertex& qs = lightVertices[s - 1];
+
+        glm::vec3 L = qs.position - pt.position;
+        float distanceSquared = glm::dot(L, L);
+        L /= std::sqrt(distanceSquared);
+
+        glm::vec3 fCamera = EvaluateBidirectionalBsdf(pt, glm::normalize(cameraVertices[t - 2].position - pt.position), L);
+        glm::vec3 fLight = EvaluateBidirectionalBsdf(qs, -L, glm::normalize(lightVertices[s - 2].position - qs.position));
+        float geometry = std::abs(glm::dot(pt.normal, L)) * std::abs(glm::dot(qs.normal, L)) / distanceSquared;
+        contribution = pt.throughput * fCamera * geometry * fLight * qs.throughput;
+
+        if (!glm::any(glm::greaterThan(contribution, glm::vec3(0.0f))) || !IsBidirectionalVisible(pt, qs.position))
+        {
+            return glm::vec3(0.0f);
+        }
+    }
+
+    return contribution * GetBidirectionalMisWeight(cameraVertices, t, lightVertices, s, sampledLight, lightTracing);
+}
+
+void PathTracingCpuBackend::RenderPixelBidirectional(TileState& tileState, int x, int y)
+{
+    size_t pixel = (size_t)y * m_width + x;
+
+    // The sample index is the amount of samples this pixel has taken
+    unsigned int sampleCount = (unsigned int)m_sums[pixel].sampleCount;
+    Sampler sampler(m_frameSettings.samplerType, x, y, m_width, m_height, sampleCount, m_frameSettings.sampleCount, m_frameSettings.seed);
+
+    // Light tracing splats with a box filter through a pinhole, which only matches anti-aliased rays of a pinhole camera
+    const bool lightTracing = m_frameSettings.apertureSize == 0.0f && m_frameSettings.antiAliasingEnabled;
+
+    glm::vec3 radiance = glm::vec3(0.0f);
+
+    // Camera subpath
+    std::array<BidirectionalVertex, MaxCameraVertexCount> cameraVertices;
+    Ray ray = GenerateCameraRay(x, y, sampler);
+
+    BidirectionalVertex& camera = cameraVertices[0];
+    camera = BidirectionalVertex{ };
+    camera.type = BidirectionalVertex::Camera;
+    camera.position = m_cameraPosition;
+    camera.throughput = glm::vec3(1.0f);
+
+    int cameraCount = TraceBidirectionalSubpath(ray, glm::vec3(1.0f), GetCameraPdf(ray.direction), sampler, 0, cameraVertices.data(), MaxCameraVertexCount, &radiance, tileState);
+
+    // Light subpath, cosine weighted from a point on an emissive triangle
+    std::array<BidirectionalVertex, MaxLightVertexCount> lightVertices;
+    int lightCount = 0;
+    if (IsEmissiveSamplingEnabled() && SampleBidirectionalLight(sampler.Get3D(Sampler::GetBounceDimension(LightSubpathBounce, Sampler::DimensionEmissive)), lightVertices[0]))
+    {
+        const BidirectionalVertex& light = lightVertices[0];
+
+        glm::vec2 Xi = sampler.Get2D(Sampler::GetBounceDimension(LightSubpathBounce, Sampler::DimensionBrdf));
+        Ray lightRay;
+        lightRay.origin = OffsetRay(light.position, light.normal);
+        lightRay.direction = DisneyBrdf::ToWorld(light.normal, DisneyBrdf::HemispherepointCos(Xi.x, Xi.y));
+
+        // The cosine of the emitted flux cancels with the one of the density
+        float pdfDirection = glm::dot(light.normal, lightRay.direction) * ONE_OVER_PI;
+        lightCount = 1;
+        if (pdfDirection > 0.0f)
+        {
+            lightCount = TraceBidirectionalSubpath(lightRay, light.throughput * PI, pdfDirection, sampler, LightSubpathBounce + 1, lightVertices.data(), MaxLightVertexCount, nullptr, tileState);
+        }
+    }
+
+    // Every strategy up to the maximum depth, each weighted against the others that could have sampled its path
+    std::vector<glm::vec3>& splats = m_splatBuffers[tileState.workerIndex];
+    for (int t = 1; t <= cameraCount; t++)
+    {
+        for (int s = 0; s <= lightCount; s++)
+        {
+            int depth = s + t - 2;
+            if ((s == 1 && t == 1) || depth < 0 || depth > BidirectionalMaxDepth || (t == 1 && !lightTracing))
+            {
+                continue;
+            }
+
+            size_t splatPixel = 0;
+            glm::vec3 contribution = ConnectBidirectional(cameraVertices.data(), t, lightVertices.data(), s, sampler, lightTracing, splatPixel);
+
+            if (t == 1)
+            {
+                // Only pixels of the render region are merged, and with them their splats cleared
+                if (IsInRenderRegion(splatPixel))
+                {
+                    splats[splatPixel] += contribution;
+                }
+            }
+            else
+            {
+                radiance += contribution;
+            }
+        }
+    }
+
+    m_bidirectionalRadiance[pixel] = glm::vec4(radiance, 1.0f);
+
+    // Albedo and normal of the primary hit, the radiance counts the sample when the frame is merged
+    if (cameraCount > 1)
+    {
+        AddPrimarySample(pixel, cameraVertices[1].material.albedo, cameraVertices[1].normal);
+    }
+}
+
+void PathTracingCpuBackend::MergeSplatTile(int tileX, int tileY, float splatScale)
+{
+    const int x0 = std::max(tileX * TileSize, m_renderRegion.x);
+    const int y0 = std::max(tileY * TileSize, m_renderRegion.y);
+    const int x1 = std::min((tileX + 1) * TileSize, m_renderRegion.z);
+    const int y1 = std::min((tileY + 1) * TileSize, m_renderRegion.w);
+
+    const bool bidirectional = m_frameSettings.integrator == Integrator::Bidirectional;
+
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            size_t pixel = (size_t)y * m_width + x;
+
+            // Splat buffers are cleared for the next frame, also where converged pixels were not traced
+            glm::vec3 splat = glm::vec3(0.0f);
+            for (std::vector<glm::vec3>& splats : m_splatBuffers)
+            {
+                splat += splats[pixel];
+                splats[pixel] = glm::vec3(0.0f);
+            }
+
+            glm::vec3 radiance = splat * splatScale;
+
+            if (bidirectional)
+            {
+                glm::vec4 cameraRadiance = m_bidirectionalRadiance[pixel];
+                if (cameraRadiance.w == 0.0f)
+                {
+                    continue;
+                }
+                m_bidirectionalRadiance[pixel] = glm::vec4(0.0f);
+
+                radiance += glm::vec3(cameraRadiance);
+            }
+            else
+            {
+                // Metropolis samples every pixel in every frame, sample statistics are reset together with the accumulation
+                if (m_accumulationReset)
+                {
+                    m_sums[pixel] = Accumulation::Pixel();
+                }
+
+                // Chains do not visit every pixel, so albedo and normal come from a primary ray of their own
+                unsigned int sampleCount = (unsigned int)m_sums[pixel].sampleCount;
+                Sampler sampler(m_frameSettings.samplerType, x, y, m_width, m_height, sampleCount, m_frameSettings.sampleCount, m_frameSettings.seed);
+
+                HitInfo hitInfo = HitBvhClosest(GenerateCameraRay(x, y, sampler));
+                glm::vec3 albedo = glm::vec3(0.0f);
+                glm::vec3 normal = glm::vec3(0.0f);
+                if (hitInfo.didHit)
+                {
+                    albedo = EvaluateMaterial(m_materials[hitInfo.materialIndex], hitInfo).albedo;
+                    normal = hitInfo.shadingNormal;
+                }
+
+                AddPrimarySample(pixel, albedo, normal);
+            }
+
+            // Temporal accumulation, the buffers are the means of all samples of the pixel
+            AddRadianceSample(pixel, radiance);
+        }
+    }
+}
+
+// -------------------------------------------------------------------------
+//    Primary sample space Metropolis
+// -------------------------------------------------------------------------
+
+void PathTracingCpuBackend::GetBootstrapSamples(unsigned int bootstrapIndex, float* samples) const
+{
+    // Every bootstrap path has its own PCG stream, so a chain can start from the numbers of the path it picked
+    Sampler sampler(Sampler::Pcg, bootstrapIndex, 0, MetropolisBootstrapCount, 1, 0, 1, m_frameSettings.seed);
+    for (unsigned int i = 0; i < MetropolisSampleCount; i++)
+    {
+        samples[i] = sampler.Get1D(0);
+    }
+}
+
+void PathTracingCpuBackend::TraceMetropolisBatch(TileState& tileState, int laneCount)
+{
+    const glm::vec2 frameDimensions = glm::vec2((float)m_width, (float)m_height);
+
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        PathState& path = tileState.paths[lane];
+        path.sampler = Sampler(tileState.primarySamples[lane].data());
+
+        // The anti-aliasing dimension picks a point on the whole image, and with it the pixel
+        glm::vec2 uv = path.sampler.Get2D(Sampler::DimensionAntiAliasing);
+        int x = std::min((int)(uv.x * frameDimensions.x), m_width - 1);
+        int y = std::min((int)(uv.y * frameDimensions.y), m_height - 1);
+        StartPath(path, (size_t)y * m_width + x);
+
+        if (!m_frameSettings.antiAliasingEnabled)
+        {
+            uv = (glm::vec2((float)x, (float)y) + 0.5f) / frameDimensions;
+        }
+        path.ray = GeneratePrimaryRay(uv, path.sampler);
+    }
+    tileState.pathCount += laneCount;
+
+    TracePaths(tileState, laneCount);
+
+    // A single invalid path would otherwise poison its chain and the normalization
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        glm::vec3& radiance = tileState.paths[lane].radiance;
+        if (!std::isfinite(radiance.x + radiance.y + radiance.z))
+        {
+            radiance = glm::vec3(0.0f);
+        }
+    }
+}
+
+void PathTracingCpuBackend::TraceMetropolisBootstrap(TileState& tileState, int batch, std::vector<float>& luminances)
+{
+    const int laneCount = TileSize * TileSize;
+    const unsigned int first = (unsigned int)(batch * laneCount);
+
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        GetBootstrapSamples(first + lane, tileState.primarySamples[lane].data());
+    }
+
+    TraceMetropolisBatch(tileState, laneCount);
+
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        luminances[first + lane] = DisneyBrdf::Luminance(tileState.paths[lane].radiance);
+    }
+}
+
+void PathTracingCpuBackend::StartMetropolisChains(TileState& tileState, int batch, const std::vector<unsigned int>& bootstrapIndices)
+{
+    const int laneCount = TileSize * TileSize;
+    const unsigned int first = (unsigned int)(batch * laneCount);
+
+    // Tracing the bootstrap path again is cheaper than keeping the numbers of every bootstrap path around
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        GetBootstrapSamples(bootstrapIndices[first + lane], tileState.primarySamples[lane].data());
+    }
+
+    TraceMetropolisBatch(tileState, laneCount);
+
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        const PathState& path = tileState.paths[lane];
+
+        MetropolisChain& chain = m_metropolisChains[first + lane];
+        chain.samples = tileState.primarySamples[lane];
+        chain.radiance = path.radiance;
+        chain.luminance = DisneyBrdf::Luminance(path.radiance);
+        chain.pixel = path.pixel;
+        chain.random = Sampler(Sampler::Pcg, first + lane, 0, MetropolisChainCount, 1, 1, 1, m_frameSettings.seed);
+    }
+}
+
+void PathTracingCpuBackend::MutateMetropolisChains(TileState& tileState, int batch, int stepCount)
+{
+    const int laneCount = TileSize * TileSize;
+    MetropolisChain* chains = &m_metropolisChains[(size_t)batch * laneCount];
+
+    std::vector<glm::vec3>& splats = m_splatBuffers[tileState.workerIndex];
+    const float normalization = m_metropolisNormalization;
+    const float logStepRatio = std::log(MetropolisMaxStep / MetropolisMinStep);
+
+    std::array<bool, TileSize * TileSize> largeSteps;
+
+    for (int step = 0; step < stepCount; step++)
+    {
+        // Large steps draw a new path, small steps perturb every number of the current one and wrap it around the unit interval
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            MetropolisChain& chain = chains[lane];
+            std::array<float, MetropolisSampleCount>& samples = tileState.primarySamples[lane];
+
+            largeSteps[lane] = chain.random.Get1D(0) < MetropolisLargeStepProbability;
+            for (unsigned int i = 0; i < MetropolisSampleCount; i++)
+            {
+                float Xi = chain.random.Get1D(0);
+                if (largeSteps[lane])
+                {
+                    samples[i] = std::min(Xi, OneMinusEpsilon);
+                    continue;
+                }
+
+                // Exponentially distributed between the min and max step, the lower half of Xi steps down
+                float u = Xi < 0.5f ? 2.0f * Xi : 2.0f * Xi - 1.0f;
+                float offset = MetropolisMaxStep * std::exp(-logStepRatio * u);
+                float sample = chain.samples[i] + (Xi < 0.5f ? -offset : offset);
+                samples[i] = std::min(sample - std::floor(sample), OneMinusEpsilon);
+            }
+        }
+
+        TraceMetropolisBatch(tileState, laneCount);
+
+        // Both the proposal and the current state splat, weighted by the probability of being the next state
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            MetropolisChain& chain = chains[lane];
+            const PathState& path = tileState.paths[lane];
+            float luminance = DisneyBrdf::Luminance(path.radiance);
+
+            if (largeSteps[lane])
+            {
+                tileState.metropolisLuminanceSum += luminance;
+                tileState.metropolisLuminanceCount++;
+            }
+
+            // Only pixels of the render region are merged, and with them their splats cleared
+            float acceptance = chain.luminance > 0.0f ? std::min(luminance / chain.luminance, 1.0f) : 1.0f;
+            if (luminance > 0.0f && IsInRenderRegion(path.pixel))
+            {
+                splats[path.pixel] += path.radiance * (acceptance * normalization / luminance);
+            }
+            if (chain.luminance > 0.0f && IsInRenderRegion(chain.pixel))
+            {
+                splats[chain.pixel] += chain.radiance * ((1.0f - acceptance) * normalization / chain.luminance);
+            }
+
+            if (chain.random.Get1D(0) < acceptance)
+            {
+                chain.samples = tileState.primarySamples[lane];
+                chain.radiance = path.radiance;
+                chain.luminance = luminance;
+                chain.pixel = path.pixel;
+            }
+        }
+    }
+}
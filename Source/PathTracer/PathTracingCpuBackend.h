@@ -0,0 +1,545 @@
+#pragma once
+
+#include "Accumulation.h"
+#include "BVH.h"
+#include "DisneyBrdf.h"
+#include "LightTree.h"
+#include "PathGuiding.h"
+#include "PhotonMap.h"
+#include "RadianceCache.h"
+#include "Sampler.h"
+#include "TextureCache.h"
+#include "Shader/Material.h"
+#include <glm/glm.hpp>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class Texture2DObject;
+
+// Multithreaded CPU implementation of pathtracing.comp
+// Renders tiles into CPU accumulation buffers, which are uploaded to the path tracing textures by the render pass
+class PathTracingCpuBackend
+{
+public:
+    // Light transport algorithm of the CPU backend
+    enum class Integrator
+    {
+        PathTracing,        // Unidirectional, same as pathtracing.comp
+        Bidirectional,      // Connects camera and light subpaths, see "Robust Monte Carlo Methods for Light Transport Simulation" (Veach 1997)
+    };
+
+    // Per frame data, mirrors the uniforms of pathtracing.comp
+    struct FrameSettings
+    {
+        glm::mat4 viewMatrix = glm::mat4(1.0f);
+        glm::mat4 invProjMatrix = glm::mat4(1.0f);
+        unsigned int frameCount = 1;
+        unsigned int frameSampleCount = 1;  // Samples per pixel rendered by a frame, frameCount is the one of the first
+
+        // Pixels rendered, at most the dimensions of the backend, 0 for all of them. Dynamic resolution renders fewer
+        glm::ivec2 renderDimensions = glm::ivec2(0);
+
+        // Min and max corner of the pixels rendered, the others keep their accumulation. An empty region renders all of them
+        glm::ivec4 renderRegion = glm::ivec4(0);
+
+        Sampler::Type samplerType = Sampler::Type::Sobol;
+        unsigned int sampleCount = 1;   // Frames the image converges over
+        unsigned int seed = 0;          // Independent renders of the same image take distinct seeds, see Accumulation
+
+        Integrator integrator = Integrator::PathTracing;
+
+        // Primary sample space Metropolis on top of the path tracer, ignored by the bidirectional integrator
+        bool metropolisEnabled = false;
+
+        bool adaptiveSamplingEnabled = false;
+        float noiseThreshold = 0.02f;
+        unsigned int minSampleCount = 16;
+
+        bool emissiveSamplingEnabled = false;
+        bool lightTreeEnabled = true;
+
+        bool pathGuidingEnabled = false;
+
+        bool reservoirResamplingEnabled = false;
+
+        bool causticPhotonsEnabled = false;
+
+        bool radianceCacheEnabled = false;
+
+        bool adjointRussianRouletteEnabled = false;
+
+        // Keeps the accumulation of surfaces which stay visible when only the camera moved, path tracer only
+        bool temporalReprojectionEnabled = false;
+        bool cameraMoved = false;       // Only the camera changed since the last frame
+
+        bool antiAliasingEnabled = true;
+        float focalLength = 3.5f;
+        float apertureSize = 0.0f;
+        glm::vec2 apertureShape = glm::vec2(1.0f, 1.0f);
+
+        DisneyBrdf::MaterialModifiers modifiers;
+    };
+
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    // Texture LOD of hits without a ray cone, below the full resolution of any texture
+    static constexpr float FullResolutionTextureLod = -128.0f;
+
+    struct HitInfo
+    {
+        bool didHit = false;
+        glm::vec3 hitPosition;
+        glm::vec3 hitDirection;
+        float dst;
+        glm::vec2 uv;
+        glm::vec3 shadingNormal;
+        glm::vec3 geometryNormal;
+        glm::vec3 tangent;
+        unsigned int materialIndex = 0;
+        unsigned int emissiveIndex = 0xffffffff;
+        float textureLodBias = 0.0f;                    // Triangle's part of the texture LOD
+        float textureLod = FullResolutionTextureLod;    // Texture LOD of the ray cone footprint for a 1x1 texture
+    };
+
+    // Material as uploaded to the GPU, with texture indices instead of bindless handles
+    struct MaterialData
+    {
+        std::array<int, Material::TextureSlotCount> textureIndices;     // -1 when the slot is empty
+        DisneyBrdf::Material attributes;
+        unsigned int lobes = DisneyBrdf::LobeAll;                       // Lobes the material can contribute to
+    };
+
+    // Alias table entry of an emissive triangle, same layout as the emissive triangle buffer
+    struct EmissiveTriangle
+    {
+        unsigned int primitiveIndex = 0;    // BVH primitive of the triangle
+        unsigned int alias = 0;             // Alias table entry
+        float aliasProbability = 1.0f;      // Probability of keeping this entry instead of the alias
+        float pdf = 0.0f;                   // Probability of picking this triangle, proportional to emitted power
+    };
+
+    // CPU copy of a texture, sampled like the GPU sampler with bilinear filtering and repeat wrapping
+    struct Texture
+    {
+        int width = 0;
+        int height = 0;
+        bool srgb = false;
+        std::vector<unsigned char> ldrTexels;   // RGBA8, for LDR textures
+        std::vector<float> hdrTexels;           // RGB32F, for HDR textures
+
+        glm::vec4 Fetch(int x, int y) const;
+        glm::vec4 Sample(const glm::vec2& uv) const;
+    };
+
+    // Scene data of the Process functions below, taken out of the backend to keep a scene resident while others render
+    struct SceneData
+    {
+        std::vector<BVH::BvhNode> bvhNodes;
+        std::vector<BVH::BvhPrimitive> bvhPrimitives;
+        std::vector<MaterialData> materials;
+        std::vector<EmissiveTriangle> emissiveTriangles;
+        std::vector<LightTree::LightTreeNode> lightTreeNodes;
+        std::vector<std::shared_ptr<Texture2DObject>> textureObjects;
+        std::unique_ptr<TextureCache> textureCache;     // Keeps its tiles in the backing file only, until restored
+        bool texturesDirty = false;
+    };
+
+    // HDRI of ProcessEnvironment with its CPU copies, once they are read back
+    struct EnvironmentData
+    {
+        std::shared_ptr<Texture2DObject> hdriObject;
+        std::shared_ptr<Texture2DObject> hdriCacheObject;
+        Texture hdri;
+        Texture hdriCache;
+        bool dirty = false;
+    };
+
+public:
+    PathTracingCpuBackend(int width, int height);
+
+    // Scene data, fed by the matching Process*Buffer functions of the renderer
+    void ProcessEnvironment(std::shared_ptr<Texture2DObject> hdri, std::shared_ptr<Texture2DObject> hdriCache);
+    void ProcessMaterials(std::vector<MaterialData> materials, std::vector<std::shared_ptr<Texture2DObject>> textures);
+    void ProcessBvhNodes(std::vector<BVH::BvhNode> bvhNodes);
+    void ProcessBvhPrimitives(std::vector<BVH::BvhPrimitive> bvhPrimitives);
+    void ProcessEmissiveTriangles(std::vector<EmissiveTriangle> emissiveTriangles);
+    void ProcessLightTree(std::vector<LightTree::LightTreeNode> lightTreeNodes);
+
+    // Moves the scene or environment out of the backend, which is left without one, and back in
+    std::unique_ptr<SceneData> TakeScene();
+    void RestoreScene(std::unique_ptr<SceneData> scene);
+    std::unique_ptr<EnvironmentData> TakeEnvironment();
+    void RestoreEnvironment(std::unique_ptr<EnvironmentData> environment);
+
+    void SetFrameSettings(const FrameSettings& frameSettings) { m_frameSettings = frameSettings; }
+
+    // Forget the learned guiding distributions, e.g. when the scene changes
+    void ResetPathGuiding() { m_pathGuiding.Reset(); }
+    const PathGuiding& GetPathGuiding() const { return m_pathGuiding; }
+
+    const PhotonMap& GetCausticPhotonMap() const { return m_causticPhotonMap; }
+
+    // Forget the cached radiance, e.g. when the scene changes
+    void ResetRadianceCache() { m_radianceCache.Clear(); }
+    const RadianceCache& GetRadianceCache() const { return m_radianceCache; }
+
+    // Render the samples per pixel of a frame and accumulate them. Must be called from the thread owning the GL context
+    void RenderFrame();
+
+    HitInfo HitBvhClosest(const Ray& ray) const;
+    bool HitBvhAny(const Ray& ray) const;
+    bool HitBvhAny(const Ray& ray, float maxDistance) const;
+
+    // Copies the texels of a mip level of a GL texture, must be called from the thread owning the GL context
+    // False if the texture does not have the level
+    static bool ReadbackTexture(Texture2DObject& textureObject, Texture& texture, int level = 0);
+
+    // Dimensions of the last frame, the accumulation buffers hold as many pixels with rows this wide
+    const int GetWidth()  const { return m_width; }
+    const int GetHeight() const { return m_height; }
+
+    const std::vector<glm::vec4>& GetRadianceData()      const { return m_radiance; }
+    const std::vector<glm::vec4>& GetPrimaryAlbedoData() const { return m_primaryAlbedo; }
+    const std::vector<glm::vec4>& GetPrimaryNormalData() const { return m_primaryNormal; }
+    const std::vector<glm::vec4>& GetSampleStatsData()   const { return m_sampleStats; }
+
+    // Sums of the samples of the last frame's pixels, to checkpoint the accumulation or merge it with other renders
+    Accumulation GetAccumulation() const;
+    // The next frame that starts the accumulation over continues from these samples instead, if its dimensions match
+    void ResumeAccumulation(Accumulation accumulation) { m_resumedAccumulation = std::move(accumulation); }
+
+    // Pixels of tiles that have not converged in the last frame
+    const unsigned int GetActivePixelCount() const { return m_activePixelCount; }
+
+    void SetBatchedShadingEnabled(bool value) { m_batchedShadingEnabled = value; }
+    const bool GetBatchedShadingEnabled() const { return m_batchedShadingEnabled; }
+
+    // Average BRDF shading time per hit of the last frame
+    const double GetShadingNanosecondsPerHit() const { return m_shadingNanosecondsPerHit; }
+    // Render time of the last frame, all of its samples
+    const float GetFrameMilliseconds() const { return m_frameMilliseconds; }
+
+    // Closest hit rays per active pixel of the last frame, shadow rays are not counted
+    const float GetRaysPerPixel() const { return m_raysPerPixel; }
+
+    // Memory the CPU backend may keep material texture tiles in
+    void SetTextureCacheBudget(size_t maxBytes) { m_textureCache->SetBudget(maxBytes); }
+    const size_t GetTextureCacheBudget() const { return m_textureCache->GetBudget(); }
+
+    // Texture cache lookups, loads and resident memory of the last frame
+    const TextureCache::Statistics& GetTextureCacheStatistics() const { return m_textureCacheStatistics; }
+
+    // Fraction of the paths of the last frame which the radiance cache terminated
+    const float GetRadianceCacheTerminationRate() const { return m_radianceCacheTerminationRate; }
+
+    // Time spent on the current accumulation, for equal-time comparisons
+    const float GetRenderMilliseconds() const { return m_renderMilliseconds; }
+
+private:
+    // Path state of every pixel in a tile, plus the scratch batch used for shading
+    struct PathState;
+    struct TileState;
+
+    // Vertex of a camera or light subpath of the bidirectional integrator
+    struct BidirectionalVertex;
+
+    // Reservoir resampling of direct lighting at primary hits, see "Spatiotemporal reservoir resampling for real-time ray tracing
+    // with dynamic direct lighting" (Bitterli et al. 2020)
+    struct LightSample
+    {
+        glm::vec3 data = glm::vec3(0.0f);           // Direction towards the HDRI, or barycentrics of the point on the emissive triangle
+        unsigned int emissiveIndex = 0xffffffff;    // Emissive triangle, 0xffffffff for HDRI samples
+    };
+
+    struct Reservoir
+    {
+        LightSample sample;
+        float weightSum = 0.0f;     // Sum of the resampling weights
+        float M = 0.0f;             // Candidates seen
+        float W = 0.0f;             // Contribution weight of the sample, the inverse of its effective pdf
+
+        // Weighted reservoir sampling, keeps the new sample with probability weight / weightSum
+        void Update(const LightSample& candidate, float weight, float count, float Xi);
+    };
+
+    // Point on an emissive triangle, uniformly distributed over its area
+    struct EmissivePoint
+    {
+        glm::vec3 barycentrics = glm::vec3(0.0f);   // Weights of the vertices A, B and C
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);         // Front side, zero for degenerate triangles
+        glm::vec2 uv = glm::vec2(0.0f);
+        float area = 0.0f;
+    };
+
+    // Footprint of a path for texture filtering, see "Texture Level of Detail Strategies for Real-Time Ray Tracing" (Akenine-Moller et al. 2019)
+    struct RayCone
+    {
+        float width = 0.0f;         // Width at the origin of the current ray
+        float spreadAngle = 0.0f;   // Growth of the width per unit of distance
+    };
+
+    // Primary hit of a pixel, reservoirs and accumulated samples are only reused across similar surfaces
+    struct ReservoirSurface
+    {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        float depth = 0.0f;         // Distance to the camera
+        bool valid = false;         // Whether the primary ray hit anything
+    };
+
+    static constexpr int TileSize = 16;
+    static constexpr int MaxBounceCount = 3;
+
+    static constexpr int ReservoirCandidateCount = 32;      // Light candidates drawn per pixel and frame
+    static constexpr int ReservoirNeighbourCount = 5;       // Spatial neighbours reused per pixel
+    static constexpr float ReservoirRadius = 30.0f;         // Pixel radius of the spatial neighbours
+    static constexpr float ReservoirHistoryLength = 20.0f;  // Temporal reservoirs count as at most this many frames of candidates
+
+    static constexpr float ReprojectionHistoryLength = 32.0f;   // Reprojected pixels count as at most this many samples
+
+    static constexpr unsigned int CausticPhotonCount = 1 << 18;     // Photons emitted per frame
+    static constexpr int MaxPhotonBounceCount = 8;
+    static constexpr float CausticRoughness = 0.1f;                 // Materials at most this rough are treated as specular
+    static constexpr float CausticRadiusFraction = 0.002f;          // Initial gather radius, relative to the scene diagonal
+    static constexpr float CausticRadiusAlpha = 2.0f / 3.0f;        // Fraction of the photons kept when the radius shrinks
+
+    static constexpr size_t RadianceCacheMemory = 64 << 20;         // Memory cap of the radiance cache in bytes
+    static constexpr float RadianceCachePixelsPerCell = 8.0f;       // Cell width in pixels, at the distance of the cell
+
+    // Adjoint-driven Russian roulette and splitting, see "Adjoint-Driven Russian Roulette and Splitting in Light Transport Simulation" (Vorba and Krivanek 2016)
+    static constexpr float AdjointWeightWindowSize = 5.0f;          // Ratio between the upper and lower bound of the weight window
+    static constexpr float AdjointMinSampleCount = 4.0f;            // Samples a pixel needs before its estimate drives the roulette
+    static constexpr float AdjointMinSurvival = 0.05f;              // Keeps the roulette unbiased where the cache underestimates
+    static constexpr int MaxSplitCount = 4;                         // Copies a path can be split into at the primary hit
+    static constexpr unsigned int SplitSamplerOffset = 1u << 24;    // Sample indices of the split copies, away from the ones of the pixel
+
+    static constexpr int BidirectionalMaxDepth = MaxBounceCount;                // Scattering vertices of a bidirectional path, same as the path tracer
+    static constexpr int MaxCameraVertexCount = BidirectionalMaxDepth + 2;      // Camera, scattering vertices and the light hit
+    static constexpr int MaxLightVertexCount = BidirectionalMaxDepth + 1;       // Light and scattering vertices
+    static constexpr unsigned int LightSubpathBounce = MaxBounceCount + 1;      // Sampler bounce of the light vertex, the light bounces follow it
+
+    // Primary sample space Metropolis, see "A Simple and Robust Mutation Strategy for the Metropolis Light Transport Algorithm" (Kelemen et al. 2002)
+    static constexpr int MetropolisChainCount = 1 << 14;                        // Independent chains, split into batches of a tile's size
+    static constexpr int MetropolisBootstrapCount = MetropolisChainCount * 16;  // Large steps that estimate the normalization and seed the chains
+    static constexpr float MetropolisLargeStepProbability = 0.3f;
+    static constexpr float MetropolisMinStep = 1.0f / 1024.0f;                  // Range of the exponentially distributed small steps
+    static constexpr float MetropolisMaxStep = 1.0f / 64.0f;
+    static constexpr unsigned int MetropolisDimensionCount = Sampler::DimensionBounce + MaxBounceCount * Sampler::DimensionsPerBounce;
+    static constexpr unsigned int MetropolisSampleCount = MetropolisDimensionCount * Sampler::PrimarySamplesPerDimension;
+
+    struct MetropolisChain
+    {
+        std::array<float, MetropolisSampleCount> samples{ };   // Primary sample vector of the current state
+        glm::vec3 radiance = glm::vec3(0.0f);                   // Contribution of the current state
+        float luminance = 0.0f;                                 // Target function of the chain
+        size_t pixel = 0;
+        Sampler random;                                         // Mutations and acceptance, apart from the primary samples
+    };
+
+    // Render and accumulate a single sample per pixel, the sample of m_frameSettings.frameCount
+    void RenderSample();
+
+    void RenderTile(TileState& tileState, int tileX, int tileY);
+    void StartPath(PathState& path, size_t pixel) const;
+    void TracePaths(TileState& tileState, int laneCount);
+    void ShadeRun(TileState& tileState, const int* lanes, int count, unsigned int lobes, int bounce);
+
+    // Bidirectional path tracing of a single pixel, light tracing splats into the buffer of the worker
+    // The samples are only accumulated by MergeSplatTile, once every light subpath of the frame has splatted
+    void RenderPixelBidirectional(TileState& tileState, int x, int y);
+    void MergeSplatTile(int tileX, int tileY, float splatScale);
+
+    // Metropolis chains are traced in batches of a tile's size, from the primary sample vectors of the tile state
+    // Their paths splat into the buffer of the worker like light tracing, and are accumulated by MergeSplatTile as well
+    void TraceMetropolisBatch(TileState& tileState, int laneCount);
+    void TraceMetropolisBootstrap(TileState& tileState, int batch, std::vector<float>& luminances);
+    void StartMetropolisChains(TileState& tileState, int batch, const std::vector<unsigned int>& bootstrapIndices);
+    void MutateMetropolisChains(TileState& tileState, int batch, int stepCount);
+    void GetBootstrapSamples(unsigned int bootstrapIndex, float* samples) const;
+
+    // Camera subpaths gather the HDRI into environmentRadiance on the way, light subpaths pass nullptr
+    int TraceBidirectionalSubpath(Ray ray, glm::vec3 throughput, float pdf, Sampler& sampler, unsigned int firstBounce, BidirectionalVertex* vertices, int maxVertexCount, glm::vec3* environmentRadiance, TileState& tileState) const;
+    glm::vec3 ConnectBidirectional(const BidirectionalVertex* cameraVertices, int t, const BidirectionalVertex* lightVertices, int s, Sampler& sampler, bool lightTracing, size_t& splatPixel) const;
+    float GetBidirectionalMisWeight(const BidirectionalVertex* cameraVertices, int t, const BidirectionalVertex* lightVertices, int s, const BidirectionalVertex& sampledLight, bool lightTracing) const;
+
+    bool SampleBidirectionalLight(const glm::vec3& Xi, BidirectionalVertex& vertex) const;
+    glm::vec3 EvaluateBidirectionalBsdf(const BidirectionalVertex& vertex, const glm::vec3& toCamera, const glm::vec3& toLight) const;
+    float GetBidirectionalPdf(const BidirectionalVertex& vertex, const BidirectionalVertex* previous, const BidirectionalVertex& next) const;
+    float GetLightOriginPdf(unsigned int emissiveIndex) const;
+    float GetEmissionPdf(const BidirectionalVertex& light, const BidirectionalVertex& next) const;
+    bool IsBidirectionalVisible(const BidirectionalVertex& from, const glm::vec3& to) const;
+
+    // Pinhole camera of the bidirectional integrator, the density of its rays per solid angle equals its importance times the cosine
+    float GetCameraPdf(const glm::vec3& direction) const;
+    bool GetRasterPixel(const glm::vec3& position, size_t& pixel) const;
+
+    // Initial candidates and temporal reuse, written to the candidate reservoirs for the spatial reuse of RenderTile
+    void GenerateReservoirs(int tileX, int tileY);
+    Reservoir ReuseSpatialReservoirs(const PathState& path, unsigned int lobes) const;
+
+    LightSample SampleLightCandidate(const glm::vec3& P, const glm::vec3& N, const glm::vec3& Xi, float Xs, float& pdf) const;
+    glm::vec3 EvaluateLightSample(const LightSample& sample, const glm::vec3& P, glm::vec3& L, float& dst, float& geometry) const;
+    float EvaluateReservoirTarget(const LightSample& sample, const DisneyBrdf::Material& material, unsigned int lobes, const glm::vec3& P, const glm::vec3& V, const glm::vec3& N) const;
+    bool IsReservoirSurfaceSimilar(const ReservoirSurface& surface, const glm::vec3& N, float depth) const;
+
+    // Temporal reprojection of the accumulation, see "Spatiotemporal Variance-Guided Filtering" (Schied et al. 2017)
+    // Pixels take the samples of the previous camera's pixel which saw the same surface, or start over
+    void TraceHistorySurfaces(int tileX, int tileY, std::vector<ReservoirSurface>& surfaces) const;
+    void ReprojectAccumulation(const std::vector<ReservoirSurface>& surfaces);
+
+    // Fills the accumulation buffers with the resumed accumulation, which a frame starting over takes instead of clearing them
+    void ApplyResumedAccumulation();
+
+    // Caustic photons, traced from the lights through specular materials onto the first non-specular surface
+    void TraceCausticPhotons();
+    bool TraceCausticPhoton(unsigned int photonIndex, const glm::vec3& casterCenter, float casterRadius, PhotonMap::Photon& photon) const;
+    glm::vec3 GatherCaustics(const DisneyBrdf::Material& material, unsigned int lobes, const glm::vec3& P, const glm::vec3& V, const glm::vec3& N) const;
+    bool IsCausticSpecular(const DisneyBrdf::Material& material) const;
+
+    // Radiance cache cells, only diffuse surfaces are cached since their outgoing radiance barely depends on the view direction
+    bool IsRadianceCacheSurface(const DisneyBrdf::Material& material) const;
+    uint64_t GetRadianceCacheKey(const HitInfo& hitInfo) const;
+    bool IsRadianceCacheRecording() const;
+
+    // Expected contribution of the rest of the path relative to the pixel estimate, false if either is unknown
+    bool GetAdjointRatio(const PathState& path, float& ratio);
+    int GetSplitCount(const PathState& path);
+
+    // Same as the ray cone functions of utility.glsl
+    RayCone GetPrimaryRayCone() const;
+    static void PropagateRayCone(RayCone& cone, HitInfo& hitInfo);
+    static void ScatterRayCone(RayCone& cone, float roughness);
+
+    Ray GenerateCameraRay(int x, int y, Sampler& sampler) const;
+    Ray GeneratePrimaryRay(glm::vec2 uv, Sampler& sampler) const;
+    Ray GeneratePinholeRay(const glm::vec2& uv) const;
+
+    bool IsInRenderRegion(size_t pixel) const;
+    bool IsPixelConverged(const Accumulation::Pixel& sums) const;
+
+    // The albedo and normal of a sample are added before its radiance, which counts the sample and updates the buffers of the pixel
+    void AddPrimarySample(size_t pixel, const glm::vec3& albedo, const glm::vec3& normal);
+    void AddRadianceSample(size_t pixel, const glm::vec3& radiance);
+    void UpdateAccumulationBuffers(size_t pixel);
+
+    DisneyBrdf::Material EvaluateMaterial(const MaterialData& material, HitInfo& hitInfo) const;
+
+    glm::vec3 SampleHdri(const glm::vec2& Xi) const;
+    glm::vec3 EvaluateHdri(const glm::vec3& L, float& pdf) const;
+
+    bool IsEmissiveSamplingEnabled() const;
+    unsigned int SampleEmissiveTriangleIndex(float Xi, float& pmf) const;
+    unsigned int PickEmissiveTriangle(const glm::vec3& P, const glm::vec3& N, float Xi, float& pmf) const;
+    glm::vec3 GetEmission(const BVH::BvhPrimitive& primitive, const glm::vec2& uv) const;
+    static EmissivePoint SampleEmissiveTrianglePoint(const BVH::BvhPrimitive& primitive, const glm::vec2& Xi);
+    unsigned int SampleLightTree(const glm::vec3& P, const glm::vec3& N, float Xi, float& pmf) const;
+    float GetLightTreePmf(unsigned int emissiveIndex, const glm::vec3& P, const glm::vec3& N) const;
+    float GetEmissiveTrianglePdf(unsigned int emissiveIndex, const glm::vec3& P, const glm::vec3& N, const glm::vec3& L, float dst) const;
+    glm::vec3 SampleEmissiveTriangle(const glm::vec3& P, const glm::vec3& N, const glm::vec3& Xi, glm::vec3& L, float& dst, float& pdf) const;
+
+    void ResolveTextures();
+
+private:
+    int m_width;
+    int m_height;
+    int m_maxWidth;     // Dimensions the buffers are allocated for
+    int m_maxHeight;
+    glm::ivec4 m_renderRegion = glm::ivec4(0);  // Min and max corner of the pixels rendered this frame
+
+    FrameSettings m_frameSettings;
+    glm::mat4 m_invViewMatrix = glm::mat4(1.0f);
+    unsigned int m_modifierLobes = 0;
+
+    // Scene
+    std::vector<BVH::BvhNode> m_bvhNodes;
+    std::vector<BVH::BvhPrimitive> m_bvhPrimitives;
+    std::vector<MaterialData> m_materials;
+    std::vector<EmissiveTriangle> m_emissiveTriangles;
+    std::vector<LightTree::LightTreeNode> m_lightTreeNodes;
+
+    // Textures are read back lazily, so the GPU backend never pays for the copies
+    std::vector<std::shared_ptr<Texture2DObject>> m_textureObjects;
+    std::unique_ptr<TextureCache> m_textureCache = std::make_unique<TextureCache>();  // Material textures, tiled with all their mip levels
+    std::shared_ptr<Texture2DObject> m_hdriObject;
+    std::shared_ptr<Texture2DObject> m_hdriCacheObject;
+    Texture m_hdri;
+    Texture m_hdriCache;
+    bool m_texturesDirty = false;           // Material textures
+    bool m_environmentDirty = false;
+
+    // Accumulation buffers, the means of the sums below in float for display and outputs
+    std::vector<glm::vec4> m_radiance;
+    std::vector<glm::vec4> m_primaryAlbedo;
+    std::vector<glm::vec4> m_primaryNormal;
+    std::vector<glm::vec4> m_sampleStats;       // Luminance sum, squared luminance sum, sample count
+    std::vector<Accumulation::Pixel> m_sums;    // Sums of the samples in double, a float running mean stops taking in samples of long renders
+    std::atomic<unsigned int> m_activePixelCount = 0;
+    bool m_accumulationReset = true;            // Whether the current frame starts the accumulation over
+    Accumulation m_resumedAccumulation;         // Taken by the next reset
+
+    // Temporal reprojection, primary hits of the pixel centers for the camera of the current accumulation
+    std::vector<ReservoirSurface> m_historySurfaces;
+    glm::mat4 m_historyViewProjMatrix = glm::mat4(1.0f);
+    glm::vec3 m_historyCameraPosition = glm::vec3(0.0f);
+
+    // Shading
+    bool m_batchedShadingEnabled = true;
+
+    // Guiding distributions, learned while rendering
+    PathGuiding m_pathGuiding;
+
+    // Reservoir resampling, allocated on first use
+    // A reservoir takes 28 bytes and a surface 32 bytes. Both are kept for the current and previous frame,
+    // which makes 120 bytes per pixel, about 250 MB at 1920x1080
+    std::vector<Reservoir> m_reservoirs;                        // Final reservoirs of the previous frame, replaced by RenderTile
+    std::vector<Reservoir> m_candidateReservoirs;               // Candidates and temporal reuse of the current frame
+    std::vector<ReservoirSurface> m_reservoirSurfaces;          // Primary hits of the current frame
+    std::vector<ReservoirSurface> m_previousReservoirSurfaces;  // Primary hits of the previous frame
+    glm::mat4 m_previousViewProjMatrix = glm::mat4(1.0f);
+    glm::vec3 m_previousCameraPosition = glm::vec3(0.0f);
+    bool m_reservoirHistoryValid = false;
+    unsigned int m_reservoirFrame = 0;
+
+    // Caustic photons of the current frame, the gather radius shrinks with every frame
+    PhotonMap m_causticPhotonMap;
+    float m_causticRadius = 0.0f;
+
+    // Radiance cache, allocated on first use
+    RadianceCache m_radianceCache;
+    float m_radianceCacheCellScale = 0.0f;      // Cell size per unit of distance to the camera
+
+    // Bidirectional path tracing and Metropolis, allocated on first use
+    // Every worker splats into its own buffer, so light tracing needs no atomics. A buffer takes 25 MB at 1920x1080
+    std::vector<std::vector<glm::vec3>> m_splatBuffers;
+    std::vector<glm::vec4> m_bidirectionalRadiance;    // Camera subpath estimates of the current frame, alpha marks the traced pixels
+    glm::mat4 m_viewProjMatrix = glm::mat4(1.0f);
+    glm::vec3 m_cameraPosition = glm::vec3(0.0f);
+    glm::vec3 m_cameraForward = glm::vec3(0.0f, 0.0f, -1.0f);
+    float m_imagePlaneArea = 1.0f;                      // Area of the image at distance 1 from the camera
+
+    // Metropolis chains persist across frames, the normalization is refined by the luminance of every large step
+    std::vector<MetropolisChain> m_metropolisChains;    // Empty until bootstrapped, and when the bootstrap found no light
+    float m_metropolisNormalization = 0.0f;             // Average luminance over the primary sample space
+    std::atomic<double> m_metropolisLuminanceSum = 0.0;
+    std::atomic<long long> m_metropolisLuminanceCount = 0;
+
+    // Statistics
+    std::atomic<long long> m_shadingNanoseconds = 0;
+    std::atomic<long long> m_shadedHits = 0;
+    std::atomic<long long> m_rayCount = 0;
+    std::atomic<long long> m_pathCount = 0;
+    std::atomic<long long> m_radianceCacheTerminations = 0;
+    double m_shadingNanosecondsPerHit = 0.0;
+    float m_raysPerPixel = 0.0f;
+    float m_radianceCacheTerminationRate = 0.0f;
+    TextureCache::Statistics m_textureCacheStatistics;
+    float m_frameMilliseconds = 0.0f;
+    float m_renderMilliseconds = 0.0f;
+};
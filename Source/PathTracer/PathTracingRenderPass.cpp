@@ -1,5 +1,8 @@
 ﻿#include "PathTracingRenderPass.h"
 #include "PathTracingApplication.h"
+#include "Accumulation.h"
+#include "ImageWriter.h"
+#include "SharedFilm.h"
 
 #include "Asset/ShaderLoader.h"
 #include "OpenImageDenoise/oidn.hpp"
@@ -16,6 +19,7 @@
 #include <chrono>
 #include "Utils/Timer.h"
 #include "PathTracingRenderer.h"
+#include "PathTracingCpuBackend.h"
 
 PathTracingRenderPass::PathTracingRenderPass(int width, int height, PathTracingRenderer* pathTracingRenderer, PathTracingApplication* pathTracingApplication, std::shared_ptr<const FramebufferObject> framebuffer)
     : RenderPass(framebuffer), m_width(width), m_height(height), m_pathTracingRenderer(pathTracingRenderer), m_pathTracingApplication(pathTracingApplication)
@@ -30,6 +34,11 @@ PathTracingRenderPass::PathTracingRenderPass(int width, int height, PathTracingR
 
 PathTracingRenderPass::~PathTracingRenderPass()
 {
+    if (m_timerQueries[0] != 0)
+    {
+        glDeleteQueries(TimerQueryCount, m_timerQueries);
+    }
+
     delete[] m_denoiserRadianceInputPtr;
     delete[] m_denoiserPrimaryAlbedoInputPtr;
     delete[] m_denoiserPrimaryNormalInputPtr;
@@ -38,8 +47,33 @@ PathTracingRenderPass::~PathTracingRenderPass()
 
 void PathTracingRenderPass::Render()
 {
+    // Dynamic resolution renders the bottom left part of the textures, which is upsampled when copying
+    const glm::ivec2 renderDimensions = m_pathTracingApplication->GetRenderDimensions();
+    const bool upsample = renderDimensions != glm::ivec2(m_width, m_height);
+
+    // Path Tracing render on the CPU backend
+    if (m_pathTracingApplication->GetShouldPathTrace() && m_pathTracingApplication->GetCpuBackendEnabled())
+    {
+        std::shared_ptr<PathTracingCpuBackend> cpuBackend = m_pathTracingRenderer->GetCpuBackend();
+        cpuBackend->RenderFrame();
+
+        m_pathTracingApplication->SetFrameTiming(m_pathTracingApplication->GetFrameSampleCount(), cpuBackend->GetFrameMilliseconds());
+        m_pathTracingApplication->AddFrameSamples(m_pathTracingApplication->GetFrameSampleCount());
+
+        // Upload accumulation buffers, so denoising and copying work the same as for the GPU backend
+        const int width = cpuBackend->GetWidth();
+        const int height = cpuBackend->GetHeight();
+        UploadCpuBackendTexture(*m_pathTracingRadianceTexture, cpuBackend->GetRadianceData(), width, height);
+        UploadCpuBackendTexture(*m_pathTracingPrimaryAlbedoTexture, cpuBackend->GetPrimaryAlbedoData(), width, height);
+        UploadCpuBackendTexture(*m_pathTracingPrimaryNormalTexture, cpuBackend->GetPrimaryNormalData(), width, height);
+        UploadCpuBackendTexture(*m_pathTracingSampleStatsTexture, cpuBackend->GetSampleStatsData(), width, height);
+
+        m_outputTexture = m_pathTracingRadianceTexture;
+
+        m_pathTracingApplication->SetActivePixelCount(cpuBackend->GetActivePixelCount());
+    }
     // Path Tracing render
-    if (m_pathTracingApplication->GetShouldPathTrace())
+    else if (m_pathTracingApplication->GetShouldPathTrace())
     {
         assert(m_pathTracingRenderer->GetPathTracingMaterial());
 
@@ -55,24 +89,81 @@ void PathTracingRenderPass::Render()
         m_pathTracingRenderer->GetSsboBvhNodes()->Bind();
         m_pathTracingRenderer->GetSsboBvhPrimitives()->Bind();
 
-        // Use material
-        m_pathTracingRenderer->GetPathTracingMaterial()->Use();
-
         // Uniform image output
         m_pathTracingRadianceTexture->BindImageTexture(0, 0, GL_FALSE, 0, GL_READ_WRITE, TextureObject::InternalFormatRGBA32F);
         m_pathTracingPrimaryAlbedoTexture->BindImageTexture(1, 0, GL_FALSE, 0, GL_READ_WRITE, TextureObject::InternalFormatRGBA32F);
         m_pathTracingPrimaryNormalTexture->BindImageTexture(2, 0, GL_FALSE, 0, GL_READ_WRITE, TextureObject::InternalFormatRGBA32F);
+        m_pathTracingSampleStatsTexture->BindImageTexture(3, 0, GL_FALSE, 0, GL_READ_WRITE, TextureObject::InternalFormatRGBA32F);
 
+        // Only the render region is dispatched, starting at its min corner
+        const glm::ivec4 renderRegion = m_pathTracingApplication->GetRenderRegion();
         const int threadSize = 16;
-        const int numGroupsX = static_cast<uint32_t>(std::ceil(m_width / threadSize));
-        const int numGroupsY = static_cast<uint32_t>(std::ceil(m_height / threadSize));
-        glDispatchCompute(numGroupsX, numGroupsY, 1);
+        const int numGroupsX = (renderRegion.z - renderRegion.x + threadSize - 1) / threadSize;
+        const int numGroupsY = (renderRegion.w - renderRegion.y + threadSize - 1) / threadSize;
+
+        // The GPU time of the dispatches is what the sample scheduler budgets, presenting and the GUI are not part of it
+        if (m_timerQueries[0] == 0)
+        {
+            glGenQueries(TimerQueryCount, m_timerQueries);
+        }
+
+        // The query taken next is the oldest one. Its frame is timed once the GPU got through it, a GPU that far behind skips it
+        const int timerQueryIndex = m_timerQueryIndex;
+        const GLuint timerQuery = m_timerQueries[timerQueryIndex];
+        if (m_timerQuerySampleCounts[timerQueryIndex] > 0)
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available == GL_TRUE)
+            {
+                GLuint64 elapsedNanoseconds = 0;
+                glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &elapsedNanoseconds);
+                m_pathTracingApplication->SetFrameTiming(m_timerQuerySampleCounts[timerQueryIndex], (float)elapsedNanoseconds * 1e-6f);
+            }
+            m_timerQuerySampleCounts[timerQueryIndex] = 0;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+
+        // One dispatch per sample, each with the frame count it would have had as a frame of its own
+        const unsigned int frameCount = m_pathTracingApplication->GetFrameCount();
+        const unsigned int frameSampleCount = m_pathTracingApplication->GetFrameSampleCount();
+        for (unsigned int i = 0; i < frameSampleCount; i++)
+        {
+            // Reset active pixel counter, so it holds the pixels of the last sample
+            const GLuint activePixelCountReset = 0;
+            m_pathTracingRenderer->GetSsboAdaptiveSampling()->Bind();
+            m_pathTracingRenderer->GetSsboAdaptiveSampling()->UpdateData(std::span<const GLuint>(&activePixelCountReset, 1));
+
+            // Use material
+            m_pathTracingRenderer->GetPathTracingMaterial()->SetUniformValue("FrameCount", frameCount + i);
+            m_pathTracingRenderer->GetPathTracingMaterial()->Use();
 
-        // Make sure writing to image has finished before read
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            glDispatchCompute(numGroupsX, numGroupsY, 1);
+
+            // Make sure writing to image has finished before read, by the next sample as well
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+
+        glEndQuery(GL_TIME_ELAPSED);
+        m_timerQuerySampleCounts[timerQueryIndex] = frameSampleCount;
+        m_timerQueryIndex = (timerQueryIndex + 1) % TimerQueryCount;
+        m_pathTracingApplication->AddFrameSamples(frameSampleCount);
 
         m_outputTexture = m_pathTracingRadianceTexture;
 
+        // Read back the amount of pixels that have not converged
+        if (m_pathTracingApplication->GetAdaptiveSamplingEnabled())
+        {
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+            GLuint activePixelCount = 0;
+            m_pathTracingRenderer->GetSsboAdaptiveSampling()->Bind();
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &activePixelCount);
+            m_pathTracingRenderer->GetSsboAdaptiveSampling()->Unbind();
+
+            m_pathTracingApplication->SetActivePixelCount(activePixelCount);
+        }
+
         // Mark all as non-resident - can be skipped if you know the same textures
         // will all be used for the next frame
         for (const GLuint64& handle : m_pathTracingRenderer->GetBindlessHandles())
@@ -81,9 +172,12 @@ void PathTracingRenderPass::Render()
         }
     }
     
-    // Denoise
-    if (m_pathTracingApplication->GetShouldDenoise() && !(m_pathTracingApplication->GetDenoised()))
+    // Denoise, only full resolution frames as the denoiser works on the whole texture
+    bool denoised = false;
+    if (m_pathTracingApplication->GetShouldDenoise() && !(m_pathTracingApplication->GetDenoised()) && !upsample)
     {
+        denoised = true;
+
         // Extract texture to memory
 
         m_pathTracingRadianceTexture->Bind();
@@ -154,7 +248,52 @@ void PathTracingRenderPass::Render()
         m_pathTracingApplication->SetDenoised(true);
     }
 
+    // Save the render the GUI asked for, the image writer compresses and writes it on its own thread
+    std::string savePath;
+    if (m_pathTracingApplication->TakeSaveRequest(savePath))
+    {
+        SaveRender(savePath);
+    }
+
+    // Viewers of other processes get every frame that changed the film
+    SharedFilm* sharedFilm = m_pathTracingApplication->GetSharedFilm();
+    if (sharedFilm && (m_pathTracingApplication->GetShouldPathTrace() || denoised))
+    {
+        PublishSharedFilm(*sharedFilm);
+    }
+
+    // Sample heatmap render
+    if (m_pathTracingApplication->GetSampleHeatmapEnabled())
+    {
+        assert(m_pathTracingRenderer->GetSampleHeatmapMaterial());
+
+        m_pathTracingRenderer->GetSampleHeatmapMaterial()->Use();
+
+        m_pathTracingRenderer->GetSampleHeatmapMaterial()->SetUniformValue("SourceTexture", m_pathTracingSampleStatsTexture);
+        m_pathTracingRenderer->GetSampleHeatmapMaterial()->SetUniformValue("MaxSampleCount", m_pathTracingApplication->GetMaxFrameCount());
+        m_pathTracingRenderer->GetSampleHeatmapMaterial()->SetUniformValue("RenderScale", glm::vec2(renderDimensions) / glm::vec2((float)m_width, (float)m_height));
+
+        Renderer& renderer = GetRenderer();
+        const Mesh* mesh = &renderer.GetFullscreenMesh();
+        mesh->DrawSubmesh(0);
+    }
+    // Upsample render, of a frame rendered at a reduced resolution
+    else if (upsample)
+    {
+        assert(m_pathTracingRenderer->GetUpsampleMaterial());
+
+        m_pathTracingRenderer->GetUpsampleMaterial()->Use();
+
+        m_pathTracingRenderer->GetUpsampleMaterial()->SetUniformValue("SourceTexture", m_outputTexture);
+        m_pathTracingRenderer->GetUpsampleMaterial()->SetUniformValue("NormalTexture", m_pathTracingPrimaryNormalTexture);
+        m_pathTracingRenderer->GetUpsampleMaterial()->SetUniformValue("RenderDimensions", glm::vec2(renderDimensions));
+
+        Renderer& renderer = GetRenderer();
+        const Mesh* mesh = &renderer.GetFullscreenMesh();
+        mesh->DrawSubmesh(0);
+    }
     // Copy render
+    else
     {
         assert(m_pathTracingRenderer->GetPathTracingCopyMaterial());
 
@@ -168,6 +307,89 @@ void PathTracingRenderPass::Render()
     }
 }
 
+void PathTracingRenderPass::SaveRender(const std::string& path)
+{
+    ImageWriter::Images images;
+    images.emplace_back(path, ImageWriter::GetRenderImage(m_width, m_height, ReadRadiance(),
+        ReadTexture(*m_pathTracingPrimaryAlbedoTexture), ReadTexture(*m_pathTracingPrimaryNormalTexture),
+        Accumulation::GetVarianceData(ReadTexture(*m_pathTracingSampleStatsTexture))));
+    images.back().second.exposure = m_pathTracingApplication->GetExposure();
+
+    m_pathTracingApplication->GetImageWriter().WriteAsync(std::move(images), [path](const std::vector<std::string>& failedPaths)
+    {
+        if (failedPaths.empty())
+        {
+            std::cout << "Saved \"" << path << "\"" << std::endl;
+        }
+        else
+        {
+            std::cout << "Error: cannot write \"" << path << "\"" << std::endl;
+        }
+    });
+}
+
+void PathTracingRenderPass::PublishSharedFilm(SharedFilm& sharedFilm)
+{
+    // Samples the pixels have after this frame, the frame count is the first sample of the frame
+    const unsigned int frameCount = m_pathTracingApplication->GetFrameCount();
+    SharedFilm::Frame frame;
+    frame.sampleCount = frameCount - 1 + (m_pathTracingApplication->GetShouldPathTrace() ? m_pathTracingApplication->GetFrameSampleCount() : 0);
+    frame.renderTime = m_pathTracingApplication->GetRenderTime();
+
+    // The CPU backend's buffers are copied into the shared memory as they are, without a readback
+    if (m_pathTracingApplication->GetCpuBackendEnabled() && m_outputTexture == m_pathTracingRadianceTexture)
+    {
+        std::shared_ptr<PathTracingCpuBackend> cpuBackend = m_pathTracingRenderer->GetCpuBackend();
+        frame.width = cpuBackend->GetWidth();
+        frame.height = cpuBackend->GetHeight();
+        frame.layers[0] = cpuBackend->GetRadianceData().data();
+        frame.layers[1] = cpuBackend->GetPrimaryAlbedoData().data();
+        frame.layers[2] = cpuBackend->GetPrimaryNormalData().data();
+        frame.layers[3] = cpuBackend->GetSampleStatsData().data();
+        sharedFilm.Publish(frame);
+        return;
+    }
+
+    std::vector<glm::vec4> radiance = ReadRadiance();
+    std::vector<glm::vec4> albedo = ReadTexture(*m_pathTracingPrimaryAlbedoTexture);
+    std::vector<glm::vec4> normal = ReadTexture(*m_pathTracingPrimaryNormalTexture);
+    std::vector<glm::vec4> sampleStats = ReadTexture(*m_pathTracingSampleStatsTexture);
+    frame.width = m_width;
+    frame.height = m_height;
+    frame.layers[0] = radiance.data();
+    frame.layers[1] = albedo.data();
+    frame.layers[2] = normal.data();
+    frame.layers[3] = sampleStats.data();
+    sharedFilm.Publish(frame);
+}
+
+std::vector<glm::vec4> PathTracingRenderPass::ReadTexture(Texture2DObject& texture) const
+{
+    std::vector<glm::vec4> pixels((size_t)m_width * (size_t)m_height);
+    texture.Bind();
+    texture.GetTextureData(0, TextureObject::Format::FormatRGBA, Data::Type::Float, pixels.data());
+    texture.Unbind();
+    return pixels;
+}
+
+std::vector<glm::vec4> PathTracingRenderPass::ReadRadiance() const
+{
+    if (!m_outputTexture || m_outputTexture != m_pathTracingDenoisedRadianceTexture)
+    {
+        return ReadTexture(*m_pathTracingRadianceTexture);
+    }
+
+    // The denoised texture only has RGB channels
+    std::vector<glm::vec3> denoised((size_t)m_width * (size_t)m_height);
+    m_outputTexture->Bind();
+    m_outputTexture->GetTextureData(0, TextureObject::Format::FormatRGB, Data::Type::Float, denoised.data());
+    m_outputTexture->Unbind();
+
+    std::vector<glm::vec4> radiance(denoised.size());
+    std::transform(denoised.begin(), denoised.end(), radiance.begin(), [](const glm::vec3& pixel) { return glm::vec4(pixel, 1.0f); });
+    return radiance;
+}
+
 void PathTracingRenderPass::InitializeTextures()
 {
     // Path Tracing Radiance Texture
@@ -194,6 +416,14 @@ void PathTracingRenderPass::InitializeTextures()
     m_pathTracingPrimaryNormalTexture->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_NEAREST);
     Texture2DObject::Unbind();
 
+    // Path Tracing Sample Stats Texture
+    m_pathTracingSampleStatsTexture = std::make_shared<Texture2DObject>();
+    m_pathTracingSampleStatsTexture->Bind();
+    m_pathTracingSampleStatsTexture->SetImage(0, m_width, m_height, TextureObject::FormatRGBA, TextureObject::InternalFormat::InternalFormatRGBA32F);
+    m_pathTracingSampleStatsTexture->SetParameter(TextureObject::ParameterEnum::MinFilter, GL_NEAREST);
+    m_pathTracingSampleStatsTexture->SetParameter(TextureObject::ParameterEnum::MagFilter, GL_NEAREST);
+    Texture2DObject::Unbind();
+
     // Denoised Path Tracing Radiance Texture
     m_pathTracingDenoisedRadianceTexture = std::make_shared<Texture2DObject>();
     m_pathTracingDenoisedRadianceTexture->Bind();
@@ -203,6 +433,16 @@ void PathTracingRenderPass::InitializeTextures()
     Texture2DObject::Unbind();
 }
 
+void PathTracingRenderPass::UploadCpuBackendTexture(Texture2DObject& texture, const std::vector<glm::vec4>& data, int width, int height)
+{
+    assert(data.size() >= (size_t)width * height);
+
+    // The texture keeps its full size, rows of the data are as wide as the rendered part
+    texture.Bind();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, data.data());
+    texture.Unbind();
+}
+
 bool PathTracingRenderPass::DenoiserCallback(void* userPtr, double n)
 {
     // TODO: GUI doesn't seem to update, even though we call it here...
@@ -5,10 +5,12 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
 #include <vector>
 
 class PathTracingRenderer;
 class PathTracingApplication;
+class SharedFilm;
 class Texture2DObject;
 class FramebufferObject;
 
@@ -23,8 +25,22 @@ public:
 private:
     void InitializeTextures();
 
+    // Uploads the first width * height texels into the bottom left part of the texture
+    void UploadCpuBackendTexture(Texture2DObject& texture, const std::vector<glm::vec4>& data, int width, int height);
+
     bool DenoiserCallback(void* userPtr, double n);
 
+    // Reads back the film with the layers of the render and queues it on the application's image writer
+    void SaveRender(const std::string& path);
+
+    // Publishes the layers of the frame, straight from the CPU backend's buffers where they are the output
+    void PublishSharedFilm(SharedFilm& sharedFilm);
+
+    // Whole texture as RGBA floats
+    std::vector<glm::vec4> ReadTexture(Texture2DObject& texture) const;
+    // Radiance of the output, denoised once there is a denoised one
+    std::vector<glm::vec4> ReadRadiance() const;
+
 private:
     int m_width;
     int m_height;
@@ -35,6 +51,7 @@ private:
     std::shared_ptr<Texture2DObject> m_pathTracingRadianceTexture;
     std::shared_ptr<Texture2DObject> m_pathTracingPrimaryAlbedoTexture;
     std::shared_ptr<Texture2DObject> m_pathTracingPrimaryNormalTexture;
+    std::shared_ptr<Texture2DObject> m_pathTracingSampleStatsTexture;
     std::shared_ptr<Texture2DObject> m_pathTracingDenoisedRadianceTexture;
     std::shared_ptr<Texture2DObject> m_outputTexture;
 
@@ -46,4 +63,10 @@ private:
 
     // Framebuffers
     std::shared_ptr<FramebufferObject> m_framebuffer;
+
+    // Time elapsed queries around the path tracing dispatches, taken in turns so a result is read frames later without waiting for the GPU
+    static constexpr int TimerQueryCount = 3;
+    GLuint m_timerQueries[TimerQueryCount] = { };
+    unsigned int m_timerQuerySampleCounts[TimerQueryCount] = { };     // Samples dispatched within each query, 0 once its result is taken
+    int m_timerQueryIndex = 0;
 };
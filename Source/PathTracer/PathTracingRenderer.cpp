@@ -75,6 +75,24 @@ void PathTracingRenderer::InitializeMaterial()
         // Initialize material uniforms
         m_toneMappingMaterial->SetUniformValue("SourceTexture", m_pathTracingTexture);
     }
+
+    // Sample Heatmap material
+    {
+        // Create material
+        m_sampleHeatmapMaterial = CreatePostFXMaterial("Shaders/heatmap.frag");
+
+        // Initialize material uniforms
+        // ...
+    }
+
+    // Upsample material, for frames rendered at a reduced resolution
+    {
+        // Create material
+        m_upsampleMaterial = CreatePostFXMaterial("Shaders/upsample.frag");
+
+        // Initialize material uniforms
+        // ...
+    }
 }
 
 void PathTracingRenderer::InitializeRenderPasses()
@@ -92,6 +110,17 @@ void PathTracingRenderer::InitializeBuffers()
     m_ssboMaterials = std::make_shared<ShaderStorageBufferObject>();
     m_ssboBvhNodes = std::make_shared<ShaderStorageBufferObject>();
     m_ssboBvhPrimitives = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboAdaptiveSampling = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboEmissiveTriangles = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboLightTree = std::make_shared<ShaderStorageBufferObject>();
+
+    // Active pixel counter of adaptive sampling, it is reset and read back every frame
+    m_ssboAdaptiveSampling->Bind();
+    m_ssboAdaptiveSampling->AllocateData(sizeof(GLuint), BufferObject::Usage::StreamRead);
+    glBindBufferBase(m_ssboAdaptiveSampling->GetTarget(), 4, m_ssboAdaptiveSampling->GetHandle()); // Binding index: 4
+    m_ssboAdaptiveSampling->Unbind();
+
+    m_cpuBackend = std::make_shared<PathTracingCpuBackend>(m_width, m_height);
 }
 
 std::shared_ptr<Material> PathTracingRenderer::CreatePathTracingMaterial()
@@ -103,9 +132,11 @@ std::shared_ptr<Material> PathTracingRenderer::CreatePathTracingMaterial()
     computeShaderPaths.push_back("Shaders/Library/utility.glsl");
     computeShaderPaths.push_back("Shaders/Library/intersection.glsl");
     computeShaderPaths.push_back("Shaders/Library/montecarlo.glsl");
+    computeShaderPaths.push_back("Shaders/Library/sampler.glsl");
     computeShaderPaths.push_back("Shaders/Library/brdf.glsl");
     computeShaderPaths.push_back("Shaders/Library/disney.glsl");
     computeShaderPaths.push_back("Shaders/Library/hdri.glsl");
+    computeShaderPaths.push_back("Shaders/Library/emissive.glsl");
     computeShaderPaths.push_back("Shaders/Library/debug.glsl");
     computeShaderPaths.push_back("Shaders/pathtracing.comp");
     Shader computeShader = ShaderLoader(Shader::ComputeShader).Load(computeShaderPaths);
@@ -167,13 +198,117 @@ void PathTracingRenderer::ClearPathTracingModels()
     m_pathTracingModels.clear();
 }
 
+const std::vector<GLuint64> PathTracingRenderer::GetBindlessHandles() const
+{
+    std::vector<GLuint64> bindlessHandles = m_environmentBindlessHandles;
+    bindlessHandles.insert(bindlessHandles.end(), m_sceneBindlessHandles.begin(), m_sceneBindlessHandles.end());
+    return bindlessHandles;
+}
+
+void PathTracingRenderer::KeepScene(const std::string& name)
+{
+    // The current scene is kept under one name at a time
+    if (!m_keptSceneName.empty())
+    {
+        m_keptScenes.erase(m_keptSceneName);
+    }
+
+    KeptScene& keptScene = m_keptScenes[name];
+    keptScene.ssboMaterials = m_ssboMaterials;
+    keptScene.ssboBvhNodes = m_ssboBvhNodes;
+    keptScene.ssboBvhPrimitives = m_ssboBvhPrimitives;
+    keptScene.ssboEmissiveTriangles = m_ssboEmissiveTriangles;
+    keptScene.ssboLightTree = m_ssboLightTree;
+    keptScene.bindlessHandles = m_sceneBindlessHandles;
+    keptScene.emissiveTriangleCount = m_emissiveTriangleCount;
+    keptScene.cpuScene.reset();
+
+    m_keptSceneName = name;
+}
+
+bool PathTracingRenderer::RestoreScene(const std::string& name)
+{
+    if (!m_keptSceneName.empty() && name == m_keptSceneName)
+    {
+        return true;
+    }
+    if (m_keptScenes.find(name) == m_keptScenes.end())
+    {
+        return false;
+    }
+
+    ParkScene();
+
+    KeptScene& keptScene = m_keptScenes[name];
+    m_ssboMaterials = keptScene.ssboMaterials;
+    m_ssboBvhNodes = keptScene.ssboBvhNodes;
+    m_ssboBvhPrimitives = keptScene.ssboBvhPrimitives;
+    m_ssboEmissiveTriangles = keptScene.ssboEmissiveTriangles;
+    m_ssboLightTree = keptScene.ssboLightTree;
+    m_sceneBindlessHandles = keptScene.bindlessHandles;
+    m_emissiveTriangleCount = keptScene.emissiveTriangleCount;
+
+    // Same binding indices as the Process functions
+    glBindBufferBase(m_ssboMaterials->GetTarget(), 1, m_ssboMaterials->GetHandle());
+    glBindBufferBase(m_ssboBvhNodes->GetTarget(), 2, m_ssboBvhNodes->GetHandle());
+    glBindBufferBase(m_ssboBvhPrimitives->GetTarget(), 3, m_ssboBvhPrimitives->GetHandle());
+    glBindBufferBase(m_ssboEmissiveTriangles->GetTarget(), 5, m_ssboEmissiveTriangles->GetHandle());
+    glBindBufferBase(m_ssboLightTree->GetTarget(), 6, m_ssboLightTree->GetHandle());
+    m_pathTracingMaterial->SetUniformValue("EmissiveTriangleCount", m_emissiveTriangleCount);
+
+    m_cpuBackend->RestoreScene(std::move(keptScene.cpuScene));
+    m_keptSceneName = name;
+    return true;
+}
+
+void PathTracingRenderer::ClearKeptScenes()
+{
+    m_keptScenes.clear();
+    m_keptSceneName.clear();
+    m_keptEnvironments.clear();
+}
+
+void PathTracingRenderer::ParkScene()
+{
+    if (m_keptSceneName.empty())
+    {
+        return;
+    }
+
+    m_keptScenes[m_keptSceneName].cpuScene = m_cpuBackend->TakeScene();
+    m_keptSceneName.clear();
+}
+
+void PathTracingRenderer::ParkEnvironment()
+{
+    if (!m_environmentHdri)
+    {
+        return;
+    }
+
+    KeptEnvironment& keptEnvironment = m_keptEnvironments[m_environmentHdri];
+    keptEnvironment.ssboEnvironment = m_ssboEnvironment;
+    keptEnvironment.hdriCache = m_hdriCache;
+    keptEnvironment.bindlessHandles = m_environmentBindlessHandles;
+    keptEnvironment.cpuEnvironment = m_cpuBackend->TakeEnvironment();
+    m_environmentHdri = nullptr;
+}
+
 void PathTracingRenderer::ProcessBuffers()
 {
     std::cout << "Processing all buffers!" << std::endl;
 
     // Clear bindless handles!
     // We're going to fill it with new data
-    m_bindlessHandles.clear();
+    m_sceneBindlessHandles.clear();
+
+    // The buffers of a kept scene are not overwritten, this scene gets buffers of its own
+    ParkScene();
+    m_ssboMaterials = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboBvhNodes = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboBvhPrimitives = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboEmissiveTriangles = std::make_shared<ShaderStorageBufferObject>();
+    m_ssboLightTree = std::make_shared<ShaderStorageBufferObject>();
 
     // VBO and EBO data of all meshes
     std::vector<std::vector<VertexSave>>    totalVertexData;
@@ -302,7 +437,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (emissionTexture)
                 {
                     materialSave.emissionTextureHandle = emissionTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.emissionTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.emissionTextureHandle);
                 }
 
                 // Albedo Texture
@@ -310,7 +445,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (albedoTexture)
                 { 
                     materialSave.albedoTextureHandle = albedoTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.albedoTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.albedoTextureHandle);
                 }
 
                 // Normal Texture
@@ -318,7 +453,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (normalTexture)
                 {
                     materialSave.normalTextureHandle = normalTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.normalTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.normalTextureHandle);
                 }
 
                 // Specular Texture
@@ -326,7 +461,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (specularTexture)
                 {
                     materialSave.specularTextureHandle = specularTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.specularTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.specularTextureHandle);
                 }
 
                 // Specular Color Texture
@@ -334,7 +469,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (specularColorTexture)
                 { 
                     materialSave.specularColorTextureHandle = specularColorTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.specularColorTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.specularColorTextureHandle);
                 }
 
                 // Metallic Roughness Texture
@@ -342,7 +477,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (metallicRoughnessTexture)
                 {
                     materialSave.metallicRoughnessTextureHandle = metallicRoughnessTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.metallicRoughnessTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.metallicRoughnessTextureHandle);
                 }
 
                 // Sheen Roughness Texture
@@ -350,7 +485,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (sheenRoughnessTexture)
                 {
                     materialSave.sheenRoughnessTextureHandle = sheenRoughnessTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.sheenRoughnessTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.sheenRoughnessTextureHandle);
                 }
 
                 // Sheen Color Texture
@@ -358,7 +493,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (sheenColorTexture)
                 {
                     materialSave.sheenColorTextureHandle = sheenColorTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.sheenColorTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.sheenColorTextureHandle);
                 }
 
                 // Clearcoat Texture
@@ -366,7 +501,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (clearcoatTexture)
                 {
                     materialSave.clearcoatTextureHandle = clearcoatTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.clearcoatTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.clearcoatTextureHandle);
                 }
 
                 // Clearcoat Roughness Texture
@@ -374,7 +509,7 @@ void PathTracingRenderer::ProcessBuffers()
                 if (clearcoatRoughnessTexture)
                 {
                     materialSave.clearcoatRoughnessTextureHandle = clearcoatRoughnessTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.clearcoatRoughnessTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.clearcoatRoughnessTextureHandle);
                 }
 
                 // Transmission Texture
@@ -382,7 +517,13 @@ void PathTracingRenderer::ProcessBuffers()
                 if (transmissionTexture)
                 {
                     materialSave.transmissionTextureHandle = transmissionTexture->GetBindlessTextureHandle();
-                    m_bindlessHandles.push_back(materialSave.transmissionTextureHandle);
+                    m_sceneBindlessHandles.push_back(materialSave.transmissionTextureHandle);
+                }
+
+                // Keep the textures for the CPU backend
+                for (int slot = 0; slot < Material::TextureSlotCount; slot++)
+                {
+                    materialSave.textures[slot] = material.GetMaterialTexture((Material::MaterialTextureSlot)slot);
                 }
 
                 // Get material attributes
@@ -439,6 +580,7 @@ void PathTracingRenderer::ProcessBuffers()
             primitive.uvC = vertexData[index3].uv;
 
             primitive.meshIndex = meshIndex;
+            primitive.textureLodBias = BVH::GetTextureLodBias(primitive);
 
             // Push
             bvhPrimitives.push_back(primitive);
@@ -454,6 +596,14 @@ void PathTracingRenderer::ProcessBuffers()
     // Create SSBO for BVH nodes
     ProcessBvhNodeBuffer(bvhPrimitives);
 
+    // Create SSBO for emissive triangles, after the BVH has ordered the primitives
+    // It modifies bvhPrimitives!
+    std::vector<LightTree::LightBounds> lightBounds;
+    ProcessEmissiveTriangleBuffer(bvhPrimitives, totalMaterialData, lightBounds);
+
+    // Create SSBO for the light tree over the emissive triangles
+    ProcessLightTreeBuffer(lightBounds);
+
     // Create SSBO for BVH primitives
     ProcessBvhPrimitiveBuffer(bvhPrimitives);
 
@@ -462,15 +612,39 @@ void PathTracingRenderer::ProcessBuffers()
 
 void PathTracingRenderer::ProcessEnvironmentBuffer()
 {
+    // Get HDRI
+    std::shared_ptr<Texture2DObject> hdri = m_pathTracingApplication->GetHdri();
+    if (hdri == m_environmentHdri)
+    {
+        return;
+    }
+
+    // An HDRI processed before takes up its environment again, the current one is kept until its HDRI comes back
+    ParkEnvironment();
+    m_environmentHdri = hdri;
+
+    auto keptEnvironment = m_keptEnvironments.find(hdri);
+    if (keptEnvironment != m_keptEnvironments.end())
+    {
+        m_ssboEnvironment = keptEnvironment->second.ssboEnvironment;
+        m_hdriCache = keptEnvironment->second.hdriCache;
+        m_environmentBindlessHandles = keptEnvironment->second.bindlessHandles;
+        glBindBufferBase(m_ssboEnvironment->GetTarget(), 0, m_ssboEnvironment->GetHandle()); // Binding index: 0
+
+        m_cpuBackend->RestoreEnvironment(std::move(keptEnvironment->second.cpuEnvironment));
+        m_keptEnvironments.erase(keptEnvironment);
+        return;
+    }
+
+    m_ssboEnvironment = std::make_shared<ShaderStorageBufferObject>();
+    m_environmentBindlessHandles.clear();
+
     // Bind SSBO for environment
     m_ssboEnvironment->Bind();
 
     // Binding index
     glBindBufferBase(m_ssboEnvironment->GetTarget(), 0, m_ssboEnvironment->GetHandle()); // Binding index: 0
 
-    // Get HDRI
-    std::shared_ptr<Texture2DObject> hdri = m_pathTracingApplication->GetHdri();
-
     // Start timer
     Timer timer("HDRI Cache");
 
@@ -485,12 +659,12 @@ void PathTracingRenderer::ProcessEnvironmentBuffer()
     // Get HDRI handle
     const GLuint64 hdriHandle = hdri->GetBindlessTextureHandle();
     if (hdriHandle == 0) { throw new std::runtime_error("Error! HDRI Handle returned null"); }
-    m_bindlessHandles.push_back(hdriHandle);
+    m_environmentBindlessHandles.push_back(hdriHandle);
 
     // Get HDRI Cache handle
     const GLuint64 hdriCacheHandle = m_hdriCache->GetBindlessTextureHandle();
     if (hdriCacheHandle == 0) { throw new std::runtime_error("Error! HDRI Cache Handle returned null"); }
-    m_bindlessHandles.push_back(hdriCacheHandle);
+    m_environmentBindlessHandles.push_back(hdriCacheHandle);
 
     // Environment
     EnvironmentAlign environment{ };
@@ -504,6 +678,8 @@ void PathTracingRenderer::ProcessEnvironmentBuffer()
     // Allocate
     m_ssboEnvironment->AllocateData(span);
     m_ssboEnvironment->Unbind();
+
+    m_cpuBackend->ProcessEnvironment(hdri, m_hdriCache);
 }
 
 void PathTracingRenderer::ProcessMaterialBuffer(std::vector<MaterialSave> totalMaterialData)
@@ -517,6 +693,11 @@ void PathTracingRenderer::ProcessMaterialBuffer(std::vector<MaterialSave> totalM
     // Convert to MaterialAlign for GPU consumption
 
     std::vector<MaterialAlign> materialsAlign;
+
+    // CPU backend materials, textures are referenced by index into a list of unique textures
+    std::vector<PathTracingCpuBackend::MaterialData> cpuMaterials;
+    std::vector<std::shared_ptr<Texture2DObject>> cpuTextures;
+
     for (const MaterialSave& materialSave : totalMaterialData)
     {
         MaterialAlign materialAlign{ };
@@ -550,8 +731,49 @@ void PathTracingRenderer::ProcessMaterialBuffer(std::vector<MaterialSave> totalM
         materialAlign.refraction = materialSave.refraction;
         materialAlign.transmission = materialSave.transmission;
 
+        // Evaluated attributes
+        DisneyBrdf::Material attributes;
+        attributes.emission = materialSave.emission;
+        attributes.albedo = materialSave.albedo;
+        attributes.specular = materialSave.specular;
+        attributes.specularTint = materialSave.specularTint;
+        attributes.metallic = materialSave.metallic;
+        attributes.roughness = materialSave.roughness;
+        attributes.subsurface = materialSave.subsurface;
+        attributes.anisotropy = materialSave.anisotropy;
+        attributes.sheenRoughness = materialSave.sheenRoughness;
+        attributes.sheenTint = materialSave.sheenTint;
+        attributes.clearcoat = materialSave.clearcoat;
+        attributes.clearcoatRoughness = materialSave.clearcoatRoughness;
+        attributes.refraction = materialSave.refraction;
+        attributes.transmission = materialSave.transmission;
+
+        // Lobes are resolved once per material, so shading can skip the lobes a material never uses
+        materialAlign.lobes = DisneyBrdf::GetMaterialLobes(attributes, materialSave.metallicRoughnessTextureHandle != 0, materialSave.transmissionTextureHandle != 0);
+
         // Push
         materialsAlign.push_back(materialAlign);
+
+        PathTracingCpuBackend::MaterialData cpuMaterial{ };
+        cpuMaterial.attributes = attributes;
+        cpuMaterial.lobes = materialAlign.lobes;
+        for (int slot = 0; slot < Material::TextureSlotCount; slot++)
+        {
+            const std::shared_ptr<Texture2DObject>& texture = materialSave.textures[slot];
+            if (!texture)
+            {
+                cpuMaterial.textureIndices[slot] = -1;
+                continue;
+            }
+
+            auto it = std::find(cpuTextures.begin(), cpuTextures.end(), texture);
+            cpuMaterial.textureIndices[slot] = (int)std::distance(cpuTextures.begin(), it);
+            if (it == cpuTextures.end())
+            {
+                cpuTextures.push_back(texture);
+            }
+        }
+        cpuMaterials.push_back(cpuMaterial);
     }
 
     // Convert to span
@@ -561,6 +783,8 @@ void PathTracingRenderer::ProcessMaterialBuffer(std::vector<MaterialSave> totalM
     m_ssboMaterials->AllocateData(span);
 
     m_ssboMaterials->Unbind();
+
+    m_cpuBackend->ProcessMaterials(cpuMaterials, cpuTextures);
 }
 
 void PathTracingRenderer::ProcessBvhNodeBuffer(std::vector<BVH::BvhPrimitive>& bvhPrimitives)
@@ -610,6 +834,8 @@ void PathTracingRenderer::ProcessBvhNodeBuffer(std::vector<BVH::BvhPrimitive>& b
     // Allocate
     m_ssboBvhNodes->AllocateData(span);
     m_ssboBvhNodes->Unbind();
+
+    m_cpuBackend->ProcessBvhNodes(bvhNodes);
 }
 
 void PathTracingRenderer::ProcessBvhPrimitiveBuffer(std::vector<BVH::BvhPrimitive> bvhPrimitives)
@@ -648,6 +874,8 @@ void PathTracingRenderer::ProcessBvhPrimitiveBuffer(std::vector<BVH::BvhPrimitiv
         primitiveAligned.norCuvY = glm::vec4(norC, uvC.y);
 
         primitiveAligned.meshIndex = primitive.meshIndex;
+        primitiveAligned.emissiveIndex = primitive.emissiveIndex;
+        primitiveAligned.textureLodBias = primitive.textureLodBias;
 
         // Push
         bvhPrimitivesAligned.push_back(primitiveAligned);
@@ -659,6 +887,190 @@ void PathTracingRenderer::ProcessBvhPrimitiveBuffer(std::vector<BVH::BvhPrimitiv
     // Allocate
     m_ssboBvhPrimitives->AllocateData(span);
     m_ssboBvhPrimitives->Unbind();
+
+    m_cpuBackend->ProcessBvhPrimitives(bvhPrimitives);
+}
+
+void PathTracingRenderer::ProcessEmissiveTriangleBuffer(std::vector<BVH::BvhPrimitive>& bvhPrimitives, const std::vector<MaterialSave>& totalMaterialData, std::vector<LightTree::LightBounds>& lightBounds)
+{
+    // Bind SSBO for emissive triangles
+    m_ssboEmissiveTriangles->Bind();
+
+    // Binding index
+    glBindBufferBase(m_ssboEmissiveTriangles->GetTarget(), 5, m_ssboEmissiveTriangles->GetHandle()); // Binding index: 5
+
+    // Start timer
+    Timer timer("Emissive Triangles");
+
+    // Average emission of every material, emission textures are averaged over all of their texels
+    std::vector<glm::vec3> materialEmissions;
+    for (const MaterialSave& materialSave : totalMaterialData)
+    {
+        glm::vec3 emission = materialSave.emission;
+
+        const std::shared_ptr<Texture2DObject>& emissionTexture = materialSave.textures[Material::EmissionTexture];
+        if (emissionTexture && DisneyBrdf::Luminance(emission) > 0.0f)
+        {
+            emission *= CalculateAverageTextureColor(*emissionTexture);
+        }
+
+        materialEmissions.push_back(emission);
+    }
+
+    // Emitted power of every emissive triangle, proportional to emission times area
+    std::vector<PathTracingCpuBackend::EmissiveTriangle> emissiveTriangles;
+    std::vector<double> powers;
+    double totalPower = 0.0;
+
+    for (unsigned int i = 0; i < bvhPrimitives.size(); i++)
+    {
+        BVH::BvhPrimitive& primitive = bvhPrimitives[i];
+
+        float area = 0.5f * glm::length(glm::cross(primitive.posB - primitive.posA, primitive.posC - primitive.posA));
+        double power = double(DisneyBrdf::Luminance(materialEmissions[primitive.meshIndex])) * area;
+        if (power <= 0.0)
+        {
+            primitive.emissiveIndex = 0xffffffff;
+            continue;
+        }
+
+        primitive.emissiveIndex = (unsigned int)emissiveTriangles.size();
+
+        PathTracingCpuBackend::EmissiveTriangle emissiveTriangle{ };
+        emissiveTriangle.primitiveIndex = i;
+        emissiveTriangles.push_back(emissiveTriangle);
+
+        powers.push_back(power);
+        totalPower += power;
+
+        lightBounds.push_back(LightTree::GetTriangleBounds(primitive.posA, primitive.posB, primitive.posC, float(power)));
+    }
+
+    // Build the alias table, so a triangle can be picked in constant time
+    // See "A Linear Algorithm for Generating Random Numbers with a Given Distribution" (Vose 1991)
+    const size_t count = emissiveTriangles.size();
+
+    std::vector<double> scaledProbabilities(count);
+    std::vector<unsigned int> small;
+    std::vector<unsigned int> large;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        emissiveTriangles[i].pdf = float(powers[i] / totalPower);
+        emissiveTriangles[i].alias = i;
+        emissiveTriangles[i].aliasProbability = 1.0f;
+
+        scaledProbabilities[i] = powers[i] / totalPower * double(count);
+        (scaledProbabilities[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        unsigned int lower = small.back();
+        unsigned int upper = large.back();
+        small.pop_back();
+
+        // The lower entry is filled up by the upper entry
+        emissiveTriangles[lower].aliasProbability = float(scaledProbabilities[lower]);
+        emissiveTriangles[lower].alias = upper;
+
+        scaledProbabilities[upper] -= 1.0 - scaledProbabilities[lower];
+        if (scaledProbabilities[upper] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(upper);
+        }
+    }
+
+    // End time point in milliseconds and print
+    timer.Stop();
+    timer.Print();
+
+    // Align emissive triangles
+    std::vector<EmissiveTriangleAlign> emissiveTrianglesAligned;
+    for (const PathTracingCpuBackend::EmissiveTriangle& emissiveTriangle : emissiveTriangles)
+    {
+        EmissiveTriangleAlign emissiveTriangleAligned{ };
+
+        emissiveTriangleAligned.primitiveIndex = emissiveTriangle.primitiveIndex;
+        emissiveTriangleAligned.alias = emissiveTriangle.alias;
+        emissiveTriangleAligned.aliasProbability = emissiveTriangle.aliasProbability;
+        emissiveTriangleAligned.pdf = emissiveTriangle.pdf;
+
+        // Add
+        emissiveTrianglesAligned.push_back(emissiveTriangleAligned);
+    }
+
+    // The buffer is never empty, the shader only reads the first EmissiveTriangleCount entries
+    if (emissiveTrianglesAligned.empty())
+    {
+        emissiveTrianglesAligned.push_back(EmissiveTriangleAlign{ });
+    }
+
+    // Convert to span
+    std::span<EmissiveTriangleAlign> span = std::span(emissiveTrianglesAligned);
+
+    // Allocate
+    m_ssboEmissiveTriangles->AllocateData(span);
+    m_ssboEmissiveTriangles->Unbind();
+
+    m_emissiveTriangleCount = (unsigned int)count;
+    m_pathTracingMaterial->SetUniformValue("EmissiveTriangleCount", m_emissiveTriangleCount);
+
+    m_cpuBackend->ProcessEmissiveTriangles(emissiveTriangles);
+}
+
+void PathTracingRenderer::ProcessLightTreeBuffer(const std::vector<LightTree::LightBounds>& lightBounds)
+{
+    // Bind SSBO for the light tree
+    m_ssboLightTree->Bind();
+
+    // Binding index
+    glBindBufferBase(m_ssboLightTree->GetTarget(), 6, m_ssboLightTree->GetHandle()); // Binding index: 6
+
+    // Start timer
+    Timer timer("Light Tree");
+
+    // Calculate light tree
+    std::vector<LightTree::LightTreeNode> lightTreeNodes;
+    LightTree::BuildLightTree(lightBounds, lightTreeNodes);
+
+    // End time point in milliseconds and print
+    timer.Stop();
+    timer.Print();
+
+    // Align light tree nodes
+    std::vector<LightTree::LightTreeNodeAlign> lightTreeNodesAligned;
+    for (const LightTree::LightTreeNode& node : lightTreeNodes)
+    {
+        LightTree::LightTreeNodeAlign nodeAligned{ };
+
+        nodeAligned.AApower = glm::vec4(node.bounds.AA, node.bounds.power);
+        nodeAligned.BBcosThetaO = glm::vec4(node.bounds.BB, node.bounds.cosThetaO);
+        nodeAligned.axisCosThetaE = glm::vec4(node.bounds.axis, node.bounds.cosThetaE);
+        nodeAligned.left = node.left;
+        nodeAligned.right = node.right;
+        nodeAligned.parent = node.parent;
+        nodeAligned.emissiveIndex = node.emissiveIndex;
+
+        // Add
+        lightTreeNodesAligned.push_back(nodeAligned);
+    }
+
+    // The buffer is never empty, the shader only traverses it when there are emissive triangles
+    if (lightTreeNodesAligned.empty())
+    {
+        lightTreeNodesAligned.push_back(LightTree::LightTreeNodeAlign{ });
+    }
+
+    // Convert to span
+    std::span<LightTree::LightTreeNodeAlign> span = std::span(lightTreeNodesAligned);
+
+    // Allocate
+    m_ssboLightTree->AllocateData(span);
+    m_ssboLightTree->Unbind();
+
+    m_cpuBackend->ProcessLightTree(lightTreeNodes);
 }
 
 void PathTracingRenderer::PrintVBOData(VertexBufferObject& vbo, GLint vboSize)
@@ -916,4 +1328,23 @@ std::shared_ptr<Texture2DObject> PathTracingRenderer::CalculateHdriCache(std::sh
     delete[] cache;
 
     return hdriCache;
+}
+
+glm::vec3 PathTracingRenderer::CalculateAverageTextureColor(Texture2DObject& texture)
+{
+    // Read back the texels, decoded the same way the CPU backend samples them
+    PathTracingCpuBackend::Texture texels;
+    PathTracingCpuBackend::ReadbackTexture(texture, texels);
+
+    glm::dvec3 sum = glm::dvec3(0.0);
+    for (int y = 0; y < texels.height; y++)
+    {
+        for (int x = 0; x < texels.width; x++)
+        {
+            sum += glm::dvec3(glm::vec3(texels.Fetch(x, y)));
+        }
+    }
+
+    size_t texelCount = (size_t)texels.width * texels.height;
+    return texelCount > 0 ? glm::vec3(sum / double(texelCount)) : glm::vec3(0.0f);
 }
\ No newline at end of file
@@ -2,9 +2,13 @@
 #include "Renderer/Renderer.h"
 #include "Geometry/Model.h"
 #include "BVH.h"
+#include "LightTree.h"
+#include "PathTracingCpuBackend.h"
+#include "Shader/Material.h"
+#include <string>
+#include <unordered_map>
 
 class PathTracingApplication;
-class Material;
 class Texture2DObject;
 class FramebufferObject;
 class ShaderStorageBufferObject;
@@ -22,13 +26,21 @@ public:
 	const std::shared_ptr<Material> GetPathTracingMaterial()     const { return m_pathTracingMaterial; }
 	const std::shared_ptr<Material> GetPathTracingCopyMaterial() const { return m_pathTracingCopyMaterial; }
 	const std::shared_ptr<Material> GetToneMappingMaterial()     const { return m_toneMappingMaterial; }
+	const std::shared_ptr<Material> GetSampleHeatmapMaterial()   const { return m_sampleHeatmapMaterial; }
+	const std::shared_ptr<Material> GetUpsampleMaterial()        const { return m_upsampleMaterial; }
 
     const std::shared_ptr<ShaderStorageBufferObject> GetSsboEnvironment()   const { return m_ssboEnvironment; }
     const std::shared_ptr<ShaderStorageBufferObject> GetSsboMaterials()     const { return m_ssboMaterials; }
     const std::shared_ptr<ShaderStorageBufferObject> GetSsboBvhNodes()      const { return m_ssboBvhNodes; }
     const std::shared_ptr<ShaderStorageBufferObject> GetSsboBvhPrimitives() const { return m_ssboBvhPrimitives; }
+    const std::shared_ptr<ShaderStorageBufferObject> GetSsboAdaptiveSampling() const { return m_ssboAdaptiveSampling; }
+    const std::shared_ptr<ShaderStorageBufferObject> GetSsboEmissiveTriangles() const { return m_ssboEmissiveTriangles; }
+    const std::shared_ptr<ShaderStorageBufferObject> GetSsboLightTree()     const { return m_ssboLightTree; }
     
-    const std::vector<GLuint64> GetBindlessHandles() const { return m_bindlessHandles; }
+    // Handles of the environment and the scene textures
+    const std::vector<GLuint64> GetBindlessHandles() const;
+
+    const std::shared_ptr<PathTracingCpuBackend> GetCpuBackend() const { return m_cpuBackend; }
 
 private:
 	void InitializeFramebuffer();
@@ -50,6 +62,7 @@ private:
     // Buffer structs that are aligned to 16 bytes
     struct alignas(16) EnvironmentAlign;
     struct alignas(16) MaterialAlign;
+    struct alignas(16) EmissiveTriangleAlign;
 
 public:
     void ClearPathTracingTexture();
@@ -62,6 +75,14 @@ public:
     void ProcessMaterialBuffer(std::vector<MaterialSave> totalMaterialData);
     void ProcessBvhNodeBuffer(std::vector<BVH::BvhPrimitive>& bvhPrimitives);
     void ProcessBvhPrimitiveBuffer(std::vector<BVH::BvhPrimitive> bvhPrimitives);
+    void ProcessEmissiveTriangleBuffer(std::vector<BVH::BvhPrimitive>& bvhPrimitives, const std::vector<MaterialSave>& totalMaterialData, std::vector<LightTree::LightBounds>& lightBounds);
+    void ProcessLightTreeBuffer(const std::vector<LightTree::LightBounds>& lightBounds);
+
+    // Processed scenes stay resident under a name while others are processed, so switching back to one skips loading the models,
+    // building the BVH and reading the textures back for the CPU backend. Environments are kept the same way for every HDRI
+    void KeepScene(const std::string& name);        // Keeps the current scene under the name
+    bool RestoreScene(const std::string& name);     // False if no scene is kept under the name
+    void ClearKeptScenes();                         // Releases the kept scenes and environments, the current ones stay
 
 private:
 	void PrintVBOData(VertexBufferObject& vbo, GLint vboSize);
@@ -76,6 +97,7 @@ private:
 	std::vector<T> FlattenVector(const std::vector<std::vector<T>>& nestedVector);
 
 	std::shared_ptr<Texture2DObject> CalculateHdriCache(std::shared_ptr<Texture2DObject> hdri, int& width, int& height);
+	glm::vec3 CalculateAverageTextureColor(Texture2DObject& texture);
 
 private:
 	int m_width;
@@ -93,19 +115,60 @@ private:
 	std::shared_ptr<Material> m_pathTracingMaterial;
 	std::shared_ptr<Material> m_pathTracingCopyMaterial;
 	std::shared_ptr<Material> m_toneMappingMaterial;
+	std::shared_ptr<Material> m_sampleHeatmapMaterial;
+	std::shared_ptr<Material> m_upsampleMaterial;
 
 private:
+    // Buffers of a processed scene, the CPU backend's data is only taken from it while another scene is current
+    struct KeptScene
+    {
+        std::shared_ptr<ShaderStorageBufferObject> ssboMaterials;
+        std::shared_ptr<ShaderStorageBufferObject> ssboBvhNodes;
+        std::shared_ptr<ShaderStorageBufferObject> ssboBvhPrimitives;
+        std::shared_ptr<ShaderStorageBufferObject> ssboEmissiveTriangles;
+        std::shared_ptr<ShaderStorageBufferObject> ssboLightTree;
+        std::vector<GLuint64> bindlessHandles;
+        unsigned int emissiveTriangleCount = 0;
+        std::unique_ptr<PathTracingCpuBackend::SceneData> cpuScene;
+    };
+
+    struct KeptEnvironment
+    {
+        std::shared_ptr<ShaderStorageBufferObject> ssboEnvironment;
+        std::shared_ptr<Texture2DObject> hdriCache;
+        std::vector<GLuint64> bindlessHandles;
+        std::unique_ptr<PathTracingCpuBackend::EnvironmentData> cpuEnvironment;
+    };
+
+    // Takes the CPU backend's data of the current scene or environment into its kept entry, before another one replaces it
+    void ParkScene();
+    void ParkEnvironment();
+
 	// Hdri Cache
 	std::shared_ptr<Texture2DObject> m_hdriCache;
 
 	// Bindless texture handles
-    std::vector<GLuint64> m_bindlessHandles;
+    std::vector<GLuint64> m_environmentBindlessHandles;
+    std::vector<GLuint64> m_sceneBindlessHandles;
+    unsigned int m_emissiveTriangleCount = 0;
+
+    // Kept scenes and environments
+    std::unordered_map<std::string, KeptScene> m_keptScenes;
+    std::string m_keptSceneName;                            // Of the current scene, empty if it is not kept
+    std::unordered_map<std::shared_ptr<Texture2DObject>, KeptEnvironment> m_keptEnvironments;
+    std::shared_ptr<Texture2DObject> m_environmentHdri;     // HDRI the current environment was processed for
 
 	// SSBOs
 	std::shared_ptr<ShaderStorageBufferObject> m_ssboEnvironment;
 	std::shared_ptr<ShaderStorageBufferObject> m_ssboMaterials;
 	std::shared_ptr<ShaderStorageBufferObject> m_ssboBvhNodes;
 	std::shared_ptr<ShaderStorageBufferObject> m_ssboBvhPrimitives;
+	std::shared_ptr<ShaderStorageBufferObject> m_ssboAdaptiveSampling;
+	std::shared_ptr<ShaderStorageBufferObject> m_ssboEmissiveTriangles;
+	std::shared_ptr<ShaderStorageBufferObject> m_ssboLightTree;
+
+	// CPU backend, fed with the same data as the SSBOs
+	std::shared_ptr<PathTracingCpuBackend> m_cpuBackend;
 };
 
 struct PathTracingRenderer::PathTracingModel
@@ -136,6 +199,9 @@ struct PathTracingRenderer::MaterialSave
     GLuint64 clearcoatRoughnessTextureHandle = 0;
     GLuint64 transmissionTextureHandle = 0;
 
+    // Textures per slot, for the CPU backend
+    std::array<std::shared_ptr<Texture2DObject>, Material::TextureSlotCount> textures;
+
     // Attributes
     glm::vec3 emission = glm::vec3(0.0f, 0.0f, 0.0f);
     glm::vec3 albedo = glm::vec3(1.0f, 1.0f, 1.0f);
@@ -190,4 +256,15 @@ struct alignas(16) PathTracingRenderer::MaterialAlign
     float clearcoatRoughness;
     float refraction;
     float transmission;
+
+    // Lobe mask, see DisneyBrdf::Lobe
+    unsigned int lobes;
+};
+
+struct alignas(16) PathTracingRenderer::EmissiveTriangleAlign
+{
+    unsigned int primitiveIndex;
+    unsigned int alias;
+    float aliasProbability;
+    float pdf;
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "PhotonMap.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <thread>
+
+namespace
+{
+    // Splits [0, count) into one contiguous range per thread
+    template<typename Function>
+    void ParallelFor(size_t count, Function&& function)
+    {
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        size_t rangeSize = (count + threadCount - 1) / threadCount;
+
+        std::vector<std::thread> threads;
+        for (size_t begin = 0; begin < count; begin += rangeSize)
+        {
+            size_t end = std::min(begin + rangeSize, count);
+            threads.emplace_back([&function, begin, end]()
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    function(i);
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+void PhotonMap::Build(std::vector<Photon> photons, float radius)
+{
+    m_radius = radius;
+    m_cellSize = 2.0f * radius;
+
+    // Twice as many hash cells as photons keeps the collisions low
+    uint32_t cellCount = std::bit_ceil(std::max<uint32_t>(2u * (uint32_t)photons.size(), 1u));
+    m_cellMask = cellCount - 1;
+
+    std::vector<uint32_t> cells(photons.size());
+    std::vector<uint32_t> counts(cellCount, 0u);
+
+    ParallelFor(photons.size(), [&](size_t i)
+    {
+        cells[i] = GetCell(glm::ivec3(glm::floor(photons[i].position / m_cellSize)));
+        std::atomic_ref<uint32_t>(counts[cells[i]]).fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // Exclusive prefix sum gives the first photon of every cell
+    m_cellStarts.resize(cellCount + 1);
+    m_cellStarts[0] = 0;
+    for (uint32_t cell = 0; cell < cellCount; cell++)
+    {
+        m_cellStarts[cell + 1] = m_cellStarts[cell] + counts[cell];
+    }
+
+    // Scatter the photons into their cells, the counts are reused as write cursors
+    std::copy(m_cellStarts.begin(), m_cellStarts.end() - 1, counts.begin());
+    m_photons.resize(photons.size());
+
+    ParallelFor(photons.size(), [&](size_t i)
+    {
+        uint32_t index = std::atomic_ref<uint32_t>(counts[cells[i]]).fetch_add(1, std::memory_order_relaxed);
+        m_photons[index] = photons[i];
+    });
+}
+
+void PhotonMap::Clear()
+{
+    m_photons.clear();
+    m_cellStarts.clear();
+}
+
+uint32_t PhotonMap::GetCell(const glm::ivec3& cell) const
+{
+    // See "Optimized Spatial Hashing for Collision Detection of Deformable Objects" (Teschner et al. 2003)
+    uint32_t hash = (uint32_t(cell.x) * 73856093u) ^ (uint32_t(cell.y) * 19349663u) ^ (uint32_t(cell.z) * 83492791u);
+    return hash & m_cellMask;
+}
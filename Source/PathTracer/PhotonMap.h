@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Hash grid over photons for gathers with a fixed radius
+// Photons are sorted by cell, so the photons of a cell are contiguous in memory
+class PhotonMap
+{
+public:
+    struct Photon
+    {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 direction = glm::vec3(0.0f);  // Direction towards where the photon came from
+        glm::vec3 power = glm::vec3(0.0f);      // Flux carried by the photon
+    };
+
+public:
+    // Sorts the photons into cells of twice the gather radius, in parallel
+    void Build(std::vector<Photon> photons, float radius);
+    void Clear();
+
+    // Calls visit for every photon within the gather radius of the position
+    template<typename Visit>
+    void Gather(const glm::vec3& position, Visit&& visit) const;
+
+    const size_t GetPhotonCount() const { return m_photons.size(); }
+    const float GetRadius() const { return m_radius; }
+
+private:
+    uint32_t GetCell(const glm::ivec3& cell) const;
+
+private:
+    std::vector<Photon> m_photons;
+    std::vector<uint32_t> m_cellStarts;     // First photon of every hash cell, with the photon count as last entry
+    uint32_t m_cellMask = 0;
+
+    float m_radius = 0.0f;
+    float m_cellSize = 1.0f;
+};
+
+template<typename Visit>
+void PhotonMap::Gather(const glm::vec3& position, Visit&& visit) const
+{
+    if (m_photons.empty()) return;
+
+    // Cells are twice the radius, so the gather sphere overlaps at most two cells per axis
+    glm::ivec3 lower = glm::ivec3(glm::floor((position - m_radius) / m_cellSize));
+    glm::ivec3 upper = glm::ivec3(glm::floor((position + m_radius) / m_cellSize));
+    float radiusSquared = m_radius * m_radius;
+
+    // Different cells can share a hash cell, which must only be visited once
+    std::array<uint32_t, 8> visited;
+    int visitedCount = 0;
+
+    for (int z = lower.z; z <= upper.z; z++)
+    {
+        for (int y = lower.y; y <= upper.y; y++)
+        {
+            for (int x = lower.x; x <= upper.x; x++)
+            {
+                uint32_t cell = GetCell(glm::ivec3(x, y, z));
+
+                bool duplicate = false;
+                for (int i = 0; i < visitedCount; i++)
+                {
+                    duplicate |= visited[i] == cell;
+                }
+                if (duplicate) continue;
+                visited[visitedCount++] = cell;
+
+                for (uint32_t i = m_cellStarts[cell]; i < m_cellStarts[cell + 1]; i++)
+                {
+                    const Photon& photon = m_photons[i];
+                    glm::vec3 offset = photon.position - position;
+                    if (glm::dot(offset, offset) <= radiusSquared)
+                    {
+                        visit(photon);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#include "RadianceCache.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+    constexpr int MaxProbeCount = 16;
+
+    // Eviction policy
+    constexpr unsigned int MaxAge = 32;             // Frames an entry is kept without being used
+    constexpr float HighWatermark = 0.75f;          // Occupancy above which only the entries of the last frame are kept
+
+    uint64_t Hash(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+}
+
+void RadianceCache::Allocate(size_t maxBytes)
+{
+    m_entries.assign(std::bit_floor(std::max<size_t>(maxBytes / sizeof(Entry), 1)), Entry{ });
+    m_mask = m_entries.size() - 1;
+
+    Clear();
+}
+
+void RadianceCache::Clear()
+{
+    std::fill(m_entries.begin(), m_entries.end(), Entry{ });
+    m_frame = 0;
+    m_entryCount = 0;
+}
+
+uint64_t RadianceCache::GetKey(const glm::vec3& position, const glm::vec3& normal, float cellSize)
+{
+    // Cell sizes are powers of two, so cells of neighbouring sizes nest
+    int level = std::clamp((int)std::ceil(std::log2(cellSize)), -63, 63);
+    glm::ivec3 cell = glm::ivec3(glm::floor(position / std::exp2((float)level)));
+
+    // Dominant axis and sign of the normal, so both sides of a thin wall do not share a cell
+    glm::vec3 absNormal = glm::abs(normal);
+    int axis = absNormal.x > absNormal.y ? (absNormal.x > absNormal.z ? 0 : 2) : (absNormal.y > absNormal.z ? 1 : 2);
+    uint64_t normalBin = uint64_t(axis * 2 + (normal[axis] < 0.0f ? 1 : 0));
+
+    // 17 bits per coordinate, 3 for the normal, 7 for the level and the top bit so no key is 0
+    const uint64_t coordinateMask = (1ull << 17) - 1;
+    return (1ull << 63) | (uint64_t(level + 64) << 54) | (normalBin << 51) |
+        ((uint64_t(cell.x) & coordinateMask) << 34) | ((uint64_t(cell.y) & coordinateMask) << 17) | (uint64_t(cell.z) & coordinateMask);
+}
+
+int64_t RadianceCache::Find(uint64_t key, bool insert)
+{
+    // Linear probing, an empty entry is claimed with compare and swap
+    // Entries are only removed in between frames, so a key can at worst end up in two entries, which both age out
+    uint64_t start = Hash(key);
+    for (int probe = 0; probe < MaxProbeCount; probe++)
+    {
+        uint64_t index = (start + probe) & m_mask;
+        std::atomic_ref<uint64_t> entryKey(m_entries[index].key);
+
+        uint64_t current = entryKey.load(std::memory_order_relaxed);
+        if (current == key)
+        {
+            return (int64_t)index;
+        }
+
+        if (current == 0 && insert)
+        {
+            if (entryKey.compare_exchange_strong(current, key, std::memory_order_relaxed) || current == key)
+            {
+                return (int64_t)index;
+            }
+        }
+    }
+
+    return -1;
+}
+
+void RadianceCache::Record(uint64_t key, const glm::vec3& radiance)
+{
+    if (!std::isfinite(radiance.x + radiance.y + radiance.z)) return;
+
+    int64_t index = Find(key, true);
+    if (index < 0) return;
+
+    Entry& entry = m_entries[index];
+    for (int c = 0; c < 3; c++)
+    {
+        std::atomic_ref<float>(entry.radianceSum[c]).fetch_add(radiance[c], std::memory_order_relaxed);
+    }
+    std::atomic_ref<float>(entry.sampleCount).fetch_add(1.0f, std::memory_order_relaxed);
+    std::atomic_ref<unsigned int>(entry.lastFrame).store(m_frame, std::memory_order_relaxed);
+}
+
+bool RadianceCache::Query(uint64_t key, glm::vec3& radiance)
+{
+    int64_t index = Find(key, false);
+    if (index < 0) return false;
+
+    Entry& entry = m_entries[index];
+    float sampleCount = std::atomic_ref<float>(entry.sampleCount).load(std::memory_order_relaxed);
+    if (sampleCount < MinSampleCount) return false;
+
+    for (int c = 0; c < 3; c++)
+    {
+        radiance[c] = std::atomic_ref<float>(entry.radianceSum[c]).load(std::memory_order_relaxed) / sampleCount;
+    }
+    std::atomic_ref<unsigned int>(entry.lastFrame).store(m_frame, std::memory_order_relaxed);
+
+    return true;
+}
+
+void RadianceCache::EndFrame()
+{
+    size_t entryCount = 0;
+    for (const Entry& entry : m_entries)
+    {
+        entryCount += entry.key != 0 ? 1 : 0;
+    }
+
+    // Least recently used entries go first, all but the last frame's entries when the table gets too full
+    unsigned int maxAge = (float)entryCount > HighWatermark * (float)m_entries.size() ? 0 : MaxAge;
+
+    m_entryCount = 0;
+    for (Entry& entry : m_entries)
+    {
+        if (entry.key == 0) continue;
+
+        if (m_frame - entry.lastFrame > maxAge)
+        {
+            entry = Entry{ };
+            continue;
+        }
+        m_entryCount++;
+    }
+
+    m_frame++;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// World space hash grid of the outgoing radiance at diffuse surfaces, learned from completed paths
+// Open addressing without locks, cells are keyed by quantized position, normal and cell size
+class RadianceCache
+{
+public:
+    struct Entry
+    {
+        uint64_t key = 0;                       // 0 for empty entries
+        std::array<float, 3> radianceSum{ };
+        float sampleCount = 0.0f;
+        unsigned int lastFrame = 0;             // Last frame the entry was recorded or queried
+    };
+
+    // Entries need this many samples before queries use them
+    static constexpr float MinSampleCount = 16.0f;
+
+public:
+    // Allocates the largest power of two amount of entries that fits into maxBytes, and clears them
+    void Allocate(size_t maxBytes);
+    void Clear();
+
+    // Key of the cell, which is cellSize wide, containing the position
+    static uint64_t GetKey(const glm::vec3& position, const glm::vec3& normal, float cellSize);
+
+    // Add a radiance sample, can be called concurrently
+    // Samples are dropped when the probe sequence of the key is full
+    void Record(uint64_t key, const glm::vec3& radiance);
+
+    // Average radiance of the cell, false if it does not have enough samples yet
+    bool Query(uint64_t key, glm::vec3& radiance);
+
+    // Call once after every frame, evicts entries that have not been used for a while
+    void EndFrame();
+
+    const bool IsAllocated() const { return !m_entries.empty(); }
+    const size_t GetCapacity() const { return m_entries.size(); }
+    const size_t GetEntryCount() const { return m_entryCount; }
+    const size_t GetMemoryBytes() const { return m_entries.size() * sizeof(Entry); }
+
+private:
+    // Index of the entry of the key, -1 if it is not in the table and could not be inserted
+    int64_t Find(uint64_t key, bool insert);
+
+private:
+    std::vector<Entry> m_entries;
+    uint64_t m_mask = 0;
+
+    unsigned int m_frame = 0;
+    size_t m_entryCount = 0;    // Occupied entries after the last eviction
+};
@@ -0,0 +1,352 @@
+#include "RenderCoordinator.h"
+#include "ImageWriter.h"
+#include "Socket.h"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    uint32_t Hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // A tile is rendered as a film of its own, its pixels are numbered from its corner the way every other tile's are
+    // Without its corner in the seed each tile would repeat the noise of the others
+    unsigned int GetTileSeed(unsigned int seed, const glm::ivec4& crop)
+    {
+        uint32_t tileSeed = Hash(seed ^ Hash((uint32_t)crop.x ^ Hash((uint32_t)crop.y)));
+        return tileSeed == 0 ? 1u : tileSeed;
+    }
+}
+
+RenderCoordinator::RenderCoordinator(std::vector<std::string> workers) : m_workers(std::move(workers))
+{
+}
+
+bool RenderCoordinator::Render(const std::vector<BatchJob>& jobs)
+{
+    bool rendered = true;
+    for (const BatchJob& job : jobs)
+    {
+        // Frames of an animation are split into tiles one after another, workers do not reproject between them
+        if (job.IsAnimation())
+        {
+            for (const BatchJob& frame : job.GetAnimationFrames())
+            {
+                rendered &= RenderJob(frame);
+            }
+        }
+        else
+        {
+            rendered &= RenderJob(job);
+        }
+    }
+    return rendered;
+}
+
+bool RenderCoordinator::RenderJob(const BatchJob& job)
+{
+    // Buffers of the outputs, RGB rows of the whole film
+    std::vector<std::pair<std::string, std::string>> outputs;
+    if (!job.radianceOutput.empty()) outputs.push_back({ "radiance", job.radianceOutput });
+    if (!job.albedoOutput.empty()) outputs.push_back({ "albedo", job.albedoOutput });
+    if (!job.normalOutput.empty()) outputs.push_back({ "normal", job.normalOutput });
+
+    std::string reply;
+    for (const auto& [buffer, path] : outputs)
+    {
+        reply += (reply.empty() ? "" : " ") + buffer;
+    }
+
+    const glm::ivec2 resolution = job.resolution;
+    std::vector<std::vector<float>> film(outputs.size(), std::vector<float>((size_t)resolution.x * resolution.y * 3, 0.0f));
+
+    // Tiles cover the region of the job, or the whole film
+    glm::ivec2 areaMin(0), areaMax = resolution;
+    if (job.region.z > 0 && job.region.w > 0)
+    {
+        areaMin = glm::clamp(glm::ivec2(job.region.x, job.region.y), glm::ivec2(0), resolution);
+        areaMax = glm::clamp(areaMin + glm::ivec2(job.region.z, job.region.w), areaMin, resolution);
+    }
+
+    std::vector<Tile> tiles;
+    for (int y = areaMin.y; y < areaMax.y; y += TileSize)
+    {
+        for (int x = areaMin.x; x < areaMax.x; x += TileSize)
+        {
+            Tile tile;
+            tile.crop = glm::ivec4(x, y, std::min(TileSize, areaMax.x - x), std::min(TileSize, areaMax.y - y));
+            tiles.push_back(tile);
+        }
+    }
+
+    std::cout << job.name << ": " << tiles.size() << " tiles on " << m_workers.size() << " workers" << std::endl;
+
+    // Tiles denoised on their own would show their seams
+    if (job.denoise)
+    {
+        std::cout << job.name << ": tiled renders are not denoised" << std::endl;
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t doneCount = 0;
+    size_t workerCount = m_workers.size();
+    bool failed = false;
+
+    auto work = [&](const std::string& worker)
+    {
+        unsigned int failuresInRow = 0;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (doneCount < tiles.size() && !failed)
+        {
+            // A waiting tile, otherwise the longest running tile nobody helps with yet
+            auto tile = std::find_if(tiles.begin(), tiles.end(), [](const Tile& tile) { return !tile.done && tile.workerCount == 0; });
+            if (tile == tiles.end())
+            {
+                for (auto candidate = tiles.begin(); candidate != tiles.end(); candidate++)
+                {
+                    if (!candidate->done && candidate->workerCount == 1 && (tile == tiles.end() || candidate->startTime < tile->startTime))
+                    {
+                        tile = candidate;
+                    }
+                }
+            }
+
+            if (tile == tiles.end())
+            {
+                condition.wait(lock);
+                continue;
+            }
+
+            if (tile->workerCount == 0)
+            {
+                tile->startTime = std::chrono::steady_clock::now();
+            }
+            tile->workerCount++;
+
+            BatchJob tileJob = job;
+            tileJob.name = job.name + " tile " + std::to_string(tile - tiles.begin() + 1);
+            tileJob.region = glm::ivec4(0);
+            tileJob.crop = tile->crop;
+            tileJob.seed = GetTileSeed(job.seed, tile->crop);
+            tileJob.radianceOutput.clear();
+            tileJob.albedoOutput.clear();
+            tileJob.normalOutput.clear();
+            tileJob.checkpoint.clear();
+            tileJob.denoise = false;
+            tileJob.reply = reply;
+
+            lock.unlock();
+            std::vector<std::vector<float>> buffers;
+            TileResult result = TileResult::WorkerFailed;
+            std::string error;
+            Socket socket = Socket::Connect(worker, error);
+            if (socket.IsValid())
+            {
+                // The other worker may have finished the tile while this one connected
+                lock.lock();
+                bool finished = tile->done;
+                if (!finished)
+                {
+                    tile->sockets.push_back(&socket);
+                }
+                lock.unlock();
+
+                result = finished ? TileResult::Lost : RenderTile(worker, socket, tileJob, buffers);
+            }
+            else
+            {
+                std::cerr << error << std::endl;
+            }
+            lock.lock();
+
+            tile->workerCount--;
+            std::erase(tile->sockets, &socket);
+
+            // Closed for the other worker of the tile, this one is free for the next
+            if (result == TileResult::Lost && tile->done)
+            {
+                condition.notify_all();
+                continue;
+            }
+
+            if (result == TileResult::Rendered)
+            {
+                failuresInRow = 0;
+
+                // The other worker of a tile that was helped with may still be rendering it, its result is dropped
+                if (!tile->done)
+                {
+                    for (size_t i = 0; i < film.size(); i++)
+                    {
+                        for (int row = 0; row < tile->crop.w; row++)
+                        {
+                            const float* source = buffers[i].data() + (size_t)row * tile->crop.z * 3;
+                            float* destination = film[i].data() + ((size_t)(tile->crop.y + row) * resolution.x + tile->crop.x) * 3;
+                            std::copy(source, source + (size_t)tile->crop.z * 3, destination);
+                        }
+                    }
+
+                    tile->done = true;
+                    doneCount++;
+
+                    // Shutting the connection down wakes the thread of the other worker, and its render server cancels the tile
+                    for (const Socket* otherSocket : tile->sockets)
+                    {
+                        otherSocket->Shutdown();
+                    }
+                    std::cout << job.name << ": " << doneCount << "/" << tiles.size() << " tiles" << std::endl;
+                }
+            }
+            else
+            {
+                if (result == TileResult::Lost)
+                {
+                    std::cerr << worker << ": connection lost during " << tileJob.name << std::endl;
+                }
+
+                failuresInRow++;
+                if (result == TileResult::Error && !tile->done && ++tile->errorCount >= MaxTileErrors)
+                {
+                    std::cerr << tileJob.name << ": " << tile->errorCount << " errors, giving up on the job" << std::endl;
+                    failed = true;
+                }
+                if (failuresInRow >= MaxWorkerFailures)
+                {
+                    std::cerr << worker << ": failed " << failuresInRow << " times in a row, giving up on the worker" << std::endl;
+                    condition.notify_all();
+                    break;
+                }
+            }
+
+            condition.notify_all();
+        }
+
+        // Tiles nobody is left to render would be waited for forever
+        workerCount--;
+        if (workerCount == 0 && doneCount < tiles.size())
+        {
+            failed = true;
+        }
+        condition.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    for (const std::string& worker : m_workers)
+    {
+        threads.emplace_back(work, std::cref(worker));
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (failed)
+    {
+        std::cerr << job.name << ": not finished" << std::endl;
+        return false;
+    }
+
+    bool written = true;
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        ImageWriter::Image image;
+        image.width = resolution.x;
+        image.height = resolution.y;
+        image.exposure = job.exposure;
+
+        ImageWriter::Layer& layer = image.layers.emplace_back();
+        layer.pixels.resize((size_t)resolution.x * resolution.y);
+        for (size_t pixel = 0; pixel < layer.pixels.size(); pixel++)
+        {
+            layer.pixels[pixel] = glm::vec4(film[i][pixel * 3], film[i][pixel * 3 + 1], film[i][pixel * 3 + 2], 1.0f);
+        }
+
+        if (!ImageWriter::Write(outputs[i].second, image))
+        {
+            std::cerr << job.name << ": cannot write \"" << outputs[i].second << "\"" << std::endl;
+            written = false;
+        }
+    }
+
+    std::cout << job.name << ": done" << std::endl;
+    return written;
+}
+
+RenderCoordinator::TileResult RenderCoordinator::RenderTile(const std::string& worker, Socket& socket, const BatchJob& tileJob, std::vector<std::vector<float>>& buffers) const
+{
+    std::ostringstream request;
+    tileJob.Save(request);
+    if (!socket.SendLine(request.str()))
+    {
+        return TileResult::Lost;
+    }
+    socket.ShutdownSend();
+
+    // Progress lines are skipped, buffer lines are followed by their floats, the last line of the job says how it went
+    const std::string prefix = tileJob.name + ": ";
+    std::istringstream replyNames(tileJob.reply);
+    std::string replyName;
+    std::string line;
+    while (socket.ReceiveLine(line))
+    {
+        if (line.compare(0, 7, "queued ") == 0)
+        {
+            continue;
+        }
+        if (line.compare(0, 5, "error") == 0)
+        {
+            std::cerr << worker << ": " << line << std::endl;
+            return TileResult::Error;
+        }
+
+        if (line.compare(0, prefix.size(), prefix) == 0)
+        {
+            std::string message = line.substr(prefix.size());
+            if (message.compare(0, 5, "error") == 0)
+            {
+                std::cerr << worker << ": " << line << std::endl;
+                return TileResult::Error;
+            }
+            if (message.compare(0, 4, "done") == 0)
+            {
+                // Every buffer of the reply has to have arrived
+                return replyNames >> replyName ? TileResult::WorkerFailed : TileResult::Rendered;
+            }
+            continue;
+        }
+
+        std::istringstream header(line);
+        std::string name;
+        int width = 0, height = 0;
+        if (header >> name >> width >> height)
+        {
+            // Buffers come in the order of the reply, each the size of the crop
+            if (!(replyNames >> replyName) || name != replyName || width != tileJob.crop.z || height != tileJob.crop.w)
+            {
+                std::cerr << worker << ": unexpected reply " << line << std::endl;
+                return TileResult::WorkerFailed;
+            }
+
+            std::vector<float>& buffer = buffers.emplace_back((size_t)width * height * 3);
+            if (!socket.Receive(buffer.data(), buffer.size() * sizeof(float)))
+            {
+                break;
+            }
+        }
+    }
+
+    return TileResult::Lost;
+}
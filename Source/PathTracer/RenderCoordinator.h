@@ -0,0 +1,55 @@
+#pragma once
+
+#include "BatchJob.h"
+#include "Socket.h"
+#include <chrono>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Renders batch jobs on the render servers of other processes or machines, and writes the outputs merged from their tiles
+//
+// A job is split into tiles, each sent to a worker as a crop of the job replying with the buffers of the outputs
+// Workers take one tile after another and keep the scene loaded in between, see RenderServer
+// A worker finding no waiting tile helps with the longest running one, which takes whichever result arrives first
+// The connection of the slower one is then closed, which cancels the tile on its render server and frees it for the next
+// Tiles of a worker that fails go back to the others, and a worker failing repeatedly is given up on
+class RenderCoordinator
+{
+public:
+    // Addresses of the render servers, see Socket
+    explicit RenderCoordinator(std::vector<std::string> workers);
+
+    // False if a job could not be finished
+    bool Render(const std::vector<BatchJob>& jobs);
+
+    static constexpr int TileSize = 128;
+    static constexpr unsigned int MaxTileErrors = 3;            // Errors workers report for a tile before its job is given up
+    static constexpr unsigned int MaxWorkerFailures = 3;        // Failures in a row before a worker is given up
+
+private:
+    enum class TileResult
+    {
+        Rendered,
+        WorkerFailed,       // Not reached or not understood, another worker can render the tile
+        Lost,               // Connection ended before the tile was done, also when it is closed for another worker finishing first
+        Error,              // Reported by the worker, e.g. for a scene it cannot find
+    };
+
+    struct Tile
+    {
+        glm::ivec4 crop;                    // x, y, width and height in the film, as the crop of a job
+        bool done = false;
+        unsigned int workerCount = 0;       // Workers rendering it right now
+        std::vector<const Socket*> sockets; // Connections of those workers, closed once one of them has finished it
+        unsigned int errorCount = 0;
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    bool RenderJob(const BatchJob& job);
+
+    // Receives the replied buffers in the order the tile job names them
+    TileResult RenderTile(const std::string& worker, Socket& socket, const BatchJob& tileJob, std::vector<std::vector<float>>& buffers) const;
+
+    std::vector<std::string> m_workers;
+};
@@ -0,0 +1,192 @@
+#include "RenderServer.h"
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+    constexpr size_t MaxRequestSize = 1 << 20;
+    constexpr int ReceiveTimeout = 30000;       // Milliseconds a client may send nothing before its request is dropped
+}
+
+struct RenderServer::Connection
+{
+    explicit Connection(Socket socket) : socket(std::move(socket)) {}
+
+    Socket socket;
+    std::mutex mutex;       // Lines are sent by the listening thread and the rendering thread
+    std::atomic<bool> disconnected = false;
+};
+
+RenderServer::~RenderServer()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    // Connecting wakes the listening thread from accept on every platform, shutting the socket down does not on all of them
+    // A server listening on every interface is reached through the loopback one
+    m_running = false;
+    std::string error;
+    Socket::Connect(m_address.starts_with("0.0.0.0:") || m_address.starts_with(":::") ? "localhost" + m_address.substr(m_address.rfind(':')) : m_address, error);
+    m_thread.join();
+
+    // Clients still sending are cut off rather than waited for
+    for (Receiver& receiver : m_receivers)
+    {
+        if (std::shared_ptr<Connection> connection = receiver.connection.lock())
+        {
+            connection->socket.Shutdown();
+        }
+        receiver.thread.join();
+    }
+}
+
+bool RenderServer::Start(const std::string& address, std::string& error)
+{
+    m_listenSocket = Socket::Listen(address, error);
+    if (!m_listenSocket.IsValid())
+    {
+        return false;
+    }
+
+    m_address = address;
+    m_running = true;
+    m_thread = std::thread(&RenderServer::Listen, this);
+    return true;
+}
+
+bool RenderServer::PopRequest(Request& request)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Jobs of clients that went away are not rendered for nobody
+    std::erase_if(m_requests, [](const Request& request) { return IsDisconnected(request); });
+    if (m_requests.empty())
+    {
+        return false;
+    }
+
+    auto first = std::min_element(m_requests.begin(), m_requests.end(), [](const Request& a, const Request& b)
+        {
+            return a.job.priority != b.job.priority ? a.job.priority > b.job.priority : a.sequence < b.sequence;
+        });
+
+    request = std::move(*first);
+    m_requests.erase(first);
+    return true;
+}
+
+void RenderServer::Send(const Request& request, const std::string& line)
+{
+    if (!request.connection)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(request.connection->mutex);
+    if (!request.connection->socket.SendLine(line))
+    {
+        request.connection->disconnected = true;
+    }
+}
+
+void RenderServer::SendBuffer(const Request& request, const std::string& name, int width, int height, const std::vector<float>& rgb)
+{
+    if (!request.connection)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(request.connection->mutex);
+    if (!request.connection->socket.SendLine(name + " " + std::to_string(width) + " " + std::to_string(height))
+        || !request.connection->socket.Send(rgb.data(), rgb.size() * sizeof(float)))
+    {
+        request.connection->disconnected = true;
+    }
+}
+
+bool RenderServer::IsDisconnected(const Request& request)
+{
+    return request.connection && request.connection->disconnected;
+}
+
+void RenderServer::Listen()
+{
+    while (m_running)
+    {
+        Socket clientSocket = m_listenSocket.Accept();
+
+        // Threads of requests read meanwhile are done with
+        std::erase_if(m_receivers, [](Receiver& receiver)
+            {
+                if (!*receiver.finished)
+                {
+                    return false;
+                }
+                receiver.thread.join();
+                return true;
+            });
+
+        if (clientSocket.IsValid() && m_running)
+        {
+            std::shared_ptr<Connection> connection = std::make_shared<Connection>(std::move(clientSocket));
+            connection->socket.SetReceiveTimeout(ReceiveTimeout);
+
+            Receiver receiver;
+            receiver.connection = connection;
+            receiver.finished = std::make_shared<std::atomic<bool>>(false);
+            receiver.thread = std::thread([this, connection, finished = receiver.finished]()
+                {
+                    Receive(connection);
+                    *finished = true;
+                });
+            m_receivers.push_back(std::move(receiver));
+        }
+    }
+}
+
+void RenderServer::Receive(const std::shared_ptr<Connection>& connection)
+{
+    Request request;
+    request.connection = connection;
+
+    // The request ends when the client shuts down its sending side
+    std::string text;
+    std::string line;
+    while (text.size() <= MaxRequestSize && request.connection->socket.ReceiveLine(line, MaxRequestSize))
+    {
+        text += line + "\n";
+    }
+    if (request.connection->socket.HasTimedOut())
+    {
+        Send(request, "error: request timed out");
+        return;
+    }
+
+    // Whatever was cut off could have been any part of a job, so none of the request is rendered
+    if (text.size() > MaxRequestSize)
+    {
+        Send(request, "error: request too large");
+        return;
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string error;
+    std::istringstream stream(text);
+    if (!BatchJob::Parse(stream, "request", jobs, error, !Socket::IsNetworkAddress(m_address)))
+    {
+        Send(request, "error: " + error);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (BatchJob& job : jobs)
+    {
+        Send(request, "queued " + job.name);
+
+        request.job = std::move(job);
+        request.sequence = m_sequence++;
+        m_requests.push_back(request);
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "BatchJob.h"
+#include "Socket.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Accepts batch jobs from other processes, so they are rendered by an application that has their scenes loaded already
+// It listens on a Unix domain socket for processes of the same machine, or on a TCP port, see Socket
+// Clients over TCP get their results as reply buffers only, their jobs cannot name files of the server to read or write
+//
+// A client connects, sends jobs in the job file format and shuts down its sending side
+// It receives a line per queued job, the progress lines of its jobs and a last line per job, "done" or starting with "error"
+// Buffers a job asks for with "reply" come before that last line, each as a line "<buffer> <width> <height>" and the RGB floats of its rows
+// The server closes the connection once all jobs of it are finished
+// A client that closes the connection before gives up its jobs, the one rendering is cancelled once a progress line cannot be sent to it
+// Each connection is read on a thread of its own, a client that sends nothing for a while gets an error instead of holding up the others
+class RenderServer
+{
+public:
+    // Connection of a client, closed when the last request holding it is destroyed
+    struct Connection;
+
+    struct Request
+    {
+        BatchJob job;
+        std::shared_ptr<Connection> connection;
+        unsigned int sequence = 0;      // Order of arrival, among jobs of the same priority
+    };
+
+    RenderServer() = default;
+    ~RenderServer();
+
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator=(const RenderServer&) = delete;
+
+    // False with a message if the address cannot be listened on
+    bool Start(const std::string& address, std::string& error);
+
+    // Takes the waiting request of the highest priority, false if none is waiting. Called from the thread rendering the jobs
+    bool PopRequest(Request& request);
+
+    // Sends a line to the client of the request, ignored if it has disconnected
+    static void Send(const Request& request, const std::string& line);
+    // Sends a buffer in the format above
+    static void SendBuffer(const Request& request, const std::string& name, int width, int height, const std::vector<float>& rgb);
+    // Whether the client of the request is known to have gone, noticed by a send that failed
+    static bool IsDisconnected(const Request& request);
+
+private:
+    // Thread reading the request of a connection
+    struct Receiver
+    {
+        std::thread thread;
+        std::weak_ptr<Connection> connection;                   // Shut down when the server stops
+        std::shared_ptr<std::atomic<bool>> finished;            // Set by the thread once the jobs are queued
+    };
+
+    void Listen();
+    void Receive(const std::shared_ptr<Connection>& connection);
+
+    std::string m_address;
+    Socket m_listenSocket;
+    std::atomic<bool> m_running = false;
+    std::thread m_thread;
+    std::vector<Receiver> m_receivers;      // Only touched by the listening thread
+
+    // Jobs waiting to be rendered, shared with the listening thread
+    std::mutex m_mutex;
+    std::vector<Request> m_requests;
+    unsigned int m_sequence = 0;
+};
@@ -0,0 +1,35 @@
+#include "SampleScheduler.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr float Smoothing = 0.25f;  // Weight of the newest frame in the measured cost, so single slow frames do not halve the next one
+}
+
+void SampleScheduler::AddFrame(unsigned int sampleCount, float milliseconds)
+{
+    if (sampleCount == 0 || milliseconds <= 0.0f)
+    {
+        return;
+    }
+
+    float sampleMilliseconds = milliseconds / (float)sampleCount;
+    m_sampleMilliseconds = m_sampleMilliseconds > 0.0f ? m_sampleMilliseconds + (sampleMilliseconds - m_sampleMilliseconds) * Smoothing : sampleMilliseconds;
+}
+
+unsigned int SampleScheduler::GetSampleCount() const
+{
+    if (m_targetMilliseconds <= 0.0f)
+    {
+        return MaxSampleCount;
+    }
+
+    // A single sample until its cost is known
+    if (m_sampleMilliseconds <= 0.0f)
+    {
+        return 1;
+    }
+
+    float sampleCount = m_targetMilliseconds / m_sampleMilliseconds;
+    return (unsigned int)std::clamp(sampleCount, 1.0f, (float)MaxSampleCount);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Picks the samples per pixel of a frame, so rendering a frame takes close to a target time
+// The cost of a sample is measured on the frames rendered so far, a frame renders at least one
+class SampleScheduler
+{
+public:
+    // Call once per rendered frame, with the samples it rendered and the time they took
+    void AddFrame(unsigned int sampleCount, float milliseconds);
+
+    // Samples of the next frame, as many as fit the target time. Unbounded if the target is 0
+    unsigned int GetSampleCount() const;
+
+    // Forget the measured cost, e.g. when the scene or the resolution changes
+    void Reset() { m_sampleMilliseconds = 0.0f; }
+
+    void SetTargetMilliseconds(float value) { m_targetMilliseconds = value; }
+    const float GetTargetMilliseconds() const { return m_targetMilliseconds; }
+
+    // Measured time per sample, 0 until a frame is added
+    const float GetSampleMilliseconds() const { return m_sampleMilliseconds; }
+
+    static constexpr unsigned int MaxSampleCount = 256;
+
+private:
+    float m_targetMilliseconds = 16.0f;
+    float m_sampleMilliseconds = 0.0f;
+};
@@ -0,0 +1,216 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+    constexpr Sampler::SobolMatrices SobolMatrices = Sampler::GenerateSobolMatrices();
+
+    // Second dimension starts with 1/2, 3/4, 5/8
+    static_assert(SobolMatrices[Sampler::SobolBitCount + 0] == 0x80000000u && SobolMatrices[Sampler::SobolBitCount + 1] == 0xc0000000u && SobolMatrices[Sampler::SobolBitCount + 2] == 0xa0000000u);
+
+    // PCG (permuted congruential generator), see montecarlo.glsl
+    unsigned int NextRandom(unsigned int& state)
+    {
+        state = state * 747796405u + 2891336453u;
+        unsigned int result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+        result = (result >> 22) ^ result;
+        return result;
+    }
+
+    uint32_t Hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32_t HashCombine(uint32_t seed, uint32_t value)
+    {
+        return seed ^ (value + (seed << 6) + (seed >> 2));
+    }
+
+    uint32_t Reseed(uint32_t x, uint32_t seed)
+    {
+        return seed == 0 ? x : Hash(HashCombine(x, seed));
+    }
+
+    uint32_t ReverseBits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Laine-Karras style permutation with the constants from Vegdahl's improved Owen hash
+    uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed)
+    {
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1u;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return x;
+    }
+
+    // Owen scrambling in base 2, see "Practical Hash-based Owen Scrambling" (Burley 2020)
+    uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+    {
+        x = ReverseBits(x);
+        x = LaineKarrasPermutation(x, seed);
+        x = ReverseBits(x);
+        return x;
+    }
+
+    uint32_t SobolSample(uint32_t index, int dimension)
+    {
+        uint32_t result = 0;
+        for (int bit = 0; index != 0; bit++, index >>= 1)
+        {
+            if (index & 1u)
+            {
+                result ^= SobolMatrices[dimension * Sampler::SobolBitCount + bit];
+            }
+        }
+        return result;
+    }
+
+    // Interleave the lower 16 bits of x and y
+    uint32_t MortonCode(uint32_t x, uint32_t y)
+    {
+        auto spread = [](uint32_t v)
+        {
+            v &= 0x0000ffffu;
+            v = (v | (v << 8)) & 0x00ff00ffu;
+            v = (v | (v << 4)) & 0x0f0f0f0fu;
+            v = (v | (v << 2)) & 0x33333333u;
+            v = (v | (v << 1)) & 0x55555555u;
+            return v;
+        };
+        return spread(x) | (spread(y) << 1);
+    }
+
+    // Upper 24 bits to a float in [0; 1), so that rounding never reaches 1
+    float ToUnitFloat(uint32_t x)
+    {
+        return float(x >> 8) * (1.0f / 16777216.0f);
+    }
+}
+
+Sampler::Sampler(Type type, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int frameIndex, unsigned int sampleCount, unsigned int seed)
+    : m_type(type)
+{
+    unsigned int pixelIndex = y * width + x;
+
+    switch (m_type)
+    {
+    case Type::Pcg:
+        // Same seed as before the sampler existed, FrameCount is frameIndex + 1
+        m_rngState = Reseed(pixelIndex + (frameIndex + 1) * 719393u, seed);
+        break;
+    case Type::Sobol:
+        // Every pixel gets its own scrambling of the same sequence
+        m_sobolIndex = frameIndex;
+        m_sobolSeed = Reseed(Hash(pixelIndex), seed);
+        break;
+    case Type::SobolBlueNoise:
+    {
+        // Neighbouring pixels take consecutive runs of one shared sequence, which distributes the error as blue noise
+        // See "Screen-Space Blue-Noise Diffusion of Monte Carlo Sampling Error via Hierarchical Ordering of Pixels" (Ahmed and Wonka 2020)
+        // The Z-curve index and the sample index share the 32 bits of the index. Where they do not fit, or past the sample count,
+        // the pixel takes plain Sobol, since cutting bits off would repeat the sequences of other pixels or earlier samples
+        uint32_t sampleBits = std::bit_width(std::max(sampleCount, 1u) - 1u);
+        uint32_t mortonBits = 2 * std::bit_width(std::max(std::max(width, height), 1u) - 1u);
+        if (mortonBits + sampleBits <= 32 && sampleBits < 32 && frameIndex < (1u << sampleBits))
+        {
+            m_sobolIndex = (MortonCode(x, y) << sampleBits) | frameIndex;
+            m_sobolSeed = Reseed(0, seed);
+        }
+        else
+        {
+            m_sobolIndex = frameIndex;
+            m_sobolSeed = Reseed(Hash(pixelIndex), seed);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+Sampler::Sampler(const float* primarySamples)
+    : m_type(Type::PrimarySampleSpace), m_primarySamples(primarySamples)
+{
+}
+
+float Sampler::NextPcg()
+{
+    return float(NextRandom(m_rngState)) / 4294967295.0f; // 2^32 - 1
+}
+
+glm::vec4 Sampler::SobolOwen(unsigned int dimension, int count) const
+{
+    uint32_t seed = Hash(HashCombine(m_sobolSeed, dimension));
+
+    // Shuffle the sample order, so every dimension set is decorrelated from the others
+    uint32_t index = NestedUniformScramble(m_sobolIndex, seed);
+
+    glm::vec4 result(0.0f);
+    for (int i = 0; i < count; i++)
+    {
+        result[i] = ToUnitFloat(NestedUniformScramble(SobolSample(index, i), HashCombine(seed, i)));
+    }
+    return result;
+}
+
+float Sampler::Get1D(unsigned int dimension)
+{
+    if (m_type == Type::Pcg)
+    {
+        return NextPcg();
+    }
+    if (m_type == Type::PrimarySampleSpace)
+    {
+        return m_primarySamples[dimension * PrimarySamplesPerDimension];
+    }
+    return SobolOwen(dimension, 1).x;
+}
+
+glm::vec2 Sampler::Get2D(unsigned int dimension)
+{
+    if (m_type == Type::Pcg)
+    {
+        float R1 = NextPcg();
+        float R2 = NextPcg();
+        return glm::vec2(R1, R2);
+    }
+    if (m_type == Type::PrimarySampleSpace)
+    {
+        const float* samples = &m_primarySamples[dimension * PrimarySamplesPerDimension];
+        return glm::vec2(samples[0], samples[1]);
+    }
+    return glm::vec2(SobolOwen(dimension, 2));
+}
+
+glm::vec3 Sampler::Get3D(unsigned int dimension)
+{
+    if (m_type == Type::Pcg)
+    {
+        float R1 = NextPcg();
+        float R2 = NextPcg();
+        float R3 = NextPcg();
+        return glm::vec3(R1, R2, R3);
+    }
+    if (m_type == Type::PrimarySampleSpace)
+    {
+        const float* samples = &m_primarySamples[dimension * PrimarySamplesPerDimension];
+        return glm::vec3(samples[0], samples[1], samples[2]);
+    }
+    return glm::vec3(SobolOwen(dimension, 3));
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+
+// CPU port of Shaders/Library/sampler.glsl
+// Hands out the random numbers of a single path, either from the PCG stream or from Owen-scrambled Sobol points
+// On the CPU it can also read them from a primary sample vector, which a Metropolis chain mutates
+class Sampler
+{
+public:
+    // Same values as the SAMPLER_* defines in sampler.glsl
+    enum Type : unsigned int
+    {
+        Pcg,                // Independent uniform samples
+        Sobol,              // Owen-scrambled Sobol, decorrelated per pixel
+        SobolBlueNoise,     // Owen-scrambled Sobol, sample indices ordered along the pixel Z-curve
+        PrimarySampleSpace, // CPU only, the numbers of a primary sample vector
+    };
+
+    // Every random decision of a path has a fixed dimension, so all pixels use the same Sobol dimensions for the same decision
+    // Same values as the SAMPLE_DIMENSION_* defines in sampler.glsl
+    enum Dimension : unsigned int
+    {
+        DimensionAntiAliasing = 0,
+        DimensionLens = 1,
+        DimensionBounce = 2,        // First dimension of bounce 0
+        DimensionsPerBounce = 4,    // HDRI, BRDF, Russian roulette and emissive triangles
+
+        DimensionHdri = 0,          // Offsets within a bounce
+        DimensionBrdf = 1,
+        DimensionRussianRoulette = 2,
+        DimensionEmissive = 3,
+    };
+
+    // Numbers a primary sample vector holds per dimension, enough for Get3D
+    static constexpr unsigned int PrimarySamplesPerDimension = 3;
+
+    static constexpr int SobolDimensionCount = 4;
+    static constexpr int SobolBitCount = 32;
+    using SobolMatrices = std::array<uint32_t, SobolDimensionCount * SobolBitCount>;
+
+public:
+    Sampler() = default;
+
+    // sampleCount is the number of frames the image converges over, used to order the blue noise sample indices
+    // Renders of another seed draw independent numbers, seed 0 draws the same ones as sampler.glsl
+    Sampler(Type type, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int frameIndex, unsigned int sampleCount, unsigned int seed = 0);
+
+    // Reads dimension d from primarySamples[d * PrimarySamplesPerDimension], the vector must outlive the sampler
+    explicit Sampler(const float* primarySamples);
+
+    float Get1D(unsigned int dimension);
+    glm::vec2 Get2D(unsigned int dimension);
+    glm::vec3 Get3D(unsigned int dimension);
+
+    static unsigned int GetBounceDimension(unsigned int bounce, unsigned int offset) { return DimensionBounce + bounce * DimensionsPerBounce + offset; }
+
+    // Generator matrices of the first Sobol dimensions, from the Joe-Kuo direction numbers
+    static constexpr SobolMatrices GenerateSobolMatrices()
+    {
+        // Degree, coefficients and initial direction numbers of the primitive polynomials of dimension 1 to 3
+        constexpr unsigned int degrees[SobolDimensionCount] = { 0, 1, 2, 3 };
+        constexpr unsigned int coefficients[SobolDimensionCount] = { 0, 0, 1, 1 };
+        constexpr unsigned int initialNumbers[SobolDimensionCount][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+
+        SobolMatrices matrices{ };
+
+        // The first dimension is the van der Corput sequence
+        for (int i = 0; i < SobolBitCount; i++)
+        {
+            matrices[i] = 1u << (SobolBitCount - 1 - i);
+        }
+
+        for (int dimension = 1; dimension < SobolDimensionCount; dimension++)
+        {
+            uint32_t* v = &matrices[dimension * SobolBitCount];
+            const unsigned int s = degrees[dimension];
+            const unsigned int a = coefficients[dimension];
+
+            for (unsigned int i = 0; i < SobolBitCount; i++)
+            {
+                if (i < s)
+                {
+                    v[i] = initialNumbers[dimension][i] << (SobolBitCount - 1 - i);
+                    continue;
+                }
+
+                v[i] = v[i - s] ^ (v[i - s] >> s);
+                for (unsigned int k = 1; k < s; k++)
+                {
+                    v[i] ^= ((a >> (s - 1 - k)) & 1u) * v[i - k];
+                }
+            }
+        }
+
+        return matrices;
+    }
+
+private:
+    // The first count Sobol dimensions of the Owen-scrambled point, padded per dimension set by the seed
+    glm::vec4 SobolOwen(unsigned int dimension, int count) const;
+
+    float NextPcg();
+
+private:
+    Type m_type = Type::Pcg;
+
+    // PCG state
+    unsigned int m_rngState = 0;
+
+    // Sobol state
+    uint32_t m_sobolIndex = 0;
+    uint32_t m_sobolSeed = 0;
+
+    // Primary sample space state
+    const float* m_primarySamples = nullptr;
+};
@@ -14,6 +14,19 @@ const float MIN_DIELECTRICS_F0 = 0.04f;
 
 #define BVH_STACKSIZE 16
 
+#define NO_EMISSIVE_TRIANGLE 0xffffffffu
+
+// Texture LOD of hits without a ray cone, below the full resolution of any texture
+const float FULL_RESOLUTION_TEXTURE_LOD = -128.0f;
+
+// Lobe mask bits, same as DisneyBrdf::Lobe
+#define LOBE_DIFFUSE	(1u << 0)
+#define LOBE_DIELECTRIC	(1u << 1)
+#define LOBE_METAL		(1u << 2)
+#define LOBE_GLASS		(1u << 3)
+#define LOBE_SHEEN		(1u << 4)
+#define LOBE_CLEARCOAT	(1u << 5)
+
 // -------------------------------------------------------------------------
 //    Configuration
 // -------------------------------------------------------------------------
@@ -64,6 +77,8 @@ struct Material
 	float clearcoatRoughness;
 	float refraction;
 	float transmission;
+
+	uint lobes;
 };
 
 struct BvhNode
@@ -88,6 +103,27 @@ struct BvhPrimitive
 	vec4 norCuvY;
 
 	uint meshIndex;
+	uint emissiveIndex;	// Index into the emissive triangles, NO_EMISSIVE_TRIANGLE if not emissive
+	float textureLodBias;	// Half the log2 ratio of the triangle's UV area to its world area
+};
+
+struct LightTreeNode
+{
+	vec4 AApower;		// Bounding box AA, emitted power
+	vec4 BBcosThetaO;	// Bounding box BB, spread of the surface normals
+	vec4 axisCosThetaE;	// Orientation cone axis, spread of the emission around a normal
+	int left;			// Left subtree, -1 for leaves
+	int right;			// Right subtree, -1 for leaves
+	int parent;			// Parent, -1 for the root
+	uint emissiveIndex;	// Emissive triangle of a leaf
+};
+
+struct EmissiveTriangle
+{
+	uint primitiveIndex;	// BVH primitive of the triangle
+	uint alias;				// Alias table entry
+	float aliasProbability;	// Probability of keeping this entry instead of the alias
+	float pdf;				// Probability of picking this triangle, proportional to emitted power
 };
 
 // -------------------------------------------------------------------------
@@ -100,6 +136,12 @@ struct Ray
 	vec3 direction;
 };
 
+struct RayCone
+{
+	float width;		// Width at the origin of the current ray
+	float spreadAngle;	// Growth of the width per unit of distance
+};
+
 struct HitInfo
 {
 	bool didHit;
@@ -112,6 +154,9 @@ struct HitInfo
 	vec3 tangent;
 	vec3 bitangent;
 	uint primitiveIndex;
+	uint emissiveIndex;
+	float textureLodBias;	// Triangle's part of the texture LOD
+	float textureLod;		// Texture LOD of the ray cone footprint for a 1x1 texture, FULL_RESOLUTION_TEXTURE_LOD without a cone
 };
 
 struct BrdfData
@@ -173,3 +218,16 @@ vec4 SampleBindlessTexture(uint64_t textureHandle, vec2 uv)
 	sampler2D sampler = sampler2D(textureHandleSplit);
 	return texture(sampler, uv);
 }
+
+// Compute shaders have no derivatives, so the LOD is explicit
+// The LOD is for a 1x1 texture, the size of the texture is added here
+vec4 SampleBindlessTextureLod(uint64_t textureHandle, vec2 uv, float lod)
+{
+	// Split the 64-bit handle into two 32-bit values
+	uvec2 textureHandleSplit = SplitUint64ToUvec2(textureHandle);
+
+	// Sample the texture, trilinear between the two nearest mip levels
+	sampler2D sampler = sampler2D(textureHandleSplit);
+	vec2 size = vec2(textureSize(sampler, 0));
+	return textureLod(sampler, uv, max(lod + 0.5f * log2(size.x * size.y), 0.0f));
+}
@@ -68,7 +68,7 @@ vec4 DebugBvh(Ray ray)
 				}
 
 				// Search in recent boxes
-				if (dstLeft > 0.0f && dstRight > 0.0f)
+				if (dstLeft >= 0.0f && dstRight >= 0.0f)
 				{
 					if (dstLeft < dstRight)
 					{
@@ -83,11 +83,11 @@ vec4 DebugBvh(Ray ray)
 						stack[stackPointer++] = node.right;
 					}
 				}
-				else if (dstLeft > 0.0f)
+				else if (dstLeft >= 0.0f)
 				{
 					stack[stackPointer++] = node.left;
 				}
-				else if (dstRight > 0.0f)
+				else if (dstRight >= 0.0f)
 				{
 					stack[stackPointer++] = node.right;
 				}
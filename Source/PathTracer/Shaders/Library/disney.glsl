@@ -107,7 +107,8 @@ vec3 EvaluateClearcoat(Material material, BrdfData brdfData, out float pdf)
 //    Disney sampling BRDF
 // -------------------------------------------------------------------------
 
-vec3 SampleDisneyBrdf(Material material, BrdfData brdfData, inout uint rngState)
+// Xi.xy are used for the direction and Xi.z for the lobe selection
+vec3 SampleDisneyBrdf(Material material, BrdfData brdfData, vec3 Xi)
 {
 	// Tint colors
 	vec3 Csheen, Cspec0;
@@ -123,14 +124,14 @@ vec3 SampleDisneyBrdf(Material material, BrdfData brdfData, inout uint rngState)
 	float sheenWeight = material.sheenRoughness;
 	float clearcoatWeight = material.clearcoat;
 
-	// Lobe probabilities
+	// Lobe probabilities, lobes outside of the material mask are known to have no weight
 	float schlickWeight = F_SchlickWeight(brdfData.NdotV);
-	float diffuseProbability = dielectricWeight * Luminance(material.albedo);
-	float dielectricProbability = dielectricWeight * Luminance(mix(Cspec0, vec3(1.0f), schlickWeight));
-	float metalProbability = metalWeight * Luminance(mix(material.albedo, vec3(1.0f), schlickWeight));
-	float glassProbability = glassWeight;
-	float sheenProbability = sheenWeight;
-	float clearcoatProbability = clearcoatWeight;
+	float diffuseProbability = (material.lobes & LOBE_DIFFUSE) != 0 ? dielectricWeight * Luminance(material.albedo) : 0.0f;
+	float dielectricProbability = (material.lobes & LOBE_DIELECTRIC) != 0 ? dielectricWeight * Luminance(mix(Cspec0, vec3(1.0f), schlickWeight)) : 0.0f;
+	float metalProbability = (material.lobes & LOBE_METAL) != 0 ? metalWeight * Luminance(mix(material.albedo, vec3(1.0f), schlickWeight)) : 0.0f;
+	float glassProbability = (material.lobes & LOBE_GLASS) != 0 ? glassWeight : 0.0f;
+	float sheenProbability = (material.lobes & LOBE_SHEEN) != 0 ? sheenWeight : 0.0f;
+	float clearcoatProbability = (material.lobes & LOBE_CLEARCOAT) != 0 ? clearcoatWeight : 0.0f;
 
 	// Normalize probabilities
 	float invTotalWeight = 1.0f / (diffuseProbability + dielectricProbability + metalProbability + glassProbability + sheenProbability + clearcoatProbability);
@@ -150,9 +151,6 @@ vec3 SampleDisneyBrdf(Material material, BrdfData brdfData, inout uint rngState)
 	cdf[4] = cdf[3] + sheenProbability;
 	cdf[5] = cdf[4] + clearcoatProbability;
 
-	// Sample Xi
-	vec3 Xi = RandomValueVec3(rngState);
-
 	// Sample a lobe based on its importance
 	float rd = Xi.z;
 
@@ -259,14 +257,14 @@ vec3 EvaluateDisneyBrdf(Material material, BrdfData brdfData, out float pdf)
 	float sheenWeight = material.sheenRoughness;
 	float clearcoatWeight = material.clearcoat;
 
-	// Lobe probabilities
+	// Lobe probabilities, lobes outside of the material mask are known to have no weight
 	float schlickWeight = F_SchlickWeight(brdfData.NdotV);
-	float diffuseProbability = dielectricWeight * Luminance(material.albedo);
-	float dielectricProbability = dielectricWeight * Luminance(mix(Cspec0, vec3(1.0f), schlickWeight));
-	float metalProbability = metalWeight * Luminance(mix(material.albedo, vec3(1.0f), schlickWeight));
-	float glassProbability = glassWeight;
-	float sheenProbability = sheenWeight;
-	float clearcoatProbability = clearcoatWeight;
+	float diffuseProbability = (material.lobes & LOBE_DIFFUSE) != 0 ? dielectricWeight * Luminance(material.albedo) : 0.0f;
+	float dielectricProbability = (material.lobes & LOBE_DIELECTRIC) != 0 ? dielectricWeight * Luminance(mix(Cspec0, vec3(1.0f), schlickWeight)) : 0.0f;
+	float metalProbability = (material.lobes & LOBE_METAL) != 0 ? metalWeight * Luminance(mix(material.albedo, vec3(1.0f), schlickWeight)) : 0.0f;
+	float glassProbability = (material.lobes & LOBE_GLASS) != 0 ? glassWeight : 0.0f;
+	float sheenProbability = (material.lobes & LOBE_SHEEN) != 0 ? sheenWeight : 0.0f;
+	float clearcoatProbability = (material.lobes & LOBE_CLEARCOAT) != 0 ? clearcoatWeight : 0.0f;
 
 	// Normalize probabilities
 	float invTotalWeight = 1.0f / (diffuseProbability + dielectricProbability + metalProbability + glassProbability + sheenProbability + clearcoatProbability);
@@ -0,0 +1,244 @@
+// -------------------------------------------------------------------------
+//    Emissive triangle sampling
+// -------------------------------------------------------------------------
+
+bool IsEmissiveSamplingEnabled()
+{
+	return bool(EmissiveSamplingEnabled) && EmissiveTriangleCount > 0u;
+}
+
+// Pick an emissive triangle proportional to its emitted power from the alias table
+uint SampleEmissiveTriangleIndex(float Xi)
+{
+	float scaled = Xi * float(EmissiveTriangleCount);
+	uint index = min(uint(scaled), EmissiveTriangleCount - 1u);
+
+	// The fractional part decides between the entry and its alias
+	EmissiveTriangle emissiveTriangle = emissiveTriangles[index];
+	return (scaled - float(index)) < emissiveTriangle.aliasProbability ? index : emissiveTriangle.alias;
+}
+
+// -------------------------------------------------------------------------
+//    Light tree, see LightTree.cpp
+// -------------------------------------------------------------------------
+
+// Cosine of max(0, theta a - theta b)
+float CosSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+{
+	if (cosThetaA > cosThetaB) return 1.0f;
+	return cosThetaA * cosThetaB + sinThetaA * sinThetaB;
+}
+
+// Sine of max(0, theta a - theta b)
+float SinSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+{
+	if (cosThetaA > cosThetaB) return 0.0f;
+	return sinThetaA * cosThetaB - cosThetaA * sinThetaB;
+}
+
+// Conservative estimate of the light a shading point at P with normal N receives from the node
+float LightTreeImportance(LightTreeNode node, vec3 P, vec3 N)
+{
+	vec3 AA = node.AApower.xyz;
+	vec3 BB = node.BBcosThetaO.xyz;
+	vec3 axis = node.axisCosThetaE.xyz;
+	float power = node.AApower.w;
+	float cosThetaO = node.BBcosThetaO.w;
+	float cosThetaE = node.axisCosThetaE.w;
+
+	vec3 center = (AA + BB) * 0.5f;
+	vec3 diagonal = BB - AA;
+	float radiusSquared = 0.25f * dot(diagonal, diagonal);
+
+	vec3 toPoint = P - center;
+	float distanceSquared = dot(toPoint, toPoint);
+
+	// Clamp the distance, so points inside the bounds do not get an unbounded importance
+	float clampedDistanceSquared = max(distanceSquared, radiusSquared);
+
+	vec3 wi = distanceSquared > 0.0f ? toPoint * inversesqrt(distanceSquared) : vec3(0.0f);
+
+	// Angle between the cone axis and the shading point
+	float cosThetaW = dot(axis, wi);
+	float sinThetaW = sqrt(max(1.0f - cosThetaW * cosThetaW, 0.0f));
+
+	// Angle bounding the box as seen from the shading point
+	float cosThetaB = distanceSquared > radiusSquared ? sqrt(max(1.0f - radiusSquared / distanceSquared, 0.0f)) : -1.0f;
+	float sinThetaB = sqrt(max(1.0f - cosThetaB * cosThetaB, 0.0f));
+
+	// Minimum angle between the emission and the shading point, max(0, theta w - theta o - theta b)
+	float sinThetaO = sqrt(max(1.0f - cosThetaO * cosThetaO, 0.0f));
+	float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+	float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+	float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaP <= cosThetaE) return 0.0f;
+
+	// Minimum incident angle at the shading point, max(0, theta i - theta b)
+	float cosThetaI = -dot(wi, N);
+	float sinThetaI = sqrt(max(1.0f - cosThetaI * cosThetaI, 0.0f));
+	float cosThetaPI = CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	if (cosThetaPI <= 0.0f) return 0.0f;
+
+	return power * cosThetaP * cosThetaPI / clampedDistanceSquared;
+}
+
+// Traverse the light tree stochastically, choosing children proportional to their importance
+// Returns NO_EMISSIVE_TRIANGLE if no light can reach the shading point
+uint SampleLightTree(vec3 P, vec3 N, float Xi, out float pmf)
+{
+	pmf = 1.0f;
+
+	// Leaves are stored first, the root is the last node
+	int nodeIndex = int(2u * EmissiveTriangleCount - 2u);
+	LightTreeNode node = lightTreeNodes[nodeIndex];
+
+	while (node.left >= 0)
+	{
+		float importanceLeft = LightTreeImportance(lightTreeNodes[node.left], P, N);
+		float importanceRight = LightTreeImportance(lightTreeNodes[node.right], P, N);
+		if (importanceLeft + importanceRight <= 0.0f)
+		{
+			pmf = 0.0f;
+			return NO_EMISSIVE_TRIANGLE;
+		}
+
+		// Reuse the random number for the next level
+		float probabilityLeft = importanceLeft / (importanceLeft + importanceRight);
+		if (Xi < probabilityLeft)
+		{
+			Xi = RescaleRandomNumber(Xi, 0.0f, probabilityLeft);
+			pmf *= probabilityLeft;
+			nodeIndex = node.left;
+		}
+		else
+		{
+			Xi = RescaleRandomNumber(Xi, probabilityLeft, 1.0f);
+			pmf *= 1.0f - probabilityLeft;
+			nodeIndex = node.right;
+		}
+
+		node = lightTreeNodes[nodeIndex];
+	}
+
+	return node.emissiveIndex;
+}
+
+// Probability of the light tree traversal ending at the emissive triangle, by walking up from its leaf
+float GetLightTreePmf(uint emissiveIndex, vec3 P, vec3 N)
+{
+	float pmf = 1.0f;
+
+	int nodeIndex = int(emissiveIndex);
+	int parentIndex = lightTreeNodes[nodeIndex].parent;
+
+	while (parentIndex >= 0)
+	{
+		LightTreeNode parent = lightTreeNodes[parentIndex];
+
+		// Same evaluation order as the traversal, so both give the exact same probability
+		float importanceLeft = LightTreeImportance(lightTreeNodes[parent.left], P, N);
+		float importanceRight = LightTreeImportance(lightTreeNodes[parent.right], P, N);
+		if (importanceLeft + importanceRight <= 0.0f)
+		{
+			return 0.0f;
+		}
+
+		float probabilityLeft = importanceLeft / (importanceLeft + importanceRight);
+		pmf *= parent.left == nodeIndex ? probabilityLeft : 1.0f - probabilityLeft;
+
+		nodeIndex = parentIndex;
+		parentIndex = parent.parent;
+	}
+
+	return pmf;
+}
+
+// -------------------------------------------------------------------------
+//    Emissive triangle sampling
+// -------------------------------------------------------------------------
+
+// Probability of picking the emissive triangle for a shading point at P with normal N
+float GetEmissiveTriangleSelectionPmf(uint emissiveIndex, vec3 P, vec3 N)
+{
+	if (bool(LightTreeEnabled))
+	{
+		return GetLightTreePmf(emissiveIndex, P, N);
+	}
+	return emissiveTriangles[emissiveIndex].pdf;
+}
+
+// Solid angle probability density of sampling the emissive triangle from P with normal N, along direction L at distance dst
+// Triangles are one-sided, so the back side has no density
+float GetEmissiveTrianglePdf(uint emissiveIndex, vec3 P, vec3 N, vec3 L, float dst)
+{
+	EmissiveTriangle emissiveTriangle = emissiveTriangles[emissiveIndex];
+	BvhPrimitive primitive = bvhPrimitives[emissiveTriangle.primitiveIndex];
+
+	vec3 normalVector = cross(primitive.posBuvX.xyz - primitive.posAuvX.xyz, primitive.posCuvX.xyz - primitive.posAuvX.xyz);
+	float doubleArea = length(normalVector);
+
+	float cosLight = -dot(L, normalVector) / doubleArea;
+	if (cosLight <= 0.0f || doubleArea <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	// Convert the area density to solid angle
+	return GetEmissiveTriangleSelectionPmf(emissiveIndex, P, N) * 2.0f * dst * dst / (doubleArea * cosLight);
+}
+
+// Sample a point on an emissive triangle as seen from position P with normal N
+// Returns the emitted radiance, with direction L, distance dst and solid angle pdf towards the point
+vec3 SampleEmissiveTriangle(vec3 P, vec3 N, vec3 Xi, out vec3 L, out float dst, out float pdf)
+{
+	L = vec3(0.0f);
+	dst = 0.0f;
+	pdf = 0.0f;
+
+	uint emissiveIndex = NO_EMISSIVE_TRIANGLE;
+	if (bool(LightTreeEnabled))
+	{
+		float pmf = 0.0f;
+		emissiveIndex = SampleLightTree(P, N, Xi.x, pmf);
+	}
+	else
+	{
+		emissiveIndex = SampleEmissiveTriangleIndex(Xi.x);
+	}
+
+	if (emissiveIndex == NO_EMISSIVE_TRIANGLE)
+	{
+		return vec3(0.0f);
+	}
+
+	BvhPrimitive primitive = bvhPrimitives[emissiveTriangles[emissiveIndex].primitiveIndex];
+
+	// Uniformly distributed barycentric coordinates
+	float su = sqrt(Xi.y);
+	float w = 1.0f - su;
+	float u = Xi.z * su;
+	float v = 1.0f - w - u;
+
+	vec3 position = primitive.posAuvX.xyz * w + primitive.posBuvX.xyz * u + primitive.posCuvX.xyz * v;
+	vec2 uv = vec2(primitive.posAuvX.w, primitive.norAuvY.w) * w + vec2(primitive.posBuvX.w, primitive.norBuvY.w) * u + vec2(primitive.posCuvX.w, primitive.norCuvY.w) * v;
+
+	vec3 toLight = position - P;
+	dst = length(toLight);
+	L = toLight / dst;
+
+	pdf = GetEmissiveTrianglePdf(emissiveIndex, P, N, L, dst);
+	if (pdf <= 0.0f)
+	{
+		return vec3(0.0f);
+	}
+
+	// Same emission as the evaluated material of a hit
+	Material material = materials[primitive.meshIndex];
+	vec3 emission = material.emission;
+	if (material.emissionTextureHandle != 0)
+	{
+		emission *= SampleBindlessTexture(material.emissionTextureHandle, uv).rgb;
+	}
+
+	return emission;
+}
@@ -12,11 +12,8 @@ vec2 GetSphericalCoordinates(vec3 V)
 }
 
 // Sample from the precomputed HDRI cache
-vec3 SampleHdri(inout uint rngState)
+vec3 SampleHdri(vec2 Xi)
 {
-	// Sample Xi
-	vec2 Xi = RandomValueVec2(rngState);
-
 	vec2 uv = SampleBindlessTexture(environment.hdriCacheHandle, Xi).rg; // x, y
 	uv.y = 1.0f - uv.y; // Flip
 
@@ -47,6 +47,10 @@ HitInfo RayTriangle(Ray ray, BvhPrimitive primitive)
 	hitInfo.shadingNormal = normalize(norA * w + norB * u + norC * v);
 	hitInfo.geometryNormal = normalize(cross(edgeAC, edgeAB));
 
+	// The texture LOD stays at full resolution until a ray cone is propagated to the hit
+	hitInfo.textureLodBias = primitive.textureLodBias;
+	hitInfo.textureLod = FULL_RESOLUTION_TEXTURE_LOD;
+
 	// Calculate tangent and bitangent
 	vec2 deltaUVB = uvB - uvA;
 	vec2 deltaUVC = uvC - uvA;
@@ -59,7 +63,7 @@ HitInfo RayTriangle(Ray ray, BvhPrimitive primitive)
 	return hitInfo;
 }
 
-// Return distance between ray and AABB box
+// Return distance at which the ray enters the AABB box, 0 if it starts inside and -1 if it misses
 float HitAABB(Ray r, vec3 AA, vec3 BB)
 {
 	vec3 invdir = 1.0 / r.direction;
@@ -73,7 +77,7 @@ float HitAABB(Ray r, vec3 AA, vec3 BB)
 	float t1 = min(tmax.x, min(tmax.y, tmax.z));
 	float t0 = max(tmin.x, max(tmin.y, tmin.z));
 
-	return (t1 >= t0) ? ((t0 > 0.0) ? (t0) : (t1)) : (-1);
+	return (t1 >= t0 && t1 >= 0.0) ? max(t0, 0.0) : (-1);
 }
 
 // -------------------------------------------------------------------------
@@ -87,6 +91,7 @@ HitInfo HitArrayClosest(Ray ray, int L, int R)
 	closestHit.dst = FLT_MAX;
 
 	uint closestPrimitiveIndex = 0;
+	uint closestEmissiveIndex = NO_EMISSIVE_TRIANGLE;
 
 	for (int i = L; i <= R; i++)
 	{
@@ -99,6 +104,7 @@ HitInfo HitArrayClosest(Ray ray, int L, int R)
 
 			// Store the index of the closest primitive
 			closestPrimitiveIndex = primitive.meshIndex;
+			closestEmissiveIndex = primitive.emissiveIndex;
 		}
 	}
 
@@ -106,6 +112,7 @@ HitInfo HitArrayClosest(Ray ray, int L, int R)
 	if (closestHit.didHit)
 	{
 		closestHit.primitiveIndex = closestPrimitiveIndex;
+		closestHit.emissiveIndex = closestEmissiveIndex;
 	}
 
 	return closestHit;
@@ -164,7 +171,7 @@ HitInfo HitBvhClosest(Ray ray)
 				}
 
 				// Search in recent boxes
-				if (dstLeft > 0.0f && dstRight > 0.0f)
+				if (dstLeft >= 0.0f && dstRight >= 0.0f)
 				{
 					if (dstLeft < dstRight)
 					{
@@ -179,11 +186,11 @@ HitInfo HitBvhClosest(Ray ray)
 						stack[stackPointer++] = node.right;
 					}
 				}
-				else if (dstLeft > 0.0f)
+				else if (dstLeft >= 0.0f)
 				{
 					stack[stackPointer++] = node.left;
 				}
-				else if (dstRight > 0.0f)
+				else if (dstRight >= 0.0f)
 				{
 					stack[stackPointer++] = node.right;
 				}
@@ -202,7 +209,7 @@ HitInfo HitBvhClosest(Ray ray)
 //    BVH hit any
 // -------------------------------------------------------------------------
 
-HitInfo HitArrayAny(Ray ray, int L, int R)
+HitInfo HitArrayAny(Ray ray, int L, int R, float maxDistance)
 {
 	HitInfo anyHit;
 	anyHit.didHit = false;
@@ -213,7 +220,7 @@ HitInfo HitArrayAny(Ray ray, int L, int R)
 		BvhPrimitive primitive = bvhPrimitives[i];
 		HitInfo hitInfo = RayTriangle(ray, primitive);
 
-		if (hitInfo.didHit)
+		if (hitInfo.didHit && hitInfo.dst < maxDistance)
 		{
 			anyHit = hitInfo;
 
@@ -225,9 +232,9 @@ HitInfo HitArrayAny(Ray ray, int L, int R)
 	return anyHit;
 }
 
-// Get any HitInfo by intersecting with Bvh nodes and Bvh primitives
+// Get any HitInfo closer than maxDistance by intersecting with Bvh nodes and Bvh primitives
 // No materials are retrieved and evaluated
-HitInfo HitBvhAny(Ray ray)
+HitInfo HitBvhAny(Ray ray, float maxDistance)
 {
 	HitInfo anyHit;
 	anyHit.didHit = false;
@@ -250,7 +257,7 @@ HitInfo HitBvhAny(Ray ray)
 			int R = node.index + node.n - 1;
 
 			// Go through all primitives inside of BVH node range and get first found primitive
-			HitInfo hitInfo = HitArrayAny(ray, L, R);
+			HitInfo hitInfo = HitArrayAny(ray, L, R, maxDistance);
 
 			// Out of the other nodes, did this one perform better?
 			if (hitInfo.didHit)
@@ -271,16 +278,18 @@ HitInfo HitBvhAny(Ray ray)
 				{
 					BvhNode leftNode = bvhNodes[node.left];
 					dstLeft = HitAABB(ray, leftNode.AA, leftNode.BB);
+					dstLeft = dstLeft < maxDistance ? dstLeft : -1.0f;
 				}
 
 				if (node.right > 0.0f)
 				{
 					BvhNode rightNode = bvhNodes[node.right];
 					dstRight = HitAABB(ray, rightNode.AA, rightNode.BB);
+					dstRight = dstRight < maxDistance ? dstRight : -1.0f;
 				}
 
 				// Search in recent boxes
-				if (dstLeft > 0.0f && dstRight > 0.0f)
+				if (dstLeft >= 0.0f && dstRight >= 0.0f)
 				{
 					if (dstLeft < dstRight)
 					{
@@ -295,11 +304,11 @@ HitInfo HitBvhAny(Ray ray)
 						stack[stackPointer++] = node.right;
 					}
 				}
-				else if (dstLeft > 0.0f)
+				else if (dstLeft >= 0.0f)
 				{
 					stack[stackPointer++] = node.left;
 				}
-				else if (dstRight > 0.0f)
+				else if (dstRight >= 0.0f)
 				{
 					stack[stackPointer++] = node.right;
 				}
@@ -312,4 +321,10 @@ HitInfo HitBvhAny(Ray ray)
 	}
 
 	return anyHit;
+}
+
+// Get any HitInfo by intersecting with Bvh nodes and Bvh primitives
+HitInfo HitBvhAny(Ray ray)
+{
+	return HitBvhAny(ray, FLT_MAX);
 }
\ No newline at end of file
@@ -8,6 +8,18 @@ uniform mat4 ProjMatrix;
 uniform mat4 InvProjMatrix;
 uniform uint FrameCount;
 uniform vec2 FrameDimensions;
+uniform vec4 RenderRegion;		// Min and max corner of the rendered pixels, the dispatch starts at the min corner
+
+uniform uint SamplerType;
+uniform uint SampleCount;
+
+uniform uint AdaptiveSamplingEnabled;
+uniform float NoiseThreshold;
+uniform uint MinSampleCount;
+
+uniform uint EmissiveSamplingEnabled;
+uniform uint EmissiveTriangleCount;
+uniform uint LightTreeEnabled;
 
 uniform uint AntiAliasingEnabled;
 uniform float FocalLength;
@@ -26,6 +38,7 @@ uniform float ClearcoatModifier;
 uniform float ClearcoatRoughnessModifier;
 uniform float RefractionModifier;
 uniform float TransmissionModifier;
+uniform uint ModifierLobes;
 
 uniform float DebugValueA;
 uniform float DebugValueB;
@@ -53,3 +66,18 @@ layout(std430, binding = 3) readonly buffer BvhPrimitiveBuffer
 {
     BvhPrimitive bvhPrimitives[];
 };
+
+layout(std430, binding = 4) buffer AdaptiveSamplingBuffer
+{
+    uint activePixelCount;
+};
+
+layout(std430, binding = 5) readonly buffer EmissiveTriangleBuffer
+{
+    EmissiveTriangle emissiveTriangles[];
+};
+
+layout(std430, binding = 6) readonly buffer LightTreeBuffer
+{
+    LightTreeNode lightTreeNodes[];
+};
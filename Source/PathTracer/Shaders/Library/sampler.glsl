@@ -0,0 +1,206 @@
+
+// -------------------------------------------------------------------------
+//    Sampler
+// -------------------------------------------------------------------------
+
+// Sampler types, same as Sampler::Type
+#define SAMPLER_PCG					0u
+#define SAMPLER_SOBOL				1u
+#define SAMPLER_SOBOL_BLUE_NOISE	2u
+
+// Fixed dimension of every random decision of a path, same as Sampler::Dimension
+#define SAMPLE_DIMENSION_ANTI_ALIASING		0u
+#define SAMPLE_DIMENSION_LENS				1u
+#define SAMPLE_DIMENSION_BOUNCE				2u
+#define SAMPLE_DIMENSIONS_PER_BOUNCE		4u
+
+#define SAMPLE_DIMENSION_HDRI				0u
+#define SAMPLE_DIMENSION_BRDF				1u
+#define SAMPLE_DIMENSION_RUSSIAN_ROULETTE	2u
+#define SAMPLE_DIMENSION_EMISSIVE			3u
+
+// Generator matrices of the first four Sobol dimensions, from the Joe-Kuo direction numbers
+// Generated by Sampler::GenerateSobolMatrices
+const uint SobolMatrices[4 * 32] = uint[](
+	// Dimension 0
+	0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+	0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+	0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+	0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u,
+	// Dimension 1
+	0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u, 0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+	0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u, 0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+	0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u, 0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+	0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u, 0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu,
+	// Dimension 2
+	0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u, 0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+	0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u, 0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+	0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u, 0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+	0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u, 0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u,
+	// Dimension 3
+	0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u, 0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+	0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u, 0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+	0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u, 0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+	0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u, 0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+);
+
+struct SamplerState
+{
+	uint rngState;		// PCG state
+	uint sobolIndex;	// Sobol sample index
+	uint sobolSeed;		// Sobol scrambling seed
+};
+
+uint SamplerHash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+uint SamplerHashCombine(uint seed, uint value)
+{
+	return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+// Laine-Karras style permutation with the constants from Vegdahl's improved Owen hash
+uint LaineKarrasPermutation(uint x, uint seed)
+{
+	x ^= x * 0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16) | 1u;
+	x ^= x * 0x05526c56u;
+	x ^= x * 0x53a22864u;
+	return x;
+}
+
+// Owen scrambling in base 2, see "Practical Hash-based Owen Scrambling" (Burley 2020)
+uint NestedUniformScramble(uint x, uint seed)
+{
+	x = bitfieldReverse(x);
+	x = LaineKarrasPermutation(x, seed);
+	x = bitfieldReverse(x);
+	return x;
+}
+
+uint SobolSample(uint index, uint dimension)
+{
+	uint result = 0u;
+	for (uint bit = 0u; index != 0u; bit++, index >>= 1)
+	{
+		if ((index & 1u) != 0u)
+		{
+			result ^= SobolMatrices[dimension * 32u + bit];
+		}
+	}
+	return result;
+}
+
+// Interleave the lower 16 bits of x and y
+uint MortonCode(uint x, uint y)
+{
+	uvec2 v = uvec2(x, y) & 0x0000ffffu;
+	v = (v | (v << 8)) & 0x00ff00ffu;
+	v = (v | (v << 4)) & 0x0f0f0f0fu;
+	v = (v | (v << 2)) & 0x33333333u;
+	v = (v | (v << 1)) & 0x55555555u;
+	return v.x | (v.y << 1);
+}
+
+// Upper 24 bits to a float in [0; 1), so that rounding never reaches 1
+float ToUnitFloat(uint x)
+{
+	return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// The first count Sobol dimensions of the Owen-scrambled point, padded per dimension set by the seed
+vec4 SobolOwen(SamplerState samplerState, uint dimension, uint count)
+{
+	uint seed = SamplerHash(SamplerHashCombine(samplerState.sobolSeed, dimension));
+
+	// Shuffle the sample order, so every dimension set is decorrelated from the others
+	uint index = NestedUniformScramble(samplerState.sobolIndex, seed);
+
+	vec4 result = vec4(0.0f);
+	for (uint i = 0u; i < count; i++)
+	{
+		result[i] = ToUnitFloat(NestedUniformScramble(SobolSample(index, i), SamplerHashCombine(seed, i)));
+	}
+	return result;
+}
+
+SamplerState InitializeSampler(uvec2 pixel, uint frameIndex)
+{
+	SamplerState samplerState;
+	samplerState.rngState = 0u;
+	samplerState.sobolIndex = 0u;
+	samplerState.sobolSeed = 0u;
+
+	uint pixelIndex = pixel.y * uint(FrameDimensions.x) + pixel.x;
+
+	if (SamplerType == SAMPLER_PCG)
+	{
+		samplerState.rngState = pixelIndex + (frameIndex + 1u) * 719393u;
+	}
+	else if (SamplerType == SAMPLER_SOBOL)
+	{
+		// Every pixel gets its own scrambling of the same sequence
+		samplerState.sobolIndex = frameIndex;
+		samplerState.sobolSeed = SamplerHash(pixelIndex);
+	}
+	else
+	{
+		// Neighbouring pixels take consecutive runs of one shared sequence, which distributes the error as blue noise
+		// See "Screen-Space Blue-Noise Diffusion of Monte Carlo Sampling Error via Hierarchical Ordering of Pixels" (Ahmed and Wonka 2020)
+		// Pixels whose Z-curve and sample index do not fit into 32 bits, and samples past the sample count, take plain Sobol, same as Sampler
+		uint sampleBits = uint(findMSB(max(SampleCount, 1u) - 1u) + 1);
+		uvec2 frameDimensions = uvec2(FrameDimensions);
+		uint mortonBits = 2u * uint(findMSB(max(max(frameDimensions.x, frameDimensions.y), 1u) - 1u) + 1);
+		if (mortonBits + sampleBits <= 32u && sampleBits < 32u && frameIndex < (1u << sampleBits))
+		{
+			samplerState.sobolIndex = (MortonCode(pixel.x, pixel.y) << sampleBits) | frameIndex;
+		}
+		else
+		{
+			samplerState.sobolIndex = frameIndex;
+			samplerState.sobolSeed = SamplerHash(pixelIndex);
+		}
+	}
+
+	return samplerState;
+}
+
+uint GetBounceDimension(uint bounce, uint offset)
+{
+	return SAMPLE_DIMENSION_BOUNCE + bounce * SAMPLE_DIMENSIONS_PER_BOUNCE + offset;
+}
+
+float SampleFloat(inout SamplerState samplerState, uint dimension)
+{
+	if (SamplerType == SAMPLER_PCG)
+	{
+		return RandomValue(samplerState.rngState);
+	}
+	return SobolOwen(samplerState, dimension, 1u).x;
+}
+
+vec2 SampleVec2(inout SamplerState samplerState, uint dimension)
+{
+	if (SamplerType == SAMPLER_PCG)
+	{
+		return RandomValueVec2(samplerState.rngState);
+	}
+	return SobolOwen(samplerState, dimension, 2u).xy;
+}
+
+vec3 SampleVec3(inout SamplerState samplerState, uint dimension)
+{
+	if (SamplerType == SAMPLER_PCG)
+	{
+		return RandomValueVec3(samplerState.rngState);
+	}
+	return SobolOwen(samplerState, dimension, 3u).xyz;
+}
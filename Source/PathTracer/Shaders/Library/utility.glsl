@@ -62,6 +62,37 @@ float Luminance(vec3 rgb)
 	return dot(rgb, vec3(0.2126f, 0.7152f, 0.0722f));
 }
 
+// -------------------------------------------------------------------------
+//    Ray cones
+// -------------------------------------------------------------------------
+
+// Texture LOD without derivatives, see "Texture Level of Detail Strategies for Real-Time Ray Tracing" (Akenine-Moller et al. 2019)
+// Primary rays start as a point, with a spread of one pixel
+RayCone GetPrimaryRayCone()
+{
+	RayCone cone;
+	cone.width = 0.0f;
+	cone.spreadAngle = atan(2.0f * abs(InvProjMatrix[1][1]) / FrameDimensions.y);
+	return cone;
+}
+
+// Widens the cone up to the hit, and sets the texture LOD of its footprint there
+void PropagateRayCone(inout RayCone cone, inout HitInfo hitInfo)
+{
+	cone.width += cone.spreadAngle * hitInfo.dst;
+
+	// The footprint stretches with the inverse cosine towards grazing angles
+	float cosTheta = max(abs(dot(hitInfo.hitDirection, hitInfo.geometryNormal)), 1e-4f);
+	hitInfo.textureLod = hitInfo.textureLodBias + log2(max(cone.width, 1e-10f)) - log2(cosTheta);
+}
+
+// Rough lobes spread the cone further, roughly by the width of the GGX lobe
+// Triangles are flat, so the curvature of the surface is not accounted for
+void ScatterRayCone(inout RayCone cone, float roughness)
+{
+	cone.spreadAngle += 2.0f * roughness * roughness;
+}
+
 // -------------------------------------------------------------------------
 //    Material evaluation
 // -------------------------------------------------------------------------
@@ -82,7 +113,7 @@ vec3 SampleNormalMap(uint64_t normalTextureHandle, HitInfo hitInfo)
 	mat3 TBN = mat3(T, B, N);
 
 	// Sample normal texture
-	vec3 normalMap = SampleBindlessTexture(normalTextureHandle, hitInfo.uv).rgb;
+	vec3 normalMap = SampleBindlessTextureLod(normalTextureHandle, hitInfo.uv, hitInfo.textureLod).rgb;
 
 	// Transform normal vector to range [-1,1]
 	normalMap = normalize(normalMap * 2.0 - 1.0);
@@ -97,12 +128,12 @@ Material EvaluateMaterial(Material material, inout HitInfo hitInfo)
 
 	if (material.emissionTextureHandle != 0)
 	{
-		vec3 emissionSample = SampleBindlessTexture(material.emissionTextureHandle, hitInfo.uv).rgb;
+		vec3 emissionSample = SampleBindlessTextureLod(material.emissionTextureHandle, hitInfo.uv, hitInfo.textureLod).rgb;
 		evaluatedMaterial.emission *= emissionSample;
 	}
 	if (material.albedoTextureHandle != 0)
 	{
-		vec3 albedoSample = SampleBindlessTexture(material.albedoTextureHandle, hitInfo.uv).rgb;
+		vec3 albedoSample = SampleBindlessTextureLod(material.albedoTextureHandle, hitInfo.uv, hitInfo.textureLod).rgb;
 		evaluatedMaterial.albedo *= albedoSample;
 	}
 	if (material.normalTextureHandle != 0)
@@ -111,43 +142,43 @@ Material EvaluateMaterial(Material material, inout HitInfo hitInfo)
 	}
 	if (material.specularTextureHandle != 0)
 	{
-		float specularSample = SampleBindlessTexture(material.specularTextureHandle, hitInfo.uv).a;
+		float specularSample = SampleBindlessTextureLod(material.specularTextureHandle, hitInfo.uv, hitInfo.textureLod).a;
 		evaluatedMaterial.specular *= specularSample;
 	}
 	if (material.specularColorTextureHandle != 0)
 	{
-		vec3 specularColorSample = SampleBindlessTexture(material.specularColorTextureHandle, hitInfo.uv).rgb;
+		vec3 specularColorSample = SampleBindlessTextureLod(material.specularColorTextureHandle, hitInfo.uv, hitInfo.textureLod).rgb;
 		evaluatedMaterial.specularTint *= length(specularColorSample); // We only care about magnitude, color will be sampled according to Disney
 	}
 	if (material.metallicRoughnessTextureHandle != 0)
 	{
-		vec2 metallicRoughnessSample = SampleBindlessTexture(material.metallicRoughnessTextureHandle, hitInfo.uv).rg;
+		vec2 metallicRoughnessSample = SampleBindlessTextureLod(material.metallicRoughnessTextureHandle, hitInfo.uv, hitInfo.textureLod).rg;
 		evaluatedMaterial.metallic *= metallicRoughnessSample.x;
 		evaluatedMaterial.roughness *= metallicRoughnessSample.y;
 	}
 	if (material.sheenRoughnessTextureHandle != 0)
 	{
-		float sheenRoughnessSample = SampleBindlessTexture(material.sheenRoughnessTextureHandle, hitInfo.uv).a;
+		float sheenRoughnessSample = SampleBindlessTextureLod(material.sheenRoughnessTextureHandle, hitInfo.uv, hitInfo.textureLod).a;
 		evaluatedMaterial.sheenRoughness *= sheenRoughnessSample;
 	}
 	if (material.sheenColorTextureHandle != 0)
 	{
-		vec3 sheenColorSample = SampleBindlessTexture(material.sheenColorTextureHandle, hitInfo.uv).rgb;
+		vec3 sheenColorSample = SampleBindlessTextureLod(material.sheenColorTextureHandle, hitInfo.uv, hitInfo.textureLod).rgb;
 		evaluatedMaterial.sheenTint *= length(sheenColorSample); // We only care about magnitude, color will be sampled according to Disney
 	}
 	if (material.clearcoatTextureHandle != 0)
 	{
-		float clearcoatSample = SampleBindlessTexture(material.clearcoatTextureHandle, hitInfo.uv).r;
+		float clearcoatSample = SampleBindlessTextureLod(material.clearcoatTextureHandle, hitInfo.uv, hitInfo.textureLod).r;
 		evaluatedMaterial.clearcoat *= clearcoatSample;
 	}
 	if (material.clearcoatRoughnessTextureHandle != 0)
 	{
-		float clearcoatRoughnessSample = SampleBindlessTexture(material.clearcoatRoughnessTextureHandle, hitInfo.uv).g;
+		float clearcoatRoughnessSample = SampleBindlessTextureLod(material.clearcoatRoughnessTextureHandle, hitInfo.uv, hitInfo.textureLod).g;
 		evaluatedMaterial.clearcoatRoughness *= clearcoatRoughnessSample;
 	}
 	if (material.transmissionTextureHandle != 0)
 	{
-		float transmissionSample = SampleBindlessTexture(material.transmissionTextureHandle, hitInfo.uv).r;
+		float transmissionSample = SampleBindlessTextureLod(material.transmissionTextureHandle, hitInfo.uv, hitInfo.textureLod).r;
 		evaluatedMaterial.transmission *= transmissionSample;
 	}
 
@@ -165,6 +196,9 @@ Material EvaluateMaterial(Material material, inout HitInfo hitInfo)
 	evaluatedMaterial.refraction = clamp(evaluatedMaterial.refraction + RefractionModifier, 1.01f, 2.0f);
 	evaluatedMaterial.transmission = clamp(evaluatedMaterial.transmission + TransmissionModifier, 0.0f, 1.0f);
 
+	// Modifiers can enable lobes the material itself never uses
+	evaluatedMaterial.lobes |= ModifierLobes;
+
 	return evaluatedMaterial;
 }
 
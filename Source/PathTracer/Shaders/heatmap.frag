@@ -0,0 +1,45 @@
+#version 460 core
+
+//Inputs
+in vec2 TexCoord;
+
+//Outputs
+out vec4 FragColor;
+
+//Uniforms
+uniform sampler2D SourceTexture; // Sample statistics, sample count in blue channel
+
+uniform uint MaxSampleCount;
+uniform vec2 RenderScale; // Part of the texture that was rendered, see upsample.frag
+
+// Source:
+// https://research.google/blog/turbo-an-improved-rainbow-colormap-for-visualization/
+vec3 TurboColormap(float x)
+{
+    const vec4 kRedVec4 = vec4(0.13572138, 4.61539260, -42.66032258, 132.13108234);
+    const vec4 kGreenVec4 = vec4(0.09140261, 2.19418839, 4.84296658, -14.18503333);
+    const vec4 kBlueVec4 = vec4(0.10667330, 12.64194608, -60.58204836, 110.36276771);
+    const vec2 kRedVec2 = vec2(-152.94239396, 59.28637943);
+    const vec2 kGreenVec2 = vec2(4.27729857, 2.82956604);
+    const vec2 kBlueVec2 = vec2(-89.90310912, 27.34824973);
+
+    x = clamp(x, 0.0, 1.0);
+    vec4 v4 = vec4(1.0, x, x * x, x * x * x);
+    vec2 v2 = v4.zw * v4.z;
+
+    return vec3(
+        dot(v4, kRedVec4) + dot(v2, kRedVec2),
+        dot(v4, kGreenVec4) + dot(v2, kGreenVec2),
+        dot(v4, kBlueVec4) + dot(v2, kBlueVec2)
+    );
+}
+
+void main()
+{
+	// Amount of samples relative to the frame cap
+	float sampleCount = texture(SourceTexture, TexCoord * RenderScale).b;
+	float x = sampleCount / float(max(MaxSampleCount, 1u));
+
+	// Assign the fragment color
+	FragColor = vec4(TurboColormap(x), 1.0f);
+}
@@ -0,0 +1,44 @@
+#version 460 core
+
+//Inputs
+in vec2 TexCoord;
+
+//Outputs
+out vec4 FragColor;
+
+//Uniforms
+uniform sampler2D SourceTexture;	// Rendered at a reduced resolution, into the bottom left part of the texture
+uniform sampler2D NormalTexture;	// Primary normals of the same pixels, zero where the HDRI was hit
+
+uniform vec2 RenderDimensions;		// Size of the rendered part in texels
+
+// Edge-aware upsampling of the rendered part to the whole frame
+// Bilinear taps on another surface than the nearest rendered pixel get little weight, so edges stay sharp
+void main()
+{
+	ivec2 maxTexel = max(ivec2(RenderDimensions) - 1, ivec2(0));
+	vec2 position = TexCoord * RenderDimensions - 0.5f;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = position - vec2(base);
+
+	ivec2 nearest = clamp(ivec2(round(position)), ivec2(0), maxTexel);
+	vec3 nearestNormal = texelFetch(NormalTexture, nearest, 0).xyz;
+
+	vec4 colorSum = vec4(0.0f);
+	float weightSum = 0.0f;
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 texel = clamp(base + offset, ivec2(0), maxTexel);
+
+		vec2 bilinear = mix(1.0f - f, f, vec2(offset));
+		vec3 normalDifference = texelFetch(NormalTexture, texel, 0).xyz - nearestNormal;
+		float weight = bilinear.x * bilinear.y * exp(-16.0f * dot(normalDifference, normalDifference));
+
+		colorSum += texelFetch(SourceTexture, texel, 0) * weight;
+		weightSum += weight;
+	}
+
+	// The nearest pixel is one of the taps, with a bilinear weight of at least a quarter
+	FragColor = colorSum / weightSum;
+}
@@ -0,0 +1,255 @@
+#include "SharedFilm.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char Magic[8] = "PTFILM";
+    constexpr char LayerNames[] = "radiance albedo normal statistics";
+    constexpr size_t PageSize = 4096;       // Slots start on pages of their own
+
+    // POSIX names start with a slash, Windows names must not contain one
+    std::string GetSystemName(const std::string& name)
+    {
+        size_t first = name.find_first_not_of('/');
+        std::string trimmed = first == std::string::npos ? std::string() : name.substr(first);
+#ifdef _WIN32
+        return trimmed;
+#else
+        return "/" + trimmed;
+#endif
+    }
+
+    // Maps the memory of the name, creating it with the size or opening it with whatever size it has. Null on failure
+    void* Map(const std::string& name, bool create, size_t& size, std::intptr_t& mapping)
+    {
+#ifdef _WIN32
+        HANDLE handle = create
+            ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xffffffff), name.c_str())
+            : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+        if (!handle)
+        {
+            return nullptr;
+        }
+
+        void* memory = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION information;
+        if (!memory || VirtualQuery(memory, &information, sizeof(information)) == 0)
+        {
+            if (memory) UnmapViewOfFile(memory);
+            CloseHandle(handle);
+            return nullptr;
+        }
+
+        size = information.RegionSize;
+        mapping = (std::intptr_t)handle;
+        return memory;
+#else
+        (void)mapping;
+        int descriptor = create ? shm_open(name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644) : shm_open(name.c_str(), O_RDWR, 0);
+        if (descriptor < 0)
+        {
+            return nullptr;
+        }
+
+        struct stat status;
+        if ((create && ftruncate(descriptor, (off_t)size) != 0) || fstat(descriptor, &status) != 0)
+        {
+            close(descriptor);
+            return nullptr;
+        }
+        size = (size_t)status.st_size;
+
+        // The mapping keeps the memory alive, the descriptor is not needed past it
+        void* memory = size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+        close(descriptor);
+        return memory == MAP_FAILED ? nullptr : memory;
+#endif
+    }
+
+    void Unmap(void* memory, size_t size, std::intptr_t mapping)
+    {
+#ifdef _WIN32
+        (void)size;
+        UnmapViewOfFile(memory);
+        CloseHandle((HANDLE)mapping);
+#else
+        (void)mapping;
+        munmap(memory, size);
+#endif
+    }
+}
+
+SharedFilm::~SharedFilm()
+{
+    Close();
+}
+
+void SharedFilm::Close()
+{
+    if (!m_header)
+    {
+        return;
+    }
+
+    // Readers still holding the memory see it closed, new readers no longer find the name
+    if (m_owner)
+    {
+        m_header->closed.store(1, std::memory_order_release);
+#ifndef _WIN32
+        shm_unlink(m_name.c_str());
+#endif
+    }
+
+    Unmap(m_header, m_size, m_mapping);
+    m_header = nullptr;
+}
+
+bool SharedFilm::Create(const std::string& name, int maxWidth, int maxHeight, std::string& error)
+{
+    Close();
+
+    const uint64_t slotOffset = (sizeof(Header) + PageSize - 1) / PageSize * PageSize;
+    const uint64_t slotSize = (uint64_t)maxWidth * maxHeight * LayerCount * sizeof(glm::vec4);
+
+    m_name = GetSystemName(name);
+    m_size = (size_t)(slotOffset + slotSize * SlotCount);
+    void* memory = Map(m_name, true, m_size, m_mapping);
+    if (!memory)
+    {
+        error = "cannot create shared memory \"" + name + "\"";
+        return false;
+    }
+
+    // New memory is zeroed, so the slots start out with sequence 0 and no frame
+    m_header = new (memory) Header();
+    std::memcpy(m_header->magic, Magic, sizeof(Magic));
+    m_header->version = Version;
+    m_header->slotCount = SlotCount;
+    m_header->layerCount = LayerCount;
+    m_header->maxWidth = (uint32_t)maxWidth;
+    m_header->maxHeight = (uint32_t)maxHeight;
+    std::memcpy(m_header->layerNames, LayerNames, sizeof(LayerNames));
+    m_header->slotOffset = slotOffset;
+    m_header->slotSize = slotSize;
+    m_owner = true;
+    m_frameNumber = 0;
+    return true;
+}
+
+void SharedFilm::Publish(const Frame& frame)
+{
+    if (!m_owner)
+    {
+        return;
+    }
+
+    const int width = std::min(frame.width, (int)m_header->maxWidth);
+    const int height = std::min(frame.height, (int)m_header->maxHeight);
+    const uint64_t frameNumber = ++m_frameNumber;
+    SlotHeader& slot = m_header->slots[frameNumber % SlotCount];
+
+    // Odd while writing, readers of the previous frame of the slot find it changed
+    slot.sequence.store(frameNumber * 2 - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.width = (uint32_t)width;
+    slot.height = (uint32_t)height;
+    slot.sampleCount = frame.sampleCount;
+    slot.renderTime = frame.renderTime;
+
+    glm::vec4* pixels = reinterpret_cast<glm::vec4*>(reinterpret_cast<char*>(m_header) + m_header->slotOffset + m_header->slotSize * (frameNumber % SlotCount));
+    const size_t layerPixelCount = (size_t)width * height;
+    for (uint32_t layer = 0; layer < LayerCount; layer++)
+    {
+        glm::vec4* destination = pixels + layer * layerPixelCount;
+        if (!frame.layers[layer])
+        {
+            std::fill(destination, destination + layerPixelCount, glm::vec4(0.0f));
+            continue;
+        }
+
+        // Rows of a cropped frame are narrower than the rows of the frame
+        for (int y = 0; y < height; y++)
+        {
+            const glm::vec4* source = frame.layers[layer] + (size_t)y * frame.width;
+            std::copy(source, source + width, destination + (size_t)y * width);
+        }
+    }
+
+    slot.sequence.store(frameNumber * 2, std::memory_order_release);
+    m_header->latest.store(frameNumber, std::memory_order_release);
+}
+
+bool SharedFilm::Open(const std::string& name, std::string& error)
+{
+    Close();
+
+    m_name = GetSystemName(name);
+    m_size = 0;
+    void* memory = Map(m_name, false, m_size, m_mapping);
+    if (!memory)
+    {
+        error = "no shared memory \"" + name + "\"";
+        return false;
+    }
+
+    Header* header = static_cast<Header*>(memory);
+    if (m_size < sizeof(Header) || std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version
+        || header->slotCount != SlotCount || header->layerCount != LayerCount || header->slotOffset + header->slotSize * SlotCount > m_size)
+    {
+        Unmap(memory, m_size, m_mapping);
+        error = "shared memory \"" + name + "\" is no film of this version";
+        return false;
+    }
+
+    m_header = header;
+    m_owner = false;
+    return true;
+}
+
+bool SharedFilm::ReadLatest(const std::function<void(const Frame&)>& read) const
+{
+    const uint64_t frameNumber = GetLatestFrameNumber();
+    if (frameNumber == 0)
+    {
+        return false;
+    }
+
+    // A newer frame may have taken the slot already, the caller asks again for the latest one
+    const SlotHeader& slot = m_header->slots[frameNumber % SlotCount];
+    const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != frameNumber * 2)
+    {
+        return false;
+    }
+
+    Frame frame;
+    frame.width = (int)std::min(slot.width, m_header->maxWidth);
+    frame.height = (int)std::min(slot.height, m_header->maxHeight);
+    frame.sampleCount = slot.sampleCount;
+    frame.renderTime = slot.renderTime;
+    frame.frameNumber = frameNumber;
+
+    const glm::vec4* pixels = reinterpret_cast<const glm::vec4*>(reinterpret_cast<const char*>(m_header) + m_header->slotOffset + m_header->slotSize * (frameNumber % SlotCount));
+    for (uint32_t layer = 0; layer < LayerCount; layer++)
+    {
+        frame.layers[layer] = pixels + layer * (size_t)frame.width * frame.height;
+    }
+
+    read(frame);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
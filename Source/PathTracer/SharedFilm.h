@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Publishes the film and its layers to named shared memory, where viewers and compositors of other processes map the latest frame
+//
+// The memory holds a header and a ring of slots, each a frame with its layers one after another as RGBA float rows from the bottom up
+// The renderer never waits for readers. A slot's sequence number is odd while the slot is written and twice the frame number once written,
+// a reader that finds the same even number before and after reading the pixels in place knows they were not overwritten meanwhile
+class SharedFilm
+{
+public:
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t SlotCount = 3;        // Readers have two frames of time to read the latest slot before it is written again
+    static constexpr uint32_t LayerCount = 4;       // Radiance, albedo, normal and the sample statistics of the CPU backend's buffers
+
+    struct SlotHeader
+    {
+        std::atomic<uint64_t> sequence;
+        uint32_t width;
+        uint32_t height;
+        uint32_t sampleCount;       // Per pixel, the most any pixel got
+        float renderTime;           // Seconds of accumulation
+    };
+
+    // Fixed layout, readers of other programs map the same bytes
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t layerCount;
+        uint32_t maxWidth;          // Capacity of a slot, frames are at most this large
+        uint32_t maxHeight;
+        char layerNames[52];        // Space separated, zero terminated
+        uint64_t slotOffset;        // Bytes from the start of the memory to the first slot's pixels
+        uint64_t slotSize;          // Bytes of the pixels of a slot
+        std::atomic<uint64_t> latest;   // Frame number of the latest written frame, 0 before the first
+        std::atomic<uint32_t> closed;   // Set once the renderer is gone
+        uint32_t padding;
+        SlotHeader slots[SlotCount];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory needs lock free atomics");
+
+    struct Frame
+    {
+        int width = 0;
+        int height = 0;
+        unsigned int sampleCount = 0;
+        float renderTime = 0.0f;
+        uint64_t frameNumber = 0;                           // Set by readers
+        const glm::vec4* layers[LayerCount] = { };          // Width * height pixels each, layers left empty publish black
+    };
+
+    SharedFilm() = default;
+    ~SharedFilm();      // The renderer marks the memory closed and removes its name
+
+    SharedFilm(const SharedFilm&) = delete;
+    SharedFilm& operator=(const SharedFilm&) = delete;
+
+    // Renderer side, the memory holds frames up to the size given. False with a message if it cannot be created
+    bool Create(const std::string& name, int maxWidth, int maxHeight, std::string& error);
+
+    // Copies the frame into the next slot, frames larger than the memory are cropped to it
+    void Publish(const Frame& frame);
+
+    // Reader side. False with a message if there is no such memory or it is no film
+    bool Open(const std::string& name, std::string& error);
+
+    bool IsOpen() const { return m_header != nullptr; }
+    bool IsClosed() const { return m_header && m_header->closed.load(std::memory_order_acquire) != 0; }
+    uint64_t GetLatestFrameNumber() const { return m_header ? m_header->latest.load(std::memory_order_acquire) : 0; }
+
+    // Calls the function with the layers of the latest frame in place, without copying them
+    // False if there is no frame yet or it was overwritten while the function read it, whatever it read is then torn
+    bool ReadLatest(const std::function<void(const Frame&)>& read) const;
+
+private:
+    void Close();
+
+    Header* m_header = nullptr;
+    size_t m_size = 0;
+    bool m_owner = false;           // Created by this process rather than opened
+    std::string m_name;
+    std::intptr_t m_mapping = 0;    // Handle of the file mapping on Windows
+    uint64_t m_frameNumber = 0;     // Of the last published frame
+};
@@ -0,0 +1,350 @@
+#include "Socket.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#else
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using Handle = SOCKET;
+    constexpr int SendFlags = 0;
+    constexpr int ShutdownSendHow = SD_SEND;
+    constexpr int ShutdownBothHow = SD_BOTH;
+
+    void CloseSocketHandle(Handle handle) { closesocket(handle); }
+    bool IsTimeout() { return WSAGetLastError() == WSAETIMEDOUT; }
+
+    // Winsock is started once for the whole process
+    void InitializeSockets()
+    {
+        static WSADATA data;
+        static bool initialized = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        (void)initialized;
+    }
+#else
+    using Handle = int;
+    constexpr int SendFlags = MSG_NOSIGNAL;     // A peer that went away must not end the process
+    constexpr int ShutdownSendHow = SHUT_WR;
+    constexpr int ShutdownBothHow = SHUT_RDWR;
+
+    void CloseSocketHandle(Handle handle) { close(handle); }
+    bool IsTimeout() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+    void InitializeSockets() {}
+#endif
+
+    bool IsPort(const std::string& text)
+    {
+        return !text.empty() && text.size() <= 5 && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // Splits "host:port" or a port alone, which is the loopback interface
+    bool SplitNetworkAddress(const std::string& address, std::string& host, std::string& port)
+    {
+        if (IsPort(address))
+        {
+            host = "127.0.0.1";
+            port = address;
+            return true;
+        }
+
+        size_t separator = address.rfind(':');
+        if (separator == std::string::npos || separator == 0 || !IsPort(address.substr(separator + 1)))
+        {
+            return false;
+        }
+        host = address.substr(0, separator);
+        port = address.substr(separator + 1);
+        return true;
+    }
+
+    bool GetUnixAddress(const std::string& path, sockaddr_un& address)
+    {
+        address = { };
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        std::memcpy(address.sun_path, path.data(), path.size());
+        return true;
+    }
+}
+
+Socket::~Socket()
+{
+    if (IsValid())
+    {
+        CloseSocketHandle(static_cast<Handle>(m_handle));
+    }
+    if (!m_path.empty())
+    {
+        std::error_code errorCode;
+        std::filesystem::remove(m_path, errorCode);
+    }
+}
+
+Socket::Socket(Socket&& other) noexcept
+    : m_handle(other.m_handle), m_buffer(std::move(other.m_buffer)), m_path(std::move(other.m_path)), m_timedOut(other.m_timedOut)
+{
+    other.m_handle = InvalidHandle;
+    other.m_path.clear();
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+    if (this != &other)
+    {
+        Socket closed(std::move(*this));
+        m_handle = other.m_handle;
+        m_buffer = std::move(other.m_buffer);
+        m_path = std::move(other.m_path);
+        m_timedOut = other.m_timedOut;
+        other.m_handle = InvalidHandle;
+        other.m_path.clear();
+    }
+    return *this;
+}
+
+bool Socket::IsNetworkAddress(const std::string& address)
+{
+    std::string host;
+    std::string port;
+    return SplitNetworkAddress(address, host, port);
+}
+
+Socket Socket::Listen(const std::string& address, std::string& error)
+{
+    InitializeSockets();
+
+    Socket socket;
+    std::string host;
+    std::string port;
+    if (SplitNetworkAddress(address, host, port))
+    {
+        addrinfo hints = { };
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) == 0)
+        {
+            for (addrinfo* info = addresses; info && !socket.IsValid(); info = info->ai_next)
+            {
+                socket.m_handle = static_cast<std::intptr_t>(::socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+                if (socket.IsValid())
+                {
+                    // A server started again right away must not wait for the connections of the previous one to time out
+                    int reuse = 1;
+                    setsockopt(static_cast<Handle>(socket.m_handle), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+                    if (bind(static_cast<Handle>(socket.m_handle), info->ai_addr, static_cast<int>(info->ai_addrlen)) != 0)
+                    {
+                        socket = Socket();
+                    }
+                }
+            }
+            freeaddrinfo(addresses);
+        }
+    }
+    else
+    {
+        sockaddr_un unixAddress;
+        if (!GetUnixAddress(address, unixAddress))
+        {
+            error = "Invalid socket path " + address;
+            return Socket();
+        }
+
+        // A socket file left behind by a server that did not exit cleanly would fail the bind
+        std::error_code errorCode;
+        std::filesystem::remove(address, errorCode);
+
+        socket.m_handle = static_cast<std::intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (socket.IsValid())
+        {
+            if (bind(static_cast<Handle>(socket.m_handle), reinterpret_cast<sockaddr*>(&unixAddress), sizeof(unixAddress)) != 0)
+            {
+                socket = Socket();
+            }
+            else
+            {
+                socket.m_path = address;
+            }
+        }
+    }
+
+    if (!socket.IsValid() || listen(static_cast<Handle>(socket.m_handle), 16) != 0)
+    {
+        error = "Cannot listen on " + address;
+        return Socket();
+    }
+    return socket;
+}
+
+Socket Socket::Connect(const std::string& address, std::string& error)
+{
+    InitializeSockets();
+
+    Socket socket;
+    std::string host;
+    std::string port;
+    if (SplitNetworkAddress(address, host, port))
+    {
+        addrinfo hints = { };
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) == 0)
+        {
+            for (addrinfo* info = addresses; info && !socket.IsValid(); info = info->ai_next)
+            {
+                socket.m_handle = static_cast<std::intptr_t>(::socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+                if (socket.IsValid() && connect(static_cast<Handle>(socket.m_handle), info->ai_addr, static_cast<int>(info->ai_addrlen)) != 0)
+                {
+                    socket = Socket();
+                }
+            }
+            freeaddrinfo(addresses);
+        }
+    }
+    else
+    {
+        sockaddr_un unixAddress;
+        if (GetUnixAddress(address, unixAddress))
+        {
+            socket.m_handle = static_cast<std::intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0));
+            if (socket.IsValid() && connect(static_cast<Handle>(socket.m_handle), reinterpret_cast<sockaddr*>(&unixAddress), sizeof(unixAddress)) != 0)
+            {
+                socket = Socket();
+            }
+        }
+    }
+
+    if (!socket.IsValid())
+    {
+        error = "Cannot connect to " + address;
+    }
+    return socket;
+}
+
+Socket Socket::Accept() const
+{
+    return Socket(static_cast<std::intptr_t>(accept(static_cast<Handle>(m_handle), nullptr, nullptr)));
+}
+
+bool Socket::Send(const void* data, size_t size) const
+{
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+        int sent = send(static_cast<Handle>(m_handle), bytes, chunk, SendFlags);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool Socket::SendLine(const std::string& line) const
+{
+    std::string text = line + "\n";
+    return Send(text.data(), text.size());
+}
+
+bool Socket::Receive(void* data, size_t size)
+{
+    while (m_buffer.size() < size)
+    {
+        if (!Fill())
+        {
+            return false;
+        }
+    }
+
+    std::memcpy(data, m_buffer.data(), size);
+    m_buffer.erase(0, size);
+    return true;
+}
+
+bool Socket::ReceiveLine(std::string& line, size_t maxSize)
+{
+    size_t end;
+    while ((end = m_buffer.find('\n')) == std::string::npos)
+    {
+        if (m_buffer.size() > maxSize)
+        {
+            line = m_buffer.substr(0, maxSize);
+            m_buffer.erase(0, maxSize);
+            return true;
+        }
+
+        if (!Fill())
+        {
+            // The last line may end with the connection instead
+            line = std::move(m_buffer);
+            m_buffer.clear();
+            return !line.empty();
+        }
+    }
+
+    line = m_buffer.substr(0, end);
+    m_buffer.erase(0, end + 1);
+    return true;
+}
+
+void Socket::SetReceiveTimeout(int milliseconds) const
+{
+#ifdef _WIN32
+    DWORD timeout = static_cast<DWORD>(milliseconds);
+#else
+    timeval timeout = { };
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+    setsockopt(static_cast<Handle>(m_handle), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+void Socket::ShutdownSend() const
+{
+    shutdown(static_cast<Handle>(m_handle), ShutdownSendHow);
+}
+
+void Socket::Shutdown() const
+{
+    shutdown(static_cast<Handle>(m_handle), ShutdownBothHow);
+}
+
+bool Socket::Fill()
+{
+    char buffer[65536];
+    int size = recv(static_cast<Handle>(m_handle), buffer, static_cast<int>(sizeof(buffer)), 0);
+    if (size <= 0)
+    {
+        m_timedOut = size < 0 && IsTimeout();
+        return false;
+    }
+
+    m_buffer.append(buffer, size);
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Stream socket of a local or a TCP connection, closed when destroyed
+//
+// Addresses are a Unix domain socket path, a port, or "host:port"
+// A port alone is listened on for connections of this machine only, other machines can only connect to an interface named with a host such as "0.0.0.0:port"
+class Socket
+{
+public:
+    Socket() = default;
+    ~Socket();
+
+    Socket(Socket&& other) noexcept;
+    Socket& operator=(Socket&& other) noexcept;
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    // Whether the address is a TCP one rather than a Unix domain socket path
+    static bool IsNetworkAddress(const std::string& address);
+
+    // Invalid with a message if the address cannot be listened on or connected to
+    static Socket Listen(const std::string& address, std::string& error);
+    static Socket Connect(const std::string& address, std::string& error);
+
+    // Waits for the next connection, invalid once the socket is shut down
+    Socket Accept() const;
+
+    bool IsValid() const { return m_handle != InvalidHandle; }
+
+    // False if the connection is gone
+    bool Send(const void* data, size_t size) const;
+    bool SendLine(const std::string& line) const;
+
+    // Exactly that many bytes, false if the connection ends before
+    bool Receive(void* data, size_t size);
+    // Up to the next newline or the end of the connection, without the newline. False if nothing is left
+    // A line longer than the maximum size is cut off after it, the rest is left for the next receive
+    bool ReceiveLine(std::string& line, size_t maxSize = std::string::npos);
+
+    // Receives give up once nothing arrived for that long, as if the connection had ended
+    void SetReceiveTimeout(int milliseconds) const;
+    // Whether a receive gave up for the timeout rather than the end of the connection
+    bool HasTimedOut() const { return m_timedOut; }
+
+    // Tells the other side nothing more is sent, it can still send
+    void ShutdownSend() const;
+    // Ends the connection both ways, waking a thread blocked on it
+    void Shutdown() const;
+
+private:
+    explicit Socket(std::intptr_t handle) : m_handle(handle) {}
+
+    // Reads whatever arrived into the buffer, false if the connection ended
+    bool Fill();
+
+    static constexpr std::intptr_t InvalidHandle = -1;
+
+    std::intptr_t m_handle = InvalidHandle;
+    std::string m_buffer;       // Received, but not yet taken by a Receive
+    std::string m_path;         // Unix domain socket file of a listening socket, removed when closed
+    bool m_timedOut = false;
+};
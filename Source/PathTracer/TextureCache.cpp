@@ -0,0 +1,332 @@
+#include "TextureCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+std::atomic<uint64_t> TextureCache::s_nextGeneration = 0;
+thread_local TextureCache::LookupCache TextureCache::s_lookupCache;
+
+namespace
+{
+    constexpr int LdrTexelBytes = 4;                        // RGBA8
+    constexpr int HdrTexelBytes = 3 * sizeof(float);        // RGB32F
+}
+
+TextureCache::~TextureCache()
+{
+    Reset();
+}
+
+void TextureCache::LookupCache::Flush()
+{
+    if (counters)
+    {
+        counters->lookups += lookups;
+        counters->misses += misses;
+        counters->ioNanoseconds += ioNanoseconds;
+    }
+    lookups = 0;
+    misses = 0;
+    ioNanoseconds = 0;
+}
+
+void TextureCache::Reset()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_residentTiles.clear();
+        m_lru.clear();
+        m_residentBytes = 0;
+    }
+
+    m_textures.clear();
+
+    m_backingWriter.close();
+    if (!m_backingPath.empty())
+    {
+        // Threads which still have the file open keep it alive on some platforms, the file is left behind then
+        std::error_code error;
+        std::filesystem::remove(m_backingPath, error);
+        m_backingPath.clear();
+    }
+    m_backingSize = 0;
+
+    m_generation = ++s_nextGeneration;
+}
+
+int TextureCache::AddTexture(bool hdr, bool srgb)
+{
+    if (m_backingPath.empty())
+    {
+        // Unique per process and reset, so concurrent instances do not share a file
+        long long timestamp = std::chrono::system_clock::now().time_since_epoch().count();
+        m_backingPath = std::filesystem::temp_directory_path() /
+            ("PathTracerTextures-" + std::to_string(timestamp) + "-" + std::to_string(m_generation) + ".bin");
+        m_backingWriter.open(m_backingPath, std::ios::binary | std::ios::trunc);
+    }
+
+    TextureInfo info;
+    info.hdr = hdr;
+    info.srgb = srgb;
+    info.tileBytes = (size_t)TileSize * TileSize * (hdr ? HdrTexelBytes : LdrTexelBytes);
+
+    m_textures.push_back(info);
+    return (int)m_textures.size() - 1;
+}
+
+void TextureCache::AddLevel(int texture, int width, int height, const void* texels)
+{
+    TextureInfo& info = m_textures[texture];
+    const size_t texelBytes = info.hdr ? HdrTexelBytes : LdrTexelBytes;
+
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.tilesX = (width + TileSize - 1) / TileSize;
+    level.firstTile = (uint32_t)m_residentTiles.size();
+    level.fileOffset = m_backingSize;
+
+    const int tilesY = (height + TileSize - 1) / TileSize;
+    const uint32_t tileCount = (uint32_t)(level.tilesX * tilesY);
+
+    // Tiles are stored with a fixed stride, so a tile's offset follows from its index
+    std::vector<unsigned char> tile(info.tileBytes);
+    const unsigned char* source = static_cast<const unsigned char*>(texels);
+    for (int tileY = 0; tileY < tilesY; tileY++)
+    {
+        for (int tileX = 0; tileX < level.tilesX; tileX++)
+        {
+            std::fill(tile.begin(), tile.end(), (unsigned char)0);
+
+            const int x0 = tileX * TileSize;
+            const int y0 = tileY * TileSize;
+            const int rowTexels = std::min(TileSize, width - x0);
+            for (int y = 0; y < std::min(TileSize, height - y0); y++)
+            {
+                std::memcpy(&tile[(size_t)y * TileSize * texelBytes], &source[((size_t)(y0 + y) * width + x0) * texelBytes], rowTexels * texelBytes);
+            }
+
+            m_backingWriter.write(reinterpret_cast<const char*>(tile.data()), (std::streamsize)tile.size());
+        }
+    }
+    m_backingWriter.flush();
+    m_backingSize += (uint64_t)tileCount * info.tileBytes;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_residentTiles.resize(m_residentTiles.size() + tileCount);
+    }
+
+    info.levels.push_back(level);
+}
+
+float TextureCache::SrgbToLinear(unsigned char value)
+{
+    static const std::array<float, 256> table = []()
+    {
+        std::array<float, 256> result;
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return result;
+    }();
+    return table[value];
+}
+
+// -------------------------------------------------------------------------
+//    Sampling
+// -------------------------------------------------------------------------
+
+glm::vec4 TextureCache::Sample(int texture, const glm::vec2& uv, float lod) const
+{
+    const TextureInfo& info = m_textures[texture];
+    if (info.levels.empty())
+    {
+        return glm::vec4(0.0f);
+    }
+
+    float level = lod + 0.5f * std::log2((float)info.levels[0].width * (float)info.levels[0].height);
+    if (!(level > 0.0f))
+    {
+        return SampleLevel(info, 0, uv);
+    }
+
+    const int lastLevel = (int)info.levels.size() - 1;
+    if (level >= (float)lastLevel)
+    {
+        return SampleLevel(info, lastLevel, uv);
+    }
+
+    // Blend the two nearest levels
+    int fine = (int)level;
+    float t = level - (float)fine;
+    return glm::mix(SampleLevel(info, fine, uv), SampleLevel(info, fine + 1, uv), t);
+}
+
+glm::vec4 TextureCache::SampleLevel(const TextureInfo& info, int levelIndex, const glm::vec2& uv) const
+{
+    const Level& level = info.levels[levelIndex];
+
+    // Bilinear filtering with repeat wrapping, texel centers at half integers
+    float x = uv.x * level.width - 0.5f;
+    float y = uv.y * level.height - 0.5f;
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float tx = x - fx;
+    float ty = y - fy;
+
+    auto wrap = [](int value, int size) { int result = value % size; return result < 0 ? result + size : result; };
+    int x0 = wrap((int)fx, level.width);
+    int y0 = wrap((int)fy, level.height);
+    int x1 = wrap(x0 + 1, level.width);
+    int y1 = wrap(y0 + 1, level.height);
+
+    glm::vec4 bottom = glm::mix(Fetch(info, level, x0, y0), Fetch(info, level, x1, y0), tx);
+    glm::vec4 top = glm::mix(Fetch(info, level, x0, y1), Fetch(info, level, x1, y1), tx);
+    return glm::mix(bottom, top, ty);
+}
+
+glm::vec4 TextureCache::Fetch(const TextureInfo& info, const Level& level, int x, int y) const
+{
+    const Tile& tile = GetTile(info, level, x / TileSize, y / TileSize);
+    size_t index = (size_t)(y % TileSize) * TileSize + (x % TileSize);
+
+    if (info.hdr)
+    {
+        float texel[3];
+        std::memcpy(texel, &tile.texels[index * HdrTexelBytes], sizeof(texel));
+        return glm::vec4(texel[0], texel[1], texel[2], 1.0f);
+    }
+
+    const unsigned char* texel = &tile.texels[index * LdrTexelBytes];
+    if (info.srgb)
+    {
+        return glm::vec4(SrgbToLinear(texel[0]), SrgbToLinear(texel[1]), SrgbToLinear(texel[2]), texel[3] / 255.0f);
+    }
+    return glm::vec4(texel[0], texel[1], texel[2], texel[3]) / 255.0f;
+}
+
+// -------------------------------------------------------------------------
+//    Residency
+// -------------------------------------------------------------------------
+
+const TextureCache::Tile& TextureCache::GetTile(const TextureInfo& info, const Level& level, int tileX, int tileY) const
+{
+    LookupCache& lookupCache = s_lookupCache;
+    if (lookupCache.generation != m_generation)
+    {
+        lookupCache.Flush();
+        lookupCache.generation = m_generation;
+        lookupCache.tileIds.fill(UINT32_MAX);
+        lookupCache.tiles.fill(nullptr);
+        lookupCache.counters = m_counters;
+        lookupCache.backingFile.close();
+    }
+
+    const uint32_t tileIndex = (uint32_t)(tileY * level.tilesX + tileX);
+    const uint32_t tileId = level.firstTile + tileIndex;
+    const int entry = tileId % LookupCache::EntryCount;
+
+    lookupCache.lookups++;
+    if (lookupCache.tileIds[entry] == tileId)
+    {
+        return *lookupCache.tiles[entry];
+    }
+
+    std::shared_ptr<const Tile> tile;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ResidentTile& resident = m_residentTiles[tileId];
+        if (resident.tile)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, resident.lruPosition);
+            tile = resident.tile;
+        }
+    }
+
+    if (!tile)
+    {
+        // The file is read without the lock, so threads loading different tiles do not wait on each other
+        auto start = std::chrono::steady_clock::now();
+
+        if (!lookupCache.backingFile.is_open())
+        {
+            lookupCache.backingFile.open(m_backingPath, std::ios::binary);
+        }
+
+        std::shared_ptr<Tile> loaded = std::make_shared<Tile>();
+        loaded->texels.resize(info.tileBytes);
+        lookupCache.backingFile.seekg((std::streamoff)(level.fileOffset + (uint64_t)tileIndex * info.tileBytes));
+        lookupCache.backingFile.read(reinterpret_cast<char*>(loaded->texels.data()), (std::streamsize)info.tileBytes);
+        lookupCache.backingFile.clear();
+
+        lookupCache.ioNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        lookupCache.misses++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Another thread may have loaded the tile in the meantime
+        ResidentTile& resident = m_residentTiles[tileId];
+        if (resident.tile)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, resident.lruPosition);
+        }
+        else
+        {
+            resident.tile = std::move(loaded);
+            m_lru.push_front(tileId);
+            resident.lruPosition = m_lru.begin();
+            m_residentBytes += info.tileBytes;
+
+            EvictToBudget();
+        }
+        tile = resident.tile;
+    }
+
+    lookupCache.tileIds[entry] = tileId;
+    lookupCache.tiles[entry] = std::move(tile);
+    return *lookupCache.tiles[entry];
+}
+
+void TextureCache::EvictToBudget() const
+{
+    // The most recently used tile always stays, it is about to be sampled
+    while (m_residentBytes > m_budget && m_lru.size() > 1)
+    {
+        ResidentTile& resident = m_residentTiles[m_lru.back()];
+        m_residentBytes -= resident.tile->texels.size();
+        resident.tile = nullptr;
+        m_lru.pop_back();
+    }
+}
+
+void TextureCache::SetBudget(size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = maxBytes;
+    EvictToBudget();
+}
+
+TextureCache::Statistics TextureCache::GetStatistics() const
+{
+    Statistics statistics;
+    statistics.lookups = m_counters->lookups;
+    statistics.misses = m_counters->misses;
+    statistics.ioMilliseconds = double(m_counters->ioNanoseconds) * 1e-6;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    statistics.residentBytes = m_residentBytes;
+    return statistics;
+}
+
+void TextureCache::ResetStatistics()
+{
+    m_counters->lookups = 0;
+    m_counters->misses = 0;
+    m_counters->ioNanoseconds = 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Mipmapped textures of the CPU backend, split into square tiles which are loaded on first access
+// Tiles are written to a backing file when a texture is added, and only the recently used ones stay in memory
+class TextureCache
+{
+public:
+    // Texels per tile side, tiles at the right and top border of a level are padded
+    static constexpr int TileSize = 64;
+
+    // Counters since the last ResetStatistics
+    struct Statistics
+    {
+        long long lookups = 0;          // Tile lookups of texel fetches
+        long long misses = 0;           // Lookups which had to load the tile
+        size_t residentBytes = 0;       // Texels of the tiles in memory
+        double ioMilliseconds = 0.0;    // Time spent waiting on the backing file, summed over threads
+    };
+
+public:
+    TextureCache() = default;
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+    ~TextureCache();
+
+    // Drops all textures and their backing file
+    void Reset();
+
+    // Adds a texture without levels, textures are numbered in the order they are added
+    int AddTexture(bool hdr, bool srgb);
+
+    // Splits the next mip level of the texture into tiles and appends them to the backing file
+    // Texels are rows of RGBA8 for LDR textures and RGB32F for HDR textures
+    void AddLevel(int texture, int width, int height, const void* texels);
+
+    // Trilinear filtering like SampleBindlessTextureLod, lod is for a 1x1 texture. Can be called concurrently
+    glm::vec4 Sample(int texture, const glm::vec2& uv, float lod) const;
+
+    // Evicts the least recently used tiles until the resident tiles fit into the budget
+    void SetBudget(size_t maxBytes);
+    const size_t GetBudget() const { return m_budget; }
+
+    Statistics GetStatistics() const;
+    void ResetStatistics();
+
+    static float SrgbToLinear(unsigned char value);
+
+private:
+    struct Level
+    {
+        int width = 0;
+        int height = 0;
+        int tilesX = 0;
+        uint32_t firstTile = 0;     // Id of the bottom left tile, ids are unique across all textures
+        uint64_t fileOffset = 0;    // Tiles are stored row by row
+    };
+
+    struct TextureInfo
+    {
+        bool hdr = false;
+        bool srgb = false;
+        size_t tileBytes = 0;
+        std::vector<Level> levels;
+    };
+
+    struct Tile
+    {
+        std::vector<unsigned char> texels;
+    };
+
+    struct ResidentTile
+    {
+        std::shared_ptr<const Tile> tile;               // Null while the tile is only in the backing file
+        std::list<uint32_t>::iterator lruPosition;
+    };
+
+    // Counters are shared with the lookup caches of threads, which may outlive the texture cache
+    struct Counters
+    {
+        std::atomic<long long> lookups = 0;
+        std::atomic<long long> misses = 0;
+        std::atomic<long long> ioNanoseconds = 0;
+    };
+
+    // Direct mapped cache of the tiles a thread used last, so most lookups do not take the lock
+    // It holds on to its tiles, which keeps them valid after they are evicted from the shared pool
+    struct LookupCache
+    {
+        static constexpr int EntryCount = 64;
+
+        uint64_t generation = 0;                                        // Texture cache the entries belong to
+        std::array<uint32_t, EntryCount> tileIds;
+        std::array<std::shared_ptr<const Tile>, EntryCount> tiles;
+        std::ifstream backingFile;
+
+        std::shared_ptr<Counters> counters;
+        long long lookups = 0;
+        long long misses = 0;
+        long long ioNanoseconds = 0;
+
+        ~LookupCache() { Flush(); }
+
+        // Adds the local counters to the shared ones
+        void Flush();
+    };
+
+private:
+    glm::vec4 SampleLevel(const TextureInfo& info, int level, const glm::vec2& uv) const;
+    glm::vec4 Fetch(const TextureInfo& info, const Level& level, int x, int y) const;
+
+    // Tile of the current thread's lookup cache, loaded from the backing file when it is not resident
+    const Tile& GetTile(const TextureInfo& info, const Level& level, int tileX, int tileY) const;
+
+    // Must be called with the lock held
+    void EvictToBudget() const;
+
+private:
+    std::vector<TextureInfo> m_textures;
+
+    std::filesystem::path m_backingPath;
+    std::ofstream m_backingWriter;
+    uint64_t m_backingSize = 0;
+
+    // Every reset starts a new generation, so lookup caches notice their entries are stale
+    uint64_t m_generation = 0;
+    static std::atomic<uint64_t> s_nextGeneration;
+    static thread_local LookupCache s_lookupCache;
+
+    // Shared pool of resident tiles, indexed by tile id, in least recently used order
+    mutable std::mutex m_mutex;
+    mutable std::vector<ResidentTile> m_residentTiles;
+    mutable std::list<uint32_t> m_lru;
+    mutable size_t m_residentBytes = 0;
+    size_t m_budget = size_t(256) << 20;
+
+    std::shared_ptr<Counters> m_counters = std::make_shared<Counters>();
+};
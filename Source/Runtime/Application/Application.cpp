@@ -8,8 +8,8 @@
 #include <iostream>
 
 // DeviceGL and main Window are constructed in the correct order because they were declared like that!
-Application::Application(int width, int height, const char* title)
-    : m_mainWindow(width, height, title), m_exitCode(0)
+Application::Application(int width, int height, const char* title, bool visible)
+    : m_mainWindow(width, height, title, visible), m_exitCode(0)
 {
     // If the main window is not valid, exit with error
     if (!m_mainWindow.IsValid())
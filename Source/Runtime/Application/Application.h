@@ -8,7 +8,8 @@ class Application
 {
 public:
     // Construct the application specifying the dimensions of the window and its title
-    Application(int width, int height, const char* title);
+    // Applications without a visible window still render, into the hidden window
+    Application(int width, int height, const char* title, bool visible = true);
 
     // Destroy de application
     virtual ~Application();
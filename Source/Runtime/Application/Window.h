@@ -6,7 +6,8 @@
 class Window
 {
 public:
-    Window(int width, int height, const char* title);
+    // Hidden windows still own an OpenGL context, for rendering without showing anything
+    Window(int width, int height, const char* title, bool visible = true);
     ~Window();
 
     // (C++) 1
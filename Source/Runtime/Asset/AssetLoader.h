@@ -30,6 +30,9 @@ public:
     inline bool GetKeepShared() const { return m_keepShared; }
     inline void SetKeepShared(bool keepShared) { m_keepShared = keepShared; }
 
+    // Drop the references kept to shared assets, each is freed once nothing else uses it
+    inline void ClearShared() { m_sharedAssets.clear(); }
+
 private:
     // If true, keep a reference to assets loaded as shared, to avoid loading twice
     bool m_keepShared;